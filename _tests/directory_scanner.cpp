@@ -0,0 +1,207 @@
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <unistd.h>
+
+#include "../threading/task_manager.hpp"
+#include "../threading/utilities/directory_scanner.hpp"
+#include "../id/string_id.hpp"
+#include "../rle/rle.hpp"
+
+#include "../logger/logger.hpp"
+#include "../debug/assert.hpp"
+
+using namespace neam;
+using directory_scanner = threading::directory_scanner;
+
+static void write_file(const std::filesystem::path& path, size_t size)
+{
+  std::filesystem::create_directories(path.parent_path());
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file << std::string(size, 'x');
+}
+
+struct scan_result
+{
+  directory_scanner::snapshot snapshot;
+  std::vector<directory_scanner::change> changes;
+  size_t max_batch_size = 0;
+};
+
+// run the scan with long-duration tasks, the calling thread helping the workers
+template<typename Func>
+static scan_result run_scan(threading::task_manager& tm, Func&& start_scan)
+{
+  scan_result result;
+  bool done = false;
+  start_scan([&](std::vector<directory_scanner::change>&& batch)
+  {
+    result.max_batch_size = std::max(result.max_batch_size, batch.size());
+    result.changes.insert(result.changes.end(), std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()));
+  })
+  .then([&](directory_scanner::snapshot&& snapshot)
+  {
+    result.snapshot = std::move(snapshot);
+    done = true;
+  });
+
+  const auto end = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (!done)
+  {
+    check::debug::n_assert(std::chrono::steady_clock::now() < end, "directory scanner: the scan timed out");
+    tm.run_a_task();
+  }
+
+  std::sort(result.changes.begin(), result.changes.end(), [](const auto& a, const auto& b) { return a.file.path < b.file.path; });
+  return result;
+}
+
+static void check_changes(const scan_result& result, const std::vector<std::pair<const char*, directory_scanner::change_type>>& expected, const char* what)
+{
+  check::debug::n_assert(result.changes.size() == expected.size(), "directory scanner ({}): {} changes instead of {}", what, result.changes.size(), expected.size());
+  for (size_t i = 0; i < expected.size(); ++i)
+  {
+    check::debug::n_assert(result.changes[i].file.path == expected[i].first && result.changes[i].type == expected[i].second,
+                           "directory scanner ({}): unexpected change for {} (expected {})", what, result.changes[i].file.path, expected[i].first);
+  }
+}
+
+// full scan, then rescans that only report the differences with the previous snapshot
+static void test_rescan(threading::task_manager& tm, const std::filesystem::path& root)
+{
+  cr::out().log("directory scanner: rescan...");
+  using change_type = directory_scanner::change_type;
+
+  write_file(root / "a.txt", 10);
+  write_file(root / "gone.txt", 20);
+  write_file(root / "sub/b.txt", 30);
+  write_file(root / "sub/deep/c.txt", 40);
+  write_file(root / "other/d.txt", 50);
+
+  directory_scanner::config conf;
+  conf.batch_size = 2;
+
+  // the first scan reports everything as added
+  scan_result first = run_scan(tm, [&](auto&& on_batch)
+  {
+    return directory_scanner::scan(tm, threading::k_invalid_task_group, root, std::move(on_batch), conf);
+  });
+  check_changes(first, { { "a.txt", change_type::added }, { "gone.txt", change_type::added }, { "other/d.txt", change_type::added },
+                         { "sub/b.txt", change_type::added }, { "sub/deep/c.txt", change_type::added } }, "scan");
+  check::debug::n_assert(first.max_batch_size <= conf.batch_size, "directory scanner: batch of {} changes (max: {})", first.max_batch_size, conf.batch_size);
+  check::debug::n_assert(first.snapshot.files.size() == 5 && first.snapshot.directories.size() == 4, "directory scanner: wrong snapshot");
+  check::debug::n_assert(std::is_sorted(first.snapshot.files.begin(), first.snapshot.files.end(), [](const auto& a, const auto& b) { return a.path < b.path; }),
+                         "directory scanner: the files of the snapshot must be sorted");
+  const directory_scanner::file_entry* const b_entry = first.snapshot.find_file("sub/b.txt");
+  check::debug::n_assert(b_entry != nullptr && b_entry->size == 30, "directory scanner: find_file() failed");
+  check::debug::n_assert(first.snapshot.find_file("sub") == nullptr && first.snapshot.find_directory("sub/deep") != nullptr, "directory scanner: find_directory() failed");
+
+  // nothing changed: nothing is reported (the unchanged files are, when asked)
+  {
+    scan_result same = run_scan(tm, [&](auto&& on_batch)
+    {
+      return directory_scanner::rescan(tm, threading::k_invalid_task_group, root, directory_scanner::snapshot(first.snapshot), std::move(on_batch), conf);
+    });
+    check_changes(same, {}, "no changes");
+
+    directory_scanner::config unchanged_conf = conf;
+    unchanged_conf.report_unchanged = true;
+    scan_result unchanged = run_scan(tm, [&](auto&& on_batch)
+    {
+      return directory_scanner::rescan(tm, threading::k_invalid_task_group, root, directory_scanner::snapshot(first.snapshot), std::move(on_batch), unchanged_conf);
+    });
+    check::debug::n_assert(unchanged.changes.size() == 5, "directory scanner: {} unchanged files reported instead of 5", unchanged.changes.size());
+    for (const auto& it : unchanged.changes)
+      check::debug::n_assert(it.type == change_type::unchanged, "directory scanner: {} is reported as changed", it.file.path);
+  }
+
+  // added / modified / removed files
+  write_file(root / "a.txt", 11);
+  std::filesystem::remove(root / "gone.txt");
+  std::filesystem::remove_all(root / "other");
+  write_file(root / "sub/new.txt", 5);
+  // same size, in a directory that did not change: only its time tells it apart
+  write_file(root / "sub/deep/c.txt", 40);
+  std::filesystem::last_write_time(root / "sub/deep/c.txt", std::filesystem::last_write_time(root / "sub/deep/c.txt") + std::chrono::hours(1));
+
+  scan_result second = run_scan(tm, [&](auto&& on_batch)
+  {
+    return directory_scanner::rescan(tm, threading::k_invalid_task_group, root, std::move(first.snapshot), std::move(on_batch), conf);
+  });
+  check_changes(second, { { "a.txt", change_type::modified }, { "gone.txt", change_type::removed }, { "other/d.txt", change_type::removed },
+                          { "sub/deep/c.txt", change_type::modified }, { "sub/new.txt", change_type::added } }, "rescan");
+  check::debug::n_assert(second.changes[1].file.size == 20, "directory scanner: removed files must be reported with their previous entry");
+  check::debug::n_assert(second.snapshot.files.size() == 4 && second.snapshot.find_file("gone.txt") == nullptr && second.snapshot.find_file("sub/new.txt") != nullptr,
+                         "directory scanner: the snapshot of the rescan does not match the tree");
+  check::debug::n_assert(second.snapshot.find_directory("other") == nullptr, "directory scanner: removed directories must not be in the snapshot");
+
+  // persisted snapshots
+  {
+    rle::status st;
+    const raw_data serialized = rle::serialize(second.snapshot);
+    directory_scanner::snapshot restored = rle::deserialize<directory_scanner::snapshot>(serialized, &st);
+    check::debug::n_assert(st == rle::status::success && restored.files.size() == second.snapshot.files.size(), "directory scanner: failed to deserialize the snapshot");
+    scan_result third = run_scan(tm, [&](auto&& on_batch)
+    {
+      return directory_scanner::rescan(tm, threading::k_invalid_task_group, root, std::move(restored), std::move(on_batch), conf);
+    });
+    check_changes(third, {}, "restored snapshot");
+  }
+
+  // a missing root is an empty tree: everything is removed
+  {
+    scan_result missing = run_scan(tm, [&](auto&& on_batch)
+    {
+      return directory_scanner::rescan(tm, threading::k_invalid_task_group, root / "missing", std::move(second.snapshot), std::move(on_batch), conf);
+    });
+    check::debug::n_assert(missing.changes.size() == 4 && missing.snapshot.files.empty(), "directory scanner: a missing root must remove all the files");
+    for (const auto& it : missing.changes)
+      check::debug::n_assert(it.type == change_type::removed, "directory scanner: {} is not reported as removed", it.file.path);
+  }
+}
+
+int main(int, char**)
+{
+  cr::get_global_logger().min_severity = neam::cr::logger::severity::message;
+  cr::get_global_logger().register_callback(neam::cr::print_log_to_console, nullptr);
+
+  const std::filesystem::path root = std::filesystem::temp_directory_path() / fmt::format("ntools_directory_scanner_test_{}", getpid());
+  std::filesystem::remove_all(root);
+  std::filesystem::create_directories(root);
+
+  threading::task_manager tm;
+  {
+    threading::task_group_dependency_tree tgd;
+    tgd.add_task_group("main"_rid);
+    tm.add_compiled_frame_operations(tgd.compile_tree(), {});
+  }
+
+  // a few workers, so directories are scanned concurrently
+  std::atomic<bool> should_stop = false;
+  std::vector<std::thread> workers;
+  for (unsigned i = 0; i < 3; ++i)
+  {
+    workers.emplace_back([&]
+    {
+      while (!should_stop.load())
+      {
+        tm.run_a_task();
+        std::this_thread::yield();
+      }
+    });
+  }
+
+  test_rescan(tm, root);
+
+  should_stop = true;
+  for (auto& it : workers)
+    it.join();
+
+  std::filesystem::remove_all(root);
+  cr::out().log("all directory scanner tests passed");
+  return 0;
+}
@@ -0,0 +1,2124 @@
+#include <filesystem>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+
+#include "../io/io.hpp"
+#include "../io/sharded_context.hpp"
+#include "../io/connections.hpp"
+
+#include "../logger/logger.hpp"
+#include "../debug/assert.hpp"
+
+using namespace neam;
+
+// process the context until done() returns true (or the timeout is reached)
+template<typename Func>
+static bool run_until(io::context& ctx, Func&& done, std::chrono::milliseconds timeout = std::chrono::milliseconds(5000))
+{
+  const auto end = std::chrono::steady_clock::now() + timeout;
+  while (!done())
+  {
+    if (std::chrono::steady_clock::now() > end)
+      return false;
+    ctx.process();
+    if (!done())
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  return true;
+}
+
+static raw_data make_data(size_t size, uint8_t seed)
+{
+  raw_data data = raw_data::allocate(size);
+  for (size_t i = 0; i < size; ++i)
+    data.get_as<uint8_t>()[i] = (uint8_t)(seed + i * 7);
+  return data;
+}
+
+static bool check_data(const void* data, size_t size, uint8_t seed, size_t offset = 0)
+{
+  for (size_t i = 0; i < size; ++i)
+  {
+    if (((const uint8_t*)data)[i] != (uint8_t)(seed + (offset + i) * 7))
+      return false;
+  }
+  return true;
+}
+
+// read the whole file (blocking)
+static raw_data read_whole_file(io::context& ctx, neam::id_t fid)
+{
+  raw_data ret;
+  bool done = false;
+  ctx.queue_read(fid, 0, io::context::whole_file).then([&](raw_data&& data, bool success, size_t)
+  {
+    check::debug::n_assert(success, "failed to read {}", ctx.get_string_for_id(fid));
+    ret = std::move(data);
+    done = true;
+  });
+  check::debug::n_assert(run_until(ctx, [&] { return done; }), "read timed out");
+  return ret;
+}
+
+// create a pair of connected tcp sockets (over the loopback)
+static void connect_tcp_pair(io::context& ctx, neam::id_t& client, neam::id_t& server)
+{
+  const neam::id_t listening = ctx.create_listening_socket(0, io::context::ipv4(127, 0, 0, 1));
+  check::debug::n_assert(listening != neam::id_t::invalid, "failed to create a listening socket");
+  const uint16_t port = ctx.get_socket_port(listening);
+
+  client = ctx.create_socket();
+  server = neam::id_t::invalid;
+  bool connected = false;
+  ctx.queue_accept(listening).then([&](neam::id_t id) { server = id; });
+  ctx.queue_connect(client, "127.0.0.1", port).then([&](bool success)
+  {
+    check::debug::n_assert(success, "failed to connect to 127.0.0.1:{}", port);
+    connected = true;
+  });
+  check::debug::n_assert(run_until(ctx, [&] { return connected && server != neam::id_t::invalid; }), "connect timed out");
+  ctx.close(listening);
+}
+
+// scatter-gather writes / sends
+static void test_segments(const std::filesystem::path& dir)
+{
+  cr::out().log("io: segment writes / sends...");
+  io::context ctx;
+  ctx.set_prefix_directory(dir);
+  const neam::id_t fid = ctx.map_file("segments.bin");
+
+  std::vector<shared_raw_data> segments;
+  size_t total_size = 0;
+  for (uint32_t i = 0; i < 32; ++i)
+  {
+    const size_t size = 100 + i * 131;
+    raw_data data = raw_data::allocate(size);
+    // make the data continuous across segments:
+    for (size_t j = 0; j < size; ++j)
+      data.get_as<uint8_t>()[j] = (uint8_t)((total_size + j) * 7);
+    segments.push_back(shared_raw_data(std::move(data)).slice(0));
+    total_size += size;
+  }
+
+  {
+    bool done = false;
+    ctx.queue_write(fid, io::context::truncate, std::vector<shared_raw_data>(segments)).then([&](raw_data&&, bool success, size_t size)
+    {
+      check::debug::n_assert(success && size == total_size, "segment write failed (size: {}, expected {})", size, total_size);
+      done = true;
+    });
+    check::debug::n_assert(run_until(ctx, [&] { return done; }), "segment write timed out");
+    const raw_data content = read_whole_file(ctx, fid);
+    check::debug::n_assert(content.size == total_size && check_data(content.get(), content.size, 0), "segment write: wrong file content");
+  }
+
+  // AF_UNIX sockets (no zero-copy) and tcp sockets (zero-copy):
+  for (bool tcp : { false, true })
+  {
+    neam::id_t a, b;
+    if (tcp)
+      connect_tcp_pair(ctx, a, b);
+    else
+      check::debug::n_assert(ctx.create_socket_pair(a, b), "failed to create a socket pair");
+    bool sent = false;
+    bool received = false;
+    ctx.queue_full_send(a, std::vector<shared_raw_data>(segments)).then([&](raw_data&&, bool success, size_t size)
+    {
+      check::debug::n_assert(success && size == total_size, "segment send failed (size: {}, expected {})", size, total_size);
+      sent = true;
+    });
+    ctx.queue_full_receive(b, total_size).then([&](raw_data&& data, bool success, size_t size)
+    {
+      check::debug::n_assert(success && size == total_size && check_data(data.get(), size, 0), "segment send: wrong received data");
+      received = true;
+    });
+    check::debug::n_assert(run_until(ctx, [&] { return sent && received; }), "segment send timed out");
+    ctx.close(a);
+    ctx.close(b);
+  }
+  ctx._wait_for_submit_queries();
+}
+
+// submission batching: all the operations queued between two process() are submitted with a single syscall
+static void test_batching()
+{
+  cr::out().log("io: submission batching...");
+  {
+    io::context ctx;
+    neam::id_t a, b;
+    check::debug::n_assert(ctx.create_socket_pair(a, b), "failed to create a socket pair");
+
+    constexpr uint32_t k_send_count = 32;
+    uint32_t sent_count = 0;
+    for (uint32_t i = 0; i < k_send_count; ++i)
+    {
+      ctx.queue_send(a, make_data(100, (uint8_t)i)).then([&](raw_data&&, bool success, size_t size)
+      {
+        check::debug::n_assert(success && size == 100, "send failed");
+        ++sent_count;
+      });
+    }
+    const uint64_t submit_count = ctx.get_submit_count();
+    const uint64_t sqe_count = ctx.get_submitted_sqe_count();
+    ctx.process();
+    check::debug::n_assert(ctx.get_submit_count() == submit_count + 1, "{} submits for a single process(), expected one", ctx.get_submit_count() - submit_count);
+    check::debug::n_assert(ctx.get_submitted_sqe_count() - sqe_count >= k_send_count, "the sends were not submitted together");
+
+    bool received = false;
+    ctx.queue_full_receive(b, k_send_count * 100).then([&](raw_data&&, bool success, size_t size)
+    {
+      check::debug::n_assert(success && size == k_send_count * 100, "receive failed");
+      received = true;
+    });
+    check::debug::n_assert(run_until(ctx, [&] { return received && sent_count == k_send_count; }), "sends timed out");
+    ctx.close(a);
+    ctx.close(b);
+    ctx._wait_for_submit_queries();
+  }
+
+  cr::out().log("io: submission batching with a full submit queue...");
+  {
+    // more operations than the submit queue can hold: the prepared operations are flushed to make some room
+    io::context::ring_config config;
+    config.queue_depth = 8;
+    io::context ctx(config);
+    neam::id_t a, b;
+    check::debug::n_assert(ctx.create_socket_pair(a, b), "failed to create a socket pair");
+
+    constexpr uint32_t k_send_count = 100;
+    uint32_t sent_count = 0;
+    for (uint32_t i = 0; i < k_send_count; ++i)
+    {
+      ctx.queue_send(a, make_data(10, (uint8_t)i), 0, 10).then([&](raw_data&&, bool success, size_t)
+      {
+        check::debug::n_assert(success, "send failed");
+        ++sent_count;
+      });
+    }
+    bool received = false;
+    ctx.queue_full_receive(b, k_send_count * 10).then([&](raw_data&&, bool success, size_t size)
+    {
+      check::debug::n_assert(success && size == k_send_count * 10, "receive failed");
+      received = true;
+    });
+    check::debug::n_assert(run_until(ctx, [&] { return received && sent_count == k_send_count; }), "sends timed out");
+    check::debug::n_assert(ctx.get_max_sqe_per_submit() <= 8, "more SQEs submitted ({}) than the size of the submit queue", ctx.get_max_sqe_per_submit());
+    check::debug::n_assert(ctx.get_average_sqe_per_submit() > 1, "operations are not batched");
+    ctx.close(a);
+    ctx.close(b);
+    ctx._wait_for_submit_queries();
+  }
+}
+
+// ring setup options: options refused by the kernel are dropped, the context must work with whatever is left
+static void test_ring_options()
+{
+  cr::out().log("io: ring options...");
+  for (uint32_t variant = 0; variant < 3; ++variant)
+  {
+    io::context::ring_config config;
+    config.queue_depth = 64;
+    config.completion_queue_depth = 512;
+    if (variant == 0)
+    {
+      config.single_issuer = true;
+      config.defer_taskrun = true;
+    }
+    else if (variant == 1)
+    {
+      config.coop_taskrun = true;
+    }
+    else
+    {
+      config.sqpoll = true;
+      config.sqpoll_idle_ms = 10;
+    }
+    io::context ctx(config);
+    cr::out().log("  variant {}: ring flags: {:#x}", variant, ctx.get_ring_flags());
+
+    neam::id_t a, b;
+    check::debug::n_assert(ctx.create_socket_pair(a, b), "failed to create a socket pair");
+    bool sent = false;
+    bool received = false;
+    ctx.queue_full_send(a, make_data(1000, 42)).then([&](raw_data&&, bool success, size_t) { sent = success; });
+    ctx.queue_full_receive(b, 1000).then([&](raw_data&& data, bool success, size_t size)
+    {
+      check::debug::n_assert(success && size == 1000 && check_data(data.get(), size, 42), "wrong received data");
+      received = true;
+    });
+    check::debug::n_assert(run_until(ctx, [&] { return sent && received; }), "variant {}: operations timed out", variant);
+    ctx.close(a);
+    ctx.close(b);
+    ctx._wait_for_submit_queries();
+  }
+}
+
+// write data to a file and wait for the write to complete
+static void write_file(io::context& ctx, neam::id_t fid, size_t offset, raw_data&& data)
+{
+  const size_t size = data.size;
+  bool done = false;
+  ctx.queue_write(fid, offset, std::move(data)).then([&](raw_data&&, bool success, size_t write_size)
+  {
+    check::debug::n_assert(success && write_size == size, "failed to write {}", ctx.get_string_for_id(fid));
+    done = true;
+  });
+  check::debug::n_assert(run_until(ctx, [&] { return done; }), "write timed out");
+}
+
+// registered files and fixed buffers
+static void test_registered_resources(const std::filesystem::path& dir)
+{
+  cr::out().log("io: registered files...");
+  io::context::ring_config config;
+  config.registered_file_count = 4;
+  config.fixed_buffer_count = 4;
+  config.fixed_buffer_size = 4096;
+  io::context ctx(config);
+  ctx.set_prefix_directory(dir);
+  check::debug::n_assert(ctx.get_registered_file_count() == 4, "the registered file table should have 4 slots");
+
+  // more files than slots: files without a slot use their fd
+  std::vector<neam::id_t> files;
+  for (uint32_t i = 0; i < 8; ++i)
+  {
+    files.push_back(ctx.map_file(fmt::format("registered_{}.bin", i)));
+    write_file(ctx, files.back(), io::context::truncate, make_data(1000 + i, (uint8_t)i));
+  }
+  for (uint32_t i = 0; i < 8; ++i)
+  {
+    const raw_data content = read_whole_file(ctx, files[i]);
+    check::debug::n_assert(content.size == 1000 + i && check_data(content.get(), content.size, (uint8_t)i), "registered_{}.bin: wrong content", i);
+  }
+
+  cr::out().log("io: fixed buffers...");
+  const io::buffer_pool* pool = ctx.get_fixed_buffer_pool();
+  check::debug::n_assert(pool != nullptr && pool->get_buffer_count() == 4, "fixed buffers should be registered");
+  {
+    std::vector<shared_raw_data> buffers;
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+      buffers.push_back(ctx.acquire_fixed_buffer());
+      check::debug::n_assert(!!buffers.back() && buffers.back().get_size() == 4096, "failed to acquire a fixed buffer");
+    }
+    check::debug::n_assert(!ctx.acquire_fixed_buffer(), "the pool should be exhausted");
+    check::debug::n_assert(pool->get_available_count() == 0, "the pool should be exhausted");
+    buffers.pop_back();
+    check::debug::n_assert(pool->get_available_count() == 1, "the buffer should be back in the pool");
+  }
+  check::debug::n_assert(pool->get_available_count() == 4, "the buffers should be back in the pool");
+
+  // fixed-buffer write, read and send:
+  {
+    shared_raw_data buffer = ctx.acquire_fixed_buffer();
+    {
+      raw_data data = make_data(4096, 3);
+      memcpy(buffer.get_mutable(), data.get(), 4096);
+    }
+    std::vector<shared_raw_data> segments;
+    segments.push_back(buffer);
+    bool done = false;
+    ctx.queue_write(files[0], io::context::truncate, std::move(segments)).then([&](raw_data&&, bool success, size_t size)
+    {
+      check::debug::n_assert(success && size == 4096, "fixed-buffer write failed");
+      done = true;
+    });
+    check::debug::n_assert(run_until(ctx, [&] { return done; }), "fixed-buffer write timed out");
+
+    done = false;
+    ctx.queue_read_fixed(files[0], 1000, 2000).then([&](shared_raw_data&& data, bool success, size_t size)
+    {
+      check::debug::n_assert(success && size == 2000 && data.get_size() == 2000, "fixed-buffer read failed");
+      check::debug::n_assert(check_data(data.get(), size, 3, 1000), "fixed-buffer read: wrong data");
+      check::debug::n_assert(pool->get_index(data) != io::buffer_pool::k_invalid_index, "the read should be done in a fixed buffer");
+      done = true;
+    });
+    check::debug::n_assert(run_until(ctx, [&] { return done; }), "fixed-buffer read timed out");
+
+    neam::id_t a, b;
+    connect_tcp_pair(ctx, a, b);
+    bool sent = false;
+    ctx.queue_full_send(a, buffer.slice(96, 2000)).then([&](raw_data&&, bool success, size_t size) { sent = success && size == 2000; });
+    done = false;
+    ctx.queue_full_receive(b, 2000).then([&](raw_data&& data, bool success, size_t size)
+    {
+      check::debug::n_assert(success && size == 2000 && check_data(data.get(), size, 3, 96), "fixed-buffer send: wrong data");
+      done = true;
+    });
+    check::debug::n_assert(run_until(ctx, [&] { return done && sent; }), "fixed-buffer send timed out");
+    ctx.close(a);
+    ctx.close(b);
+  }
+  ctx._wait_for_submit_queries();
+  check::debug::n_assert(pool->get_available_count() == 4, "the buffers should be back in the pool");
+
+  // buffers can outlive the context: their memory is released (and accounted as such) when they are dropped
+  {
+    memory::accounting::tag& tag = memory::accounting::get_tag("io::buffer_pool");
+    const int64_t reserved_before = tag.get_snapshot().reserved_bytes;
+    shared_raw_data held;
+    {
+      io::context other(config);
+      held = other.acquire_fixed_buffer();
+      if (!held)
+        cr::out().warn("io: fixed buffers are disabled, skipping the fixed buffer accounting test");
+      else
+        check::debug::n_assert(tag.get_snapshot().reserved_bytes == reserved_before + 4 * 4096, "fixed buffers: the pool is not accounted");
+    }
+    if (held)
+      check::debug::n_assert(tag.get_snapshot().reserved_bytes == reserved_before + 4096, "fixed buffers: only the held buffer must stay reserved");
+    held = {};
+    check::debug::n_assert(tag.get_snapshot().reserved_bytes == reserved_before, "fixed buffers: {} bytes still reserved after the last buffer was dropped",
+                           tag.get_snapshot().reserved_bytes - reserved_before);
+  }
+}
+
+// receive buffer ring: copying receives, buffer recycling, backpressure when the ring is exhausted
+static void test_buffer_ring()
+{
+  cr::out().log("io: receive buffer ring...");
+  io::context::ring_config config;
+  config.recv_buffer_count = 8;
+  config.recv_buffer_size = 1024;
+  io::context ctx(config);
+
+  constexpr size_t k_total_size = 32 * 1024;
+  neam::id_t a, b;
+  check::debug::n_assert(ctx.create_socket_pair(a, b), "failed to create a socket pair");
+
+  // copying receives give the buffers back to the ring immediately:
+  size_t copied_size = 0;
+  bool copied_ok = true;
+  ctx.queue_multi_receive(b).then([&](raw_data&& data, bool success, size_t size)
+  {
+    if (!success) return;
+    copied_ok = copied_ok && check_data(data.get(), size, 9, copied_size);
+    copied_size += size;
+  });
+  ctx.queue_full_send(a, make_data(k_total_size, 9)).then([](raw_data&&, bool, size_t) {});
+  const auto ring_is_unusable = [&]
+  {
+    // the kernel refuses buffers from a full ring: provided buffer rings don't work here
+    return copied_size == 0 && ctx.has_recv_buffer_pressure()
+        && ctx.get_recv_buffer_ring()->get_available_count() == ctx.get_recv_buffer_ring()->get_buffer_count();
+  };
+  run_until(ctx, [&] { return copied_size == k_total_size || ring_is_unusable(); });
+
+  // a buffer handed out by the ring can outlive it: its memory is released (and accounted as such) when it is dropped
+  {
+    memory::accounting::tag& tag = memory::accounting::get_tag("io::buffer_ring");
+    const int64_t reserved_before = tag.get_snapshot().reserved_bytes;
+    io_uring ring;
+    check::debug::n_assert(io_uring_queue_init(8, &ring, 0) == 0, "failed to create an io_uring");
+    io::buffer_ring* br = io::buffer_ring::create(ring, 4, 1024, 1);
+    check::debug::n_assert(br != nullptr, "failed to create a buffer ring");
+    check::debug::n_assert(tag.get_snapshot().reserved_bytes == reserved_before + 4 * 1024, "buffer ring: the buffers are not accounted");
+    shared_raw_data held = br->take(2, 100);
+    br->destroy();
+    io_uring_queue_exit(&ring);
+    check::debug::n_assert(tag.get_snapshot().reserved_bytes == reserved_before + 1024, "buffer ring: only the held buffer must stay reserved");
+    held = {};
+    check::debug::n_assert(tag.get_snapshot().reserved_bytes == reserved_before, "buffer ring: {} bytes still reserved after the last buffer was dropped",
+                           tag.get_snapshot().reserved_bytes - reserved_before);
+  }
+
+  if (ring_is_unusable())
+  {
+    cr::out().warn("io: the kernel does not fill provided buffer rings, skipping the receive buffer ring tests");
+    ctx.close(a);
+    ctx.close(b);
+    run_until(ctx, [&] { return !ctx.has_recv_buffer_pressure(); }, std::chrono::milliseconds(100));
+    return;
+  }
+  check::debug::n_assert(copied_size == k_total_size, "copying receive timed out ({} bytes received)", copied_size);
+  check::debug::n_assert(copied_ok, "copying receive: wrong data");
+  check::debug::n_assert(ctx.get_recv_buffer_ring()->get_available_count() == 8, "copying receives should not hold buffers");
+  ctx.close(b);
+  ctx.close(a);
+  ctx._wait_for_submit_queries();
+
+  // hold on to the received buffers, so the ring is exhausted:
+  check::debug::n_assert(ctx.create_socket_pair(a, b), "failed to create a socket pair");
+  std::vector<shared_raw_data> held;
+  std::vector<uint8_t> received;
+  ctx.queue_multi_receive_shared(b).then([&](shared_raw_data&& data, bool success, size_t size)
+  {
+    if (!success) return;
+    check::debug::n_assert(data.get_size() == size && size <= 1024, "received buffer has the wrong size ({})", size);
+    received.insert(received.end(), (const uint8_t*)data.get(), (const uint8_t*)data.get() + size);
+    held.push_back(std::move(data));
+  });
+
+  bool sent = false;
+  ctx.queue_full_send(a, make_data(k_total_size, 9)).then([&](raw_data&&, bool success, size_t) { sent = success; });
+
+  check::debug::n_assert(run_until(ctx, [&] { return ctx.has_recv_buffer_pressure(); }), "the receive should be stalled once the ring is exhausted");
+  check::debug::n_assert(ctx.get_recv_buffer_ring()->get_exhausted_count() > 0, "the ring exhaustion should be counted");
+  check::debug::n_assert(ctx.get_recv_buffer_ring()->get_min_available_count() == 0, "the ring should have been empty");
+  check::debug::n_assert(received.size() <= 8 * 1024, "more data received than the ring can hold");
+
+  // release the buffers as they come, the receive must resume:
+  const auto release_and_check = [&] { held.clear(); return received.size() == k_total_size; };
+  check::debug::n_assert(run_until(ctx, release_and_check), "the receive did not resume ({} bytes received)", received.size());
+  check::debug::n_assert(sent && check_data(received.data(), received.size(), 9), "wrong received data");
+  check::debug::n_assert(!ctx.has_recv_buffer_pressure(), "the receive should not be stalled anymore");
+  check::debug::n_assert(ctx.get_recv_buffer_ring()->get_available_count() == 8, "all the buffers should be back in the ring");
+
+  ctx.close(a);
+  ctx.close(b);
+  ctx._wait_for_submit_queries();
+}
+
+static uint16_t get_port(const io::dns_resolver::address& addr)
+{
+  if (addr.get_family() == AF_INET6)
+    return ntohs(((const sockaddr_in6*)&addr.addr)->sin6_port);
+  return ntohs(((const sockaddr_in*)&addr.addr)->sin_port);
+}
+
+// name resolution: numeric addresses, connection ordering, cache
+static void test_dns()
+{
+  cr::out().log("io: dns resolver...");
+  using address = io::dns_resolver::address;
+
+  address addr;
+  check::debug::n_assert(io::dns_resolver::parse_numeric_address("127.0.0.1", 80, addr), "failed to parse an ipv4 address");
+  check::debug::n_assert(addr.get_family() == AF_INET && get_port(addr) == 80, "wrong ipv4 address");
+  check::debug::n_assert(io::dns_resolver::parse_numeric_address("::1", 81, addr), "failed to parse an ipv6 address");
+  check::debug::n_assert(addr.get_family() == AF_INET6 && get_port(addr) == 81, "wrong ipv6 address");
+  check::debug::n_assert(io::dns_resolver::parse_numeric_address("[::1]", 82, addr) && addr.get_family() == AF_INET6, "failed to parse a bracketed ipv6 address");
+  check::debug::n_assert(!io::dns_resolver::parse_numeric_address("localhost", 80, addr), "host names are not numeric addresses");
+  check::debug::n_assert(!io::dns_resolver::parse_numeric_address("1.2.3", 80, addr), "1.2.3 is not a valid address");
+
+  // ordering: ipv4 sockets only keep ipv4 addresses, ipv6 sockets interleave the families (ipv6 first)
+  {
+    io::dns_resolver::address_list list(3);
+    io::dns_resolver::parse_numeric_address("10.0.0.1", 1, list[0]);
+    io::dns_resolver::parse_numeric_address("10.0.0.2", 1, list[1]);
+    io::dns_resolver::parse_numeric_address("fe80::1", 1, list[2]);
+
+    io::dns_resolver::address_list v4_list = list;
+    io::dns_resolver::order_for_connection(v4_list, AF_INET);
+    check::debug::n_assert(v4_list.size() == 2 && v4_list[0].get_family() == AF_INET && v4_list[1].get_family() == AF_INET, "ipv4 sockets must only keep ipv4 addresses");
+
+    io::dns_resolver::order_for_connection(list, AF_INET6);
+    check::debug::n_assert(list.size() == 3, "ipv6 sockets must keep every address");
+    for (const address& it : list)
+      check::debug::n_assert(it.get_family() == AF_INET6 && get_port(it) == 1, "ipv4 addresses must be v4-mapped");
+    const in6_addr& first = ((const sockaddr_in6*)&list[0].addr)->sin6_addr;
+    const in6_addr& second = ((const sockaddr_in6*)&list[1].addr)->sin6_addr;
+    check::debug::n_assert(!IN6_IS_ADDR_V4MAPPED(&first) && IN6_IS_ADDR_V4MAPPED(&second), "the families must be interleaved, ipv6 first");
+  }
+
+  // resolution + cache
+  {
+    io::dns_resolver resolver;
+    io::dns_resolver::address_list out;
+    check::debug::n_assert(resolver.try_resolve("127.0.0.1", 10, out) && out.size() == 1, "numeric addresses must resolve inline");
+    check::debug::n_assert(!resolver.try_resolve("localhost", 10, out), "localhost should not be in the cache yet");
+
+    bool done = false;
+    resolver.resolve("localhost", 1234).then([&](io::dns_resolver::address_list&& addresses)
+    {
+      out = std::move(addresses);
+      done = true;
+    });
+    const auto end = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!done && std::chrono::steady_clock::now() < end)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    check::debug::n_assert(done && !out.empty(), "failed to resolve localhost");
+    for (const address& it : out)
+      check::debug::n_assert(get_port(it) == 1234, "the port must be set on resolved addresses");
+    check::debug::n_assert(resolver.get_cache_miss_count() == 1, "the first resolution must be a cache miss");
+
+    // cached: resolved inline, with the new port
+    io::dns_resolver::address_list cached;
+    check::debug::n_assert(resolver.try_resolve("localhost", 4321, cached) && cached.size() == out.size(), "localhost should be in the cache");
+    check::debug::n_assert(get_port(cached[0]) == 4321, "the port of cached addresses must be updated");
+    check::debug::n_assert(resolver.get_cache_hit_count() >= 1, "cache hits must be counted");
+
+    resolver.clear_cache();
+    check::debug::n_assert(!resolver.try_resolve("localhost", 10, cached), "the cache should be empty");
+    check::debug::n_assert(resolver.get_pending_resolution_count() == 0, "no resolution should be pending");
+  }
+
+  // connect by name through the context:
+  {
+    io::context ctx;
+    const neam::id_t listening = ctx.create_listening_socket(0, io::ipv6::any(), 16, true);
+    const uint16_t port = ctx.get_socket_port(listening);
+    neam::id_t server = neam::id_t::invalid;
+    bool connected = false;
+    const neam::id_t client = ctx.create_socket(true);
+    ctx.queue_accept(listening).then([&](neam::id_t id) { server = id; });
+    ctx.queue_connect(client, "localhost", port).then([&](bool success)
+    {
+      check::debug::n_assert(success, "failed to connect to localhost:{}", port);
+      connected = true;
+    });
+    check::debug::n_assert(run_until(ctx, [&] { return connected && server != neam::id_t::invalid; }), "connect to localhost timed out");
+    ctx.close(client);
+    ctx.close(server);
+    ctx.close(listening);
+    ctx._wait_for_submit_queries();
+  }
+}
+
+// asynchronous opens, LRU of open files, statx
+static void test_open_files(const std::filesystem::path& dir)
+{
+  cr::out().log("io: open file lru...");
+  io::context::ring_config config;
+  config.max_open_file_count = 4;
+  io::context ctx(config);
+  ctx.set_prefix_directory(dir);
+
+  // more files than the LRU can hold, all the operations queued at once (the opens are in flight together):
+  constexpr uint32_t k_file_count = 16;
+  std::vector<neam::id_t> fids;
+  uint32_t written = 0;
+  uint32_t max_open_count = 0;
+  for (uint32_t i = 0; i < k_file_count; ++i)
+  {
+    fids.push_back(ctx.map_file(fmt::format("lru_{}.bin", i)));
+    ctx.queue_write(fids.back(), 0, make_data(1024 + i, (uint8_t)i)).then([&](raw_data&&, bool success, size_t)
+    {
+      check::debug::n_assert(success, "write failed");
+      ++written;
+    });
+  }
+  check::debug::n_assert(run_until(ctx, [&]
+  {
+    max_open_count = std::max(max_open_count, ctx.get_opened_file_count());
+    return written == k_file_count;
+  }), "writes timed out");
+  check::debug::n_assert(max_open_count > 0 && max_open_count <= config.max_open_file_count, "too many open files ({}, max: {})", max_open_count, config.max_open_file_count);
+
+  // read them back (the evicted files are opened again):
+  uint32_t read_count = 0;
+  for (uint32_t i = 0; i < k_file_count; ++i)
+  {
+    ctx.queue_read(fids[i], 0, io::context::whole_file).then([&, i](raw_data&& data, bool success, size_t size)
+    {
+      check::debug::n_assert(success && size == 1024 + i && check_data(data.get(), size, (uint8_t)i), "wrong content for file {}", i);
+      ++read_count;
+    });
+  }
+  check::debug::n_assert(run_until(ctx, [&]
+  {
+    max_open_count = std::max(max_open_count, ctx.get_opened_file_count());
+    return read_count == k_file_count;
+  }), "reads timed out");
+  check::debug::n_assert(max_open_count <= config.max_open_file_count, "too many open files ({}, max: {})", max_open_count, config.max_open_file_count);
+
+  cr::out().log("io: stat...");
+  bool stat_done = false;
+  ctx.queue_stat(fids[3]).then([&](struct statx&& st, bool success)
+  {
+    check::debug::n_assert(success && io::context::get_file_size(st) == 1024 + 3, "wrong stat result");
+    stat_done = true;
+  });
+  bool missing_done = false;
+  ctx.queue_stat(ctx.map_file("missing.bin")).then([&](struct statx&&, bool success)
+  {
+    check::debug::n_assert(!success, "stat of a missing file should fail");
+    missing_done = true;
+  });
+  check::debug::n_assert(run_until(ctx, [&] { return stat_done && missing_done; }), "stat timed out");
+  check::debug::n_assert(ctx.get_file_size(fids[5]) == 1024 + 5, "wrong file size");
+
+  // reading a missing file fails (and does not leave a pending operation behind):
+  bool missing_read = false;
+  ctx.queue_read(ctx.map_file("missing.bin"), 0, io::context::whole_file).then([&](raw_data&&, bool success, size_t)
+  {
+    check::debug::n_assert(!success, "reading a missing file should fail");
+    missing_read = true;
+  });
+  check::debug::n_assert(run_until(ctx, [&] { return missing_read; }), "read of a missing file timed out");
+  ctx._wait_for_submit_queries();
+}
+
+// direct-io reads: aligned chunks, unaligned offsets / sizes
+static void test_direct_io(const std::filesystem::path& dir)
+{
+  cr::out().log("io: direct-io reads...");
+  io::context::ring_config config;
+  config.direct_io_buffer_count = 4;
+  config.direct_io_buffer_size = 8192;
+  io::context ctx(config);
+  ctx.set_prefix_directory(dir);
+
+  constexpr size_t k_file_size = 8192 * 5 + 1234;
+  const neam::id_t fid = ctx.map_file("direct.bin");
+  write_file(ctx, fid, 0, make_data(k_file_size, 3));
+  ctx._wait_for_submit_queries();
+
+  ctx.set_direct_io(fid, 2);
+  check::debug::n_assert(ctx.is_using_direct_io(fid), "direct-io should be set");
+
+  struct read_range { size_t offset; size_t size; size_t expected_size; };
+  const read_range ranges[] =
+  {
+    { 0, io::context::whole_file, k_file_size },
+    { 0, 1, 1 },
+    { 1000, 10000, 10000 },         // unaligned offset and size, over multiple chunks
+    { 8192, 8192, 8192 },           // exactly one chunk
+    { 8191, 2, 2 },                 // across a chunk boundary
+    { k_file_size - 10, 100, 10 },  // past the end of the file
+  };
+  uint32_t done = 0;
+  for (const read_range& it : ranges)
+  {
+    ctx.queue_read(fid, it.offset, it.size).then([&, it](raw_data&& data, bool success, size_t size)
+    {
+      check::debug::n_assert(success && size == it.expected_size, "direct read [{}, {}]: wrong size ({}, expected {})", it.offset, it.size, size, it.expected_size);
+      check::debug::n_assert(check_data(data.get(), size, 3, it.offset), "direct read [{}, {}]: wrong data", it.offset, it.size);
+      ++done;
+    });
+  }
+  check::debug::n_assert(run_until(ctx, [&] { return done == std::size(ranges); }), "direct reads timed out");
+
+  // read in a caller provided buffer, at an offset:
+  bool provided_done = false;
+  ctx.queue_read(fid, 4097, 5000, raw_data::allocate(6000), 1000).then([&](raw_data&& data, bool success, size_t size)
+  {
+    check::debug::n_assert(success && size == 5000 && data.size == 6000, "direct read in a provided buffer: wrong size");
+    check::debug::n_assert(check_data(data.get_as<uint8_t>() + 1000, size, 3, 4097), "direct read in a provided buffer: wrong data");
+    provided_done = true;
+  });
+  check::debug::n_assert(run_until(ctx, [&] { return provided_done; }), "direct read in a provided buffer timed out");
+
+  ctx.clear_direct_io(fid);
+  check::debug::n_assert(!ctx.is_using_direct_io(fid), "direct-io should be cleared");
+  const raw_data content = read_whole_file(ctx, fid);
+  check::debug::n_assert(content.size == k_file_size && check_data(content.get(), content.size, 3), "buffered read after direct-io: wrong data");
+  ctx._wait_for_submit_queries();
+}
+
+// memory-mapped file views
+static void test_file_views(const std::filesystem::path& dir)
+{
+  cr::out().log("io: file views...");
+  io::context ctx;
+  ctx.set_prefix_directory(dir);
+
+  constexpr size_t k_file_size = 3 * 4096 + 100;
+  const neam::id_t fid = ctx.map_file("view.bin");
+  write_file(ctx, fid, 0, make_data(k_file_size, 5));
+  ctx._wait_for_submit_queries();
+
+  const io::file_view whole = ctx.map_file_view(fid);
+  check::debug::n_assert(!!whole && whole.get_size() == k_file_size && check_data(whole.get(), whole.get_size(), 5), "wrong whole file view");
+
+  const io::file_view range = ctx.map_file_view(fid, 5000, 1000);
+  check::debug::n_assert(range.get_offset() == 5000 && range.get_size() == 1000 && check_data(range.get(), range.get_size(), 5, 5000), "wrong ranged view");
+  check::debug::n_assert(range.get_mapping_size() == whole.get_mapping_size(), "views of a file must share the mapping");
+
+  const io::file_view slice = range.slice(10, 10000);
+  check::debug::n_assert(slice.get_offset() == 5010 && slice.get_size() == 990 && check_data(slice.get(), slice.get_size(), 5, 5010), "wrong slice (must be clamped to the view)");
+  const raw_data copy = slice.duplicate();
+  check::debug::n_assert(copy.size == 990 && check_data(copy.get(), copy.size, 5, 5010), "wrong view copy");
+
+  check::debug::n_assert(ctx.map_file_view(fid, k_file_size - 10, 100).get_size() == 10, "views must be clamped to the end of the file");
+  check::debug::n_assert(!ctx.map_file_view(fid, k_file_size + 10), "views starting past the end of the file must be empty");
+  check::debug::n_assert(!ctx.map_file_view(ctx.map_file("missing.bin")), "views of missing files must be empty");
+
+  // the file grows: new views past the old end remap the file
+  write_file(ctx, fid, k_file_size, make_data(8192, (uint8_t)(5 + k_file_size * 7)));
+  ctx._wait_for_submit_queries();
+  const io::file_view grown = ctx.map_file_view(fid, k_file_size, 8192);
+  check::debug::n_assert(grown.get_size() == 8192 && check_data(grown.get(), grown.get_size(), 5, k_file_size), "wrong view after the file has grown");
+  check::debug::n_assert(check_data(whole.get(), whole.get_size(), 5), "old views must stay valid after a remap");
+
+  // views outlive the mapping kept by the context:
+  ctx.release_file_view(fid);
+  check::debug::n_assert(check_data(range.get(), range.get_size(), 5, 5000), "views must keep the mapping alive");
+
+  bool prefetched = false;
+  ctx.queue_prefetch(grown).then([&](bool success)
+  {
+    check::debug::n_assert(success, "prefetch failed");
+    prefetched = true;
+  });
+  check::debug::n_assert(run_until(ctx, [&] { return prefetched; }), "prefetch timed out");
+  ctx._wait_for_submit_queries();
+}
+
+// block cache: hits, coalesced reads, invalidation by writes
+static void test_block_cache(const std::filesystem::path& dir)
+{
+  cr::out().log("io: block cache...");
+  io::context::ring_config config;
+  config.block_cache_budget = 64 * 4096;
+  config.block_cache_block_size = 4096;
+  config.block_cache_max_read_size = 3 * 4096;
+  io::context ctx(config);
+  ctx.set_prefix_directory(dir);
+  io::block_cache& cache = *ctx.get_block_cache();
+
+  constexpr size_t k_file_size = 16 * 4096;
+  const neam::id_t fid = ctx.map_file("cache.bin");
+  write_file(ctx, fid, 0, make_data(k_file_size, 1));
+  ctx._wait_for_submit_queries();
+
+  const auto cached_read = [&](size_t offset, size_t size, uint8_t seed)
+  {
+    bool done = false;
+    ctx.queue_read(fid, offset, size).then([&](raw_data&& data, bool success, size_t read_size)
+    {
+      check::debug::n_assert(success && read_size == size && check_data(data.get(), size, seed, offset), "cached read [{}, {}]: wrong data", offset, size);
+      done = true;
+    });
+    check::debug::n_assert(run_until(ctx, [&] { return done; }), "cached read timed out");
+  };
+
+  // concurrent reads of the same blocks share a single read:
+  uint32_t done = 0;
+  for (uint32_t i = 0; i < 8; ++i)
+  {
+    ctx.queue_read(fid, 100 + i, 5000).then([&, i](raw_data&& data, bool success, size_t size)
+    {
+      check::debug::n_assert(success && size == 5000 && check_data(data.get(), size, 1, 100 + i), "coalesced read: wrong data");
+      ++done;
+    });
+  }
+  check::debug::n_assert(run_until(ctx, [&] { return done == 8; }), "coalesced reads timed out");
+  check::debug::n_assert(cache.get_miss_count() == 2 && cache.get_coalesced_count() == 14, "reads were not coalesced (misses: {}, coalesced: {})", cache.get_miss_count(), cache.get_coalesced_count());
+  check::debug::n_assert(cache.get_block_count() == 2, "wrong cached block count ({})", cache.get_block_count());
+
+  // hits:
+  cached_read(4096, 4096, 1);
+  check::debug::n_assert(cache.get_hit_count() == 1 && cache.get_miss_count() == 2, "the block should have been served from the cache");
+
+  // writes invalidate the blocks they touch:
+  write_file(ctx, fid, 4096 + 10, make_data(10, (uint8_t)(1 + (4096 + 10) * 7 + 100)));
+  check::debug::n_assert(cache.get_block_count() == 1, "the written block should have been invalidated");
+  {
+    bool read_done = false;
+    ctx.queue_read(fid, 4096, 4096).then([&](raw_data&& data, bool success, size_t)
+    {
+      check::debug::n_assert(success && check_data(data.get(), 10, 1, 4096), "wrong data before the write");
+      check::debug::n_assert(check_data(data.get_as<uint8_t>() + 10, 10, 1 + 100, 4096 + 10), "the write is not visible");
+      read_done = true;
+    });
+    check::debug::n_assert(run_until(ctx, [&] { return read_done; }), "read after write timed out");
+  }
+
+  // reads done while a write is in flight must not keep the old content in the cache:
+  for (uint32_t i = 0; i < 16; ++i)
+  {
+    const size_t offset = 8 * 4096;
+    const uint8_t seed = (uint8_t)(50 + i);
+    cached_read(offset, 4096, i == 0 ? 1 : (uint8_t)(seed - 1));
+
+    bool written = false;
+    bool read_done = false;
+    ctx.queue_write(fid, offset, make_data(4096, (uint8_t)(seed + offset * 7))).then([&](raw_data&&, bool success, size_t)
+    {
+      check::debug::n_assert(success, "write failed");
+      written = true;
+    });
+    ctx.queue_read(fid, offset, 4096).then([&](raw_data&&, bool success, size_t) { read_done = success; });
+    check::debug::n_assert(run_until(ctx, [&] { return written && read_done; }), "concurrent read / write timed out");
+    ctx._wait_for_submit_queries();
+
+    cached_read(offset, 4096, seed);
+  }
+  ctx._wait_for_submit_queries();
+
+  // small budgets (fewer blocks than shards) are not exceeded:
+  for (const size_t budget : { 3 * 4096, 4096, 1000 })
+  {
+    io::block_cache small(budget, 4096);
+    for (uint64_t i = 0; i < 32; ++i)
+    {
+      bool should_read = false;
+      small.get_block(fid, i, should_read).then([](shared_raw_data&&, bool) {});
+      check::debug::n_assert(should_read, "small cache: block {} should be read", i);
+      small.on_block_read(fid, i, shared_raw_data(make_data(4096, (uint8_t)i)), true);
+      check::debug::n_assert(small.get_memory_usage() <= small.get_budget(), "small cache: {} bytes used for a budget of {}", small.get_memory_usage(), small.get_budget());
+    }
+    bool should_read = true;
+    small.get_block(fid, 31, should_read).then([](shared_raw_data&&, bool) {});
+    if (budget >= 4096)
+      check::debug::n_assert(!should_read && small.get_hit_count() == 1, "small cache: the last block should be cached");
+    else
+      check::debug::n_assert(should_read && small.get_block_count() == 0, "small cache: nothing should be cached below a block");
+    if (should_read)
+      small.on_block_read(fid, 31, {}, false);
+  }
+}
+
+// wait (on this thread) for the workers of a sharded context
+template<typename Func>
+static bool wait_until(Func&& done, std::chrono::milliseconds timeout = std::chrono::milliseconds(5000))
+{
+  const auto end = std::chrono::steady_clock::now() + timeout;
+  while (!done())
+  {
+    if (std::chrono::steady_clock::now() > end)
+      return false;
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  return true;
+}
+
+// sharded context: routing of files / sockets to their shard, operations queued from other threads / shards
+static void test_sharded_context(const std::filesystem::path& dir)
+{
+  cr::out().log("io: sharded context...");
+  io::sharded_context sctx(4);
+  sctx.set_prefix_directory(dir.string());
+
+  // files are routed from their id:
+  constexpr uint32_t k_file_count = 16;
+  std::vector<neam::id_t> fids;
+  std::atomic<uint32_t> written = 0;
+  for (uint32_t i = 0; i < k_file_count; ++i)
+  {
+    fids.push_back(sctx.map_file(fmt::format("sharded_{}.bin", i)));
+    const unsigned shard_index = sctx.get_shard_index_for(fids.back());
+    check::debug::n_assert(shard_index == (uint64_t)fids.back() % 4, "files must be routed from their id");
+    check::debug::n_assert(sctx.get_shard(shard_index).is_file_mapped(fids.back()), "the file must be mapped on its shard");
+    sctx.queue_write(fids.back(), 0, make_data(4096, (uint8_t)i)).then([&](raw_data&&, bool success, size_t)
+    {
+      check::debug::n_assert(success, "sharded write failed");
+      written.fetch_add(1);
+    });
+  }
+  check::debug::n_assert(wait_until([&] { return written.load() == k_file_count; }), "sharded writes timed out");
+
+  std::atomic<uint32_t> read_count = 0;
+  for (uint32_t i = 0; i < k_file_count; ++i)
+  {
+    sctx.queue_read(fids[i], 0, io::context::whole_file).then([&, i](raw_data&& data, bool success, size_t size)
+    {
+      check::debug::n_assert(success && size == 4096 && check_data(data.get(), size, (uint8_t)i), "sharded read: wrong data");
+      read_count.fetch_add(1);
+    });
+  }
+  check::debug::n_assert(wait_until([&] { return read_count.load() == k_file_count; }), "sharded reads timed out");
+  uint64_t expected_bytes[4] = {};
+  for (neam::id_t fid : fids)
+    expected_bytes[sctx.get_shard_index_for(fid)] += 4096;
+  for (unsigned i = 0; i < 4; ++i)
+  {
+    check::debug::n_assert(sctx.get_shard(i).get_total_written_bytes() == expected_bytes[i] && sctx.get_shard(i).get_total_read_bytes() == expected_bytes[i],
+                           "shard {}: the file operations were not done by the shard of the file", i);
+  }
+
+  // sockets are created on the shards in turn, accepted sockets belong to the shard of the listening socket:
+  const neam::id_t listening = sctx.create_listening_socket(0, io::context::ipv4(127, 0, 0, 1));
+  const neam::id_t client = sctx.create_socket();
+  check::debug::n_assert(sctx.get_shard_index_for(listening) != sctx.get_shard_index_for(client), "sockets should be created on different shards");
+  const uint16_t port = sctx.get_socket_port(listening);
+
+  // operations queued from completion callbacks of another shard:
+  constexpr size_t k_data_size = 64 * 1024;
+  std::atomic<neam::id_t> server = neam::id_t::invalid;
+  std::atomic<bool> received = false;
+  sctx.queue_accept(listening).then([&](neam::id_t id)
+  {
+    check::debug::n_assert(sctx.get_shard_index_for(id) == sctx.get_shard_index_for(listening), "accepted sockets must belong to the shard of the listening socket");
+    sctx.queue_full_receive(id, k_data_size).then([&](raw_data&& data, bool success, size_t size)
+    {
+      check::debug::n_assert(success && size == k_data_size && check_data(data.get(), size, 4), "sharded receive: wrong data");
+      received = true;
+    });
+    server = id;
+  });
+  std::atomic<bool> sent = false;
+  sctx.queue_connect(client, "127.0.0.1", port).then([&](bool success)
+  {
+    check::debug::n_assert(success, "sharded connect failed");
+    sctx.queue_full_send(client, make_data(k_data_size, 4)).then([&](raw_data&&, bool success, size_t)
+    {
+      check::debug::n_assert(success, "sharded send failed");
+      sent = true;
+    });
+  });
+  check::debug::n_assert(wait_until([&] { return sent.load() && received.load(); }), "sharded send / receive timed out");
+
+  sctx.close(client);
+  sctx.close(server.load());
+  sctx.close(listening);
+  sctx.stop();
+}
+
+// fsync / durable writes / atomic replace
+static void test_durability(const std::filesystem::path& dir)
+{
+  cr::out().log("io: fsync...");
+  // queue depths smaller / bigger than the number of writes (the writes are linked to the fsync only if they fit in a single batch):
+  for (const unsigned queue_depth : { 4u, 8u, 64u })
+  {
+    io::context ctx(queue_depth);
+    ctx.set_prefix_directory(dir);
+    const neam::id_t fid = ctx.map_file(fmt::format("fsync_{}.bin", queue_depth));
+    const neam::id_t other_fid = ctx.map_file(fmt::format("fsync_other_{}.bin", queue_depth));
+
+    constexpr uint32_t k_write_count = 12;
+    uint32_t written = 0;
+    uint32_t synced = 0;
+    for (uint32_t i = 0; i < k_write_count; ++i)
+    {
+      // not contiguous, so the writes are not merged:
+      ctx.queue_write(fid, i * 8192, make_data(4096, (uint8_t)i)).then([&](raw_data&&, bool success, size_t)
+      {
+        check::debug::n_assert(success, "write failed");
+        ++written;
+      });
+      ctx.queue_write(other_fid, i * 8192, make_data(4096, (uint8_t)i)).then([](raw_data&&, bool success, size_t)
+      {
+        check::debug::n_assert(success, "write failed");
+      });
+    }
+    // merged in a single fsync:
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+      ctx.queue_fsync(fid, i != 0).then([&](bool success)
+      {
+        check::debug::n_assert(success, "fsync failed (queue depth: {})", queue_depth);
+        check::debug::n_assert(written == k_write_count, "the fsync completed before the writes (queue depth: {}, {} writes completed)", queue_depth, written);
+        ++synced;
+      });
+    }
+    check::debug::n_assert(run_until(ctx, [&] { return synced == 3; }), "fsync timed out (queue depth: {})", queue_depth);
+    ctx._wait_for_submit_queries();
+    for (uint32_t i = 0; i < k_write_count; ++i)
+    {
+      bool done = false;
+      ctx.queue_read(fid, i * 8192, 4096).then([&](raw_data&& data, bool success, size_t size)
+      {
+        check::debug::n_assert(success && size == 4096 && check_data(data.get(), size, (uint8_t)i), "wrong content after fsync");
+        done = true;
+      });
+      check::debug::n_assert(run_until(ctx, [&] { return done; }), "read timed out");
+    }
+  }
+
+  cr::out().log("io: durable writes...");
+  {
+    io::context ctx;
+    ctx.set_prefix_directory(dir);
+    const neam::id_t fid = ctx.map_file("durable.bin");
+    uint32_t done = 0;
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+      ctx.queue_write_durable(fid, i * 1024, make_data(1024, (uint8_t)(i * 1024 * 7))).then([&](raw_data&&, bool success, size_t size)
+      {
+        check::debug::n_assert(success && size == 1024, "durable write failed");
+        ++done;
+      });
+    }
+    // a sync of a directory:
+    bool dir_synced = false;
+    ctx.queue_fsync(ctx.map_unprefixed_file(dir.string())).then([&](bool success) { dir_synced = success; });
+    check::debug::n_assert(run_until(ctx, [&] { return done == 4 && dir_synced; }), "durable writes timed out");
+    const raw_data content = read_whole_file(ctx, fid);
+    check::debug::n_assert(content.size == 4096 && check_data(content.get(), content.size, 0), "wrong content after durable writes");
+    ctx._wait_for_submit_queries();
+  }
+
+  cr::out().log("io: atomic replace...");
+  {
+    io::context ctx;
+    ctx.set_prefix_directory(dir);
+    const neam::id_t fid = ctx.map_file("replace.bin");
+    write_file(ctx, fid, 0, make_data(8192, 1));
+    // keep the file open with the old content:
+    check::debug::n_assert(read_whole_file(ctx, fid).size == 8192, "wrong initial file size");
+
+    bool replaced = false;
+    ctx.queue_atomic_replace(fid, make_data(3000, 2)).then([&](bool success)
+    {
+      check::debug::n_assert(success, "atomic replace failed");
+      replaced = true;
+    });
+    check::debug::n_assert(run_until(ctx, [&] { return replaced; }), "atomic replace timed out");
+    const raw_data content = read_whole_file(ctx, fid);
+    check::debug::n_assert(content.size == 3000 && check_data(content.get(), content.size, 2), "wrong content after the atomic replace");
+    check::debug::n_assert(!std::filesystem::exists(dir / "replace.bin.tmp"), "the temporary file should have been renamed");
+
+    // the rename fails (the target is a non-empty directory): the temporary file is removed
+    std::filesystem::create_directories(dir / "replace_dir" / "child");
+    bool failed = false;
+    ctx.queue_atomic_replace(ctx.map_file("replace_dir"), make_data(100, 3)).then([&](bool success)
+    {
+      check::debug::n_assert(!success, "atomic replace of a directory should fail");
+      failed = true;
+    });
+    check::debug::n_assert(run_until(ctx, [&] { return failed; }), "failing atomic replace timed out");
+    ctx._wait_for_submit_queries();
+    check::debug::n_assert(!std::filesystem::exists(dir / "replace_dir.tmp"), "the temporary file should have been removed");
+    check::debug::n_assert(std::filesystem::exists(dir / "replace_dir" / "child"), "the target should be untouched");
+  }
+}
+
+// per-operation timeouts
+static void test_timeouts()
+{
+  cr::out().log("io: operation timeouts...");
+  io::context ctx;
+  constexpr std::chrono::milliseconds k_timeout(50);
+
+  // accept: nobody connects
+  {
+    const neam::id_t listening = ctx.create_listening_socket(0, io::context::ipv4(127, 0, 0, 1));
+    ctx.set_operation_timeout(listening, k_timeout);
+    bool done = false;
+    ctx.queue_accept(listening).then([&](neam::id_t id)
+    {
+      check::debug::n_assert(id == neam::id_t::none, "a timed-out accept must complete with id_t::none");
+      done = true;
+    });
+    check::debug::n_assert(run_until(ctx, [&] { return done; }, std::chrono::milliseconds(2000)), "accept did not time out");
+    ctx.close(listening);
+  }
+
+  // receive: the peer never sends anything, but the connection stays usable
+  {
+    neam::id_t a, b;
+    connect_tcp_pair(ctx, a, b);
+    ctx.set_operation_timeout(b, k_timeout);
+    bool done = false;
+    ctx.queue_receive(b, 16).then([&](raw_data&& /*data*/, bool success, size_t size)
+    {
+      check::debug::n_assert(!success && size == io::context::k_timed_out, "a timed-out receive must fail with k_timed_out");
+      done = true;
+    });
+    check::debug::n_assert(run_until(ctx, [&] { return done; }, std::chrono::milliseconds(2000)), "receive did not time out");
+
+    ctx.clear_operation_timeout(b);
+    done = false;
+    ctx.queue_send(a, make_data(16, 3)).then([](raw_data&&, bool success, size_t) { check::debug::n_assert(success, "send failed"); });
+    ctx.queue_receive(b, 16).then([&](raw_data&& data, bool success, size_t size)
+    {
+      check::debug::n_assert(success && size == 16 && check_data(data.get(), 16, 3), "receive after a timeout failed");
+      done = true;
+    });
+    check::debug::n_assert(run_until(ctx, [&] { return done; }), "receive after a timeout did not complete");
+    ctx.close(a);
+    ctx.close(b);
+  }
+
+  // connect: the backlog of the listener is full and nobody accepts, so the connects hang until they time out
+  // (the connect must then fail, and the socket id must still be closable / the listener still reachable)
+  {
+    ctx.reset_metrics();
+    const neam::id_t listening = ctx.create_listening_socket(0, io::context::ipv4(127, 0, 0, 1), 1);
+    const uint16_t port = ctx.get_socket_port(listening);
+    std::vector<neam::id_t> sockets;
+    unsigned done_count = 0;
+    unsigned failed_count = 0;
+    for (unsigned i = 0; i < 8; ++i)
+    {
+      const neam::id_t sock = ctx.create_socket();
+      ctx.set_operation_timeout(sock, k_timeout);
+      sockets.push_back(sock);
+      ctx.queue_connect(sock, "127.0.0.1", port).then([&](bool success)
+      {
+        failed_count += success ? 0 : 1;
+        ++done_count;
+      });
+    }
+    check::debug::n_assert(run_until(ctx, [&] { return done_count == sockets.size(); }, std::chrono::milliseconds(2000)), "connects did not time out");
+    const uint64_t timeout_count = ctx.get_metrics()[io::context::metric_type::connect].timeout_count;
+    check::debug::n_assert(timeout_count == failed_count, "failed connects must be the timed-out ones ({} timeouts, {} failures)", timeout_count, failed_count);
+    if (failed_count == 0)
+      cr::out().warn("io: the backlog of the listener never filled up, skipping the connect timeout check");
+    for (const neam::id_t sock : sockets)
+      ctx.close(sock);
+    ctx.close(listening);
+  }
+
+  // connect: a connect that completes before its deadline is not affected by the timeout
+  {
+    const neam::id_t listening = ctx.create_listening_socket(0, io::context::ipv4(127, 0, 0, 1));
+    const uint16_t port = ctx.get_socket_port(listening);
+    const neam::id_t sock = ctx.create_socket();
+    ctx.set_operation_timeout(sock, std::chrono::milliseconds(2000));
+    bool done = false;
+    neam::id_t server = neam::id_t::invalid;
+    ctx.queue_accept(listening).then([&](neam::id_t id) { server = id; });
+    ctx.queue_connect(sock, "127.0.0.1", port).then([&](bool success)
+    {
+      check::debug::n_assert(success, "connect with a timeout failed");
+      done = true;
+    });
+    check::debug::n_assert(run_until(ctx, [&] { return done && server != neam::id_t::invalid; }), "connect with a timeout did not complete");
+    ctx.close(sock);
+    ctx.close(server);
+    ctx.close(listening);
+  }
+}
+
+// streaming_header_connection_t: packets reassembled from arbitrary receive boundaries
+template<bool SharedPackets>
+struct framed_connection : io::network::streaming_header_connection_t<framed_connection<SharedPackets>, 64 * 1024>
+{
+  struct packet_header_t
+  {
+    uint32_t size;
+    uint32_t seed;
+  };
+  static constexpr uint32_t k_invalid_seed = ~0u;
+
+  struct packet_t
+  {
+    packet_header_t header;
+    bool is_valid;
+    bool is_in_buffer; // a slice of the receive buffer (not copied)
+  };
+  std::vector<packet_t> packets;
+  bool is_oversized = false;
+  const uint8_t* buffer_begin = nullptr;
+  const uint8_t* buffer_end = nullptr;
+
+  bool is_header_valid(const packet_header_t& ph) const { return ph.seed != k_invalid_seed; }
+  uint32_t get_size_of_data_to_read(const packet_header_t& ph) const { return ph.size; }
+  void on_packet_oversized(const packet_header_t&) { is_oversized = true; }
+
+  void on_packet(const packet_header_t& ph, shared_raw_data&& data) requires(SharedPackets)
+  {
+    const uint8_t* const ptr = (const uint8_t*)data.get();
+    const bool is_valid = data.get_size() == ph.size && (ph.size == 0 || check_data(ptr, ph.size, (uint8_t)ph.seed));
+    packets.push_back({ ph, is_valid, ph.size > 0 && ptr >= buffer_begin && ptr + ph.size <= buffer_end });
+  }
+  void on_packet(const packet_header_t& ph, raw_data&& data) requires(!SharedPackets)
+  {
+    const bool is_valid = data.size == ph.size && (ph.size == 0 || check_data(data.get(), ph.size, (uint8_t)ph.seed));
+    packets.push_back({ ph, is_valid, false });
+  }
+
+  // feed the stream, cut in chunks of the given sizes (cycled)
+  void feed(const std::vector<uint8_t>& stream, const std::vector<size_t>& chunk_sizes)
+  {
+    size_t offset = 0;
+    for (size_t i = 0; offset < stream.size(); ++i)
+    {
+      const size_t size = std::min(chunk_sizes[i % chunk_sizes.size()], stream.size() - offset);
+      shared_raw_data buffer(raw_data::duplicate(stream.data() + offset, size));
+      buffer_begin = (const uint8_t*)buffer.get();
+      buffer_end = buffer_begin + size;
+      this->_parse(std::move(buffer));
+      offset += size;
+    }
+  }
+};
+
+static std::vector<uint8_t> make_framed_stream(const std::vector<uint32_t>& sizes, uint32_t size_override = 0, uint32_t seed_override = 0)
+{
+  std::vector<uint8_t> stream;
+  for (uint32_t i = 0; i < sizes.size(); ++i)
+  {
+    const framed_connection<true>::packet_header_t header { size_override != 0 ? size_override : sizes[i], seed_override != 0 ? seed_override : i + 1 };
+    stream.insert(stream.end(), (const uint8_t*)&header, (const uint8_t*)&header + sizeof(header));
+    raw_data data = make_data(sizes[i], (uint8_t)(i + 1));
+    stream.insert(stream.end(), (const uint8_t*)data.get(), (const uint8_t*)data.get() + sizes[i]);
+  }
+  return stream;
+}
+
+template<typename Connection>
+static void check_framed_packets(const Connection& c, const std::vector<uint32_t>& sizes, const char* what)
+{
+  check::debug::n_assert(c.packets.size() == sizes.size(), "framing ({}): {} packets instead of {}", what, c.packets.size(), sizes.size());
+  for (uint32_t i = 0; i < sizes.size(); ++i)
+  {
+    check::debug::n_assert(c.packets[i].header.size == sizes[i] && c.packets[i].header.seed == i + 1, "framing ({}): packet {} is out of order", what, i);
+    check::debug::n_assert(c.packets[i].is_valid, "framing ({}): packet {} has the wrong data", what, i);
+  }
+}
+
+static void test_framing()
+{
+  cr::out().log("io: packet framing...");
+  io::context ctx;
+  const std::vector<uint32_t> sizes = { 0, 1, 7, 100, 5000, 3, 30000, 16, 0, 8 };
+  const std::vector<uint8_t> stream = make_framed_stream(sizes);
+
+  const auto make_connection = [&]<typename Connection>(Connection& c)
+  {
+    neam::id_t a, b;
+    check::debug::n_assert(ctx.create_socket_pair(a, b), "failed to create a socket pair");
+    ctx.close(a);
+    c.ioctx = &ctx;
+    c.socket = b;
+  };
+
+  // single buffer: every packet is a slice of it
+  {
+    framed_connection<true> c;
+    make_connection(c);
+    c.feed(stream, { stream.size() });
+    check_framed_packets(c, sizes, "single buffer");
+    for (const auto& it : c.packets)
+      check::debug::n_assert(it.header.size == 0 || it.is_in_buffer, "framing: packets in a single buffer must not be copied");
+    c.close();
+  }
+
+  // headers and bodies split across buffers (byte per byte, in the middle of the headers, ...)
+  for (const std::vector<size_t>& chunks : std::vector<std::vector<size_t>> { { 1 }, { 3 }, { 5 }, { 8 }, { 13, 4, 1 }, { 4096 }, { 9000, 2 } })
+  {
+    framed_connection<true> shared;
+    make_connection(shared);
+    shared.feed(stream, chunks);
+    check_framed_packets(shared, sizes, "shared packets");
+    shared.close();
+
+    framed_connection<false> copied;
+    make_connection(copied);
+    copied.feed(stream, chunks);
+    check_framed_packets(copied, sizes, "copied packets");
+    copied.close();
+  }
+
+  // oversized packets and invalid headers close the connection
+  {
+    framed_connection<true> c;
+    make_connection(c);
+    c.feed(make_framed_stream({ 4, 4 }, 65 * 1024), { 3 });
+    check::debug::n_assert(c.is_oversized && c.is_closed() && c.packets.empty(), "framing: oversized packets must close the connection");
+
+    framed_connection<false> invalid;
+    make_connection(invalid);
+    std::vector<uint8_t> invalid_stream = make_framed_stream({ 4 });
+    const std::vector<uint8_t> tail = make_framed_stream({ 4 }, 0, framed_connection<false>::k_invalid_seed);
+    invalid_stream.insert(invalid_stream.end(), tail.begin(), tail.end());
+    invalid.feed(invalid_stream, { 5 });
+    check::debug::n_assert(invalid.is_closed() && invalid.packets.size() == 1, "framing: invalid headers must close the connection");
+  }
+
+  // over a socket (multishot receive with the buffer ring):
+  {
+    io::context::ring_config config;
+    config.recv_buffer_count = 8;
+    config.recv_buffer_size = 1024;
+    io::context rctx(config);
+    neam::id_t a, b;
+    check::debug::n_assert(rctx.create_socket_pair(a, b), "failed to create a socket pair");
+    framed_connection<true> c;
+    c.ioctx = &rctx;
+    c.socket = b;
+    framed_connection<true>::on_connection(c);
+    rctx.queue_full_send(a, raw_data::duplicate(stream.data(), stream.size())).then([](raw_data&&, bool, size_t) {});
+    const auto ring_is_unusable = [&]
+    {
+      return c.packets.empty() && rctx.has_recv_buffer_pressure()
+          && rctx.get_recv_buffer_ring()->get_available_count() == rctx.get_recv_buffer_ring()->get_buffer_count();
+    };
+    run_until(rctx, [&] { return c.packets.size() == sizes.size() || ring_is_unusable(); });
+    if (ring_is_unusable())
+      cr::out().warn("io: the kernel does not fill provided buffer rings, skipping the framing test over a socket");
+    else
+      check_framed_packets(c, sizes, "socket");
+    c.close();
+    rctx.close(a);
+    run_until(rctx, [&] { return c.in_flight_operations.get_count() == 0; }, std::chrono::milliseconds(1000));
+  }
+}
+
+// connection_t coalesced sends: batching, cork / flush, send budget
+static void test_coalesced_sends()
+{
+  cr::out().log("io: coalesced sends...");
+  io::context ctx;
+  neam::id_t a, b;
+  connect_tcp_pair(ctx, a, b);
+  io::network::connection_t c;
+  c.ioctx = &ctx;
+  c.socket = a;
+
+  // receive \e size bytes on b, and check they are the concatenation of the chunks of make_data(chunk_size, seed + i)
+  const auto receive_chunks = [&](unsigned count, size_t chunk_size, uint8_t seed)
+  {
+    bool done = false;
+    ctx.queue_full_receive(b, count * chunk_size).then([&, count, chunk_size, seed](raw_data&& data, bool success, size_t size)
+    {
+      check::debug::n_assert(success && size == count * chunk_size, "coalesced sends: receive failed");
+      for (unsigned i = 0; i < count; ++i)
+        check::debug::n_assert(check_data((const uint8_t*)data.get() + i * chunk_size, chunk_size, (uint8_t)(seed + i)), "coalesced sends: chunk {} is out of order", i);
+      done = true;
+    });
+    check::debug::n_assert(run_until(ctx, [&] { return done; }), "coalesced sends: receive timed out");
+  };
+
+  // sends queued during the same process() are sent with a single sendmsg, and each chain gets its own size
+  {
+    constexpr unsigned k_count = 16;
+    ctx.reset_metrics();
+    unsigned completed = 0;
+    for (unsigned i = 0; i < k_count; ++i)
+    {
+      c.queue_coalesced_send(make_data(100 + i, (uint8_t)(10 + i))).then([&, i](raw_data&&, bool success, size_t size)
+      {
+        check::debug::n_assert(success && size == 100 + i, "coalesced send {} completed with the wrong size ({})", i, size);
+        ++completed;
+      });
+    }
+    check::debug::n_assert(c.get_queued_send_size() > 0, "coalesced sends must be queued until the end of process()");
+    check::debug::n_assert(run_until(ctx, [&] { return completed == k_count; }), "coalesced sends did not complete");
+    check::debug::n_assert(ctx.get_metrics()[io::context::metric_type::send].completion_count == 1, "coalesced sends must be sent with a single sendmsg");
+    check::debug::n_assert(c.get_outbound_size() == 0, "coalesced sends: outbound size not released");
+
+    bool done = false;
+    size_t offset = 0;
+    std::vector<uint8_t> received;
+    ctx.queue_full_receive(b, k_count * 100 + k_count * (k_count - 1) / 2).then([&](raw_data&& data, bool success, size_t size)
+    {
+      check::debug::n_assert(success, "coalesced sends: receive failed");
+      received.assign((const uint8_t*)data.get(), (const uint8_t*)data.get() + size);
+      done = true;
+    });
+    check::debug::n_assert(run_until(ctx, [&] { return done; }), "coalesced sends: receive timed out");
+    for (unsigned i = 0; i < k_count; ++i)
+    {
+      check::debug::n_assert(check_data(received.data() + offset, 100 + i, (uint8_t)(10 + i)), "coalesced sends: chunk {} is out of order", i);
+      offset += 100 + i;
+    }
+  }
+
+  // corked: nothing is sent until flush()
+  {
+    c.cork();
+    for (unsigned i = 0; i < 4; ++i)
+      c.queue_coalesced_send(make_data(64, (uint8_t)(20 + i))).then([](raw_data&&, bool success, size_t) { check::debug::n_assert(success, "corked send failed"); });
+    run_until(ctx, [] { return false; }, std::chrono::milliseconds(50));
+    check::debug::n_assert(c.get_queued_send_size() == 4 * 64, "corked sends must stay queued");
+    c.flush();
+    check::debug::n_assert(c.get_queued_send_size() == 0, "flush() must send the queued data");
+    receive_chunks(4, 64, 20);
+
+    // uncork sends what was queued while corked
+    c.queue_coalesced_send(make_data(64, 30)).then([](raw_data&&, bool, size_t) {});
+    c.uncork();
+    check::debug::n_assert(c.get_queued_send_size() == 0 && !c.is_corked(), "uncork() must send the queued data");
+    receive_chunks(1, 64, 30);
+  }
+
+  // the send budget sends the queue right away (even when corked)
+  {
+    c.cork();
+    c.set_send_budget(256);
+    c.queue_coalesced_send(make_data(200, 40)).then([](raw_data&&, bool, size_t) {});
+    check::debug::n_assert(c.get_queued_send_size() == 200, "sends below the budget must stay queued");
+    c.queue_coalesced_send(make_data(200, 41)).then([](raw_data&&, bool, size_t) {});
+    check::debug::n_assert(c.get_queued_send_size() == 0, "sends above the budget must be sent right away");
+    receive_chunks(2, 200, 40);
+    c.uncork();
+    c.set_send_budget(io::network::connection_t::k_default_send_budget);
+  }
+
+  // closing the connection fails the queued sends
+  {
+    c.cork();
+    bool failed = false;
+    c.queue_coalesced_send(make_data(64, 50)).then([&](raw_data&&, bool success, size_t) { failed = !success; });
+    c.close();
+    check::debug::n_assert(failed, "queued sends must fail when the connection is closed");
+    bool closed_failed = false;
+    c.queue_coalesced_send(make_data(64, 51)).then([&](raw_data&&, bool success, size_t) { closed_failed = !success; });
+    check::debug::n_assert(closed_failed, "sends on a closed connection must fail");
+    run_until(ctx, [&] { return c.in_flight_operations.get_count() == 0; }, std::chrono::milliseconds(1000));
+  }
+  ctx.close(b);
+}
+
+// receive the pending datagrams of the socket (blocking until the first one is there)
+static std::vector<raw_data> receive_datagrams(io::context& ctx, neam::id_t sid, size_t count)
+{
+  std::vector<raw_data> ret;
+  const int fd = ctx._get_fd(sid);
+  while (ret.size() < count)
+  {
+    pollfd pfd { fd, POLLIN, 0 };
+    if (poll(&pfd, 1, 2000) <= 0)
+      break;
+    raw_data data = raw_data::allocate(64 * 1024);
+    const ssize_t size = recv(fd, data.get(), data.size, MSG_DONTWAIT);
+    if (size < 0)
+      break;
+    data.size = (size_t)size;
+    ret.push_back(std::move(data));
+  }
+  return ret;
+}
+
+// UDP: single datagrams, batches (GSO or not), multishot receives
+static void test_udp()
+{
+  cr::out().log("io: udp...");
+  io::context ctx;
+  const neam::id_t receiver = ctx.create_udp_socket(0, io::context::ipv4(127, 0, 0, 1));
+  const neam::id_t sender = ctx.create_udp_socket(0, io::context::ipv4(127, 0, 0, 1));
+  check::debug::n_assert(receiver != neam::id_t::invalid && sender != neam::id_t::invalid, "failed to create udp sockets");
+  io::dns_resolver::address destination;
+  check::debug::n_assert(io::dns_resolver::parse_numeric_address("127.0.0.1", ctx.get_socket_port(receiver), destination), "failed to parse the address");
+
+  // sends the datagrams (with queue_send_datagrams()) and check they are received as separate datagrams, in order
+  const auto check_batch = [&](const std::vector<size_t>& sizes, const char* what)
+  {
+    std::vector<shared_raw_data> datagrams;
+    size_t total_size = 0;
+    for (size_t i = 0; i < sizes.size(); ++i)
+    {
+      datagrams.push_back(shared_raw_data(make_data(sizes[i], (uint8_t)i)));
+      total_size += sizes[i];
+    }
+    bool done = false;
+    ctx.queue_send_datagrams(sender, destination, std::move(datagrams)).then([&](raw_data&&, bool success, size_t size)
+    {
+      check::debug::n_assert(success && size == total_size, "udp ({}): send failed (sent {} of {} bytes)", what, size, total_size);
+      done = true;
+    });
+    check::debug::n_assert(run_until(ctx, [&] { return done; }), "udp ({}): send timed out", what);
+
+    const std::vector<raw_data> received = receive_datagrams(ctx, receiver, sizes.size());
+    check::debug::n_assert(received.size() == sizes.size(), "udp ({}): received {} datagrams instead of {}", what, received.size(), sizes.size());
+    for (size_t i = 0; i < sizes.size(); ++i)
+    {
+      check::debug::n_assert(received[i].size == sizes[i] && check_data(received[i].get(), sizes[i], (uint8_t)i),
+                             "udp ({}): datagram {} is wrong ({} bytes instead of {})", what, i, received[i].size, sizes[i]);
+    }
+  };
+
+  // single datagram
+  {
+    bool done = false;
+    ctx.queue_send_datagram(sender, destination, shared_raw_data(make_data(500, 3))).then([&](raw_data&&, bool success, size_t size)
+    {
+      check::debug::n_assert(success && size == 500, "udp: datagram send failed");
+      done = true;
+    });
+    check::debug::n_assert(run_until(ctx, [&] { return done; }), "udp: datagram send timed out");
+    const std::vector<raw_data> received = receive_datagrams(ctx, receiver, 1);
+    check::debug::n_assert(received.size() == 1 && received[0].size == 500 && check_data(received[0].get(), 500, 3), "udp: wrong datagram received");
+  }
+
+  // same size datagrams, with a smaller last one (a single GSO send if supported)
+  check_batch(std::vector<size_t>(10, 1000), "same size");
+  {
+    std::vector<size_t> sizes(10, 1000);
+    sizes.push_back(300);
+    check_batch(sizes, "smaller last datagram");
+  }
+  // different sizes (one sendmsg per datagram)
+  check_batch({ 100, 500, 200, 1, 1400 }, "different sizes");
+  // more datagrams than a GSO send can hold, and more data than a GSO batch
+  check_batch(std::vector<size_t>(io::context::k_max_gso_segment_count + 10, 200), "more than the gso segment count");
+  check_batch(std::vector<size_t>(40, 1400), "more than the gso batch size");
+  cr::out().debug("io: udp gso support: {}", ctx.has_udp_gso());
+
+  // multishot receives, with the source address
+  {
+    io::context::ring_config config;
+    config.recv_buffer_count = 8;
+    config.recv_buffer_size = 2048;
+    io::context rctx(config);
+    const neam::id_t rreceiver = rctx.create_udp_socket(0, io::context::ipv4(127, 0, 0, 1));
+    const neam::id_t rsender = rctx.create_udp_socket(0, io::context::ipv4(127, 0, 0, 1));
+    const uint16_t sender_port = rctx.get_socket_port(rsender);
+    io::dns_resolver::address rdestination;
+    io::dns_resolver::parse_numeric_address("127.0.0.1", rctx.get_socket_port(rreceiver), rdestination);
+
+    constexpr unsigned k_count = 32;
+    unsigned received = 0;
+    bool is_ok = true;
+    rctx.queue_multi_receive_datagrams(rreceiver).then([&](shared_raw_data&& data, const io::dns_resolver::address& source, bool success)
+    {
+      if (!success) return;
+      is_ok = is_ok && data.get_size() == 100 + received && check_data(data.get(), data.get_size(), (uint8_t)received) && get_port(source) == sender_port;
+      ++received;
+    });
+    for (unsigned i = 0; i < k_count; ++i)
+      rctx.queue_send_datagram(rsender, rdestination, shared_raw_data(make_data(100 + i, (uint8_t)i))).then([](raw_data&&, bool, size_t) {});
+    const auto ring_is_unusable = [&]
+    {
+      return received == 0 && rctx.has_recv_buffer_pressure()
+          && rctx.get_recv_buffer_ring()->get_available_count() == rctx.get_recv_buffer_ring()->get_buffer_count();
+    };
+    run_until(rctx, [&] { return received == k_count || ring_is_unusable(); });
+    if (ring_is_unusable())
+    {
+      cr::out().warn("io: the kernel does not fill provided buffer rings, skipping the udp multishot receive test");
+    }
+    else
+    {
+      check::debug::n_assert(received == k_count, "udp: multishot receive got {} datagrams instead of {}", received, k_count);
+      check::debug::n_assert(is_ok, "udp: multishot receive got wrong datagrams / source addresses");
+    }
+    rctx.close(rreceiver);
+    rctx.close(rsender);
+    rctx._wait_for_submit_queries();
+  }
+
+  ctx.close(receiver);
+  ctx.close(sender);
+}
+
+// AF_UNIX sockets: SCM_RIGHTS fd passing
+static void test_fd_passing()
+{
+  cr::out().log("io: fd passing...");
+  io::context ctx;
+
+  // send the fds with the data, and receive them on the other end
+  const auto pass_fds = [&](neam::id_t from, neam::id_t to, std::vector<int> fds, size_t data_size, uint8_t seed)
+  {
+    std::vector<int> received;
+    bool done = false;
+    ctx.queue_send_fds(from, std::move(fds), shared_raw_data(make_data(data_size, seed))).then([](raw_data&&, bool success, size_t)
+    {
+      check::debug::n_assert(success, "fd passing: send failed");
+    });
+    ctx.queue_receive_fds(to, data_size).then([&](raw_data&& data, std::vector<int>&& fds, bool success, size_t size)
+    {
+      check::debug::n_assert(success && size == data_size && check_data(data.get(), size, seed), "fd passing: wrong data received");
+      received = std::move(fds);
+      done = true;
+    });
+    check::debug::n_assert(run_until(ctx, [&] { return done; }), "fd passing: receive timed out");
+    return received;
+  };
+
+  neam::id_t a, b;
+  check::debug::n_assert(ctx.create_socket_pair(a, b), "failed to create a socket pair");
+
+  // the received fd refers to the same pipe
+  {
+    int pipe_fds[2];
+    check::debug::n_assert(pipe2(pipe_fds, O_CLOEXEC | O_NONBLOCK) == 0, "failed to create a pipe");
+    const std::vector<int> received = pass_fds(a, b, { pipe_fds[1] }, 32, 1);
+    check::debug::n_assert(received.size() == 1 && received[0] != pipe_fds[1], "fd passing: expected a new fd");
+    check::debug::n_assert(write(received[0], "abc", 3) == 3, "fd passing: failed to write to the received fd");
+    char buffer[4] = {};
+    check::debug::n_assert(read(pipe_fds[0], buffer, sizeof(buffer)) == 3 && memcmp(buffer, "abc", 3) == 0, "fd passing: the received fd is not the pipe");
+    check::debug::n_assert((fcntl(received[0], F_GETFD) & FD_CLOEXEC) != 0, "fd passing: received fds must be O_CLOEXEC");
+    ::close(received[0]);
+    ::close(pipe_fds[0]);
+    ::close(pipe_fds[1]);
+  }
+
+  // the maximum number of fds at once
+  {
+    std::vector<int> fds;
+    for (unsigned i = 0; i < io::context::k_max_passed_fd_count; ++i)
+      fds.push_back(dup(STDERR_FILENO));
+    const std::vector<int> received = pass_fds(b, a, fds, 8, 2);
+    check::debug::n_assert(received.size() == io::context::k_max_passed_fd_count, "fd passing: received {} fds instead of {}", received.size(), fds.size());
+    for (const int fd : received)
+      ::close(fd);
+    for (const int fd : fds)
+      ::close(fd);
+  }
+
+  // shared memory
+  {
+    constexpr size_t k_size = 64 * 1024;
+    const int memfd = io::context::create_shared_memory_fd("io_context_test", k_size);
+    check::debug::n_assert(memfd >= 0, "failed to create a shared memory fd");
+    void* const ptr = mmap(nullptr, k_size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    raw_data pattern = make_data(k_size, 3);
+    memcpy(ptr, pattern.get(), k_size);
+    const std::vector<int> received = pass_fds(a, b, { memfd }, 1, 4);
+    check::debug::n_assert(received.size() == 1, "fd passing: shared memory fd not received");
+    void* const received_ptr = mmap(nullptr, k_size, PROT_READ, MAP_SHARED, received[0], 0);
+    check::debug::n_assert(received_ptr != MAP_FAILED && check_data(received_ptr, k_size, 3), "fd passing: wrong shared memory content");
+    munmap(received_ptr, k_size);
+    munmap(ptr, k_size);
+    ::close(received[0]);
+    ::close(memfd);
+  }
+  ctx.close(a);
+  ctx.close(b);
+
+  // seqpacket: message boundaries are kept, with their fds
+  {
+    check::debug::n_assert(ctx.create_socket_pair(a, b, true), "failed to create a seqpacket socket pair");
+    int pipe_fds[2];
+    check::debug::n_assert(pipe2(pipe_fds, O_CLOEXEC) == 0, "failed to create a pipe");
+    ctx.queue_send_fds(a, { pipe_fds[0] }, shared_raw_data(make_data(10, 5))).then([](raw_data&&, bool, size_t) {});
+    ctx.queue_send_fds(a, { pipe_fds[1] }, shared_raw_data(make_data(20, 6))).then([](raw_data&&, bool, size_t) {});
+    std::vector<std::pair<size_t, size_t>> messages;
+    for (unsigned i = 0; i < 2; ++i)
+    {
+      ctx.queue_receive_fds(b, 1024).then([&](raw_data&&, std::vector<int>&& fds, bool success, size_t size)
+      {
+        check::debug::n_assert(success, "fd passing: seqpacket receive failed");
+        messages.push_back({ size, fds.size() });
+        for (const int fd : fds)
+          ::close(fd);
+      });
+    }
+    check::debug::n_assert(run_until(ctx, [&] { return messages.size() == 2; }), "fd passing: seqpacket receive timed out");
+    check::debug::n_assert(messages[0].first == 10 && messages[0].second == 1 && messages[1].first == 20 && messages[1].second == 1,
+                           "fd passing: seqpacket messages merged");
+    ::close(pipe_fds[0]);
+    ::close(pipe_fds[1]);
+    ctx.close(a);
+    ctx.close(b);
+  }
+
+  // the fds of a canceled receive are closed
+  {
+    check::debug::n_assert(ctx.create_socket_pair(a, b), "failed to create a socket pair");
+    int pipe_fds[2];
+    check::debug::n_assert(pipe2(pipe_fds, O_CLOEXEC | O_NONBLOCK) == 0, "failed to create a pipe");
+
+    bool done = false;
+    async::continuation_chain chain = ctx.queue_receive_fds(b, 16).then([&](raw_data&&, std::vector<int>&& fds, bool, size_t)
+    {
+      // not supposed to get any fd, but avoid leaking it if the cancel went first
+      for (const int fd : fds)
+        ::close(fd);
+      check::debug::n_assert(fds.empty(), "fd passing: a canceled receive must not pass fds");
+      done = true;
+    });
+    ctx.process();
+
+    // send the fd behind the back of the context, wait for the recvmsg to complete, and cancel before the completion is processed:
+    {
+      char byte = 0;
+      iovec iov { &byte, 1 };
+      alignas(cmsghdr) uint8_t control[CMSG_SPACE(sizeof(int))] = {};
+      msghdr msg {};
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+      cmsghdr* const cmsg = CMSG_FIRSTHDR(&msg);
+      cmsg->cmsg_level = SOL_SOCKET;
+      cmsg->cmsg_type = SCM_RIGHTS;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+      memcpy(CMSG_DATA(cmsg), &pipe_fds[1], sizeof(int));
+      check::debug::n_assert(sendmsg(ctx._get_fd(a), &msg, 0) == 1, "fd passing: sendmsg failed");
+    }
+    ::close(pipe_fds[1]);
+    ctx.wait_for_activity();
+    chain.cancel();
+    check::debug::n_assert(run_until(ctx, [&] { return done; }), "fd passing: canceled receive did not complete");
+    ctx.close(a);
+    ctx.close(b);
+    ctx._wait_for_submit_queries();
+
+    // all the write ends of the pipe are closed:
+    char c;
+    check::debug::n_assert(read(pipe_fds[0], &c, 1) == 0, "fd passing: the fds of a canceled receive are leaked");
+    ::close(pipe_fds[0]);
+  }
+}
+
+// sharded_context::queue_send_file(): the file and the socket belong to different shards
+static void test_sharded_send_file(const std::filesystem::path& dir)
+{
+  cr::out().log("io: sharded send file...");
+  io::sharded_context sctx(4);
+  sctx.set_prefix_directory(dir.string());
+
+  constexpr size_t k_file_size = 256 * 1024 + 123;
+  constexpr uint32_t k_file_count = 4;
+  std::vector<neam::id_t> fids;
+  std::atomic<uint32_t> written = 0;
+  for (uint32_t i = 0; i < k_file_count; ++i)
+  {
+    fids.push_back(sctx.map_file(fmt::format("sharded_send_file_{}.bin", i)));
+    sctx.queue_write(fids.back(), 0, make_data(k_file_size, (uint8_t)(60 + i))).then([&](raw_data&&, bool success, size_t)
+    {
+      check::debug::n_assert(success, "sharded send file: write failed");
+      written.fetch_add(1);
+    });
+  }
+  check::debug::n_assert(wait_until([&] { return written.load() == k_file_count; }), "sharded send file: writes timed out");
+
+  // socket pairs are created on the shards in turn: send every file through every shard
+  unsigned cross_shard_count = 0;
+  for (unsigned s = 0; s < sctx.get_shard_count(); ++s)
+  {
+    neam::id_t a, b;
+    check::debug::n_assert(sctx.create_socket_pair(a, b), "failed to create a socket pair");
+    for (uint32_t i = 0; i < k_file_count; ++i)
+    {
+      cross_shard_count += sctx.get_shard_index_for(a) != sctx.get_shard_index_for(fids[i]) ? 1 : 0;
+      std::atomic<bool> sent = false;
+      std::atomic<bool> received = false;
+      sctx.queue_send_file(a, fids[i]).then([&](raw_data&&, bool success, size_t size)
+      {
+        check::debug::n_assert(success && size == k_file_size, "sharded send file: send failed (shard {} / file shard {})", sctx.get_shard_index_for(a), sctx.get_shard_index_for(fids[i]));
+        sent = true;
+      });
+      sctx.queue_full_receive(b, k_file_size).then([&](raw_data&& data, bool success, size_t size)
+      {
+        check::debug::n_assert(success && size == k_file_size && check_data(data.get(), size, (uint8_t)(60 + i)), "sharded send file: wrong data");
+        received = true;
+      });
+      check::debug::n_assert(wait_until([&] { return sent.load() && received.load(); }), "sharded send file timed out");
+    }
+    sctx.close(a);
+    sctx.close(b);
+  }
+  check::debug::n_assert(cross_shard_count > 0, "sharded send file: no file was sent from an other shard");
+
+  // unmapping the file unmaps it everywhere
+  sctx.unmap_file(fids[0]);
+  for (unsigned s = 0; s < sctx.get_shard_count(); ++s)
+    check::debug::n_assert(!sctx.get_shard(s).is_file_mapped(fids[0]), "sharded send file: the file is still mapped on shard {}", s);
+  sctx.stop();
+}
+
+// log histograms and the operation metrics of the contexts
+static void test_metrics(const std::filesystem::path& dir)
+{
+  cr::out().log("io: metrics...");
+  using metric_type = io::context::metric_type;
+
+  // histogram: the percentiles are within the relative error of the buckets (1/8)
+  {
+    cr::log_histogram<> histogram;
+    for (uint64_t i = 1; i <= 10000; ++i)
+      histogram.record(i);
+    const auto snapshot = histogram.get_snapshot();
+    check::debug::n_assert(snapshot.count == 10000 && snapshot.min == 1 && snapshot.max == 10000 && snapshot.sum == 10000 * 10001 / 2, "histogram: wrong totals");
+    for (const double percentile : { 1.0, 50.0, 90.0, 99.0, 99.9 })
+    {
+      const double expected = percentile * 100;
+      const double value = (double)snapshot.get_percentile(percentile);
+      check::debug::n_assert(value >= expected && value <= expected * 1.125 + 1, "histogram: p{} is {} (expected ~{})", percentile, value, expected);
+    }
+    check::debug::n_assert(snapshot.get_percentile(100) == 10000, "histogram: p100 must be the max");
+
+    cr::log_histogram<> other;
+    other.record(1ull << 30);
+    auto merged = snapshot;
+    merged.merge(other.get_snapshot());
+    check::debug::n_assert(merged.count == 10001 && merged.max == (1ull << 30) && merged.min == 1, "histogram: wrong merge");
+    histogram.reset();
+    check::debug::n_assert(histogram.get_snapshot().count == 0, "histogram: reset failed");
+  }
+
+  io::context ctx;
+  ctx.set_prefix_directory(dir.string());
+  const neam::id_t fid = ctx.map_file("metrics.bin");
+
+  // write, full read, short read
+  {
+    bool done = false;
+    ctx.queue_write(fid, io::context::truncate, make_data(10000, 5)).then([&](raw_data&&, bool success, size_t) { check::debug::n_assert(success, "metrics: write failed"); done = true; });
+    check::debug::n_assert(run_until(ctx, [&] { return done; }), "metrics: write timed out");
+    ctx.reset_metrics();
+
+    unsigned read_count = 0;
+    ctx.queue_read(fid, 0, 10000).then([&](raw_data&&, bool success, size_t) { check::debug::n_assert(success, "metrics: read failed"); ++read_count; });
+    check::debug::n_assert(run_until(ctx, [&] { return read_count == 1; }), "metrics: read timed out");
+    ctx.queue_read(fid, 8000, 4000).then([&](raw_data&&, bool, size_t) { ++read_count; });
+    check::debug::n_assert(run_until(ctx, [&] { return read_count == 2; }), "metrics: read timed out");
+
+    const io::context::metrics_snapshot metrics = ctx.get_metrics();
+    const io::context::operation_metrics& reads = metrics[metric_type::read];
+    check::debug::n_assert(reads.completion_count == 2 && reads.error_count == 0, "metrics: {} reads ({} errors) instead of 2", reads.completion_count, reads.error_count);
+    check::debug::n_assert(reads.short_count == 1, "metrics: the read at the end of the file must be counted as short");
+    check::debug::n_assert(reads.size.count == 2 && reads.size.max == 10000 && reads.size.min == 2000, "metrics: wrong read sizes");
+    check::debug::n_assert(reads.latency.count == 2 && reads.latency.max > 0, "metrics: read latencies not recorded");
+    check::debug::n_assert(reads.queue_wait.count == 2, "metrics: read queue waits not recorded");
+    check::debug::n_assert(metrics[metric_type::write].completion_count == 0, "metrics: reset_metrics() did not reset the writes");
+  }
+
+  // errors are counted by errno
+  {
+    ctx.reset_metrics();
+    std::filesystem::create_directories(dir / "metrics_dir");
+    const neam::id_t dir_fid = ctx.map_file("metrics_dir");
+    bool done = false;
+    ctx.queue_read(dir_fid, 0, 16).then([&](raw_data&&, bool success, size_t) { check::debug::n_assert(!success, "metrics: reading a directory succeeded"); done = true; });
+    check::debug::n_assert(run_until(ctx, [&] { return done; }), "metrics: read timed out");
+    const io::context::operation_metrics reads = ctx.get_metrics()[metric_type::read];
+    if (reads.completion_count > 0)
+      check::debug::n_assert(reads.error_count == 1 && reads.errors[EISDIR] == 1, "metrics: the EISDIR error is not counted");
+    else
+      cr::out().warn("io: reading a directory failed before submission, skipping the error metrics check");
+  }
+
+  // file operations / connects / accepts
+  {
+    ctx.reset_metrics();
+    bool done = false;
+    ctx.queue_fsync(fid).then([&](bool success) { check::debug::n_assert(success, "metrics: fsync failed"); done = true; });
+    check::debug::n_assert(run_until(ctx, [&] { return done; }), "metrics: fsync timed out");
+    check::debug::n_assert(ctx.get_metrics()[metric_type::file].completion_count == 1, "metrics: fsyncs must be counted as file operations");
+
+    neam::id_t a, b;
+    connect_tcp_pair(ctx, a, b);
+    const io::context::metrics_snapshot metrics = ctx.get_metrics();
+    check::debug::n_assert(metrics[metric_type::connect].completion_count == 1 && metrics[metric_type::accept].completion_count == 1, "metrics: connect / accept not counted");
+    ctx.close(a);
+    ctx.close(b);
+  }
+
+  for (unsigned i = 0; i < io::context::k_metric_type_count; ++i)
+    check::debug::n_assert(io::context::get_metric_type_str((metric_type)i) != nullptr, "metrics: missing name for metric type {}", i);
+
+  // the sharded context merges the metrics of its shards
+  {
+    io::sharded_context sctx(4);
+    sctx.set_prefix_directory(dir.string());
+    constexpr uint32_t k_file_count = 8;
+    std::atomic<uint32_t> written = 0;
+    for (uint32_t i = 0; i < k_file_count; ++i)
+    {
+      sctx.queue_write(sctx.map_file(fmt::format("metrics_{}.bin", i)), 0, make_data(1000, 1)).then([&](raw_data&&, bool success, size_t)
+      {
+        check::debug::n_assert(success, "metrics: sharded write failed");
+        written.fetch_add(1);
+      });
+    }
+    check::debug::n_assert(wait_until([&] { return written.load() == k_file_count; }), "metrics: sharded writes timed out");
+    const io::context::operation_metrics writes = sctx.get_metrics()[metric_type::write];
+    check::debug::n_assert(writes.completion_count == k_file_count && writes.size.count == k_file_count && writes.size.sum == k_file_count * 1000,
+                           "metrics: the sharded metrics must be the sum of the shards ({} writes)", writes.completion_count);
+    sctx.reset_metrics();
+    check::debug::n_assert(sctx.get_metrics()[metric_type::write].completion_count == 0, "metrics: sharded reset failed");
+    sctx.stop();
+  }
+}
+
+
+// flow control: send / receive watermarks, memory budget of the servers, paused reads
+struct held_packets_connection : io::network::header_connection_t<held_packets_connection, 64 * 1024>
+{
+  struct packet_header_t
+  {
+    uint32_t size;
+    uint32_t seed;
+  };
+  std::vector<raw_data> packets;
+
+  bool is_header_valid(const packet_header_t&) const { return true; }
+  uint32_t get_size_of_data_to_read(const packet_header_t& ph) const { return ph.size; }
+  void on_packet_oversized(const packet_header_t&) {}
+  // the packets are held (processed later), so they are accounted as inbound data
+  void on_packet(const packet_header_t&, raw_data&& data)
+  {
+    add_inbound_size(data.size);
+    packets.push_back(std::move(data));
+  }
+};
+
+struct ring_connection : io::network::ring_buffer_connection_t<ring_connection, 1024> {};
+
+struct budget_connection : io::network::connection_t
+{
+  static bool on_connection(budget_connection&) { return true; }
+};
+
+static void test_watermarks()
+{
+  cr::out().log("io: flow control...");
+  io::context ctx;
+
+  // send watermarks: above the high watermark, wait until the connection is below the low one
+  {
+    neam::id_t a, b;
+    connect_tcp_pair(ctx, a, b);
+    io::network::connection_t c;
+    c.ioctx = &ctx;
+    c.socket = a;
+    c.set_send_watermarks(4000, 16000);
+
+    c.cork();
+    for (uint32_t i = 0; i < 3; ++i)
+      c.queue_coalesced_send(make_data(6000, (uint8_t)i)).then([](raw_data&&, bool success, size_t) { check::debug::n_assert(success, "flow control: send failed"); });
+    check::debug::n_assert(c.get_outbound_size() == 18000 && !c.has_send_capacity(), "flow control: the queued data must count as outbound data");
+
+    bool has_capacity = false;
+    c.wait_for_send_capacity().then([&](bool success) { check::debug::n_assert(success, "flow control: waiting for send capacity failed"); has_capacity = true; });
+    ctx.process();
+    check::debug::n_assert(!has_capacity, "flow control: send capacity while above the high watermark");
+
+    bool received = false;
+    ctx.queue_full_receive(b, 18000).then([&](raw_data&& data, bool success, size_t)
+    {
+      for (uint32_t i = 0; i < 3; ++i)
+        check::debug::n_assert(success && check_data((const uint8_t*)data.get() + i * 6000, 6000, (uint8_t)i), "flow control: wrong data");
+      received = true;
+    });
+    c.flush();
+    check::debug::n_assert(run_until(ctx, [&] { return has_capacity && received; }), "flow control: send capacity timed out");
+    check::debug::n_assert(c.get_outbound_size() == 0 && c.has_send_capacity(), "flow control: the sent data is still accounted");
+
+    // receive watermarks: paused above the high watermark, resumed below the low one
+    c.set_receive_watermarks(100, 1000);
+    c.add_inbound_size(1000);
+    check::debug::n_assert(c.is_receive_paused(), "flow control: reads not paused at the high watermark");
+    bool resumed = false;
+    c.wait_for_receive_capacity().then([&](bool success) { check::debug::n_assert(success, "flow control: waiting for receive capacity failed"); resumed = true; });
+    c.release_inbound_size(800);
+    check::debug::n_assert(!resumed && c.is_receive_paused(), "flow control: reads must stay paused above the low watermark");
+    c.release_inbound_size(150);
+    check::debug::n_assert(resumed && !c.is_receive_paused(), "flow control: reads not resumed at the low watermark");
+    c.release_inbound_size(50);
+
+    // closing the connection fails the waiters
+    c.add_inbound_size(2000);
+    bool failed = false;
+    c.wait_for_receive_capacity().then([&](bool success) { failed = !success; });
+    c.close();
+    check::debug::n_assert(failed, "flow control: closing the connection must fail the waiters");
+    bool closed_failed = false;
+    c.wait_for_send_capacity().then([&](bool success) { closed_failed = !success; });
+    check::debug::n_assert(closed_failed, "flow control: waiting on a closed connection must fail");
+    ctx.close(b);
+  }
+
+  // header_connection_t: no header is read while the held packets are above the watermark
+  {
+    neam::id_t a, b;
+    connect_tcp_pair(ctx, a, b);
+    held_packets_connection c;
+    c.ioctx = &ctx;
+    c.socket = b;
+    c.set_receive_watermarks(1000, 3000);
+    held_packets_connection::on_connection(c);
+
+    const std::vector<uint32_t> sizes(10, 1000);
+    const std::vector<uint8_t> stream = make_framed_stream(sizes);
+    ctx.queue_full_send(a, raw_data::duplicate(stream.data(), stream.size())).then([](raw_data&&, bool, size_t) {});
+    check::debug::n_assert(run_until(ctx, [&] { return c.is_receive_paused(); }), "flow control: reads never paused");
+    run_until(ctx, [] { return false; }, std::chrono::milliseconds(50));
+    // the packet being read when the watermark is reached still completes
+    check::debug::n_assert(c.packets.size() <= 4, "flow control: {} packets read while paused", c.packets.size());
+
+    // processing the held packets resumes the reads
+    check::debug::n_assert(run_until(ctx, [&]
+    {
+      if (c.get_inbound_size() > 0)
+        c.release_inbound_size(c.get_inbound_size());
+      return c.packets.size() == sizes.size();
+    }), "flow control: reads not resumed");
+    for (uint32_t i = 0; i < sizes.size(); ++i)
+      check::debug::n_assert(check_data(c.packets[i].get(), sizes[i], (uint8_t)(i + 1)), "flow control: packet {} has the wrong data", i);
+    c.close();
+    ctx.close(a);
+    run_until(ctx, [&] { return c.in_flight_operations.get_count() == 0; }, std::chrono::milliseconds(1000));
+  }
+
+  // memory budget: over the budget, all the connections of the server are paused
+  {
+    io::network::base_server<budget_connection> server(ctx);
+    server.set_memory_budget(10000);
+    server.set_connection_receive_watermarks(1000, 8000);
+    neam::id_t a, b;
+    connect_tcp_pair(ctx, a, b);
+    std::unique_ptr<budget_connection> first = io::network::base_server<budget_connection>::create_connection({ &server, &ctx, a });
+    std::unique_ptr<budget_connection> second = io::network::base_server<budget_connection>::create_connection({ &server, &ctx, b });
+    check::debug::n_assert(first && second, "flow control: failed to create the connections");
+
+    first->add_inbound_size(6000);
+    check::debug::n_assert(!server.is_over_memory_budget() && server.get_buffered_size() == 6000 && !first->is_receive_paused(), "flow control: wrong accounting below the budget");
+    second->add_inbound_size(5000);
+    check::debug::n_assert(server.is_over_memory_budget(), "flow control: the server must be over its budget");
+    check::debug::n_assert(first->is_receive_paused() && !first->has_send_capacity(), "flow control: the connections below their watermarks must be paused over the budget");
+
+    bool has_capacity = false;
+    first->wait_for_send_capacity().then([&](bool success) { has_capacity = success; });
+    second->release_inbound_size(2000);
+    check::debug::n_assert(server.is_over_memory_budget() && !has_capacity, "flow control: the budget must be released below 3/4 of it");
+    first->release_inbound_size(2000);
+    check::debug::n_assert(!server.is_over_memory_budget() && has_capacity, "flow control: capacity not given back below 3/4 of the budget");
+
+    // closing a connection removes what it accounted from the server
+    second->close();
+    check::debug::n_assert(server.get_buffered_size() == 4000, "flow control: {} bytes still accounted after close", server.get_buffered_size());
+    first->close();
+    check::debug::n_assert(server.get_buffered_size() == 0, "flow control: {} bytes still accounted after close", server.get_buffered_size());
+  }
+
+  // ring_buffer_connection_t: the multishot receive is canceled while paused, and restarted once the buffer is consumed
+  {
+    io::context::ring_config config;
+    config.recv_buffer_count = 8;
+    config.recv_buffer_size = 1024;
+    io::context rctx(config);
+    neam::id_t a, b;
+    check::debug::n_assert(rctx.create_socket_pair(a, b), "failed to create a socket pair");
+    ring_connection c;
+    c.ioctx = &rctx;
+    c.socket = b;
+    c.set_receive_watermarks(512, 4096);
+    ring_connection::on_connection(c);
+
+    constexpr size_t k_size = 32 * 1024;
+    rctx.queue_full_send(a, make_data(k_size, 3)).then([](raw_data&&, bool, size_t) {});
+    const auto ring_is_unusable = [&]
+    {
+      return c.read_buffer.size() == 0 && rctx.has_recv_buffer_pressure()
+          && rctx.get_recv_buffer_ring()->get_available_count() == rctx.get_recv_buffer_ring()->get_buffer_count();
+    };
+    run_until(rctx, [&] { return c.is_receive_paused() || ring_is_unusable(); });
+    if (ring_is_unusable())
+    {
+      cr::out().warn("io: the kernel does not fill provided buffer rings, skipping the paused multishot receive test");
+    }
+    else
+    {
+      run_until(rctx, [] { return false; }, std::chrono::milliseconds(50));
+      check::debug::n_assert(c.get_inbound_size() <= 4096 + 1024, "flow control: {} bytes received while paused", c.get_inbound_size());
+
+      std::vector<uint8_t> consumed;
+      check::debug::n_assert(run_until(rctx, [&]
+      {
+        uint8_t buffer[1024];
+        const size_t count = c.read_buffer.pop_front(buffer, sizeof(buffer));
+        consumed.insert(consumed.end(), buffer, buffer + count);
+        c.on_read_buffer_consumed();
+        return consumed.size() == k_size;
+      }), "flow control: reads not resumed ({} bytes received)", consumed.size());
+      check::debug::n_assert(check_data(consumed.data(), k_size, 3), "flow control: wrong data");
+    }
+    c.close();
+    rctx.close(a);
+    run_until(rctx, [&] { return c.in_flight_operations.get_count() == 0; }, std::chrono::milliseconds(1000));
+  }
+}
+
+int main(int, char**)
+{
+  cr::get_global_logger().min_severity = neam::cr::logger::severity::message;
+  cr::get_global_logger().register_callback(neam::cr::print_log_to_console, nullptr);
+
+  const std::filesystem::path dir = std::filesystem::temp_directory_path() / fmt::format("ntools_io_context_test_{}", getpid());
+  std::filesystem::create_directories(dir);
+
+  test_segments(dir);
+  test_batching();
+  test_ring_options();
+  test_registered_resources(dir);
+  test_buffer_ring();
+  test_dns();
+  test_open_files(dir);
+  test_direct_io(dir);
+  test_file_views(dir);
+  test_block_cache(dir);
+  test_sharded_context(dir);
+  test_durability(dir);
+  test_timeouts();
+  test_framing();
+  test_coalesced_sends();
+  test_udp();
+  test_fd_passing();
+  test_sharded_send_file(dir);
+  test_metrics(dir);
+  test_watermarks();
+
+  std::filesystem::remove_all(dir);
+  cr::out().log("all io tests passed");
+  return 0;
+}
@@ -0,0 +1,526 @@
+#include <cstring>
+#include <random>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <memory_resource>
+
+#include "../slab_allocator.hpp"
+#include "../frame_allocation.hpp"
+#include "../memory_accounting.hpp"
+#include "../raw_data.hpp"
+#include "../shared_raw_data.hpp"
+#include "../memory_allocator.hpp"
+#include "../rle/rle.hpp"
+
+#include "../logger/logger.hpp"
+#include "../debug/assert.hpp"
+
+using namespace neam;
+
+// fill an allocation with a pattern that depends on its address, so overlapping allocations are detected
+static void fill_pattern(void* ptr, size_t size)
+{
+  const uint8_t seed = (uint8_t)((uintptr_t)ptr >> 4);
+  for (size_t i = 0; i < size; ++i)
+    ((uint8_t*)ptr)[i] = (uint8_t)(seed + i);
+}
+static bool check_pattern(const void* ptr, size_t size)
+{
+  const uint8_t seed = (uint8_t)((uintptr_t)ptr >> 4);
+  for (size_t i = 0; i < size; ++i)
+  {
+    if (((const uint8_t*)ptr)[i] != (uint8_t)(seed + i))
+      return false;
+  }
+  return true;
+}
+
+// slab_allocator: size classes, alignment, multi-threaded allocations and pmr/stl interfaces
+static void test_slab_allocator()
+{
+  cr::out().log("slab_allocator: size classes...");
+  using cr::slab_allocator;
+
+  for (uint32_t i = 0; i < slab_allocator::k_size_class_count; ++i)
+  {
+    const size_t size = slab_allocator::get_size_class_size(i);
+    check::debug::n_assert(slab_allocator::get_size_class_index(size, 1) == i, "size class {} ({} bytes): wrong index", i, size);
+    if (i > 0)
+      check::debug::n_assert(slab_allocator::get_size_class_size(i - 1) < size, "size classes must be increasing");
+  }
+  // worst-case internal fragmentation is 1/3:
+  for (size_t size = slab_allocator::k_min_size_class + 1; size <= slab_allocator::k_max_size_class; size += 7)
+  {
+    const size_t class_size = slab_allocator::get_size_class_size(slab_allocator::get_size_class_index(size, 1));
+    check::debug::n_assert(class_size >= size && class_size * 2 <= size * 3 + 16, "size {}: size class is {} bytes", size, class_size);
+  }
+
+  cr::out().log("slab_allocator: allocations...");
+  slab_allocator allocator;
+  {
+    struct allocation { void* ptr; size_t size; size_t alignment; };
+    std::vector<allocation> allocations;
+    for (size_t size = 1; size < 3 * slab_allocator::k_max_size_class; size = size * 5 / 4 + 1)
+    {
+      for (size_t alignment : { 1, 8, 16, 64, 256 })
+      {
+        void* ptr = allocator.allocate(size, alignment);
+        check::debug::n_assert(ptr != nullptr, "failed to allocate {} bytes (alignment: {})", size, alignment);
+        check::debug::n_assert((uintptr_t)ptr % alignment == 0, "{} bytes allocation is not aligned on {}", size, alignment);
+        fill_pattern(ptr, size);
+        allocations.push_back({ ptr, size, alignment });
+      }
+    }
+    check::debug::n_assert(allocator.get_large_allocation_page_count() > 0, "large allocations should go directly to memory pages");
+    for (const allocation& it : allocations)
+    {
+      check::debug::n_assert(check_pattern(it.ptr, it.size), "allocation of {} bytes has been overwritten", it.size);
+      allocator.deallocate(it.ptr, it.size, it.alignment);
+    }
+    check::debug::n_assert(allocator.get_number_of_object() == 0, "allocations were leaked");
+    check::debug::n_assert(allocator.get_large_allocation_page_count() == 0, "large allocations were leaked");
+  }
+
+  cr::out().log("slab_allocator: short-lived allocations from multiple threads...");
+  {
+    constexpr uint32_t k_thread_count = 8;
+    constexpr uint32_t k_iteration_count = 200000;
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < k_thread_count; ++t)
+    {
+      threads.emplace_back([&allocator, t]
+      {
+        std::mt19937 rng(t);
+        std::vector<std::pair<void*, size_t>> live;
+        for (uint32_t i = 0; i < k_iteration_count; ++i)
+        {
+          if (live.size() < 16 && (rng() % 3) != 0)
+          {
+            const size_t size = 8 + rng() % 200;
+            void* ptr = allocator.allocate(size);
+            check::debug::n_assert(ptr != nullptr, "failed to allocate {} bytes", size);
+            fill_pattern(ptr, size);
+            live.push_back({ ptr, size });
+          }
+          else if (!live.empty())
+          {
+            const size_t index = rng() % live.size();
+            check::debug::n_assert(check_pattern(live[index].first, live[index].second), "allocation has been overwritten by another thread");
+            allocator.deallocate(live[index].first, live[index].second);
+            live[index] = live.back();
+            live.pop_back();
+          }
+        }
+        for (auto& it : live)
+          allocator.deallocate(it.first, it.second);
+      });
+    }
+    for (auto& it : threads)
+      it.join();
+    check::debug::n_assert(allocator.get_number_of_object() == 0, "allocations were leaked");
+  }
+
+  cr::out().log("slab_allocator: pmr / stl allocators...");
+  {
+    cr::slab_memory_resource resource(allocator);
+    {
+      std::pmr::vector<std::pmr::string> strings(&resource);
+      for (uint32_t i = 0; i < 1000; ++i)
+        strings.emplace_back(fmt::format("a string that is long enough to not fit in the small string buffer: {}", i));
+      for (uint32_t i = 0; i < 1000; ++i)
+        check::debug::n_assert(strings[i].ends_with(fmt::format(": {}", i)), "pmr strings are corrupted");
+      check::debug::n_assert(allocator.get_number_of_object() > 0, "pmr containers should allocate through the slab allocator");
+    }
+    {
+      std::vector<uint64_t, cr::slab_stl_allocator<uint64_t>> values { cr::slab_stl_allocator<uint64_t>(allocator) };
+      for (uint64_t i = 0; i < 10000; ++i)
+        values.push_back(i * i);
+      for (uint64_t i = 0; i < 10000; ++i)
+        check::debug::n_assert(values[i] == i * i, "stl container is corrupted");
+    }
+    check::debug::n_assert(allocator.get_number_of_object() == 0, "allocations were leaked");
+  }
+}
+
+// frame_allocator: index order, multi-threaded allocations, resets and memory resource
+static void test_frame_allocator()
+{
+  cr::out().log("frame_allocator: array order...");
+  {
+    cr::frame_allocator<1, true, 8> allocator;
+    // enough entries to span several chunks:
+    constexpr uint64_t k_entry_count = 20000;
+    for (uint64_t i = 0; i < k_entry_count; ++i)
+      check::debug::n_assert(allocator.allocate<uint64_t>(i) != nullptr, "failed to allocate entry {}", i);
+    check::debug::n_assert(allocator.get_allocation_count() == k_entry_count, "wrong allocation count");
+    check::debug::n_assert(allocator.get_current_thread_stats().claimed_chunk_count > 1, "entries should span several chunks");
+
+    for (uint64_t i = 0; i < k_entry_count; i += 97)
+    {
+      const uint64_t* entry = allocator.get_entry<uint64_t>(i);
+      check::debug::n_assert(entry != nullptr && *entry == i, "entry {}: index does not follow the allocation order", i);
+    }
+
+    auto state = allocator.swap_and_reset();
+    check::debug::n_assert(state.size() == k_entry_count, "state has {} entries, expected {}", state.size(), k_entry_count);
+    check::debug::n_assert(allocator.get_allocation_count() == 0, "allocator should be empty after swap_and_reset");
+    check::debug::n_assert(allocator.get_entry<uint64_t>(0) == nullptr, "allocator should be empty after swap_and_reset");
+    for (uint64_t i = 0; i < k_entry_count; i += 89)
+      check::debug::n_assert(*state.get_entry<uint64_t>(i) == i, "state entry {}: index does not follow the allocation order", i);
+    state.build_array_access_accelerator();
+    for (uint64_t i = 0; i < k_entry_count; ++i)
+      check::debug::n_assert(*state.get_entry<uint64_t>(i) == i, "state entry {}: index does not follow the allocation order", i);
+    check::debug::n_assert(state.get_entry<uint64_t>(k_entry_count) == nullptr, "out of bound entry should be null");
+  }
+
+  cr::out().log("frame_allocator: allocations from multiple threads...");
+  {
+    cr::frame_allocator<1, true, 8> allocator;
+    constexpr uint32_t k_thread_count = 8;
+    constexpr uint64_t k_entry_count = 50000;
+    for (uint32_t pass = 0; pass < 3; ++pass)
+    {
+      std::vector<std::thread> threads;
+      for (uint32_t t = 0; t < k_thread_count; ++t)
+      {
+        threads.emplace_back([&allocator, t]
+        {
+          for (uint64_t i = 0; i < k_entry_count; ++i)
+            check::debug::n_assert(allocator.allocate<uint64_t>((uint64_t)t << 32 | i) != nullptr, "failed to allocate entry");
+        });
+      }
+      for (auto& it : threads)
+        it.join();
+
+      auto state = allocator.swap_and_reset();
+      check::debug::n_assert(state.size() == k_thread_count * k_entry_count, "state has {} entries, expected {}", state.size(), k_thread_count * k_entry_count);
+      state.build_array_access_accelerator();
+
+      // every entry must be present once, and the entries of a thread must be in its allocation order:
+      std::vector<uint64_t> next_index(k_thread_count, 0);
+      for (uint64_t i = 0; i < state.size(); ++i)
+      {
+        const uint64_t value = *state.get_entry<uint64_t>(i);
+        const uint32_t thread = (uint32_t)(value >> 32);
+        check::debug::n_assert(thread < k_thread_count, "entry {} is corrupted", i);
+        check::debug::n_assert((value & 0xFFFFFFFF) == next_index[thread], "thread {}: entries are not in allocation order", thread);
+        ++next_index[thread];
+      }
+    }
+  }
+
+  cr::out().log("frame_allocator: fast_clear / reset...");
+  {
+    cr::frame_allocator<1, false, 16> allocator;
+    for (uint32_t pass = 0; pass < 4; ++pass)
+    {
+      std::vector<void*> allocations;
+      for (uint32_t i = 0; i < 2000; ++i)
+      {
+        void* ptr = allocator.allocate(24 + i % 40);
+        check::debug::n_assert(ptr != nullptr && (uintptr_t)ptr % 16 == 0, "allocation is null or not aligned");
+        fill_pattern(ptr, 24);
+        allocations.push_back(ptr);
+      }
+      for (void* it : allocations)
+        check::debug::n_assert(check_pattern(it, 24), "allocation has been overwritten");
+      check::debug::n_assert(allocator.get_allocation_count() == 2000, "wrong allocation count");
+      allocator.fast_clear();
+      check::debug::n_assert(allocator.get_allocation_count() == 0, "allocator should be empty after fast_clear");
+    }
+    check::debug::n_assert(allocator.allocate(memory::get_page_size() * 2) == nullptr, "allocations larger than a chunk should fail");
+    allocator.reset();
+  }
+
+  cr::out().log("frame_allocator: memory resource...");
+  {
+    cr::frame_memory_resource<1, 16> resource;
+    for (uint32_t pass = 0; pass < 3; ++pass)
+    {
+      std::pmr::vector<std::pmr::string> strings(&resource);
+      for (uint32_t i = 0; i < 500; ++i)
+        strings.emplace_back(fmt::format("a string that is long enough to not fit in the small string buffer: {}", i));
+      // oversized and over-aligned allocations go to the upstream resource:
+      void* large = resource.allocate(memory::get_page_size() * 4, 16);
+      void* aligned = resource.allocate(64, 256);
+      check::debug::n_assert(large != nullptr && aligned != nullptr && (uintptr_t)aligned % 256 == 0, "oversized allocations should not fail");
+      fill_pattern(large, memory::get_page_size() * 4);
+      for (uint32_t i = 0; i < 500; ++i)
+        check::debug::n_assert(strings[i].ends_with(fmt::format(": {}", i)), "pmr strings are corrupted");
+      check::debug::n_assert(check_pattern(large, memory::get_page_size() * 4), "oversized allocation has been overwritten");
+      strings = std::pmr::vector<std::pmr::string>(&resource);
+      resource.reset();
+    }
+  }
+}
+
+// memory accounting: tags, snapshots / diffs, allocator reporting and the periodic dump
+static void test_memory_accounting()
+{
+  namespace accounting = memory::accounting;
+
+  cr::out().log("memory accounting: tags and snapshots...");
+  {
+    accounting::tag& tag = accounting::get_tag("memory_test");
+    check::debug::n_assert(&tag == &accounting::get_tag("memory_test"), "get_tag should always return the same tag for a name");
+
+    const accounting::snapshot_t before = accounting::take_snapshot();
+    // allocations from multiple threads, so multiple shards are used:
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < 4; ++t)
+    {
+      threads.emplace_back([&tag]
+      {
+        for (uint32_t i = 0; i < 1000; ++i)
+          tag.on_allocate(1024);
+        for (uint32_t i = 0; i < 500; ++i)
+          tag.on_deallocate(1024);
+      });
+    }
+    for (auto& it : threads)
+      it.join();
+    tag.on_reserve(4 * 1000 * 1024);
+
+    const accounting::snapshot_t after = accounting::take_snapshot();
+    const accounting::tag_snapshot_t* snap = after.find("memory_test");
+    check::debug::n_assert(snap != nullptr, "tag is missing from the snapshot");
+    check::debug::n_assert(snap->live_bytes == 4 * 500 * 1024, "live bytes: {}, expected {}", snap->live_bytes, 4 * 500 * 1024);
+    check::debug::n_assert(snap->peak_live_bytes >= snap->live_bytes, "peak is below the live bytes");
+    check::debug::n_assert(snap->allocation_count == 4000 && snap->deallocation_count == 2000, "wrong allocation / deallocation count");
+    check::debug::n_assert(snap->get_fragmentation() > 0.49f && snap->get_fragmentation() < 0.51f, "fragmentation is {}, expected 0.5", snap->get_fragmentation());
+
+    const accounting::diff_t diff = accounting::diff(before, after);
+    bool found = false;
+    for (const auto& it : diff.tags)
+    {
+      if (it.name != "memory_test") continue;
+      found = true;
+      check::debug::n_assert(it.allocation_count == 4000 && it.live_bytes_delta == 4 * 500 * 1024, "wrong diff");
+    }
+    check::debug::n_assert(found, "tag is missing from the diff");
+
+    for (uint32_t i = 0; i < 2000; ++i)
+      tag.on_deallocate(1024);
+    tag.on_release(4 * 1000 * 1024);
+    check::debug::n_assert(tag.get_snapshot().live_bytes == 0 && tag.get_snapshot().reserved_bytes == 0, "tag should be empty");
+  }
+
+  cr::out().log("memory accounting: allocators...");
+  {
+    accounting::tag& tag = accounting::get_tag("memory_test/frame_allocator");
+    {
+      cr::frame_allocator<1, false, 8> allocator;
+      allocator.set_accounting_tag(tag);
+      for (uint32_t i = 0; i < 1000; ++i)
+        allocator.allocate(64);
+      const accounting::tag_snapshot_t snap = tag.get_snapshot();
+      check::debug::n_assert(snap.live_bytes == 64 * 1000, "frame_allocator: live bytes: {}, expected {}", snap.live_bytes, 64 * 1000);
+      check::debug::n_assert(snap.reserved_bytes >= snap.live_bytes, "frame_allocator: reserved bytes should include the live bytes");
+      allocator.fast_clear();
+      check::debug::n_assert(tag.get_snapshot().live_bytes == 0, "frame_allocator: fast_clear should release the live bytes");
+    }
+    check::debug::n_assert(tag.get_snapshot().reserved_bytes == 0, "frame_allocator: chunks were not released");
+
+#if N_RAW_DATA_ACCOUNTING
+    const int64_t live_before = accounting::get_tag("raw_data").get_snapshot().live_bytes;
+    {
+      raw_data data = raw_data::allocate(100000);
+      check::debug::n_assert(accounting::get_tag("raw_data").get_snapshot().live_bytes == live_before + 100000, "raw_data: allocation is not reported");
+    }
+    check::debug::n_assert(accounting::get_tag("raw_data").get_snapshot().live_bytes == live_before, "raw_data: deallocation is not reported");
+#endif
+  }
+
+  cr::out().log("memory accounting: periodic dump...");
+  {
+    uint32_t call_count = 0;
+    accounting::set_periodic_dump_hook(std::chrono::milliseconds(1), [&call_count](const accounting::snapshot_t& current, const accounting::diff_t&)
+    {
+      ++call_count;
+      check::debug::n_assert(current.find("memory_test") != nullptr, "dump is missing a tag");
+      // the hook must be able to poll and change the hook:
+      accounting::poll();
+      accounting::set_periodic_dump_hook(std::chrono::milliseconds(1), {});
+    });
+    for (uint32_t i = 0; i < 10; ++i)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+      accounting::poll();
+    }
+    check::debug::n_assert(call_count == 1, "the dump hook has been called {} times, expected once", call_count);
+  }
+}
+
+// shared_raw_data: refcount, slices, conversion back to raw_data, recycling and rle decoding as slices
+static void test_shared_raw_data()
+{
+  cr::out().log("shared_raw_data: slices...");
+  {
+    shared_raw_data data = shared_raw_data::allocate(1024);
+    check::debug::n_assert(data.is_unique() && data.get_size() == 1024, "new buffer should be unique");
+    for (uint32_t i = 0; i < 1024; ++i)
+      ((uint8_t*)data.get_mutable())[i] = (uint8_t)i;
+
+    shared_raw_data slice = data.slice(100, 200);
+    check::debug::n_assert(data.get_ref_count() == 2 && !data.is_unique(), "slices should share the buffer");
+    check::debug::n_assert(slice.get_base() == data.get_base(), "slices should not copy the buffer");
+    check::debug::n_assert(slice.get_offset() == 100 && slice.get_size() == 200, "wrong slice range");
+    check::debug::n_assert(slice.get_as<uint8_t>()[0] == 100 && slice.get_as<uint8_t>()[199] == (uint8_t)299, "wrong slice content");
+
+    // slice of a slice, clamped to the view:
+    shared_raw_data sub = slice.slice(150, 1000);
+    check::debug::n_assert(sub.get_offset() == 250 && sub.get_size() == 50, "slices of a slice should be relative to the view and clamped");
+    check::debug::n_assert(sub.get_as<uint8_t>()[0] == (uint8_t)250, "wrong slice content");
+    check::debug::n_assert(slice.slice(200).get_size() == 0, "a slice at the end of the view should be empty");
+
+    // the buffer is kept alive by the slices:
+    data.reset();
+    slice.reset();
+    check::debug::n_assert(sub.is_unique() && sub.get_as<uint8_t>()[49] == (uint8_t)299, "the buffer should be kept alive by the remaining slice");
+
+    // conversion back to a raw_data:
+    raw_data copy = std::move(sub).to_raw_data();
+    check::debug::n_assert(copy.size == 50 && copy.get_as<uint8_t>()[0] == (uint8_t)250 && !sub, "partial views should be copied");
+
+    shared_raw_data full = shared_raw_data::duplicate(copy.get(), copy.size);
+    const void* base = full.get_base();
+    raw_data moved = std::move(full).to_raw_data();
+    check::debug::n_assert(moved.get() == base && moved.size == 50, "a unique, complete view should not be copied");
+  }
+
+  cr::out().log("shared_raw_data: recycling...");
+  {
+    struct test_recycler : shared_raw_data::recycler
+    {
+      std::atomic<uint32_t> recycled_count = 0;
+      std::atomic<uint64_t> recycled_index_sum = 0;
+      void recycle(raw_data&& data, uint32_t index) override
+      {
+        check::debug::n_assert(data.size == 64, "recycled data has the wrong size");
+        recycled_count.fetch_add(1);
+        recycled_index_sum.fetch_add(index);
+      }
+    } recycler;
+
+    constexpr uint32_t k_buffer_count = 1000;
+    std::vector<shared_raw_data> buffers;
+    for (uint32_t i = 0; i < k_buffer_count; ++i)
+    {
+      buffers.push_back(shared_raw_data::make_recyclable(raw_data::allocate(64), recycler, i));
+      check::debug::n_assert(buffers.back().get_recycler() == &recycler && buffers.back().get_recycler_index() == i, "wrong recycler");
+    }
+
+    // copies and slices dropped from multiple threads, the buffer must be recycled exactly once:
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < 4; ++t)
+    {
+      std::vector<shared_raw_data> copies;
+      for (const auto& it : buffers)
+        copies.push_back(it.slice(t));
+      threads.emplace_back([copies = std::move(copies)]() mutable { copies.clear(); });
+    }
+    buffers.clear();
+    for (auto& it : threads)
+      it.join();
+    check::debug::n_assert(recycler.recycled_count == k_buffer_count, "{} buffers recycled, expected {}", recycler.recycled_count.load(), k_buffer_count);
+    check::debug::n_assert(recycler.recycled_index_sum == k_buffer_count * (k_buffer_count - 1) / 2, "wrong recycled indices");
+  }
+
+  cr::out().log("shared_raw_data: rle decoding...");
+  {
+    std::vector<shared_raw_data> values;
+    for (uint32_t i = 0; i < 10; ++i)
+      values.push_back(shared_raw_data::duplicate(fmt::format("value number {}", i).data(), fmt::format("value number {}", i).size()));
+    const shared_raw_data serialized(rle::serialize(values));
+
+    rle::status st;
+    std::vector<shared_raw_data> decoded = rle::deserialize<std::vector<shared_raw_data>>(serialized, &st);
+    check::debug::n_assert(st == rle::status::success && decoded.size() == values.size(), "failed to deserialize");
+    for (uint32_t i = 0; i < decoded.size(); ++i)
+    {
+      check::debug::n_assert(decoded[i].get_as_string_view() == fmt::format("value number {}", i), "wrong decoded value");
+      check::debug::n_assert(decoded[i].get_base() == serialized.get_base(), "values decoded from a shared buffer should be slices");
+    }
+    check::debug::n_assert(serialized.get_ref_count() == 1 + decoded.size(), "slices should hold a reference on the source");
+  }
+}
+
+// memory_allocator: scatter-gather export of the chunks
+static void test_memory_allocator_segments()
+{
+  cr::out().log("memory_allocator: segments...");
+  {
+    // fill enough data to span multiple chunks, with allocations of varying sizes:
+    cr::memory_allocator allocator;
+    std::vector<uint8_t> expected;
+    for (uint32_t i = 0; i < 5000; ++i)
+    {
+      const size_t size = 1 + (i * 37) % 300;
+      uint8_t* ptr = (uint8_t*)allocator.allocate(size);
+      check::debug::n_assert(ptr != nullptr, "failed to allocate {} bytes", size);
+      for (size_t j = 0; j < size; ++j)
+      {
+        ptr[j] = (uint8_t)(i + j);
+        expected.push_back((uint8_t)(i + j));
+      }
+    }
+    check::debug::n_assert(allocator.size() == expected.size(), "wrong allocator size");
+    check::debug::n_assert(!allocator.is_data_contiguous(), "the data should span multiple chunks");
+
+    const auto spans = allocator.get_segments();
+    check::debug::n_assert(spans.size() > 1, "the data should span multiple segments");
+    std::vector<uint8_t> gathered;
+    for (const auto& it : spans)
+      gathered.insert(gathered.end(), it.begin(), it.end());
+    check::debug::n_assert(gathered == expected, "get_segments: the segments do not match the allocated data");
+
+    const void* first_chunk = spans.front().data();
+    std::vector<shared_raw_data> segments = allocator.give_up_segments();
+    check::debug::n_assert(allocator.size() == 0, "the allocator should be empty after give_up_segments");
+    check::debug::n_assert(segments.size() == spans.size() && segments.front().get() == first_chunk, "give_up_segments should not copy the data");
+    gathered.clear();
+    for (const auto& it : segments)
+      gathered.insert(gathered.end(), it.get_as<uint8_t>(), it.get_as<uint8_t>() + it.get_size());
+    check::debug::n_assert(gathered == expected, "give_up_segments: the segments do not match the allocated data");
+  }
+
+  cr::out().log("memory_allocator: rle encoder segments...");
+  {
+    std::vector<std::string> values;
+    for (uint32_t i = 0; i < 20000; ++i)
+      values.push_back(fmt::format("value {}", i));
+    const raw_data flat = rle::serialize(values);
+
+    cr::memory_allocator allocator;
+    rle::encoder ec(allocator);
+    rle::status st = rle::status::success;
+    rle::coder<std::vector<std::string>>::encode(ec, values, st);
+    check::debug::n_assert(st == rle::status::success, "failed to serialize");
+    const std::vector<shared_raw_data> segments = ec.to_segments();
+
+    size_t offset = 0;
+    for (const auto& it : segments)
+    {
+      check::debug::n_assert(offset + it.get_size() <= flat.size && memcmp(it.get(), flat.get_as<uint8_t>() + offset, it.get_size()) == 0,
+                             "segments do not match the serialized data");
+      offset += it.get_size();
+    }
+    check::debug::n_assert(offset == flat.size, "segments do not match the serialized data");
+  }
+}
+
+int main(int, char**)
+{
+  cr::get_global_logger().min_severity = neam::cr::logger::severity::message;
+  cr::get_global_logger().register_callback(neam::cr::print_log_to_console, nullptr);
+
+  test_slab_allocator();
+  test_frame_allocator();
+  test_memory_accounting();
+  test_shared_raw_data();
+  test_memory_allocator_segments();
+
+  cr::out().log("all memory tests passed");
+  return 0;
+}
@@ -27,34 +27,60 @@
 #pragma once
 
 #include <atomic>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <memory_resource>
 #include "tracy.hpp"
 #include "memory.hpp"
+#include "memory_accounting.hpp"
 #include "raw_ptr.hpp"
+#include "spinlock.hpp"
 #include "mt_check/mt_check_base.hpp"
 
 namespace neam::cr
 {
   /// \brief fast, thread-safe allocator that has a fast-clear / fast allocation but no dealocation
   /// \brief IsArray means that all allocations will have the same type / same memory footprint
-  /// \note Contention makes it slow
-  /// \todo Do a better multi-threading-aware implem
+  /// \note Allocations do not wait on each other: each thread bump-allocates (atomic fetch_add) in the chunk of its slot,
+  ///       and new chunks are claimed with a CAS. Threads are dispatched in k_thread_slot_count slots, threads sharing a slot also share its chunk.
+  /// \note Allocations hold the lock of their slot in shared mode, so reset operations (fast_clear, reset, swap_and_reset),
+  ///       which take every slot lock exclusively, are exclusive with allocations.
   template<size_t PageCount = 4, bool IsArray = false, uint32_t Alignment = 8>
   class frame_allocator
   {
+    public:
+      static constexpr uint32_t k_thread_slot_count = 64;
+
     private:
       struct chunk_t
       {
-        uint32_t offset;
-        chunk_t* next;
+        std::atomic<uint32_t> offset;
+        std::atomic<uint32_t> end_offset; // set when an allocation overflows the chunk (offset is then invalid)
+        std::atomic<chunk_t*> next;
         uint8_t data[];
       };
 
+      static uint64_t get_data_size()
+      {
+        return memory::get_page_size() * PageCount - sizeof(chunk_t);
+      }
+
+      /// \brief Return the size (in bytes) of the allocations in a chunk
+      static uint32_t get_used_size(const chunk_t* chk, uint64_t data_size)
+      {
+        const uint32_t offset = chk->offset.load(std::memory_order_acquire);
+        if (offset <= data_size)
+          return offset;
+        return chk->end_offset.load(std::memory_order_acquire);
+      }
+
     public:
       /// \brief non-thread safe class that will store the current state of the allocator for postponning deallocation
       class allocator_state : public cr::mt_checked<allocator_state>
       {
         public:
-          explicit allocator_state(chunk_t* chunk, uint32_t count) : entry_count(count), first(chunk) {}
+          explicit allocator_state(chunk_t* chunk, uint32_t count, memory::accounting::tag& tag) : entry_count(count), first(chunk), accounting_tag(&tag) {}
           allocator_state() = default;
 
           ~allocator_state() { destroy(); }
@@ -65,10 +91,14 @@ namespace neam::cr
 
             if (&o == this) return *this;
             destroy();
+            entry_count = o.entry_count;
+            accounting_tag = o.accounting_tag;
             first = std::move(o.first);
             chunk_array = std::move(o.chunk_array);
+            chunk_byte_offset = std::move(o.chunk_byte_offset);
 
             o.first = nullptr;
+            o.entry_count = 0;
             return *this;
           }
 
@@ -78,15 +108,22 @@ namespace neam::cr
           {
             N_MTC_WRITER_SCOPE;
 
+            const uint64_t data_size = get_data_size();
+            uint64_t byte_offset = 0;
             chunk_t* it = first;
             while (it != nullptr)
             {
               chunk_array.push_back(it);
-              it = it->next;
+              chunk_byte_offset.push_back(byte_offset);
+              byte_offset += get_used_size(it, data_size);
+              it = it->next.load(std::memory_order_relaxed);
             }
           }
 
           /// \brief Index the in the allocated memory. Requires IsArray to be true.
+          /// \note Entries are indexed chunk by chunk, in the order the chunks were claimed.
+          ///       Allocations done by a single thread are indexed in allocation order, but allocations done by different threads
+          ///       are grouped by chunk (the index is not the global allocation order).
           /// \warning Slow if build_array_access_accelerator wasn't called
           template<typename Type>
           Type* get_entry(size_t index) const requires IsArray
@@ -95,33 +132,17 @@ namespace neam::cr
 
             if (!first) return nullptr;
 
-            const uint64_t data_size = memory::get_page_size() * PageCount - sizeof(chunk_t);
-            const size_t entry_per_chunk = data_size / sizeof(Type);
-            size_t chunk_index = index / entry_per_chunk;
-            const size_t offset_in_chunk = (index % entry_per_chunk) * sizeof(Type);
-            chunk_t* it = first;
-
-            if (chunk_index < chunk_array.size())
+            const uint64_t byte_offset = index * sizeof(Type);
+            if (!chunk_array.empty())
             {
               [[likely]];
-              it = chunk_array[chunk_index];
+              // find the last chunk that starts before byte_offset:
+              const auto it = std::upper_bound(chunk_byte_offset.begin(), chunk_byte_offset.end(), byte_offset);
+              const size_t chunk_index = (it - chunk_byte_offset.begin()) - 1;
+              return get_entry_in_chunk<Type>(chunk_array[chunk_index], byte_offset - chunk_byte_offset[chunk_index]);
             }
-            else
-            {
-              while (it != nullptr && chunk_index > 0)
-              {
-                it = it->next;
-                --chunk_index;
-              }
-            }
-
-            if (it == nullptr)
-              return nullptr;
-
-            if (it->offset < offset_in_chunk + sizeof(Type))
-              return nullptr;
 
-            return (Type*)(&it->data[offset_in_chunk]);
+            return frame_allocator::get_entry_in_list<Type>(first, index);
           }
 
           /// \brief Explicitly destroy the state (and clear all the allocations)
@@ -131,19 +152,31 @@ namespace neam::cr
 
             while (first != nullptr)
             {
-              chunk_t* next = first->next;
+              chunk_t* next = first->next.load(std::memory_order_relaxed);
               memory::free_page(first.release(), PageCount);
+              accounting_tag->on_release(PageCount * memory::get_page_size());
               first = next;
             }
             chunk_array.clear();
+            chunk_byte_offset.clear();
           }
 
           uint32_t size() const { return entry_count; }
 
         private:
-          uint32_t entry_count;
+          uint32_t entry_count = 0;
           raw_ptr<chunk_t> first;
+          memory::accounting::tag* accounting_tag = nullptr;
           std::vector<chunk_t*> chunk_array;
+          std::vector<uint64_t> chunk_byte_offset;
+      };
+
+      /// \brief Usage statistics of a thread slot (since the last reset)
+      struct thread_stats_t
+      {
+        uint32_t allocation_count = 0;
+        uint64_t allocated_bytes = 0;
+        uint32_t claimed_chunk_count = 0;
       };
 
     public:
@@ -165,38 +198,36 @@ namespace neam::cr
         if (count % Alignment != 0)
           count += Alignment - count % Alignment;
 
-        std::lock_guard<spinlock> _lg(lock);
+        thread_slot_t& slot = get_thread_slot();
+        std::lock_guard _lg(spinlock_shared_adapter::adapt(slot.lock));
 
-        // Setup the first chunk
-        if (first_chunk == nullptr)
+        chunk_t* current = slot.current.load(std::memory_order_acquire);
+        void* ptr = nullptr;
+        if (current != nullptr)
         {
-          TRACY_PLOT_CONFIG(pool_debug_name.data(), tracy::PlotFormatType::Memory);
-          // allocate the first chunk
-          first_chunk = allocate_chunk();
-          current_chunk = first_chunk;
+          [[likely]];
+          ptr = allocate_in_chunk(current, count);
         }
 
-        // allocate a new chunk as we don't have enough space:
-        if (current_chunk->offset + count > data_size)
+        // claim a new chunk as we don't have enough space:
+        if (ptr == nullptr)
         {
-          if (current_chunk->next != nullptr)
-          {
-            current_chunk = current_chunk->next;
-          }
-          else
-          {
-            chunk_t* new_current = allocate_chunk();
-            current_chunk->next = new_current;
-            current_chunk = new_current;
-          }
+          chunk_t* new_current = claim_chunk();
+          if (new_current == nullptr)
+            return nullptr;
+          slot.claimed_chunk_count.fetch_add(1, std::memory_order_relaxed);
+
+          // the chunk is not visible to other threads yet, so this cannot fail
+          ptr = allocate_in_chunk(new_current, count);
+
+          // another thread of the slot may have been faster, in which case we keep its chunk
+          slot.current.compare_exchange_strong(current, new_current, std::memory_order_acq_rel);
         }
 
-        uint32_t offset = current_chunk->offset;
-        current_chunk->offset += count;
-        total_memory += count;
-        allocation_count += 1;
-        TRACY_PLOT(pool_debug_name.data(), (int64_t)total_memory);
-        return &current_chunk->data[offset];
+        slot.allocation_count.fetch_add(1, std::memory_order_relaxed);
+        slot.allocated_bytes.fetch_add(count, std::memory_order_relaxed);
+        accounting_tag->on_allocate(count);
+        return ptr;
       }
 
       /// \brief Allocate and construct
@@ -219,52 +250,51 @@ namespace neam::cr
       ///          It is the duty of the caller to release the memory at a correct time
       allocator_state swap_and_reset()
       {
-        std::lock_guard<spinlock> _lg(lock);
-        if (first_chunk == nullptr)
-          return {};
+        lock_all_slots();
+        chunk_t* const current = take_used_chunks();
+        const uint32_t current_count = reset_slots();
+        unlock_all_slots();
 
-        chunk_t* const current = first_chunk;
-        const uint32_t current_count = allocation_count;
+        if (current == nullptr)
+          return {};
 
-        first_chunk = nullptr;
-        allocation_count = 0;
-        total_memory = 0;
-        current_chunk = nullptr;
+        // the chunks are now owned by the state
+        uint32_t state_chunk_count = 0;
+        for (chunk_t* it = current; it != nullptr; it = it->next.load(std::memory_order_relaxed))
+          ++state_chunk_count;
+        chunk_count.fetch_sub(state_chunk_count, std::memory_order_relaxed);
 
-        return allocator_state(current, current_count);
+        return allocator_state(current, current_count, *accounting_tag);
       }
 
-      /// \brief Clear the state of the allocator, only free n chunks (will always keep the first chunk allocated
+      /// \brief Clear the state of the allocator, only free n chunks (will always keep the first chunk allocated)
+      /// \note The chunks that are kept are given back to the threads on their next allocations
       void fast_clear(size_t chunks_to_free = 2)
       {
-        std::lock_guard<spinlock> _lg(lock);
-        if (first_chunk == nullptr)
-          return;
+        lock_all_slots();
+        chunk_t* current = take_used_chunks();
+        reset_slots();
 
-        allocation_count = 0;
-        total_memory = 0;
-        current_chunk = first_chunk;
-
-        chunk_t* current = first_chunk;
-        chunk_t* last = first_chunk;
+        chunk_t* free_list = free_chunks.load(std::memory_order_relaxed);
         while (current != nullptr)
         {
-          current->offset = 0;
-          current = current->next;
-
-          if (chunks_to_free == 0)
-            last = last->next;
-          else
+          chunk_t* next = current->next.load(std::memory_order_relaxed);
+          if (chunks_to_free > 0 && (next != nullptr || free_list != nullptr))
+          {
             --chunks_to_free;
+            deallocate_chunk(current);
+          }
+          else
+          {
+            current->offset.store(0, std::memory_order_relaxed);
+            current->end_offset.store(0, std::memory_order_relaxed);
+            current->next.store(free_list, std::memory_order_relaxed);
+            free_list = current;
+          }
+          current = next;
         }
-
-        // delete the extra chunks
-        current = last->next;
-        last->next = nullptr;
-        while (current != nullptr)
-        {
-          current = deallocate_chunk(current);
-        }
+        free_chunks.store(free_list, std::memory_order_release);
+        unlock_all_slots();
       }
 
       /// \brief Release all memory allocated by the allocator
@@ -272,80 +302,338 @@ namespace neam::cr
       ///          allocation invalid. It is expected that the caller has an external way to prevent concurrency for this operation
       void reset()
       {
-        std::lock_guard<spinlock> _lg(lock);
-        chunk_t* current = first_chunk;
-        first_chunk = nullptr;
-        allocation_count = 0;
-        total_memory = 0;
-        current_chunk = nullptr;
+        lock_all_slots();
+        chunk_t* current = take_used_chunks();
+        reset_slots();
+        while (current != nullptr)
+          current = deallocate_chunk(current);
 
+        current = free_chunks.exchange(nullptr, std::memory_order_acq_rel);
         while (current != nullptr)
-        {
           current = deallocate_chunk(current);
-        }
+        unlock_all_slots();
       }
 
+      /// \brief Return the number of allocations since the last reset
       uint32_t get_allocation_count() const
       {
-        std::lock_guard<spinlock> _lg(lock);
-        return allocation_count;
+        uint32_t count = 0;
+        for (const auto& it : slots)
+          count += it.allocation_count.load(std::memory_order_relaxed);
+        return count;
+      }
+
+      /// \brief Return the usage stats of a thread slot (since the last reset)
+      thread_stats_t get_thread_stats(uint32_t slot_index) const
+      {
+        const thread_slot_t& slot = slots[slot_index % k_thread_slot_count];
+        return
+        {
+          slot.allocation_count.load(std::memory_order_relaxed),
+          slot.allocated_bytes.load(std::memory_order_relaxed),
+          slot.claimed_chunk_count.load(std::memory_order_relaxed),
+        };
+      }
+
+      /// \brief Return the usage stats of the slot of the calling thread (since the last reset)
+      thread_stats_t get_current_thread_stats() const
+      {
+        return get_thread_stats(memory::get_thread_index());
+      }
+
+      /// \brief Set the tag the allocator reports its memory usage to (default is "frame_allocator")
+      /// \warning Must be called before any allocation
+      void set_accounting_tag(memory::accounting::tag& tag)
+      {
+        accounting_tag = &tag;
+      }
+
+      /// \brief Return the number of chunks currently allocated (in use or not)
+      uint32_t get_chunk_count() const
+      {
+        return chunk_count.load(std::memory_order_relaxed);
       }
 
       /// \brief If IsArray, return the entry at a given index. Might be slow.
+      /// \note Entries are indexed chunk by chunk, in the order the chunks were claimed (see allocator_state::get_entry())
       /// \warning Slow
       template<typename Type>
       Type* get_entry(size_t index) const requires IsArray
       {
-        std::lock_guard<spinlock> _lg(lock);
-        constexpr size_t entry_per_chunk = data_size / sizeof(Type);
-        size_t chunk_index = index / entry_per_chunk;
-        const size_t offset_in_chunk = (index % entry_per_chunk) * sizeof(Type);
+        thread_slot_t& slot = get_thread_slot();
+        std::lock_guard _lg(spinlock_shared_adapter::adapt(slot.lock));
+        return get_entry_in_list<Type>(used_chunks.load(std::memory_order_acquire), index);
+      }
+
+    public:
+      std::string pool_debug_name;
+
+    private:
+      struct alignas(64) thread_slot_t
+      {
+        mutable shared_spinlock lock;
+        std::atomic<chunk_t*> current = nullptr;
+
+        std::atomic<uint32_t> allocation_count = 0;
+        std::atomic<uint64_t> allocated_bytes = 0;
+        std::atomic<uint32_t> claimed_chunk_count = 0;
+      };
+
+      static memory::accounting::tag& get_default_accounting_tag()
+      {
+        static memory::accounting::tag& tag = memory::accounting::get_tag("frame_allocator");
+        return tag;
+      }
+
+      thread_slot_t& get_thread_slot() const
+      {
+        return slots[memory::get_thread_index() % k_thread_slot_count];
+      }
 
-        chunk_t* it = first_chunk;
-        while (it != nullptr && chunk_index > 0)
+      void lock_all_slots()
+      {
+        for (auto& it : slots)
+          it.lock.lock_exclusive();
+      }
+
+      void unlock_all_slots()
+      {
+        for (auto& it : slots)
+          it.lock.unlock_exclusive();
+      }
+
+      /// \brief Reset the current chunk and stats of all slots. Slots must be locked.
+      /// \return the number of allocations
+      uint32_t reset_slots()
+      {
+        uint32_t count = 0;
+        uint64_t bytes = 0;
+        for (auto& it : slots)
         {
-          it = it->next.load(std::memory_order_acquire);
-          --chunk_index;
+          it.current.store(nullptr, std::memory_order_relaxed);
+          count += it.allocation_count.exchange(0, std::memory_order_relaxed);
+          bytes += it.allocated_bytes.exchange(0, std::memory_order_relaxed);
+          it.claimed_chunk_count.store(0, std::memory_order_relaxed);
         }
-        if (it == nullptr)
-          return nullptr;
+        if (count > 0)
+          accounting_tag->on_deallocate(bytes, count);
+        return count;
+      }
 
-        if (it->offset.load(std::memory_order_acquire) < offset_in_chunk + sizeof(Type))
-          return nullptr;
+      void* allocate_in_chunk(chunk_t* chk, uint32_t count)
+      {
+        const uint32_t offset = chk->offset.fetch_add(count, std::memory_order_acq_rel);
+        [[likely]] if (offset + count <= data_size)
+          return &chk->data[offset];
 
-        return (Type*)(&it->data[offset_in_chunk]);
+        // we are the first to overflow the chunk: record where the allocations end
+        if (offset <= data_size)
+          chk->end_offset.store(offset, std::memory_order_release);
+        return nullptr;
       }
 
-    public:
-      std::string pool_debug_name;
+      /// \brief Get a chunk from the free list (or allocate a new one) and add it to the list of used chunks
+      chunk_t* claim_chunk()
+      {
+        // pop from the free list
+        // (there's no ABA issue here, as chunks are only pushed back in the free list when the slots are exclusively locked)
+        chunk_t* chk = free_chunks.load(std::memory_order_acquire);
+        while (chk != nullptr && !free_chunks.compare_exchange_weak(chk, chk->next.load(std::memory_order_relaxed), std::memory_order_acq_rel));
+
+        if (chk == nullptr)
+        {
+          chk = allocate_chunk();
+          if (chk == nullptr)
+            return nullptr;
+          [[maybe_unused]] const uint32_t count = chunk_count.fetch_add(1, std::memory_order_relaxed) + 1;
+          accounting_tag->on_reserve(PageCount * memory::get_page_size());
+          TRACY_PLOT_CONFIG(pool_debug_name.data(), tracy::PlotFormatType::Memory);
+          TRACY_PLOT(pool_debug_name.data(), (int64_t)(count * PageCount * memory::get_page_size()));
+        }
+
+        append_used_chunk(chk);
+        return chk;
+      }
+
+      /// \brief Append a chunk at the end of the list of used chunks, so the list stays in the order the chunks were claimed
+      /// \note There's no ABA issue, as chunks are only removed from the list when the slots are exclusively locked
+      void append_used_chunk(chunk_t* chk)
+      {
+        chk->next.store(nullptr, std::memory_order_relaxed);
+        chunk_t* tail = used_chunks_tail.load(std::memory_order_acquire);
+        while (true)
+        {
+          if (tail == nullptr)
+          {
+            // empty list: the chunk becomes the head
+            chunk_t* head = nullptr;
+            if (used_chunks.compare_exchange_strong(head, chk, std::memory_order_acq_rel))
+            {
+              used_chunks_tail.compare_exchange_strong(tail, chk, std::memory_order_acq_rel);
+              return;
+            }
+            // another thread set the head, help it set the tail
+            used_chunks_tail.compare_exchange_strong(tail, head, std::memory_order_acq_rel);
+          }
+          else
+          {
+            chunk_t* next = nullptr;
+            if (tail->next.compare_exchange_strong(next, chk, std::memory_order_acq_rel))
+            {
+              used_chunks_tail.compare_exchange_strong(tail, chk, std::memory_order_acq_rel);
+              return;
+            }
+            // the tail is lagging behind, help move it forward
+            used_chunks_tail.compare_exchange_strong(tail, next, std::memory_order_acq_rel);
+          }
+          tail = used_chunks_tail.load(std::memory_order_acquire);
+        }
+      }
+
+      /// \brief Take the list of used chunks. Slots must be locked.
+      chunk_t* take_used_chunks()
+      {
+        used_chunks_tail.store(nullptr, std::memory_order_relaxed);
+        return used_chunks.exchange(nullptr, std::memory_order_acq_rel);
+      }
+
+      template<typename Type>
+      static Type* get_entry_in_chunk(chunk_t* chk, uint64_t byte_offset)
+      {
+        if (get_used_size(chk, get_data_size()) < byte_offset + sizeof(Type))
+          return nullptr;
+        return (Type*)(&chk->data[byte_offset]);
+      }
+
+      template<typename Type>
+      static Type* get_entry_in_list(chunk_t* it, size_t index)
+      {
+        const uint64_t data_size = get_data_size();
+        uint64_t byte_offset = index * sizeof(Type);
+        while (it != nullptr)
+        {
+          const uint32_t used_size = get_used_size(it, data_size);
+          if (byte_offset < used_size)
+            return get_entry_in_chunk<Type>(it, byte_offset);
+          byte_offset -= used_size;
+          it = it->next.load(std::memory_order_acquire);
+        }
+        return nullptr;
+      }
 
-    private:
       static chunk_t* allocate_chunk()
       {
         void* ptr = memory::allocate_page(PageCount);
         chunk_t* chk = reinterpret_cast<chunk_t*>(ptr);
         if (chk != nullptr)
         {
-          // we don't even care about atomicity here:
-          chk->next = nullptr;
-          chk->offset = 0;
+          new (chk) chunk_t { {0}, {0}, {nullptr} };
         }
         return chk;
       }
-      static chunk_t* deallocate_chunk(chunk_t* chk)
+      chunk_t* deallocate_chunk(chunk_t* chk)
       {
-        chunk_t* next = chk->next;
+        chunk_t* next = chk->next.load(std::memory_order_relaxed);
         memory::free_page(chk, PageCount);
+        chunk_count.fetch_sub(1, std::memory_order_relaxed);
+        accounting_tag->on_release(PageCount * memory::get_page_size());
         return next;
       }
 
     private:
-      mutable spinlock lock;
-      uint32_t allocation_count = 0;
-      uint64_t total_memory = 0;
-      const uint64_t data_size = memory::get_page_size() * PageCount - sizeof(chunk_t);
+      mutable thread_slot_t slots[k_thread_slot_count];
+
+      alignas(64) std::atomic<chunk_t*> used_chunks = nullptr;
+      std::atomic<chunk_t*> used_chunks_tail = nullptr;
+      std::atomic<chunk_t*> free_chunks = nullptr;
+      std::atomic<uint32_t> chunk_count = 0;
+      const uint64_t data_size = get_data_size();
+
+      memory::accounting::tag* accounting_tag = &get_default_accounting_tag();
+  };
+
+  /// \brief std::pmr::memory_resource for per-frame temporaries, on top of a frame_allocator.
+  ///        Deallocations are no-op, memory is only reclaimed by a call to reset().
+  /// \note Allocations that cannot fit in a chunk (or that are over-aligned) are forwarded to the upstream resource
+  ///       and are kept alive until the next reset().
+  /// \warning reset() has the same constraints as frame_allocator::fast_clear(): no allocation must be still in use.
+  template<size_t PageCount = 4, uint32_t Alignment = 16>
+  class frame_memory_resource : public std::pmr::memory_resource
+  {
+    public:
+      explicit frame_memory_resource(std::pmr::memory_resource* _upstream = std::pmr::get_default_resource()) : upstream(_upstream) {}
+      ~frame_memory_resource() { reset(); }
+
+      frame_memory_resource(const frame_memory_resource&) = delete;
+      frame_memory_resource& operator = (const frame_memory_resource&) = delete;
+
+      /// \brief Release all the allocations done since the last reset
+      void reset(size_t chunks_to_free = 2)
+      {
+        oversized_allocation_t* it;
+        {
+          std::lock_guard<spinlock> _lg(lock);
+          it = oversized_allocations;
+          oversized_allocations = nullptr;
+        }
+        while (it != nullptr)
+        {
+          oversized_allocation_t* next = it->next;
+          upstream->deallocate(it->ptr, it->size, it->alignment);
+          it = next;
+        }
+        allocator.fast_clear(chunks_to_free);
+      }
+
+      std::pmr::memory_resource* get_upstream() const { return upstream; }
+      frame_allocator<PageCount, false, Alignment>& get_allocator() { return allocator; }
+
+    protected:
+      void* do_allocate(size_t bytes, size_t alignment) override
+      {
+        if (bytes == 0)
+          bytes = 1;
+
+        if (alignment <= Alignment)
+        {
+          [[likely]] if (void* ptr = allocator.allocate(bytes); ptr != nullptr)
+            return ptr;
+        }
+
+        // oversized/over-aligned allocation:
+        oversized_allocation_t* entry = allocator.template allocate<oversized_allocation_t>();
+        if (entry == nullptr)
+          throw std::bad_alloc();
+        entry->ptr = upstream->allocate(bytes, alignment);
+        entry->size = bytes;
+        entry->alignment = alignment;
+
+        std::lock_guard<spinlock> _lg(lock);
+        entry->next = oversized_allocations;
+        oversized_allocations = entry;
+        return entry->ptr;
+      }
+
+      void do_deallocate(void* /*ptr*/, size_t /*bytes*/, size_t /*alignment*/) override {}
+
+      bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+      {
+        return this == &other;
+      }
+
+    private:
+      struct oversized_allocation_t
+      {
+        void* ptr;
+        size_t size;
+        size_t alignment;
+        oversized_allocation_t* next;
+      };
+
+      std::pmr::memory_resource* upstream;
+      frame_allocator<PageCount, false, Alignment> allocator;
 
-      chunk_t* first_chunk = nullptr;
-      chunk_t* current_chunk = nullptr;
+      spinlock lock;
+      oversized_allocation_t* oversized_allocations = nullptr;
   };
 }
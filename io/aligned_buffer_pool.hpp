@@ -0,0 +1,149 @@
+//
+// created by : Timothée Feuillet
+// date: 2026-10-18
+//
+//
+// Copyright (c) 2026 Timothée Feuillet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <atomic>
+#include <mutex>
+
+#include "../memory.hpp"
+#include "../spinlock.hpp"
+#include "../memory_accounting.hpp"
+#include "../debug/assert.hpp"
+
+namespace neam::io
+{
+  /// \brief A fixed set of same-size, page-aligned buffers (for O_DIRECT operations, which require aligned memory).
+  /// Buffers are allocated on first use and kept until the pool is destructed.
+  ///
+  /// \note Unlike buffer_pool, buffers are raw pointers: they never leave the owner of the pool.
+  class aligned_buffer_pool
+  {
+    public:
+      /// \brief Create a pool of \e count buffers of \e size bytes (rounded up to a multiple of the page size)
+      aligned_buffer_pool(uint32_t count, size_t size)
+        : page_count((uint32_t)((std::max<size_t>(size, 1) + memory::get_page_size() - 1) / memory::get_page_size()))
+        , buffer_count(count)
+        , min_available_count(count)
+      {
+        check::debug::n_assert(count > 0, "aligned_buffer_pool: invalid buffer count");
+        buffers.reserve(count);
+        free_buffers.reserve(count);
+      }
+
+      ~aligned_buffer_pool()
+      {
+        check::debug::n_check(free_buffers.size() == buffers.size(), "aligned_buffer_pool: destructed with {} buffers still in use",
+                              buffers.size() - free_buffers.size());
+        for (void* it : buffers)
+        {
+          memory::free_page(it, page_count);
+          get_accounting_tag().on_release(get_buffer_size());
+        }
+      }
+
+      /// \brief Return a buffer of get_buffer_size() bytes, or nullptr if the pool is exhausted
+      void* acquire()
+      {
+        std::lock_guard _l(lock);
+        void* ret = nullptr;
+        if (!free_buffers.empty())
+        {
+          ret = free_buffers.back();
+          free_buffers.pop_back();
+        }
+        else if (buffers.size() < buffer_count)
+        {
+          ret = memory::allocate_page(page_count);
+          if (ret == nullptr)
+            return nullptr;
+          buffers.push_back(ret);
+          get_accounting_tag().on_reserve(get_buffer_size());
+        }
+        else
+        {
+          exhausted_count.fetch_add(1, std::memory_order_relaxed);
+          return nullptr;
+        }
+        ++in_use;
+        if (buffer_count - in_use < min_available_count.load(std::memory_order_relaxed))
+          min_available_count.store(buffer_count - in_use, std::memory_order_relaxed);
+        return ret;
+      }
+
+      /// \brief Give back a buffer returned by acquire()
+      void release(void* buffer)
+      {
+        if (buffer == nullptr)
+          return;
+        std::lock_guard _l(lock);
+        check::debug::n_assert(in_use > 0, "aligned_buffer_pool: releasing a buffer that is not in use");
+        --in_use;
+        free_buffers.push_back(buffer);
+      }
+
+      /// \brief Alignment of the buffers (any offset / size multiple of this is valid for O_DIRECT operations)
+      static size_t get_alignment() { return memory::get_page_size(); }
+
+      size_t get_buffer_size() const { return page_count * memory::get_page_size(); }
+      uint32_t get_buffer_count() const { return buffer_count; }
+
+      uint32_t get_available_count() const
+      {
+        std::lock_guard _l(lock);
+        return buffer_count - in_use;
+      }
+
+      /// \brief Number of acquire() that failed because the pool was exhausted
+      uint64_t get_exhausted_count() const { return exhausted_count.load(std::memory_order_relaxed); }
+
+      /// \brief Lowest number of available buffers since the creation of the pool
+      uint32_t get_min_available_count() const { return min_available_count.load(std::memory_order_relaxed); }
+
+    private:
+      static memory::accounting::tag& get_accounting_tag()
+      {
+        static memory::accounting::tag& tag = memory::accounting::get_tag("io::aligned_buffer_pool");
+        return tag;
+      }
+
+    private:
+      const uint32_t page_count;
+      const uint32_t buffer_count;
+
+      mutable spinlock lock;
+      std::vector<void*> buffers;
+      std::vector<void*> free_buffers;
+      uint32_t in_use = 0;
+
+      std::atomic<uint64_t> exhausted_count = 0;
+      std::atomic<uint32_t> min_available_count;
+  };
+}
@@ -0,0 +1,195 @@
+//
+// created by : Timothée Feuillet
+// date: 2026-10-18
+//
+//
+// Copyright (c) 2026 Timothée Feuillet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#include <algorithm>
+#include <mutex>
+
+#include "../debug/assert.hpp"
+
+#include "block_cache.hpp"
+
+namespace neam::io
+{
+  block_cache::block_cache(size_t _budget, size_t _block_size)
+    : budget(_budget)
+    , block_size(_block_size)
+    , shard_count((uint32_t)std::clamp<size_t>(_budget / std::max<size_t>(_block_size, 1), 1, k_shard_count))
+    , shard_budget(_budget / shard_count)
+  {
+    check::debug::n_assert(block_size > 0, "block_cache: invalid block size");
+  }
+
+  block_cache::block_chain block_cache::get_block(id_t fid, uint64_t block_index, bool& should_read)
+  {
+    should_read = false;
+    const key_t k { fid, block_index };
+    shard_t& shard = get_shard(k);
+
+    block_chain ret;
+    {
+      std::lock_guard _l(shard.lock);
+      if (auto it = shard.entries.find(k); it != shard.entries.end())
+      {
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lru_it);
+        shared_raw_data data = it->second.data;
+        stats_hits.fetch_add(1, std::memory_order_relaxed);
+        stats_bytes_saved.fetch_add(data.get_size(), std::memory_order_relaxed);
+        return block_chain::create_and_complete(std::move(data), true);
+      }
+
+      auto [it, is_new] = shard.pending.try_emplace(k);
+      should_read = is_new;
+      it->second.waiters.push_back(ret.create_state());
+    }
+
+    if (should_read)
+      stats_misses.fetch_add(1, std::memory_order_relaxed);
+    else
+      stats_coalesced.fetch_add(1, std::memory_order_relaxed);
+    return ret;
+  }
+
+  void block_cache::on_block_read(id_t fid, uint64_t block_index, shared_raw_data&& data, bool success)
+  {
+    const key_t k { fid, block_index };
+    shard_t& shard = get_shard(k);
+
+    pending_block_t pending;
+    {
+      std::lock_guard _l(shard.lock);
+      const auto it = shard.pending.find(k);
+      check::debug::n_assert(it != shard.pending.end(), "block_cache: block {} of {} is not being read", block_index, fid);
+      pending = std::move(it->second);
+      shard.pending.erase(it);
+
+      if (success && !pending.is_invalidated)
+        insert(shard, k, data);
+    }
+
+    // the first waiter is the reader:
+    if (pending.waiters.size() > 1 && success)
+      stats_bytes_saved.fetch_add(data.get_size() * (pending.waiters.size() - 1), std::memory_order_relaxed);
+    for (auto& it : pending.waiters)
+      it.complete(shared_raw_data(data), success);
+  }
+
+  void block_cache::invalidate(id_t fid, uint64_t offset, uint64_t size)
+  {
+    if (size == 0)
+      return;
+    const uint64_t first_block = offset / block_size;
+    const uint64_t last_block = (size > ~uint64_t(0) - offset) ? ~uint64_t(0) : (offset + size - 1) / block_size;
+
+    // big ranges: go over the whole cache instead
+    if (last_block - first_block >= budget / block_size)
+    {
+      invalidate(fid);
+      return;
+    }
+
+    for (uint64_t block = first_block; block <= last_block; ++block)
+    {
+      const key_t k { fid, block };
+      shard_t& shard = get_shard(k);
+      std::lock_guard _l(shard.lock);
+      if (auto it = shard.entries.find(k); it != shard.entries.end())
+        erase(shard, it);
+      if (auto it = shard.pending.find(k); it != shard.pending.end())
+        it->second.is_invalidated = true;
+    }
+  }
+
+  void block_cache::invalidate(id_t fid)
+  {
+    for (shard_t& shard : shards)
+    {
+      std::lock_guard _l(shard.lock);
+      for (auto it = shard.entries.begin(); it != shard.entries.end();)
+      {
+        if (it->first.fid == fid)
+        {
+          auto next = std::next(it);
+          erase(shard, it);
+          it = next;
+        }
+        else
+        {
+          ++it;
+        }
+      }
+      for (auto& it : shard.pending)
+      {
+        if (it.first.fid == fid)
+          it.second.is_invalidated = true;
+      }
+    }
+  }
+
+  void block_cache::clear()
+  {
+    for (shard_t& shard : shards)
+    {
+      std::lock_guard _l(shard.lock);
+      while (!shard.entries.empty())
+        erase(shard, shard.entries.begin());
+      for (auto& it : shard.pending)
+        it.second.is_invalidated = true;
+    }
+  }
+
+  void block_cache::insert(shard_t& shard, const key_t& k, const shared_raw_data& data)
+  {
+    if (auto it = shard.entries.find(k); it != shard.entries.end())
+      erase(shard, it);
+
+    // budget below a block: nothing is cached
+    if (block_size > shard_budget)
+      return;
+
+    // make some space:
+    while (!shard.lru.empty() && shard.memory_usage + block_size > shard_budget)
+    {
+      erase(shard, shard.entries.find(shard.lru.back()));
+      stats_evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    shard.lru.push_front(k);
+    shard.entries.emplace(k, entry_t { data, shard.lru.begin() });
+    shard.memory_usage += block_size;
+    memory_usage.fetch_add(block_size, std::memory_order_relaxed);
+    block_count.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void block_cache::erase(shard_t& shard, decltype(shard_t::entries)::iterator it)
+  {
+    shard.lru.erase(it->second.lru_it);
+    shard.entries.erase(it);
+    shard.memory_usage -= block_size;
+    memory_usage.fetch_sub(block_size, std::memory_order_relaxed);
+    block_count.fetch_sub(1, std::memory_order_relaxed);
+  }
+}
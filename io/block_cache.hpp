@@ -0,0 +1,164 @@
+//
+// created by : Timothée Feuillet
+// date: 2026-10-18
+//
+//
+// Copyright (c) 2026 Timothée Feuillet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <list>
+
+#include "../id/id.hpp"
+#include "../mt_check/unordered_map.hpp"
+#include "../mt_check/vector.hpp"
+#include "../async/chain.hpp"
+#include "../shared_raw_data.hpp"
+#include "../slab_allocator.hpp"
+#include "../spinlock.hpp"
+
+namespace neam::io
+{
+  /// \brief In-process cache of fixed-size file blocks, keyed by (fid, block index), with a memory budget and LRU eviction.
+  /// Concurrent requests for a block that is being read are coalesced: only the first requester reads the block.
+  ///
+  /// The cache is split in shards (each with its own lock, LRU and part of the budget) to limit contention.
+  /// Small budgets use fewer shards, so each shard can hold at least a block without going over the budget.
+  /// It doesn't do any I/O itself, see context::queue_read() for the integration.
+  ///
+  /// \note Blocks are shared_raw_data: cached blocks handed out stay valid after they are evicted / invalidated.
+  /// \note Only the writes that go through the context invalidate the blocks. Files modified externally must be invalidated manually.
+  class block_cache
+  {
+    public:
+      using block_chain = async::chain<shared_raw_data&& /*block*/, bool /*success*/>;
+
+      static constexpr uint32_t k_shard_count = 8;
+
+    public:
+      /// \param budget maximum memory used by the cached blocks (in bytes). Below \e block_size, nothing is cached.
+      block_cache(size_t budget, size_t block_size);
+
+      size_t get_block_size() const { return block_size; }
+      size_t get_budget() const { return budget; }
+
+      /// \brief Request a block.
+      /// On a cache hit, the returned chain is already completed.
+      /// On a miss, \e should_read is set if no read of the block is in flight: the caller must then read the block and call on_block_read().
+      /// (in both cases, the chain is completed by on_block_read())
+      [[nodiscard]] block_chain get_block(id_t fid, uint64_t block_index, bool& should_read);
+
+      /// \brief Complete a read requested by get_block(). A short (or empty) block means the end of the file has been reached.
+      void on_block_read(id_t fid, uint64_t block_index, shared_raw_data&& data, bool success);
+
+      /// \brief Remove the blocks overlapping [offset, offset + size) from the cache
+      /// Reads in flight for those blocks will not be inserted in the cache.
+      void invalidate(id_t fid, uint64_t offset, uint64_t size);
+      /// \brief Remove all the blocks of the file from the cache
+      void invalidate(id_t fid);
+      /// \brief Remove all the blocks from the cache
+      void clear();
+
+    public: // stats
+      uint64_t get_hit_count() const { return stats_hits.load(std::memory_order_relaxed); }
+      uint64_t get_miss_count() const { return stats_misses.load(std::memory_order_relaxed); }
+      /// \brief Number of requests that waited for a read that was already in flight
+      uint64_t get_coalesced_count() const { return stats_coalesced.load(std::memory_order_relaxed); }
+      /// \brief Number of bytes that have not been read from the file thanks to the cache (hits + coalesced requests)
+      uint64_t get_bytes_saved() const { return stats_bytes_saved.load(std::memory_order_relaxed); }
+      uint64_t get_eviction_count() const { return stats_evictions.load(std::memory_order_relaxed); }
+      /// \brief hits / (hits + misses) (coalesced requests count as hits)
+      float get_hit_rate() const
+      {
+        const uint64_t hits = get_hit_count() + get_coalesced_count();
+        const uint64_t total = hits + get_miss_count();
+        return total > 0 ? (float)hits / (float)total : 0.0f;
+      }
+
+      size_t get_memory_usage() const { return memory_usage.load(std::memory_order_relaxed); }
+      uint32_t get_block_count() const { return block_count.load(std::memory_order_relaxed); }
+
+    private:
+      struct key_t
+      {
+        id_t fid;
+        uint64_t block_index;
+
+        bool operator == (const key_t& o) const = default;
+      };
+      struct key_hash
+      {
+        size_t operator()(const key_t& k) const
+        {
+          return std::hash<uint64_t>{}((uint64_t)k.fid ^ (k.block_index * 0x9E3779B97F4A7C15ull));
+        }
+      };
+      using lru_list_t = std::list<key_t, cr::slab_stl_allocator<key_t>>;
+
+      struct entry_t
+      {
+        shared_raw_data data;
+        lru_list_t::iterator lru_it;
+      };
+
+      struct pending_block_t
+      {
+        std::mtc_vector<block_chain::state> waiters;
+        bool is_invalidated = false;
+      };
+
+      struct shard_t
+      {
+        spinlock lock;
+        lru_list_t lru; // most recently used first
+        std::mtc_unordered_map<key_t, entry_t, key_hash> entries;
+        std::mtc_unordered_map<key_t, pending_block_t, key_hash> pending;
+        size_t memory_usage = 0;
+      };
+
+      shard_t& get_shard(const key_t& k) { return shards[key_hash{}(k) % shard_count]; }
+
+      // NOTE: the lock of the shard must be held
+      void insert(shard_t& shard, const key_t& k, const shared_raw_data& data);
+      void erase(shard_t& shard, decltype(shard_t::entries)::iterator it);
+
+    private:
+      const size_t budget;
+      const size_t block_size;
+      const uint32_t shard_count; // at most k_shard_count
+      const size_t shard_budget;
+
+      shard_t shards[k_shard_count];
+
+      std::atomic<size_t> memory_usage = 0;
+      std::atomic<uint32_t> block_count = 0;
+
+      std::atomic<uint64_t> stats_hits = 0;
+      std::atomic<uint64_t> stats_misses = 0;
+      std::atomic<uint64_t> stats_coalesced = 0;
+      std::atomic<uint64_t> stats_bytes_saved = 0;
+      std::atomic<uint64_t> stats_evictions = 0;
+  };
+}
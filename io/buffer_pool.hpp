@@ -0,0 +1,194 @@
+//
+// created by : Timothée Feuillet
+// date: 2026-10-18
+//
+//
+// Copyright (c) 2026 Timothée Feuillet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <atomic>
+#include <mutex>
+
+#include <sys/uio.h>
+
+#include "../raw_data.hpp"
+#include "../shared_raw_data.hpp"
+#include "../spinlock.hpp"
+#include "../memory_accounting.hpp"
+#include "../debug/assert.hpp"
+
+namespace neam::io
+{
+  /// \brief A fixed set of same-size buffers, handed out as recyclable shared_raw_data.
+  /// Buffers go back to the pool when their last reference is dropped, so their address never changes
+  /// (which is what io_uring requires for registered / provided buffers).
+  ///
+  /// \note The pool is heap allocated and outlives its owner if buffers are still in use:
+  ///       the owner must call destroy() instead of deleting it.
+  class buffer_pool final : public shared_raw_data::recycler
+  {
+    public:
+      static constexpr uint32_t k_invalid_index = ~0u;
+
+      /// \brief Create a pool of \e count buffers of \e size bytes
+      static buffer_pool* create(uint32_t count, size_t size)
+      {
+        return new buffer_pool(count, size);
+      }
+
+      /// \brief Release the pool. Buffers in use are freed when their last reference is dropped.
+      void destroy()
+      {
+        std::unique_lock _l(lock);
+        destroyed = true;
+        for (auto& it : buffers)
+        {
+          if (it.data)
+            get_accounting_tag().on_release(it.size);
+          it = {};
+        }
+        free_indices.clear();
+        if (in_use == 0)
+        {
+          _l.unlock();
+          delete this;
+        }
+      }
+
+      /// \brief Return a buffer from the pool, or an empty shared_raw_data if the pool is exhausted
+      shared_raw_data acquire()
+      {
+        std::lock_guard _l(lock);
+        if (free_indices.empty())
+        {
+          exhausted_count.fetch_add(1, std::memory_order_relaxed);
+          return {};
+        }
+        const uint32_t index = free_indices.back();
+        free_indices.pop_back();
+        ++in_use;
+        update_min_available();
+        return shared_raw_data::make_recyclable(std::move(buffers[index]), *this, index);
+      }
+
+      /// \brief Return the index of the buffer if the data comes from this pool, k_invalid_index otherwise
+      uint32_t get_index(const shared_raw_data& data) const
+      {
+        if (data.get_recycler() != this)
+          return k_invalid_index;
+        return data.get_recycler_index();
+      }
+
+      /// \brief Return the iovecs for all the buffers (for registration). Must be called before any acquire().
+      std::vector<iovec> get_iovecs() const
+      {
+        std::lock_guard _l(lock);
+        std::vector<iovec> ret;
+        ret.reserve(buffers.size());
+        for (const auto& it : buffers)
+          ret.push_back({ .iov_base = it.data.get(), .iov_len = it.size });
+        return ret;
+      }
+
+      size_t get_buffer_size() const { return buffer_size; }
+      uint32_t get_buffer_count() const { return buffer_count; }
+
+      uint32_t get_available_count() const
+      {
+        std::lock_guard _l(lock);
+        return (uint32_t)free_indices.size();
+      }
+
+      /// \brief Number of acquire() that failed because the pool was exhausted
+      uint64_t get_exhausted_count() const { return exhausted_count.load(std::memory_order_relaxed); }
+
+      /// \brief Lowest number of available buffers since the creation of the pool
+      uint32_t get_min_available_count() const { return min_available_count.load(std::memory_order_relaxed); }
+
+    public: // recycler
+      void recycle(raw_data&& data, uint32_t index) override
+      {
+        std::unique_lock _l(lock);
+        --in_use;
+        if (destroyed)
+        {
+          // destroy() only released the buffers that were not in use
+          const bool should_delete = in_use == 0;
+          _l.unlock();
+          data = {};
+          get_accounting_tag().on_release(buffer_size);
+          if (should_delete)
+            delete this;
+          return;
+        }
+        buffers[index] = std::move(data);
+        free_indices.push_back(index);
+      }
+
+    private:
+      buffer_pool(uint32_t count, size_t size)
+        : buffer_size(size)
+        , buffer_count(count)
+        , min_available_count(count)
+      {
+        check::debug::n_assert(size > 0, "buffer_pool: invalid buffer size");
+        buffers.reserve(count);
+        free_indices.reserve(count);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+          buffers.push_back(raw_data::allocate(size));
+          get_accounting_tag().on_reserve(size);
+          free_indices.push_back(count - i - 1);
+        }
+      }
+
+      ~buffer_pool() = default;
+
+      void update_min_available()
+      {
+        if (free_indices.size() < min_available_count.load(std::memory_order_relaxed))
+          min_available_count.store((uint32_t)free_indices.size(), std::memory_order_relaxed);
+      }
+
+      static memory::accounting::tag& get_accounting_tag()
+      {
+        static memory::accounting::tag& tag = memory::accounting::get_tag("io::buffer_pool");
+        return tag;
+      }
+
+    private:
+      const size_t buffer_size;
+      const uint32_t buffer_count;
+
+      mutable spinlock lock;
+      std::vector<raw_data> buffers;
+      std::vector<uint32_t> free_indices;
+      uint32_t in_use = 0;
+      bool destroyed = false;
+
+      std::atomic<uint64_t> exhausted_count = 0;
+      std::atomic<uint32_t> min_available_count;
+  };
+}
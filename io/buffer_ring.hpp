@@ -0,0 +1,217 @@
+//
+// created by : Timothée Feuillet
+// date: 2026-10-18
+//
+//
+// Copyright (c) 2026 Timothée Feuillet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+
+#include <liburing.h>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <atomic>
+#include <mutex>
+
+#include "../raw_data.hpp"
+#include "../shared_raw_data.hpp"
+#include "../spinlock.hpp"
+#include "../memory_accounting.hpp"
+#include "../debug/assert.hpp"
+
+namespace neam::io
+{
+  /// \brief A provided-buffer ring (io_uring_setup_buf_ring): the kernel picks a buffer when the data arrives,
+  /// so receives don't have to allocate a buffer upfront.
+  ///
+  /// Buffers taken by the kernel are either copied out (take_copy(), the buffer goes back to the ring immediately)
+  /// or handed out as recyclable shared_raw_data (take()), in which case they go back to the ring when their last reference is dropped.
+  /// Adding a buffer back to the ring only touches memory shared with the kernel (no syscall), so it can be done from any thread.
+  ///
+  /// \note The ring is heap allocated and outlives its owner if buffers are still in use:
+  ///       the owner must call destroy() (before exiting the io_uring) instead of deleting it.
+  class buffer_ring final : public shared_raw_data::recycler
+  {
+    public:
+      static constexpr uint32_t k_max_buffer_count = 32768;
+
+      /// \brief Create a ring of \e count buffers of \e size bytes, registered as the buffer group \e group_id
+      /// \param count must be a power of two
+      /// \return nullptr if the kernel refused the ring (kernels older than 5.19)
+      static buffer_ring* create(io_uring& ring, uint32_t count, size_t size, uint16_t group_id)
+      {
+        check::debug::n_assert(count > 0 && count <= k_max_buffer_count && (count & (count - 1)) == 0,
+                               "buffer_ring: the buffer count ({}) must be a power of two (and at most {})", count, k_max_buffer_count);
+        check::debug::n_assert(size > 0 && size <= ~0u, "buffer_ring: invalid buffer size");
+
+        int ret = 0;
+        io_uring_buf_ring* br = io_uring_setup_buf_ring(&ring, count, group_id, 0, &ret);
+        if (br == nullptr)
+        {
+          cr::out().warn("io::buffer_ring: failed to setup a buffer ring of {} entries: {}", count, strerror(-ret));
+          return nullptr;
+        }
+        return new buffer_ring(ring, br, count, size, group_id);
+      }
+
+      /// \brief Unregister the ring. Buffers in use are freed when their last reference is dropped.
+      /// \warning Must be called before io_uring_queue_exit()
+      void destroy()
+      {
+        std::unique_lock _l(lock);
+        destroyed = true;
+        io_uring_free_buf_ring(&uring, br, buffer_count, group_id);
+        br = nullptr;
+        for (auto& it : buffers)
+        {
+          if (it.data)
+            get_accounting_tag().on_release(it.size);
+          it = {};
+        }
+        if (in_use == 0)
+        {
+          _l.unlock();
+          delete this;
+        }
+      }
+
+      /// \brief Hand out a buffer the kernel filled. It goes back to the ring when the last reference is dropped.
+      shared_raw_data take(uint16_t index, size_t size)
+      {
+        std::lock_guard _l(lock);
+        check::debug::n_assert(index < buffer_count && buffers[index].data, "buffer_ring: buffer {} is not in the ring", index);
+        --available;
+        ++in_use;
+        update_min_available();
+        return shared_raw_data::make_recyclable(std::move(buffers[index]), *this, index).slice(0, size);
+      }
+
+      /// \brief Copy the content of a buffer the kernel filled and give the buffer back to the ring
+      raw_data take_copy(uint16_t index, size_t size)
+      {
+        std::lock_guard _l(lock);
+        check::debug::n_assert(index < buffer_count && buffers[index].data, "buffer_ring: buffer {} is not in the ring", index);
+        --available;
+        update_min_available();
+        raw_data ret = size > 0 ? raw_data::duplicate(buffers[index].get(), size) : raw_data {};
+        add_to_ring(index);
+        return ret;
+      }
+
+      /// \brief Called when a receive failed with ENOBUFS (the kernel found no buffer in the ring)
+      void on_exhausted() { exhausted_count.fetch_add(1, std::memory_order_relaxed); }
+
+      uint16_t get_group_id() const { return group_id; }
+      size_t get_buffer_size() const { return buffer_size; }
+      uint32_t get_buffer_count() const { return buffer_count; }
+
+      /// \brief Number of buffers in the ring (the kernel may have taken some of them without a completion being processed yet)
+      uint32_t get_available_count() const { return available.load(std::memory_order_relaxed); }
+
+      /// \brief Number of receives that failed because the ring was empty
+      uint64_t get_exhausted_count() const { return exhausted_count.load(std::memory_order_relaxed); }
+
+      /// \brief Lowest number of buffers in the ring since its creation
+      uint32_t get_min_available_count() const { return min_available_count.load(std::memory_order_relaxed); }
+
+    public: // recycler
+      void recycle(raw_data&& data, uint32_t index) override
+      {
+        std::unique_lock _l(lock);
+        --in_use;
+        if (destroyed)
+        {
+          // destroy() only released the buffers that were not in use
+          const bool should_delete = in_use == 0;
+          _l.unlock();
+          data = {};
+          get_accounting_tag().on_release(buffer_size);
+          if (should_delete)
+            delete this;
+          return;
+        }
+        buffers[index] = std::move(data);
+        add_to_ring((uint16_t)index);
+      }
+
+    private:
+      buffer_ring(io_uring& _uring, io_uring_buf_ring* _br, uint32_t count, size_t size, uint16_t _group_id)
+        : uring(_uring)
+        , br(_br)
+        , buffer_size(size)
+        , buffer_count(count)
+        , group_id(_group_id)
+        , min_available_count(count)
+      {
+        buffers.reserve(count);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+          buffers.push_back(raw_data::allocate(size));
+          get_accounting_tag().on_reserve(size);
+          io_uring_buf_ring_add(br, buffers.back().get(), (unsigned)size, (uint16_t)i, io_uring_buf_ring_mask(count), (int)i);
+        }
+        io_uring_buf_ring_advance(br, (int)count);
+        available.store(count, std::memory_order_relaxed);
+      }
+
+      ~buffer_ring() = default;
+
+      // NOTE: the lock must be held
+      void add_to_ring(uint16_t index)
+      {
+        io_uring_buf_ring_add(br, buffers[index].get(), (unsigned)buffer_size, index, io_uring_buf_ring_mask(buffer_count), 0);
+        io_uring_buf_ring_advance(br, 1);
+        available.fetch_add(1, std::memory_order_relaxed);
+      }
+
+      void update_min_available()
+      {
+        const uint32_t count = available.load(std::memory_order_relaxed);
+        if (count < min_available_count.load(std::memory_order_relaxed))
+          min_available_count.store(count, std::memory_order_relaxed);
+      }
+
+      static memory::accounting::tag& get_accounting_tag()
+      {
+        static memory::accounting::tag& tag = memory::accounting::get_tag("io::buffer_ring");
+        return tag;
+      }
+
+    private:
+      io_uring& uring;
+      io_uring_buf_ring* br;
+      const size_t buffer_size;
+      const uint32_t buffer_count;
+      const uint16_t group_id;
+
+      spinlock lock;
+      std::vector<raw_data> buffers;
+      uint32_t in_use = 0;
+      bool destroyed = false;
+
+      std::atomic<uint32_t> available = 0;
+      std::atomic<uint64_t> exhausted_count = 0;
+      std::atomic<uint32_t> min_available_count;
+  };
+}
@@ -26,12 +26,18 @@
 
 #pragma once
 
+#include <cstring>
+#include <deque>
+
 #include "network_helper.hpp"
 
 namespace neam::io::network
 {
   /// \brief Handle a buffered connection, where data is to be put in a ring-buffer until some kind of event
   /// \note the max memory is allocated. Please multiply this number with the max number of connection to see if it is a risk
+  /// \note With receive watermarks (see connection_t::set_receive_watermarks()), data that does not fit in the ring-buffer is held
+  ///       (and reads are paused above the high watermark) instead of calling on_buffer_full().
+  ///       The content of the ring-buffer + the held data is accounted as inbound data.
   template<typename Child, size_t MaxRingBufferSize = 1024>
   struct ring_buffer_connection_t : public connection_t
   {
@@ -49,49 +55,71 @@ namespace neam::io::network
     /// (default behavior, overridable in the child class)
     void on_read(uint32_t start_offset, uint32_t size) {}
 
+    /// \brief To call when data of read_buffer has been consumed outside of on_read():
+    /// the held data is inserted in the ring-buffer (on_read() is called), and reads resume if the connection is below its watermark.
+    /// \warning Must not be called from on_read(), or concurrently with it
+    void on_read_buffer_consumed()
+    {
+      while (!held_data.empty() && !is_closed())
+      {
+        shared_raw_data& front = held_data.front();
+        const size_t inserted = insert((const uint8_t*)front.get(), front.get_size());
+        held_size -= inserted;
+        if (inserted < front.get_size())
+        {
+          front = front.slice(inserted);
+          break;
+        }
+        held_data.pop_front();
+      }
+      update_inbound_size();
+    }
 
 
     /// \brief Start the async read loop
     /// automatically called when the connection is initiated
     void async_read(cr::token_counter::ref&& tk)
     {
-      queue_multi_receive().then([this, tk = std::move(tk)](raw_data&& rd, bool success, uint32_t read_size) mutable
+      if (is_closed())
+        return;
+      // then() resets the chain, so the one to cancel is the returned one. It is registered first, as the loop can end during then()
+      std::shared_ptr<async::continuation_chain> loop = std::make_shared<async::continuation_chain>();
+      _set_receive_loop([loop] { loop->cancel(); });
+      *loop = ioctx->queue_multi_receive(socket).then([this, tk = std::move(tk)](raw_data&& rd, bool success, size_t read_size) mutable
       {
-        if (!success)
+        if (!success || read_size == 0)
+        {
+          // the receive was canceled because reads are paused: restart it once they resume
+          if (!_on_receive_loop_ended([this, tk = std::move(tk)]() mutable { async_read(std::move(tk)); }))
+            close();
           return;
+        }
 
-        const uint32_t old_offset = read_buffer.size();
-        size_t inserted = read_buffer.push_back((uint8_t*)rd.get(), rd.size);
-
-        uint32_t size_before_on_read = read_buffer.size();
-        static_cast<Child*>(this)->on_read(old_offset, (uint32_t)inserted);
-        uint32_t size_after_on_read = read_buffer.size();
-
-        if (is_closed()) return;
-
-        // Handle the case where we could not insert everything _but_ the on-read made enough space to for part of another entry
-        // (Can happen, in case ReadSize is bigger than MaxBufferSize or when there's an entry close to MaxBufferSize)
-        while (inserted != rd.size)
+        if (held_data.empty())
         {
-          if (size_before_on_read != size_after_on_read)
-          {
-            const uint32_t old_offset = read_buffer.size();
-
-            size_t new_inserted = read_buffer.push_back((uint8_t*)rd.get(), rd.size);
-
-            size_before_on_read = read_buffer.size();
-            static_cast<Child*>(this)->on_read(old_offset, (uint32_t)new_inserted);
-            size_after_on_read = read_buffer.size();
-
-            inserted += new_inserted;
-          }
-          else
+          const size_t inserted = insert((const uint8_t*)rd.get(), rd.size);
+          if (is_closed())
+            return;
+          if (inserted < rd.size)
           {
-            static_cast<Child*>(this)->on_buffer_full();
-            break;
+            if (receive_high_watermark == 0)
+            {
+              static_cast<Child*>(this)->on_buffer_full();
+              return;
+            }
+            held_size += rd.size - inserted;
+            held_data.push_back(shared_raw_data(std::move(rd)).slice(inserted));
           }
-          if (is_closed()) return;
         }
+        else
+        {
+          // keep the order: the new data goes after the held data
+          held_size += rd.size;
+          held_data.push_back(shared_raw_data(std::move(rd)));
+        }
+
+        update_inbound_size();
+        _check_receive_pause();
       });
     }
 
@@ -101,11 +129,46 @@ namespace neam::io::network
       chld.on_connection_setup();
       return true;
     }
+
+  private:
+    /// \brief Insert as much data as possible in the ring-buffer (on_read() can make room for more), return the inserted size
+    size_t insert(const uint8_t* data, size_t size)
+    {
+      size_t inserted = 0;
+      while (inserted < size && !is_closed())
+      {
+        const uint32_t old_offset = read_buffer.size();
+        const size_t count = read_buffer.push_back(data + inserted, size - inserted);
+        if (count == 0)
+          break;
+        inserted += count;
+        static_cast<Child*>(this)->on_read(old_offset, (uint32_t)count);
+      }
+      return inserted;
+    }
+
+    void update_inbound_size()
+    {
+      const size_t current = read_buffer.size() + held_size;
+      if (current > accounted_size)
+        add_inbound_size(current - accounted_size);
+      else if (current < accounted_size)
+        release_inbound_size(accounted_size - current);
+      accounted_size = current;
+    }
+
+  private:
+    // data that did not fit in the ring-buffer (only with receive watermarks)
+    std::deque<shared_raw_data> held_data;
+    size_t held_size = 0;
+    size_t accounted_size = 0;
   };
 
 
   /// \brief Handle connections that are driven by headers (that can infer packet size)
   /// \note Doesn't support parallel/interleaved sends
+  /// \note Headers are not read while the reads are paused (see connection_t::is_receive_paused()):
+  ///       children that hold packets can account for them with add_inbound_size() / release_inbound_size()
   template<typename Child, size_t MaxDataSize = 1024 * 1024>
   struct header_connection_t : public connection_t
   {
@@ -127,6 +190,15 @@ namespace neam::io::network
     {
       if (is_closed())
         return;
+      if (is_receive_paused())
+      {
+        wait_for_receive_capacity().then([this, tk = std::move(tk)](bool success) mutable
+        {
+          if (success)
+            read_packet_header(std::move(tk));
+        });
+        return;
+      }
       queue_full_receive(get_header_size()).then([this, tk = std::move(tk)](raw_data&& rd, bool success, uint32_t) mutable
       {
         if (!success)
@@ -176,5 +248,167 @@ namespace neam::io::network
       return true;
     }
   };
+
+  /// \brief Same as header_connection_t, but parses a stream of multishot receives (one receive for the whole connection)
+  /// All the complete packets of a receive buffer are handled at once. Packets are only copied when they span multiple receive buffers.
+  /// Same Child API as header_connection_t, except on_packet can take the data as a shared_raw_data:
+  ///   void on_packet(const packet_header_t& ph, shared_raw_data&& packet_data)
+  /// in which case packets that fit in a receive buffer are slices of it (no copy).
+  /// \warning Shared packet data holds a buffer of the receive buffer ring: receives stall when all the buffers are held
+  ///          (see context::queue_multi_receive_shared())
+  /// \note Doesn't support parallel/interleaved sends
+  /// \note The receive is canceled while the reads are paused (see connection_t::is_receive_paused()), and restarted once they resume
+  template<typename Child, size_t MaxDataSize = 1024 * 1024>
+  struct streaming_header_connection_t : public connection_t
+  {
+    static constexpr uint32_t get_header_size() { return sizeof(typename Child::packet_header_t); }
+
+    // Child API:
+
+    /// \brief Called when the connection has been completly setup
+    /// (default behavior, overridable in the child class)
+    void on_connection_setup() {}
+
+    // bool is_header_valid(const packet_header_t& ph) { return true; }
+    // uint32_t get_size_of_data_to_read(const packet_header_t& ph) { return ph.size; }
+    // void on_packet(const packet_header_t& ph, raw_data&& packet_data) (or shared_raw_data&&)
+    // void on_packet_oversized(const packet_header_t& ph) {}
+
+
+    /// \brief Start the async read loop
+    /// automatically called when the connection is initiated
+    void async_read(cr::token_counter::ref&& tk)
+    {
+      if (is_closed())
+        return;
+      // then() resets the chain, so the one to cancel is the returned one. It is registered first, as the loop can end during then()
+      std::shared_ptr<async::continuation_chain> loop = std::make_shared<async::continuation_chain>();
+      _set_receive_loop([loop] { loop->cancel(); });
+      *loop = ioctx->queue_multi_receive_shared(socket).then([this, tk = std::move(tk)](shared_raw_data&& data, bool success, size_t read_size) mutable
+      {
+        if (!success || read_size == 0)
+        {
+          // the receive was canceled because reads are paused: restart it once they resume
+          if (!_on_receive_loop_ended([this, tk = std::move(tk)]() mutable { async_read(std::move(tk)); }))
+            close();
+          return;
+        }
+        _parse(std::move(data));
+        _check_receive_pause();
+      });
+    }
+
+    static bool on_connection(Child& chld)
+    {
+      chld.async_read(chld.in_flight_operations.get_token());
+      chld.on_connection_setup();
+      return true;
+    }
+
+    /// \brief Parse a receive buffer: dispatch the complete packets and keep the partial header / body for the next buffer
+    /// (called by the receive loop, can be used to feed the connection from an other source)
+    void _parse(shared_raw_data&& buffer)
+    {
+      using packet_header_t = typename Child::packet_header_t;
+
+      const uint8_t* const ptr = (const uint8_t*)buffer.get();
+      const size_t size = buffer.get_size();
+      size_t offset = 0;
+      while (offset < size && !is_closed())
+      {
+        if (!is_reading_body)
+        {
+          // get the header (from the buffer directly if it's all there):
+          packet_header_t header;
+          if (header_offset == 0 && size - offset >= get_header_size())
+          {
+            memcpy(&header, ptr + offset, get_header_size());
+            offset += get_header_size();
+          }
+          else
+          {
+            if (!header_data)
+              header_data = raw_data::allocate(get_header_size());
+            const size_t count = std::min<size_t>(get_header_size() - header_offset, size - offset);
+            memcpy((uint8_t*)header_data.get() + header_offset, ptr + offset, count);
+            header_offset += (uint32_t)count;
+            offset += count;
+            if (header_offset < get_header_size())
+              return;
+            header_offset = 0;
+            memcpy(&header, header_data.get(), get_header_size());
+          }
+
+          if (!static_cast<Child*>(this)->is_header_valid(header))
+          {
+            close();
+            return;
+          }
+          const uint32_t body_size = static_cast<Child*>(this)->get_size_of_data_to_read(header);
+          if (body_size > MaxDataSize)
+          {
+            static_cast<Child*>(this)->on_packet_oversized(header);
+            close();
+            return;
+          }
+
+          // the whole body is in the buffer: slice it
+          if (size - offset >= body_size)
+          {
+            dispatch_packet(header, buffer.slice(offset, body_size));
+            offset += body_size;
+            continue;
+          }
+
+          // the body spans multiple buffers: reassemble it
+          if (!header_data)
+            header_data = raw_data::allocate(get_header_size());
+          memcpy(header_data.get(), &header, get_header_size());
+          body = raw_data::allocate(body_size);
+          body_offset = 0;
+          is_reading_body = true;
+        }
+
+        const size_t count = std::min<size_t>(body.size - body_offset, size - offset);
+        memcpy((uint8_t*)body.get() + body_offset, ptr + offset, count);
+        body_offset += (uint32_t)count;
+        offset += count;
+        if (body_offset < body.size)
+          return;
+
+        is_reading_body = false;
+        packet_header_t header;
+        memcpy(&header, header_data.get(), get_header_size());
+        dispatch_packet(header, std::move(body));
+      }
+    }
+
+  private:
+    template<typename Header>
+    void dispatch_packet(const Header& header, shared_raw_data&& data)
+    {
+      if constexpr (requires(Child& c) { c.on_packet(header, shared_raw_data{}); })
+        static_cast<Child*>(this)->on_packet(header, std::move(data));
+      else
+        static_cast<Child*>(this)->on_packet(header, data.get_size() > 0 ? raw_data::duplicate(data.get(), data.get_size()) : raw_data{});
+    }
+
+    template<typename Header>
+    void dispatch_packet(const Header& header, raw_data&& data)
+    {
+      if constexpr (requires(Child& c) { c.on_packet(header, shared_raw_data{}); })
+        static_cast<Child*>(this)->on_packet(header, shared_raw_data(std::move(data)));
+      else
+        static_cast<Child*>(this)->on_packet(header, std::move(data));
+    }
+
+  private:
+    // partial header / body (spanning multiple receive buffers):
+    raw_data header_data;
+    uint32_t header_offset = 0;
+    bool is_reading_body = false;
+    raw_data body;
+    uint32_t body_offset = 0;
+  };
 }
 
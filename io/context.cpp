@@ -26,10 +26,14 @@
 
 #include <fcntl.h>
 #include <sys/ioctl.h>
+#include <sys/eventfd.h>
 #include <memory>
 #include <string>
 
+#include <sys/mman.h>
+#include <sys/un.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 
@@ -45,11 +49,112 @@
 namespace neam::io
 {
   context::context(const unsigned _queue_depth)
-    : queue_depth(_queue_depth)
+    : context(ring_config { .queue_depth = _queue_depth })
+  {
+  }
+
+  context::context(const ring_config& config)
+    : queue_depth(config.queue_depth)
+    , direct_io_buffers(std::max(1u, config.direct_io_buffer_count), config.direct_io_buffer_size)
+    , cache(config.block_cache_budget > 0 ? new block_cache(config.block_cache_budget, config.block_cache_block_size) : nullptr)
+    , block_cache_max_read_size(config.block_cache_max_read_size)
+    , recv_buffer_count(config.recv_buffer_count)
+    , recv_buffer_size(config.recv_buffer_size)
+    , shard_index(config.shard_index)
+    , dns_config(config.dns)
+    , max_open_file_count(std::max(1u, config.max_open_file_count))
   {
     signal(SIGPIPE, SIG_IGN); // ignore sigpipe, we handle that with the return value of the syscall
-    check::unx::n_assert_success(io_uring_queue_init(queue_depth, &ring, 0));
+
+    unsigned flags = 0;
+    if (config.completion_queue_depth > 0)
+      flags |= IORING_SETUP_CQSIZE;
+    if (config.sqpoll)
+      flags |= IORING_SETUP_SQPOLL | (config.sqpoll_cpu >= 0 ? IORING_SETUP_SQ_AFF : 0);
+    if (config.single_issuer)
+      flags |= IORING_SETUP_SINGLE_ISSUER;
+    if (config.single_issuer && config.defer_taskrun)
+      flags |= IORING_SETUP_DEFER_TASKRUN;
+    if (config.coop_taskrun)
+      flags |= IORING_SETUP_COOP_TASKRUN;
+
+    // options to drop (in order) when the kernel refuses the setup (newest first)
+    struct fallback_t { unsigned flags; const char* name; };
+    static constexpr fallback_t k_fallbacks[] =
+    {
+      { IORING_SETUP_DEFER_TASKRUN, "defer-taskrun" },
+      { IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN, "single-issuer" },
+      { IORING_SETUP_COOP_TASKRUN, "coop-taskrun" },
+      { IORING_SETUP_SQPOLL | IORING_SETUP_SQ_AFF, "sqpoll" },
+      { IORING_SETUP_CQSIZE, "cq-size" },
+    };
+
+    int ret;
+    for (unsigned i = 0;; ++i)
+    {
+      io_uring_params params;
+      memset(&params, 0, sizeof(params));
+      params.flags = flags;
+      params.cq_entries = config.completion_queue_depth;
+      params.sq_thread_cpu = config.sqpoll_cpu >= 0 ? (unsigned)config.sqpoll_cpu : 0;
+      params.sq_thread_idle = config.sqpoll_idle_ms;
+      ret = io_uring_queue_init_params(queue_depth, &ring, &params);
+
+      // EINVAL: unknown flag / invalid combination, EPERM: sqpoll on old kernels
+      if (ret != -EINVAL && ret != -EPERM)
+        break;
+
+      while (i < std::size(k_fallbacks) && (flags & k_fallbacks[i].flags) == 0)
+        ++i;
+      if (i >= std::size(k_fallbacks))
+        break;
+      cr::out().warn("io::context: failed to create the ring ({}), retrying without {}", strerror(-ret), k_fallbacks[i].name);
+      flags &= ~k_fallbacks[i].flags;
+    }
+    check::unx::n_assert_success(ret);
     check::unx::n_assert_success(io_uring_ring_dontfork(&ring));
+
+    ring_flags = flags;
+    completion_queue_depth = ring.cq.ring_entries;
+
+    wakeup_fd = check::unx::n_assert_success(eventfd(0, EFD_CLOEXEC));
+    if (io_uring_probe* probe = io_uring_get_probe_ring(&ring); probe != nullptr)
+    {
+      has_msg_ring = io_uring_opcode_supported(probe, IORING_OP_MSG_RING);
+      io_uring_free_probe(probe);
+    }
+
+    if (config.registered_file_count > 0)
+    {
+      const int rf_ret = io_uring_register_files_sparse(&ring, config.registered_file_count);
+      if (rf_ret < 0)
+      {
+        cr::out().warn("io::context: failed to create a registered file table of {} entries ({}), registered files are disabled",
+                       config.registered_file_count, strerror(-rf_ret));
+      }
+      else
+      {
+        registered_file_count = config.registered_file_count;
+        free_fixed_file_slots.reserve(registered_file_count);
+        for (unsigned i = registered_file_count; i > 0; --i)
+          free_fixed_file_slots.push_back(i - 1);
+      }
+    }
+
+    if (config.fixed_buffer_count > 0)
+    {
+      fixed_buffers = buffer_pool::create(config.fixed_buffer_count, config.fixed_buffer_size);
+      const std::vector<iovec> iovecs = fixed_buffers->get_iovecs();
+      const int rb_ret = io_uring_register_buffers(&ring, iovecs.data(), (unsigned)iovecs.size());
+      if (rb_ret < 0)
+      {
+        // most likely RLIMIT_MEMLOCK
+        cr::out().warn("io::context: failed to register {} buffers of {} bytes ({}), fixed buffers are disabled",
+                       config.fixed_buffer_count, config.fixed_buffer_size, strerror(-rb_ret));
+        fixed_buffers->destroy();
+        fixed_buffers = nullptr;
+      }
+    }
   }
 
   context::~context()
@@ -57,14 +162,47 @@ namespace neam::io
     // wait pending submissions:
     _wait_for_submit_queries();
 
+    {
+      direct_read_request* rq;
+      while (direct_read_requests.requests.try_pop_front(rq))
+        delete rq;
+    }
+    {
+      file_send_request* rq;
+      while (file_send_requests.requests.try_pop_front(rq))
+      {
+        rq->in_pipe = 1; // don't recycle the pipe
+        release_splice_pipe(*rq);
+        delete rq;
+      }
+    }
+    for (splice_pipe& it : free_splice_pipes)
+    {
+      check::unx::n_check_success(::close(it.fds[0]));
+      check::unx::n_check_success(::close(it.fds[1]));
+    }
+
     // close all opened fd:
     for (auto& it : opened_fd)
       check::unx::n_check_success(::close(it.second.fd));
     for (int it : fd_to_be_closed)
       check::unx::n_check_success(::close(it));
 
+    // stop the resolver threads before closing the fd they use to wake us up
+    resolver.reset();
+    if (wakeup_fd >= 0)
+      check::unx::n_check_success(::close(wakeup_fd));
+
+    // must be done before exiting the ring. Buffers still in use will be freed when their last reference is dropped
+    if (recv_buffers != nullptr)
+      recv_buffers->destroy();
+
     // exit uring
     io_uring_queue_exit(&ring);
+
+    // buffers still in use will be freed when their last reference is dropped
+    if (fixed_buffers != nullptr)
+      fixed_buffers->destroy();
   }
 
   context::read_chain context::queue_read(id_t fid, size_t offset, size_t size)
@@ -73,9 +211,21 @@ namespace neam::io
     check::debug::n_check(fid != id_t::none && fid != id_t::invalid, "Invalid read operation");
 
     if (size == whole_file)
-      size = get_file_size(fid);
-    if (size == k_invalid_file_size)
-      return read_chain::create_and_complete({}, false, 0);
+    {
+      // don't stat the file on the calling thread:
+      return queue_stat(fid).then([this, fid, offset](struct statx&& st, bool success)
+      {
+        const size_t file_size = success ? get_file_size(st) : k_invalid_file_size;
+        if (file_size == k_invalid_file_size || file_size <= offset)
+          return read_chain::create_and_complete({}, file_size != k_invalid_file_size, 0);
+        return queue_read(fid, offset, file_size - offset);
+      });
+    }
+
+    if (const unsigned readahead_window = get_direct_io_window(fid); readahead_window > 0)
+      return queue_direct_read(fid, offset, size, raw_data::allocate(size), 0, readahead_window);
+    if (cache && size <= block_cache_max_read_size)
+      return queue_cached_read(fid, offset, size);
 
     read_chain ret;
     read_requests.add_request({fid, offset, size, {}, 0, ret.create_state()});
@@ -96,11 +246,272 @@ namespace neam::io
     if (size == k_invalid_file_size)
       return read_chain::create_and_complete(std::move(data), false, 0);
 
+    if (const unsigned readahead_window = get_direct_io_window(fid); readahead_window > 0)
+      return queue_direct_read(fid, offset, size, std::move(data), offset_in_data, readahead_window);
+
     read_chain ret;
     read_requests.add_request({fid, offset, size, std::move(data), offset_in_data, ret.create_state()});
     return ret;
   }
 
+  context::read_chain context::queue_direct_read(id_t fid, size_t offset, size_t size, raw_data&& data, uint32_t offset_in_data, unsigned readahead_window)
+  {
+    const size_t alignment = aligned_buffer_pool::get_alignment();
+    direct_read_request* rq = new direct_read_request
+    {
+      .fid = fid,
+      .offset = offset,
+      .size = size,
+      .data = std::move(data),
+      .offset_in_data = offset_in_data,
+      .state = {},
+      .readahead_window = readahead_window,
+      .lock = {},
+      .next_chunk_offset = offset - offset % alignment,
+      .end_offset = ((offset + size + alignment - 1) / alignment) * alignment,
+    };
+
+    read_chain ret;
+    rq->state = ret.create_state();
+    direct_read_requests.add_request(std::move(rq));
+    return ret;
+  }
+
+  context::read_chain context::queue_cached_read(id_t fid, size_t offset, size_t size)
+  {
+    struct cached_read_t
+    {
+      std::atomic<uint32_t> remaining_blocks = 0;
+      spinlock lock;
+      raw_data data;
+      size_t read_size = 0;
+      bool has_failed = false;
+      read_chain::state state;
+    };
+
+    const size_t block_size = cache->get_block_size();
+    const uint64_t first_block = offset / block_size;
+    const uint64_t last_block = (offset + size - 1) / block_size;
+
+    read_chain ret;
+    std::shared_ptr<cached_read_t> rd = std::make_shared<cached_read_t>();
+    rd->remaining_blocks = (uint32_t)(last_block - first_block + 1);
+    rd->data = raw_data::allocate(size);
+    rd->state = ret.create_state();
+
+    for (uint64_t block = first_block; block <= last_block; ++block)
+    {
+      bool should_read;
+      block_cache::block_chain chain = cache->get_block(fid, block, should_read);
+      if (should_read)
+      {
+        // shared read of the whole block, the cache completes all the requests for the block:
+        shared_read_chain read_chain;
+        read_requests.add_request(
+        {
+          .fid = fid,
+          .offset = block * block_size,
+          .size = block_size,
+          .data = {},
+          .offset_in_data = 0,
+          .state = {},
+          .shared_buffer = shared_raw_data::allocate(block_size),
+          .shared_state = read_chain.create_state(),
+        });
+        read_chain.then([this, fid, block](shared_raw_data&& data, bool success, size_t /*read_size*/)
+        {
+          cache->on_block_read(fid, block, std::move(data), success);
+        });
+      }
+
+      chain.then([rd, offset, size, block_offset = block * block_size](shared_raw_data&& block_data, bool success)
+      {
+        {
+          std::lock_guard _l(rd->lock);
+          if (!success)
+          {
+            rd->has_failed = true;
+          }
+          else
+          {
+            // copy the part of the block that was asked for:
+            const size_t start = std::max<size_t>(block_offset, offset);
+            const size_t end = std::min<size_t>(block_offset + block_data.get_size(), offset + size);
+            if (end > start)
+            {
+              memcpy((uint8_t*)rd->data.get() + (start - offset), (const uint8_t*)block_data.get() + (start - block_offset), end - start);
+              rd->read_size += end - start;
+            }
+          }
+        }
+
+        if (rd->remaining_blocks.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+          const bool success = !rd->has_failed;
+          rd->state.complete(std::move(rd->data), success, success ? rd->read_size : 0);
+        }
+      });
+    }
+    return ret;
+  }
+
+  void context::invalidate_cached_blocks(id_t fid, size_t offset, size_t size)
+  {
+    if (!cache)
+      return;
+    // appends and truncating writes (and writes at offset 0 that might truncate the file) invalidate the whole file:
+    if (offset == append || offset == truncate || offset == 0)
+      cache->invalidate(fid);
+    else
+      cache->invalidate(fid, offset, size);
+  }
+
+  void context::set_direct_io(id_t fid, unsigned readahead_window)
+  {
+    {
+      std::lock_guard<spinlock> _ml(mapped_lock);
+      direct_io_files.insert_or_assign(fid, direct_io_file { .readahead_window = std::max(1u, readahead_window) });
+    }
+    // the file has to be re-opened with O_DIRECT:
+    close(fid);
+  }
+
+  void context::clear_direct_io(id_t fid)
+  {
+    {
+      std::lock_guard<spinlock> _ml(mapped_lock);
+      if (direct_io_files.erase(fid) == 0)
+        return;
+    }
+    close(fid);
+  }
+
+  file_view context::map_file_view(id_t fid, size_t offset, size_t size, file_view::advice advice)
+  {
+    check::debug::n_assert(size > 0, "Views of size 0 are invalid");
+    check::debug::n_check(fid != id_t::none && fid != id_t::invalid, "Invalid map operation");
+
+    file_view whole;
+    std::string path;
+    {
+      std::lock_guard<spinlock> _ml(mapped_lock);
+      const auto it = mapped_files.find(fid);
+      if (it == mapped_files.end())
+      {
+        check::debug::n_check(false, "Failed to map {}: file not mapped", fid);
+        return {};
+      }
+      path = it->second;
+      if (const auto vit = file_views.find(fid); vit != file_views.end())
+        whole = vit->second;
+    }
+
+    // not mapped yet, or the view goes past the end of the mapping (the file might have grown):
+    const bool is_past_the_end = whole && (offset >= whole.get_size() || (size != whole_file && offset + size > whole.get_size()));
+    if (!whole || is_past_the_end)
+    {
+      file_view new_whole = map_whole_file(path);
+      if (new_whole && new_whole.get_size() > whole.get_size())
+      {
+        whole = std::move(new_whole);
+        std::lock_guard<spinlock> _ml(mapped_lock);
+        file_views.insert_or_assign(fid, whole);
+      }
+    }
+
+    if (!whole || offset >= whole.get_size())
+      return {};
+
+    file_view ret = whole.slice(offset, size);
+    if (advice != file_view::advice::normal)
+      ret.advise(advice);
+    return ret;
+  }
+
+  file_view context::map_whole_file(const std::string& path)
+  {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+      cr::out().debug("io::context::map_file_view: failed to open `{}`: {}", path, strerror(errno));
+      return {};
+    }
+
+    struct stat st;
+    void* base = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+      base = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      if (base == MAP_FAILED)
+        cr::out().debug("io::context::map_file_view: failed to map `{}`: {}", path, strerror(errno));
+    }
+    // the mapping keeps a reference to the file
+    ::close(fd);
+
+    if (base == MAP_FAILED)
+      return {};
+    return file_view::from_mapping(base, st.st_size);
+  }
+
+  context::prefetch_chain context::queue_prefetch(file_view view)
+  {
+    if (!view || view.get_size() == 0)
+      return prefetch_chain::create_and_complete(false);
+
+    prefetch_chain ret;
+    prefetch_requests.add_request({ std::move(view), ret.create_state() });
+    return ret;
+  }
+
+  unsigned context::get_direct_io_window(id_t fid) const
+  {
+    std::lock_guard<spinlock> _ml(mapped_lock);
+    if (const auto it = direct_io_files.find(fid); it != direct_io_files.end())
+      return it->second.readahead_window;
+    return 0;
+  }
+
+  context::shared_read_chain context::queue_read_fixed(id_t fid, size_t offset, size_t size)
+  {
+    check::debug::n_check(fid != id_t::none && fid != id_t::invalid, "Invalid read operation");
+
+    if (size == whole_file)
+      size = get_file_size(fid);
+    if (size == k_invalid_file_size || size == 0)
+      return shared_read_chain::create_and_complete({}, false, 0);
+
+    shared_raw_data buffer;
+    if (fixed_buffers != nullptr && size <= fixed_buffers->get_buffer_size())
+      buffer = fixed_buffers->acquire();
+    if (!buffer)
+      buffer = shared_raw_data::allocate(size);
+
+    shared_read_chain ret;
+    read_requests.add_request(
+    {
+      .fid = fid,
+      .offset = offset,
+      .size = size,
+      .data = {},
+      .offset_in_data = 0,
+      .state = {},
+      .shared_buffer = std::move(buffer),
+      .shared_state = ret.create_state(),
+    });
+    return ret;
+  }
+
+  static size_t get_segments_size(const std::vector<shared_raw_data>& segments)
+  {
+    size_t size = 0;
+    for (const auto& it : segments)
+    {
+      check::debug::n_assert(!!it && it.get_size() > 0, "Invalid segment");
+      size += it.get_size();
+    }
+    return size;
+  }
+
   context::write_chain context::queue_write(id_t fid, size_t offset, raw_data&& data, uint32_t offset_in_data, uint32_t size_to_write)
   {
     check::debug::n_check(data.size > 0, "Writes of size 0 are invalid");
@@ -112,11 +523,132 @@ namespace neam::io
       size_to_write = data.size - offset_in_data;
     size_to_write = std::min((uint32_t)data.size - offset_in_data, size_to_write);
 
+    invalidate_cached_blocks(fid, offset, size_to_write);
+
     write_chain ret;
     write_requests.add_request({fid, offset, std::move(data), offset_in_data, size_to_write, ret.create_state()});
     return ret;
   }
 
+  context::write_chain context::queue_write(id_t fid, size_t offset, std::vector<shared_raw_data>&& segments)
+  {
+    check::debug::n_check(fid != id_t::none && fid != id_t::invalid, "Invalid write operation");
+    check::debug::n_assert(segments.size() <= k_max_iovec_merge, "Invalid segment count ({})", segments.size());
+    if (segments.empty())
+      return write_chain::create_and_complete({}, false, 0);
+    const size_t size = get_segments_size(segments);
+    invalidate_cached_blocks(fid, offset, size);
+
+    write_chain ret;
+    write_requests.add_request({fid, offset, {}, 0, (uint32_t)std::min<size_t>(size, ~uint32_t(0)), ret.create_state(), std::move(segments)});
+    return ret;
+  }
+
+  context::sync_chain context::queue_fsync(id_t fid, bool datasync)
+  {
+    check::debug::n_check(fid != id_t::none && fid != id_t::invalid, "Invalid fsync operation");
+    if (fid == id_t::none || fid == id_t::invalid)
+      return sync_chain::create_and_complete(false);
+
+    sync_chain ret;
+    sync_requests.add_request({fid, datasync, ret.create_state()});
+    return ret;
+  }
+
+  context::write_chain context::queue_write_durable(id_t fid, size_t offset, raw_data&& data, uint32_t offset_in_data, uint32_t size_to_write)
+  {
+    struct durable_write_t
+    {
+      raw_data data = {};
+      size_t write_size = 0;
+      bool write_success = false;
+      bool sync_success = false;
+
+      void on_write(raw_data&& _data, bool success, size_t size)
+      {
+        data = std::move(_data);
+        write_success = success;
+        write_size = size;
+      }
+      void on_sync(bool success) { sync_success = success; }
+    };
+
+    write_chain write = queue_write(fid, offset, std::move(data), offset_in_data, size_to_write);
+    sync_chain sync = queue_fsync(fid, true);
+    return async::multi_chain(durable_write_t{}, [](durable_write_t& st, auto&&... args)
+    {
+      if constexpr (sizeof...(args) == 3)
+        st.on_write(std::forward<decltype(args)>(args)...);
+      else
+        st.on_sync(args...);
+    }, std::move(write), std::move(sync))
+    .then([](durable_write_t&& st)
+    {
+      const bool success = st.write_success && st.sync_success;
+      return write_chain::create_and_complete(std::move(st.data), success, success ? st.write_size : 0);
+    });
+  }
+
+  context::sync_chain context::queue_atomic_replace(id_t fid, raw_data&& data)
+  {
+    std::string path;
+    {
+      std::lock_guard<spinlock> _ml(mapped_lock);
+      if (auto it = mapped_files.find(fid); it != mapped_files.end())
+        path = it->second;
+    }
+    if (path.empty())
+    {
+      check::debug::n_check(false, "io::context::queue_atomic_replace: {}: file not mapped", fid);
+      return sync_chain::create_and_complete(false);
+    }
+
+    const size_t size = data.size;
+    std::string tmp_path = path + ".tmp";
+    const id_t tmp_fid = map_unprefixed_file(tmp_path);
+    return queue_write_durable(tmp_fid, truncate, std::move(data))
+    .then([this, fid, tmp_fid, size, path = std::move(path), tmp_path = std::move(tmp_path)](raw_data&&, bool success, size_t write_size)
+    {
+      close(tmp_fid);
+      unmap_file(tmp_fid);
+      if (!success || write_size != size)
+      {
+        cr::out().warn("io::context::queue_atomic_replace: failed to write {}", tmp_path);
+        return queue_unlink(tmp_path).then([](bool) { return false; });
+      }
+
+      // rename only touches metadata (the data of the temporary file is already on the disk)
+      return queue_rename(tmp_path, path).then([this, fid, path, tmp_path](bool renamed)
+      {
+        if (!renamed)
+        {
+          cr::out().warn("io::context::queue_atomic_replace: failed to rename {} to {}", tmp_path, path);
+          return queue_unlink(tmp_path).then([](bool) { return false; });
+        }
+
+        // the fd of the file (and the cached blocks) are those of the old content:
+        close(fid);
+        invalidate_cached_blocks(fid, 0, whole_file);
+
+        // the rename is only durable once the directory is flushed:
+        std::string directory = std::filesystem::path(path).parent_path().string();
+        if (directory.empty())
+          directory = ".";
+        const bool is_directory_mapped = is_file_mapped(get_file_id(directory));
+        const id_t dir_fid = map_unprefixed_file(std::move(directory));
+        return queue_fsync(dir_fid).then([this, dir_fid, is_directory_mapped](bool sync_success)
+        {
+          if (!is_directory_mapped)
+          {
+            close(dir_fid);
+            unmap_file(dir_fid);
+          }
+          return sync_success;
+        });
+      });
+    });
+  }
+
   std::string context::get_string_for_id(id_t fid) const
   {
     if (fid == id_t::invalid)
@@ -127,9 +659,9 @@ namespace neam::io
     if (u64id & k_external_id_flag)
     {
       const auto fd = std::bit_cast<file_descriptor>(fid);
-      return fmt::format("external:[fd: {} | type: {}{}{} | caps: {}{}{}]",
+      return fmt::format("external:[fd: {} | type: {}{}{}{} | caps: {}{}{}]",
                                      fd.fd,
-                                     fd.socket ? "s" : "", fd.pipe ? "p" : "", fd.file ? "f" : "",
+                                     fd.socket ? "s" : "", fd.pipe ? "p" : "", fd.file ? "f" : "", fd.local ? "l" : "",
                                      fd.read ? "r" : "", fd.write ? "w" : "", fd.accept ? "a" : "");
     }
     {
@@ -211,6 +743,43 @@ namespace neam::io
     return c > m ? c : m;
   }
 
+  size_t context::get_file_size(const struct statx& st)
+  {
+    if (!S_ISREG(st.stx_mode))
+      return k_invalid_file_size;
+    return st.stx_size;
+  }
+
+  std::filesystem::file_time_type context::get_modified_or_created_time(const struct statx& st)
+  {
+    std::filesystem::file_time_type m = timespec_to_fstime({ .tv_sec = st.stx_mtime.tv_sec, .tv_nsec = st.stx_mtime.tv_nsec });
+    std::filesystem::file_time_type c = timespec_to_fstime({ .tv_sec = st.stx_ctime.tv_sec, .tv_nsec = st.stx_ctime.tv_nsec });
+    return c > m ? c : m;
+  }
+
+  context::stat_chain context::queue_stat(id_t fid)
+  {
+    check::debug::n_check(fid != id_t::none && fid != id_t::invalid, "Invalid stat operation");
+
+    stat_chain ret;
+    stat_requests.add_request({ fid, ret.create_state() });
+    return ret;
+  }
+
+  context::sync_chain context::queue_rename(std::string path, std::string new_path)
+  {
+    sync_chain ret;
+    path_requests.add_request({ std::move(path), std::move(new_path), ret.create_state() });
+    return ret;
+  }
+
+  context::sync_chain context::queue_unlink(std::string path)
+  {
+    sync_chain ret;
+    path_requests.add_request({ std::move(path), {}, ret.create_state() });
+    return ret;
+  }
+
   void context::force_close_all_fd(bool include_sockets)
   {
     // read then write
@@ -228,6 +797,11 @@ namespace neam::io
       else
         opened_fd.emplace_hint(opened_fd.end(), it.first, it.second);
     }
+    file_lru.clear();
+    file_lru_entries.clear();
+    // opens in flight will be closed on completion:
+    opening_files.clear();
+    failed_opens.clear();
   }
 
   void context::clear_mapped_files()
@@ -236,6 +810,8 @@ namespace neam::io
     std::lock_guard<spinlock> _ml(mapped_lock);
     neam::cr::out().debug("io::context: forcefully clearing all mapped files ({})", mapped_files.size());
     mapped_files.clear();
+    direct_io_files.clear();
+    file_views.clear();
   }
 
 
@@ -280,6 +856,7 @@ namespace neam::io
   {
     // create an ID for the socket
 //     const id_t id = (id_t)(k_external_id_flag | fd.fd);
+    fd.shard_index = shard_index;
     const id_t id = (id_t)(k_external_id_flag | reinterpret_cast<uint64_t&>(fd));
 
     std::lock_guard<spinlock> _sl(fd_lock);
@@ -289,15 +866,17 @@ namespace neam::io
         return id;
     }
     opened_fd.insert_or_assign(id, fd);
+    register_fixed_file(fd.fd);
 
     return id;
   }
 
-  id_t context::register_socket(int fd, bool accept)
+  id_t context::register_socket(int fd, bool accept, bool local)
   {
     return register_fd({
       .fd = fd,
       .socket = true,
+      .local = local,
 
       .read = !accept,
       .write = !accept,
@@ -399,6 +978,24 @@ namespace neam::io
     return ret;
   }
 
+  context::shared_read_chain context::queue_multi_receive_shared(id_t fid)
+  {
+    shared_read_chain ret;
+    recv_requests.add_request(
+    {
+      .fid = fid,
+      .sock_fd = _get_fd(fid),
+      .data = {},
+      .offset_in_data = 0,
+      .size_to_recv = 0,
+      .wait_all = false,
+      .multishot = true,
+      .state = {},
+      .shared_state = ret.create_state(true),
+    });
+    return ret;
+  }
+
   context::write_chain context::queue_send(id_t fid, raw_data&& data, uint32_t offset_in_data, size_t size)
   {
     check::debug::n_assert(!!data.data, "Invalid data");
@@ -445,13 +1042,221 @@ namespace neam::io
     return ret;
   }
 
-  void context::close(id_t fid)
+  context::write_chain context::queue_send(id_t fid, shared_raw_data data)
   {
-    std::lock_guard<spinlock> _sl(fd_lock);
-    _unlocked_close(fid);
+    std::vector<shared_raw_data> segments;
+    segments.push_back(std::move(data));
+    return queue_send(fid, std::move(segments));
   }
 
-  void context::_unlocked_close(id_t fid)
+  context::write_chain context::queue_full_send(id_t fid, shared_raw_data data)
+  {
+    std::vector<shared_raw_data> segments;
+    segments.push_back(std::move(data));
+    return queue_full_send(fid, std::move(segments));
+  }
+
+  context::write_chain context::queue_send(id_t fid, std::vector<shared_raw_data>&& segments)
+  {
+    check::debug::n_assert(!segments.empty() && segments.size() <= k_max_iovec_merge, "Invalid segment count ({})", segments.size());
+    check::debug::n_check(fid != id_t::none && fid != id_t::invalid, "Invalid send operation");
+
+    write_chain ret;
+    const size_t size = get_segments_size(segments);
+    send_requests.add_request(
+    {
+      .fid = fid,
+      .sock_fd = _get_fd(fid),
+      .segments = std::move(segments),
+      .offset_in_data = 0,
+      .size_to_send = size,
+      .wait_all = false,
+      .state = ret.create_state()
+    });
+    return ret;
+  }
+
+  context::write_chain context::queue_full_send(id_t fid, std::vector<shared_raw_data>&& segments)
+  {
+    check::debug::n_assert(!segments.empty() && segments.size() <= k_max_iovec_merge, "Invalid segment count ({})", segments.size());
+    check::debug::n_check(fid != id_t::none && fid != id_t::invalid, "Invalid full-send operation");
+
+    write_chain ret;
+    const size_t size = get_segments_size(segments);
+    send_requests.add_request(
+    {
+      .fid = fid,
+      .sock_fd = _get_fd(fid),
+      .segments = std::move(segments),
+      .offset_in_data = 0,
+      .size_to_send = size,
+      .wait_all = true,
+      .state = ret.create_state()
+    });
+    return ret;
+  }
+
+  context::write_chain context::queue_send_fds(id_t fid, std::vector<int> fds, shared_raw_data data)
+  {
+    check::debug::n_assert(!fds.empty() && fds.size() <= k_max_passed_fd_count, "Invalid fd count ({})", fds.size());
+    check::debug::n_check(fid != id_t::none && fid != id_t::invalid, "Invalid send operation");
+
+    if (data.get_size() == 0)
+    {
+      // the fds must be sent with at least a byte:
+      raw_data byte = raw_data::allocate(1);
+      *(uint8_t*)byte.get() = 0;
+      data = shared_raw_data(std::move(byte));
+    }
+
+    write_chain ret;
+    const size_t size = data.get_size();
+    std::vector<shared_raw_data> segments;
+    segments.push_back(std::move(data));
+    send_requests.add_request(
+    {
+      .fid = fid,
+      .sock_fd = _get_fd(fid),
+      .segments = std::move(segments),
+      .offset_in_data = 0,
+      .size_to_send = size,
+      .wait_all = true,
+      .state = ret.create_state(),
+      .fds = std::move(fds),
+    });
+    return ret;
+  }
+
+  context::fd_read_chain context::queue_receive_fds(id_t fid, size_t size)
+  {
+    check::debug::n_assert(size > 0 && size != everything, "Invalid size for a receive with fd passing");
+    check::debug::n_check(fid != id_t::none && fid != id_t::invalid, "Invalid receive operation");
+
+    fd_read_chain ret;
+    recv_requests.add_request(
+    {
+      .fid = fid,
+      .sock_fd = _get_fd(fid),
+      .data = {},
+      .offset_in_data = 0,
+      .size_to_recv = size,
+      .wait_all = false,
+      .multishot = false,
+      .state = {},
+      .fd_state = ret.create_state(),
+    });
+    return ret;
+  }
+
+  context::datagram_chain context::queue_multi_receive_datagrams(id_t fid)
+  {
+    check::debug::n_check(fid != id_t::none && fid != id_t::invalid, "Invalid datagram receive operation");
+
+    datagram_chain ret;
+    recv_requests.add_request(
+    {
+      .fid = fid,
+      .sock_fd = _get_fd(fid),
+      .data = {},
+      .offset_in_data = 0,
+      .size_to_recv = 0,
+      .wait_all = false,
+      .multishot = true,
+      .state = {},
+      .shared_state = {},
+      .datagram_state = ret.create_state(true),
+    });
+    return ret;
+  }
+
+  context::write_chain context::queue_send_datagram(id_t fid, const dns_resolver::address& destination, shared_raw_data data)
+  {
+    check::debug::n_check(fid != id_t::none && fid != id_t::invalid, "Invalid datagram send operation");
+
+    write_chain ret;
+    const size_t size = data.get_size();
+    std::vector<shared_raw_data> segments;
+    segments.push_back(std::move(data));
+    send_requests.add_request(
+    {
+      .fid = fid,
+      .sock_fd = _get_fd(fid),
+      .segments = std::move(segments),
+      .offset_in_data = 0,
+      .size_to_send = size,
+      .wait_all = false,
+      .state = ret.create_state(),
+      .is_datagram = true,
+      .gso_size = 0,
+      .destination = destination,
+    });
+    return ret;
+  }
+
+  context::write_chain context::queue_send_datagrams(id_t fid, const dns_resolver::address& destination, std::vector<shared_raw_data>&& datagrams)
+  {
+    check::debug::n_assert(!datagrams.empty(), "Invalid datagram count (0)");
+    if (datagrams.size() == 1)
+      return queue_send_datagram(fid, destination, std::move(datagrams.front()));
+
+    // GSO: all the datagrams must have the same size, except the last one which can be smaller
+    const size_t total_size = get_segments_size(datagrams);
+    const size_t segment_size = datagrams.front().get_size();
+    bool can_use_gso = has_udp_gso() && datagrams.size() <= k_max_gso_segment_count && total_size <= k_max_gso_batch_size && segment_size > 0;
+    for (size_t i = 1; can_use_gso && i < datagrams.size(); ++i)
+    {
+      const size_t size = datagrams[i].get_size();
+      can_use_gso = (i + 1 < datagrams.size()) ? size == segment_size : (size > 0 && size <= segment_size);
+    }
+
+    if (can_use_gso)
+    {
+      write_chain ret;
+      send_requests.add_request(
+      {
+        .fid = fid,
+        .sock_fd = _get_fd(fid),
+        .segments = std::move(datagrams),
+        .offset_in_data = 0,
+        .size_to_send = total_size,
+        .wait_all = false,
+        .state = ret.create_state(),
+        .is_datagram = true,
+        .gso_size = (uint16_t)segment_size,
+        .destination = destination,
+      });
+      return ret;
+    }
+
+    // one sendmsg per datagram:
+    struct send_status
+    {
+      bool success = true;
+      size_t size = 0;
+    };
+    std::vector<write_chain> chains;
+    chains.reserve(datagrams.size());
+    for (shared_raw_data& it : datagrams)
+      chains.push_back(queue_send_datagram(fid, destination, std::move(it)));
+    return async::multi_chain(send_status{}, std::move(chains), [](send_status& status, raw_data&& /*data*/, bool success, size_t size)
+    {
+      status.success = status.success && success;
+      if (success)
+        status.size += size;
+    })
+    .then([](send_status&& status)
+    {
+      return write_chain::create_and_complete({}, status.success, status.success ? status.size : 0);
+    });
+  }
+
+  void context::close(id_t fid)
+  {
+    std::lock_guard<spinlock> _sl(fd_lock);
+    _unlocked_close(fid);
+  }
+
+  void context::_unlocked_close(id_t fid)
   {
     const auto it = opened_fd.find(fid);
     if (it == opened_fd.end())
@@ -459,6 +1264,9 @@ namespace neam::io
     const int fd = it->second.fd;
     opened_fd.erase(it);
     fd_to_be_closed.insert(fd);
+    remove_from_file_lru(fid);
+    if (operation_timeout_count.load(std::memory_order_acquire) > 0)
+      clear_operation_timeout(fid);
   }
 
   id_t context::create_listening_socket(uint16_t port, uint32_t listen_addr, uint16_t backlog_connection_count)
@@ -552,6 +1360,234 @@ namespace neam::io
     return id;
   }
 
+  bool context::reset_socket(int fd)
+  {
+    int domain = AF_UNSPEC;
+    int type = 0;
+    int protocol = 0;
+    socklen_t len = sizeof(int);
+    if (check::unx::n_check_success(getsockopt(fd, SOL_SOCKET, SO_DOMAIN, &domain, &len)) < 0)
+      return false;
+    len = sizeof(int);
+    if (check::unx::n_check_success(getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len)) < 0)
+      return false;
+    len = sizeof(int);
+    if (check::unx::n_check_success(getsockopt(fd, SOL_SOCKET, SO_PROTOCOL, &protocol, &len)) < 0)
+      return false;
+
+    int v6_only = 0;
+    len = sizeof(int);
+    if (domain == AF_INET6)
+      check::unx::n_check_success(getsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6_only, &len));
+
+    const int sock = check::unx::n_check_success(socket(domain, type, protocol));
+    if (sock == -1)
+      return false;
+    if (domain == AF_INET6)
+      check::unx::n_check_success(setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, &v6_only, sizeof(v6_only)));
+
+    // the registered slot holds a reference to the old socket:
+    unregister_fixed_file(fd);
+    // atomically closes the old socket, so the fd (and the id) stays valid
+    const int res = check::unx::n_check_success(dup2(sock, fd));
+    ::close(sock);
+    register_fixed_file(fd);
+    return res == fd;
+  }
+
+  bool context::get_unix_address(std::string_view path, dns_resolver::address& out)
+  {
+    memset(&out, 0, sizeof(out));
+    sockaddr_un* const addr = (sockaddr_un*)&out.addr;
+    // abstract names are not null-terminated, paths are:
+    const bool is_abstract = !path.empty() && path.front() == '@';
+    if (path.empty() || path.size() + (is_abstract ? 0 : 1) > sizeof(addr->sun_path))
+    {
+      cr::out().warn("io::context: invalid unix socket path: {}", path);
+      return false;
+    }
+    addr->sun_family = AF_UNIX;
+    memcpy(addr->sun_path, path.data(), path.size());
+    if (is_abstract)
+      addr->sun_path[0] = 0;
+    out.len = (socklen_t)(offsetof(sockaddr_un, sun_path) + path.size() + (is_abstract ? 0 : 1));
+    return true;
+  }
+
+  id_t context::create_unix_listening_socket(std::string_view path, bool seqpacket, uint16_t backlog_connection_count)
+  {
+    dns_resolver::address addr;
+    if (!get_unix_address(path, addr))
+      return id_t::invalid;
+
+    const int sock = check::unx::n_check_success(socket(PF_UNIX, seqpacket ? SOCK_SEQPACKET : SOCK_STREAM, 0));
+    if (sock == -1)
+      return id_t::invalid;
+    const id_t id = register_socket(sock, true, true);
+
+    // remove a stale socket file (bind fails otherwise):
+    if (path.front() != '@')
+    {
+      const std::string str_path(path);
+      struct stat st;
+      if (::stat(str_path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+        check::unx::n_check_success(unlink(str_path.c_str()));
+    }
+
+    if (check::unx::n_check_success(bind(sock, addr.get_sockaddr(), addr.len)) < 0)
+    {
+      close(id);
+      return id_t::invalid;
+    }
+    if (check::unx::n_check_success(listen(sock, backlog_connection_count)) < 0)
+    {
+      close(id);
+      return id_t::invalid;
+    }
+
+    return id;
+  }
+
+  id_t context::create_unix_socket(bool seqpacket)
+  {
+    const int sock = check::unx::n_check_success(socket(PF_UNIX, seqpacket ? SOCK_SEQPACKET : SOCK_STREAM, 0));
+    if (sock == -1)
+      return id_t::invalid;
+    return register_socket(sock, false, true);
+  }
+
+  context::connect_chain context::queue_connect_unix(id_t fid, std::string_view path)
+  {
+    dns_resolver::address addr;
+    if (!get_unix_address(path, addr))
+      return connect_chain::create_and_complete(false);
+
+    // already resolved, so the connect skips the resolver:
+    connect_chain ret;
+    connect_requests.add_request(
+    {
+      .fid = fid,
+      .sock_fd = _get_fd(fid),
+      .addr = std::string(path),
+      .port = 0,
+      .state = ret.create_state(),
+      .addresses = { addr },
+      .address_index = 0,
+      .is_resolved = true,
+    });
+    return ret;
+  }
+
+  bool context::create_socket_pair(id_t& a, id_t& b, bool seqpacket)
+  {
+    int fds[2] = { -1, -1 };
+    if (check::unx::n_check_success(socketpair(AF_UNIX, (seqpacket ? SOCK_SEQPACKET : SOCK_STREAM) | SOCK_CLOEXEC, 0, fds)) < 0)
+      return false;
+
+    a = register_socket(fds[0], false, true);
+    b = register_socket(fds[1], false, true);
+    return true;
+  }
+
+  int context::create_shared_memory_fd(const char* name, size_t size)
+  {
+    const int fd = check::unx::n_check_success(memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING));
+    if (fd < 0)
+      return -1;
+    if (check::unx::n_check_success(ftruncate(fd, (off_t)size)) < 0)
+    {
+      ::close(fd);
+      return -1;
+    }
+    return fd;
+  }
+
+  id_t context::create_udp_socket(uint16_t port, uint32_t bind_addr)
+  {
+    const int sock = check::unx::n_check_success(socket(PF_INET, SOCK_DGRAM, 0));
+    if (sock == -1)
+      return id_t::invalid;
+    const id_t id = register_socket(sock, false);
+
+    if (port != 0)
+    {
+      int enable = 1;
+      check::unx::n_check_success(setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(int)));
+      check::unx::n_check_success(setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(int)));
+    }
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(bind_addr);
+
+    if (check::unx::n_check_success(bind(sock, (const struct sockaddr*)&addr, sizeof(addr))) < 0)
+    {
+      close(id);
+      return id_t::invalid;
+    }
+
+    probe_udp_gso(sock);
+    return id;
+  }
+
+  id_t context::create_udp_socket(uint16_t port, const ipv6& ip, bool allow_ipv4)
+  {
+    const int sock = check::unx::n_check_success(socket(PF_INET6, SOCK_DGRAM, 0));
+    if (sock == -1)
+      return id_t::invalid;
+    const id_t id = register_socket(sock, false);
+
+    if (port != 0)
+    {
+      int enable = 1;
+      check::unx::n_check_success(setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(int)));
+      check::unx::n_check_success(setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(int)));
+    }
+    {
+      int enable = allow_ipv4 ? 0 /* allow ipv4 */ : 1 /* only ipv6 */;
+      check::unx::n_check_success(setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, &enable, sizeof(int)));
+    }
+
+    sockaddr_in6 addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin6_family = AF_INET6;
+    addr.sin6_port = htons(port);
+    memcpy(addr.sin6_addr.s6_addr, ip.addr, sizeof(ip.addr));
+
+    if (check::unx::n_check_success(bind(sock, (const struct sockaddr*)&addr, sizeof(addr))) < 0)
+    {
+      close(id);
+      return id_t::invalid;
+    }
+
+    probe_udp_gso(sock);
+    return id;
+  }
+
+  void context::probe_udp_gso(int sock)
+  {
+    // kernels without UDP_SEGMENT (< 4.18) don't know the option:
+    int value = 0;
+    socklen_t len = sizeof(value);
+    has_udp_gso_support.store(getsockopt(sock, SOL_UDP, UDP_SEGMENT, &value, &len) == 0, std::memory_order_relaxed);
+  }
+
+  bool context::set_udp_gro(id_t sid, bool enable)
+  {
+    const int sock = _get_fd(sid);
+    if (sock < 0)
+      return false;
+    int value = enable ? 1 : 0;
+    if (setsockopt(sock, SOL_UDP, UDP_GRO, &value, sizeof(value)) < 0)
+    {
+      cr::out().debug("io::context: UDP_GRO is not supported on {}: {}", get_string_for_id(sid), strerror(errno));
+      return false;
+    }
+    return true;
+  }
+
   bool context::create_pipe(id_t& read, id_t& write)
   {
     int pipe_fds[2] = { -1, -1 };
@@ -584,6 +1620,11 @@ namespace neam::io
 
 
   void context::process()
+  {
+    process_internal(true);
+  }
+
+  void context::process_internal(bool submit)
   {
     // Avoid both re-entering and concurrency on that function
     if (!process_lock.try_lock())
@@ -592,24 +1633,8 @@ namespace neam::io
 
     process_completed_queries();
 
-    // we move all the opened files to the to_close list, so that next time we attempt to close them too
-    {
-      std::lock_guard<spinlock> _fdl(fd_lock);
-      std::vector<id_t> to_remove;
-      bool had_files = !opened_fd.empty();
-      for (auto& it : opened_fd)
-      {
-        if (it.second.file && (it.second.counter++) >= k_max_cycle_to_close)
-        {
-          fd_to_be_closed.insert(it.second.fd);
-          to_remove.push_back(it.first);
-        }
-      }
-      for (const id_t id : to_remove)
-        opened_fd.erase(id);
-      if (had_files && opened_fd.empty())
-        cr::out().debug("io::context: all opened fd are now closed");
-    }
+    // timed-out queries are canceled with the other cancels:
+    process_expired_deadlines();
 
     // It may call process_completed_queries() when needed
     {
@@ -620,8 +1645,12 @@ namespace neam::io
 
     {
       if (!queue_close_operations_fd())
-        return; // failed to perform the close operations, submit queue is full
-    }
+      {
+        // failed to perform the close operations, submit queue is full
+        submit_pending_operations();
+        return;
+      }
+    }
 
     // remove the close queries from the results:
     // (close queries are completed inline)
@@ -633,6 +1662,15 @@ namespace neam::io
     queue_connect_operations();
     queue_recv_operations();
     queue_send_operations();
+    queue_stat_operations();
+    queue_path_operations();
+    queue_direct_read_operations();
+    queue_file_send_operations();
+    queue_prefetch_operations();
+
+    // submit everything at once (if the caller is about to wait, it will submit them in the same syscall as the wait)
+    if (submit)
+      submit_pending_operations();
 
     process_completed_queries();
 
@@ -647,9 +1685,13 @@ namespace neam::io
       return;
     std::lock_guard<spinlock> _cl(completion_lock, std::adopt_lock);
 
+    // with defer-taskrun, the completions are only posted when explicitly asked for:
+    if ((ring_flags & IORING_SETUP_DEFER_TASKRUN) != 0)
+      io_uring_get_events(&ring);
+
     // batch process the completion queue:
-    io_uring_cqe* cqes[queue_depth * 2];
-    const unsigned completed_count = io_uring_peek_batch_cqe(&ring, cqes, queue_depth * 2);
+    io_uring_cqe* cqes[completion_queue_depth];
+    const unsigned completed_count = io_uring_peek_batch_cqe(&ring, cqes, completion_queue_depth);
 
     if (completed_count > 0)
       cr::out().debug("process_completed_queries: {} completed queries", completed_count);
@@ -666,13 +1708,14 @@ namespace neam::io
       return;
     std::lock_guard<spinlock> _cl(completion_lock, std::adopt_lock);
 
-    // Send the remaining queries
-    process();
+    // Prepare the remaining queries
+    process_internal(false);
 
     unsigned count = 0;
     // wat for everything to be done
     while (has_in_flight_operations())
     {
+      submit_pending_operations(true);
       io_uring_cqe* cqe;
       check::unx::n_check_success(io_uring_wait_cqe(&ring, &cqe));
       process_completed_query(cqe);
@@ -680,11 +1723,12 @@ namespace neam::io
       ++count;
 
       // Just in case the callback added new stuff to process:
-      process();
+      process_internal(false);
 
       if (!wait_for_everything)
         break;
     }
+    submit_pending_operations();
   }
 
   void context::_wait_for_queries()
@@ -693,7 +1737,7 @@ namespace neam::io
       return;
     std::lock_guard<spinlock> _cl(completion_lock, std::adopt_lock);
 
-    process();
+    process_internal(false);
 
     // try to process everything
     process_completed_queries();
@@ -701,10 +1745,16 @@ namespace neam::io
     // wait for the remaining in-flight stuff
     if (has_in_flight_operations() && !has_pending_operations())
     {
+      // submit + wait in a single syscall:
+      submit_pending_operations(true);
       io_uring_cqe* cqe;
       check::unx::n_check_success(io_uring_wait_cqe(&ring, &cqe));
       process_completed_query(cqe);
     }
+    else
+    {
+      submit_pending_operations();
+    }
   }
 
 
@@ -713,12 +1763,24 @@ namespace neam::io
     // cleanup the remaining allocated memory / call destructors
     for (unsigned i = 0; i < iovec_count; ++i)
     {
-      if (iovecs[i].iov_base != nullptr)
+      if (shared_data != nullptr)
+        shared_data[i].~shared_raw_data();
+      else if (iovecs[i].iov_base != nullptr)
         raw_data::free_allocated_raw_memory((void*)((uint8_t*)iovecs[i].iov_base - *get_data_offset_for_iovec(i)));
       if (type == type_t::read || type == type_t::recv)
         read_states[i].~state();
+      else if (type == type_t::read_shared || type == type_t::recv_shared)
+        shared_read_state[i].~state();
       else if (type == type_t::write || type == type_t::send)
         write_states[i].~state();
+      else if (type == type_t::recv_datagram)
+        datagram_state[i].~state();
+      else if (type == type_t::recv_fds)
+        fd_read_state[i].~state();
+    }
+    if (has_msg_op)
+    {
+      delete msg_op;
     }
     if (type == type_t::accept)
     {
@@ -727,10 +1789,43 @@ namespace neam::io
     else if (type == type_t::connect)
     {
       connect_state->~state();
+      delete connect_rq;
+    }
+    else if (type == type_t::stat)
+    {
+      stat_state->~state();
+      delete file_op;
+    }
+    else if (type == type_t::open)
+    {
+      delete file_op;
+    }
+    else if (type == type_t::read_direct)
+    {
+      delete direct_chunk;
+    }
+    else if (type == type_t::splice)
+    {
+      delete splice_chunk;
+    }
+    else if (type == type_t::madvise)
+    {
+      prefetch_state->~state();
+      delete view;
+    }
+    else if (type == type_t::fsync)
+    {
+      for (unsigned i = 0; i < iovec_count; ++i)
+        sync_states[i].~state();
+    }
+    else if (type == type_t::rename || type == type_t::unlink)
+    {
+      sync_states[0].~state();
+      delete file_op;
     }
   }
 
-  context::query* context::query::allocate(id_t fid, type_t t, unsigned iovec_count)
+  context::query* context::query::allocate(id_t fid, type_t t, unsigned iovec_count, bool with_shared_data)
   {
     size_t callback_size = 0;
     switch (t)
@@ -743,17 +1838,57 @@ namespace neam::io
 
       case type_t::accept: callback_size = sizeof(accept_chain::state); break;
       case type_t::connect: callback_size = sizeof(connect_chain::state); break;
+
+      case type_t::recv_shared: [[fallthrough]];
+      case type_t::read_shared: callback_size = sizeof(shared_read_chain::state); break;
+      case type_t::recv_datagram: callback_size = sizeof(datagram_chain::state); break;
+      case type_t::recv_fds: callback_size = sizeof(fd_read_chain::state); break;
+
+      case type_t::read_direct: [[fallthrough]];
+      case type_t::splice: [[fallthrough]];
+      case type_t::open: callback_size = 0; break;
+      case type_t::stat: callback_size = sizeof(stat_chain::state); break;
+      case type_t::madvise: callback_size = sizeof(prefetch_chain::state); break;
+      case type_t::rename: [[fallthrough]];
+      case type_t::unlink: [[fallthrough]];
+      case type_t::fsync: callback_size = sizeof(sync_chain::state); break;
     }
     const size_t offset_offset = sizeof(query) + sizeof(iovec) * iovec_count;
     const size_t unaligned_callback_offset = offset_offset + sizeof(unsigned) * iovec_count * 2;
     const size_t callback_offset = unaligned_callback_offset + (unaligned_callback_offset % 16 ? 16 - unaligned_callback_offset % 16 : 0);
-    void* ptr = operator new(callback_offset + callback_size * std::max(1u, iovec_count));
+    const size_t shared_data_offset = callback_offset + callback_size * std::max(1u, iovec_count);
+    const size_t msg_offset = shared_data_offset + (with_shared_data ? sizeof(shared_raw_data) * iovec_count : 0);
+    const bool with_msg = with_shared_data && t == type_t::send && iovec_count > 1;
+    void* ptr = operator new(msg_offset + (with_msg ? sizeof(msghdr) : 0));
     query* q = (query*)ptr;
     q->fid = fid;
     q->type = t;
     q->iovec_count = iovec_count;
     q->data_offet_array_offset = offset_offset;
     q->multishot = false;
+    q->segmented = false;
+    q->has_deadline = false;
+    q->has_timed_out = false;
+    q->has_msg_op = false;
+    q->timeout_ms = 0;
+    new (&q->deadline) std::chrono::steady_clock::time_point();
+    // queries are allocated when their sqe is prepared, and submitted at the end of the same process()
+    new (&q->submit_time) std::chrono::steady_clock::time_point(std::chrono::steady_clock::now());
+    q->shared_data = nullptr;
+    q->msg = nullptr;
+    if (with_shared_data)
+    {
+      q->shared_data = (shared_raw_data*)(((uint8_t*)ptr) + shared_data_offset);
+      for (unsigned i = 0; i < iovec_count; ++i)
+        new (q->shared_data + i) shared_raw_data();
+    }
+    if (with_msg)
+    {
+      q->msg = (msghdr*)(((uint8_t*)ptr) + msg_offset);
+      memset(q->msg, 0, sizeof(msghdr));
+    }
+    // queries that don't use their iovecs (stat, fsync, ...) must not have the destructor free garbage
+    memset(q->iovecs, 0, sizeof(iovec) * iovec_count);
     memset((uint8_t*)ptr + offset_offset, 0, sizeof(unsigned) * iovec_count * 2);
     if (t == type_t::read || t == type_t::recv)
     {
@@ -781,6 +1916,49 @@ namespace neam::io
       q->connect_state = (connect_chain::state*)(((uint8_t*)ptr) + callback_offset);
       new (q->connect_state) connect_chain::state();
     }
+    else if (t == type_t::read_shared || t == type_t::recv_shared)
+    {
+      q->shared_read_state = (shared_read_chain::state*)(((uint8_t*)ptr) + callback_offset);
+      for (unsigned i = 0; i < iovec_count; ++i)
+      {
+        new (q->shared_read_state + i) shared_read_chain::state ();
+      }
+    }
+    else if (t == type_t::recv_datagram)
+    {
+      q->datagram_state = (datagram_chain::state*)(((uint8_t*)ptr) + callback_offset);
+      for (unsigned i = 0; i < iovec_count; ++i)
+      {
+        new (q->datagram_state + i) datagram_chain::state ();
+      }
+    }
+    else if (t == type_t::recv_fds)
+    {
+      q->fd_read_state = (fd_read_chain::state*)(((uint8_t*)ptr) + callback_offset);
+      for (unsigned i = 0; i < iovec_count; ++i)
+      {
+        new (q->fd_read_state + i) fd_read_chain::state ();
+      }
+    }
+    else if (t == type_t::stat)
+    {
+      q->stat_state = (stat_chain::state*)(((uint8_t*)ptr) + callback_offset);
+      new (q->stat_state) stat_chain::state();
+    }
+    else if (t == type_t::madvise)
+    {
+      q->prefetch_state = (prefetch_chain::state*)(((uint8_t*)ptr) + callback_offset);
+      new (q->prefetch_state) prefetch_chain::state();
+    }
+    else if (t == type_t::fsync || t == type_t::rename || t == type_t::unlink)
+    {
+      q->sync_states = (sync_chain::state*)(((uint8_t*)ptr) + callback_offset);
+      for (unsigned i = 0; i < iovec_count; ++i)
+      {
+        q->iovecs[i] = {};
+        new (q->sync_states + i) sync_chain::state();
+      }
+    }
     return q;
   }
 
@@ -806,36 +1984,107 @@ namespace neam::io
       return sqe;
     }
 
-    io_uring_sqe* const sqe = io_uring_get_sqe(&ring);
+    io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+    if (sqe == nullptr && pending_sqe_count > 0)
+    {
+      // the submit queue is full of prepared operations, submit them to make some room:
+      submit_pending_operations();
+      sqe = io_uring_get_sqe(&ring);
+    }
     if (sqe == nullptr)
     {
       // no space in queue, cannot do anything.
       neam::cr::out().debug("io::context::get_sqe: submit queue is full");
+      return nullptr;
     }
+    ++pending_sqe_count;
     return sqe;
   }
 
+  void context::submit_pending_operations(bool wait_for_one_completion)
+  {
+    if (returned_sqe != nullptr)
+    {
+      // the sqe is already in the submit queue, so make it harmless:
+      io_uring_prep_nop(returned_sqe);
+      io_uring_sqe_set_flags(returned_sqe, IOSQE_CQE_SKIP_SUCCESS);
+      io_uring_sqe_set_data(returned_sqe, nullptr);
+      returned_sqe = nullptr;
+    }
+
+    if (pending_sqe_count == 0 && !wait_for_one_completion)
+      return;
+
+    const int submitted = wait_for_one_completion ? io_uring_submit_and_wait(&ring, 1) : io_uring_submit(&ring);
+    check::unx::n_check_success(submitted);
+    pending_sqe_count = 0;
+    if (submitted > 0)
+    {
+      stats_submit_count.fetch_add(1, std::memory_order_relaxed);
+      stats_submitted_sqe_count.fetch_add((uint64_t)submitted, std::memory_order_relaxed);
+      if ((uint64_t)submitted > stats_max_sqe_per_submit.load(std::memory_order_relaxed))
+        stats_max_sqe_per_submit.store((uint64_t)submitted, std::memory_order_relaxed); // single writer
+    }
+  }
+
   void context::return_sqe(io_uring_sqe* sqe)
   {
     check::debug::n_assert(returned_sqe == nullptr, "io::context: return sqe: a sqe has already been returned.");
     returned_sqe = sqe;
   }
 
+  void context::apply_fixed_file(io_uring_sqe* sqe)
+  {
+    if (registered_file_count == 0)
+      return;
+    std::lock_guard _l(fixed_file_lock);
+    if (const auto it = fixed_file_slots.find(sqe->fd); it != fixed_file_slots.end())
+    {
+      sqe->fd = (int)it->second;
+      sqe->flags |= IOSQE_FIXED_FILE;
+    }
+  }
+
+  void context::register_fixed_file(int fd)
+  {
+    if (registered_file_count == 0 || fd < 0)
+      return;
+    std::lock_guard _l(fixed_file_lock);
+    if (fixed_file_slots.contains(fd) || free_fixed_file_slots.empty())
+      return;
+    const unsigned slot = free_fixed_file_slots.back();
+    // can fail (for instance when not called from the issuer thread with single-issuer rings), the fd is simply not registered then
+    if (io_uring_register_files_update(&ring, slot, &fd, 1) != 1)
+      return;
+    free_fixed_file_slots.pop_back();
+    fixed_file_slots.emplace(fd, slot);
+  }
+
+  void context::unregister_fixed_file(int fd)
+  {
+    if (registered_file_count == 0)
+      return;
+    std::lock_guard _l(fixed_file_lock);
+    const auto it = fixed_file_slots.find(fd);
+    if (it == fixed_file_slots.end())
+      return;
+    const int removed_fd = -1;
+    check::unx::n_check_success(io_uring_register_files_update(&ring, it->second, &removed_fd, 1));
+    free_fixed_file_slots.push_back(it->second);
+    fixed_file_slots.erase(it);
+  }
+
 
-  int context::open_file(id_t fid, bool read, bool write, bool truncate, bool force_truncate, bool& try_again)
+  int context::open_file(id_t fid, bool read, bool write, bool truncate, bool force_truncate, bool& is_pending)
   {
     check::debug::n_assert(read || write, "io::context: cannot open a file with neither read nor write flags.");
-    off_t offset = 0;
-    try_again = false;
+    is_pending = false;
 
     std::lock_guard _fdl(fd_lock);
     if (const auto it = opened_fd.find(fid); it != opened_fd.end())
     {
       check::debug::n_assert(!it->second.accept, "io::context: cannot perform operations other than accept() on a fd flagged for accept.");
 
-      // reset the counter:
-      it->second.counter = 0;
-
       bool reopen = false;
       // the file is already opened, check if it has the correct flags:
       if (read && !it->second.read)
@@ -843,94 +2092,195 @@ namespace neam::io
       if (write && !it->second.write)
         reopen = true;
 
-      if (reopen)
+      if (!reopen)
       {
-        if (!it->second.file)
-        {
-          check::debug::n_check(false, "io::context::open_file: cannot change read/write mode on {}: it's not a file", fid);
-          return -1;
-        }
+        if (it->second.file)
+          touch_file_lru(fid);
+        if (force_truncate)
+          ftruncate(it->second.fd, 0);
+        return it->second.fd;
+      }
+
+      if (!it->second.file)
+      {
+        check::debug::n_check(false, "io::context::open_file: cannot change read/write mode on {}: it's not a file", fid);
+        return -1;
+      }
 
-        neam::cr::out().debug("io::context::open_file: reopening {} with a different mode", fid);
+      neam::cr::out().debug("io::context::open_file: reopening {} with a different mode", fid);
 #if NEAM_IO_SKIP_WRITES
-        if (read)
-          read = read || it->second.read;
-#else
+      if (read)
         read = read || it->second.read;
+#else
+      read = read || it->second.read;
 #endif
-        write = write || it->second.write;
-        truncate = false;
+      write = write || it->second.write;
+      truncate = false;
 
-        offset = lseek(it->second.fd, 0, SEEK_CUR);
+      // move the current fd to be closed (all operations use explicit offsets, so there's nothing to restore)
+      fd_to_be_closed.emplace(it->second.fd);
+      opened_fd.erase(it);
+      remove_from_file_lru(fid);
+    }
 
-        // move the current fd to be closed
-        fd_to_be_closed.emplace(it->second.fd);
-        it->second.fd = -1;
-      }
-      else
-      {
-        if (force_truncate)
-          ftruncate(it->second.fd, 0);
-        return it->second.fd;
-      }
+    if (opening_files.contains(fid))
+    {
+      // the open is in flight, operations will be queued once it completes
+      // (if the mode is not the correct one, the file will simply be re-opened)
+      is_pending = true;
+      return -1;
     }
 
+    // the open failed, fail the operations:
+    if (failed_opens.erase(fid) > 0)
+      return -1;
+
     // not already opened, open it
-    std::lock_guard<spinlock> _ml(mapped_lock);
-    if (auto it = mapped_files.find(fid); it != mapped_files.end())
+    std::string path;
+    bool direct = false;
     {
-      // avoid busting the fd limit
-      if (opened_fd.size() >= k_max_open_file_count)
+      std::lock_guard<spinlock> _ml(mapped_lock);
+      if (auto it = mapped_files.find(fid); it != mapped_files.end())
       {
-        try_again = true;
+        path = it->second;
+        if (const auto dit = direct_io_files.find(fid); dit != direct_io_files.end())
+          direct = !dit->second.is_refused && !write;
+      }
+      else
+      {
+        check::debug::n_check(false, "Failed to open {}: file not mapped", fid);
         return -1;
       }
+    }
+
+    // avoid busting the fd limit
+    if (file_lru.size() + opening_files.size() >= max_open_file_count && !close_least_recently_used_file())
+    {
+      is_pending = true;
+      return -1;
+    }
+
+    io_uring_sqe* const sqe = get_sqe();
+    if (!sqe)
+    {
+      is_pending = true;
+      return -1;
+    }
 
-      // compute the flags:
-      int flags = O_CLOEXEC; // our file fd (as compared to socket/pipe/... fd) are auto-managed, and should not be relied upon
-      if (read && write)
-        flags |= O_RDWR;
-      else if (read)
-        flags |= O_RDONLY;
-      else if (write)
-        flags = O_WRONLY|O_CREAT;
+    // compute the flags:
+    int flags = O_CLOEXEC; // our file fd (as compared to socket/pipe/... fd) are auto-managed, and should not be relied upon
+    if (read && write)
+      flags |= O_RDWR;
+    else if (read)
+      flags |= O_RDONLY;
+    else if (write)
+      flags = O_WRONLY|O_CREAT;
 
-      if (truncate || force_truncate)
-        flags |= O_TRUNC;
+    if (truncate || force_truncate)
+      flags |= O_TRUNC;
+    if (direct)
+      flags |= O_DIRECT;
 
 #if NEAM_IO_SKIP_WRITES
-      const int fd = open(!read && write ? "/dev/null" : it->second.c_str(), flags, 0644);
-#else
-      const int fd = open(it->second.c_str(), flags, 0644);
+    if (!read && write)
+      path = "/dev/null";
 #endif
-      if (offset != 0) // restore the offset
-        lseek(fd, offset, SEEK_SET);
-      neam::cr::out().debug("io::context::open_file: opening `{}` [read: {}, write: {}, fd: {}]", it->second.c_str(), read, write, fd);
 
-      if (fd < 0)
-      {
-        opened_fd.erase(fid);
-        return -1;
-      }
+    query* q = query::allocate(fid, query::type_t::open, 0, false);
+    q->file_op = new file_operation { .path = std::move(path), .stx = {}, .read = read, .write = write, .direct = direct, .new_path = {} };
+    io_uring_prep_openat(sqe, AT_FDCWD, q->file_op->path.c_str(), flags, 0644);
+    io_uring_sqe_set_data(sqe, q);
 
-      // opened: place the file in the opened files list
-      opened_fd.insert_or_assign(fid, file_descriptor
-      {
-        .fd = fd,
-        .socket = false,
-        .file = true,
-        .read = read,
-        .write = write,
-        .accept = false,
-      });
-      return fd;
+    open_in_flight.fetch_add(1, std::memory_order_release);
+    opening_files.emplace(fid, file_descriptor
+    {
+      .fd = -1,
+      .socket = false,
+      .file = true,
+      .read = read,
+      .write = write,
+      .accept = false,
+    });
+    is_pending = true;
+    return -1;
+  }
+
+  void context::process_open_completion(query& q, int res)
+  {
+    std::lock_guard _fdl(fd_lock);
+    if (opening_files.erase(q.fid) == 0)
+    {
+      // the files were force-closed while the open was in flight
+      if (res >= 0)
+        fd_to_be_closed.insert(res);
+      return;
     }
-    else
+
+    if (res == -EINVAL && q.file_op->direct)
     {
-      opened_fd.erase(fid);
-      check::debug::n_check(false, "Failed to open {}: file not mapped", fid);
-      return -1;
+      // the operations waiting for the file will open it again, without O_DIRECT:
+      cr::out().warn("io::context::open_file: `{}`: O_DIRECT is not supported by the filesystem, using buffered reads", q.file_op->path);
+      std::lock_guard<spinlock> _ml(mapped_lock);
+      if (const auto it = direct_io_files.find(q.fid); it != direct_io_files.end())
+        it->second.is_refused = true;
+      return;
+    }
+    if (res < 0)
+    {
+      failed_opens.insert(q.fid);
+      return;
+    }
+    neam::cr::out().debug("io::context::open_file: opened `{}` [read: {}, write: {}, fd: {}]", q.file_op->path, q.file_op->read, q.file_op->write, res);
+
+    // opened: place the file in the opened files list
+    opened_fd.insert_or_assign(q.fid, file_descriptor
+    {
+      .fd = res,
+      .socket = false,
+      .file = true,
+      .read = q.file_op->read,
+      .write = q.file_op->write,
+      .accept = false,
+    });
+    register_fixed_file(res);
+    touch_file_lru(q.fid);
+  }
+
+  void context::touch_file_lru(id_t fid)
+  {
+    if (const auto it = file_lru_entries.find(fid); it != file_lru_entries.end())
+    {
+      file_lru.splice(file_lru.begin(), file_lru, it->second);
+      return;
     }
+    file_lru.push_front(fid);
+    file_lru_entries.emplace(fid, file_lru.begin());
+  }
+
+  void context::remove_from_file_lru(id_t fid)
+  {
+    if (const auto it = file_lru_entries.find(fid); it != file_lru_entries.end())
+    {
+      file_lru.erase(it->second);
+      file_lru_entries.erase(it);
+    }
+  }
+
+  bool context::close_least_recently_used_file()
+  {
+    if (file_lru.empty())
+      return false;
+
+    const id_t fid = file_lru.back();
+    file_lru.pop_back();
+    file_lru_entries.erase(fid);
+    if (const auto it = opened_fd.find(fid); it != opened_fd.end())
+    {
+      // operations in flight on the fd keep a reference to the file, so it can be closed right away
+      fd_to_be_closed.insert(it->second.fd);
+      opened_fd.erase(it);
+    }
+    return true;
   }
 
   void context::process_completed_query(io_uring_cqe* cqe)
@@ -939,6 +2289,29 @@ namespace neam::io
     if (cqe == nullptr)
       return;
 
+    // woken up (the resolved connects / the operations are already in the queues)
+    if (io_uring_cqe_get_data64(cqe) == k_wakeup_user_data)
+    {
+      is_wakeup_armed = false;
+      io_uring_cqe_seen(&ring, cqe);
+      return;
+    }
+    if (io_uring_cqe_get_data64(cqe) == k_msg_ring_user_data)
+    {
+      io_uring_cqe_seen(&ring, cqe);
+      return;
+    }
+    // the earliest deadline expired (the queries are canceled by the next process())
+    if (io_uring_cqe_get_data64(cqe) == k_timeout_user_data)
+    {
+      {
+        std::lock_guard _tl(timeout_lock);
+        is_timeout_armed = false;
+      }
+      io_uring_cqe_seen(&ring, cqe);
+      return;
+    }
+
     query* const data = (query*)io_uring_cqe_get_data(cqe);
 
     if (cqe->res < 0)
@@ -971,8 +2344,18 @@ namespace neam::io
     // We also don't care about waiting for them (no state to complete)
     if (data != nullptr)
     {
+      // only a cancellation is a timeout (the operation may have completed before the cancel)
+      data->has_timed_out = data->has_timed_out && cqe->res == -ECANCELED;
+      if (data->multishot && multishot_has_more && data->has_deadline)
+      {
+        // idle timeout: the deadline restarts after each completion
+        disarm_deadline(*data);
+        arm_deadline(*data);
+      }
+
       if (!is_notif)
       {
+        record_completion_metrics(*data, cqe->res);
         switch (data->type)
         {
           case query::type_t::write: process_write_completion(*data, cqe->res >= 0, cqe->res);
@@ -981,12 +2364,34 @@ namespace neam::io
             break;
           case query::type_t::accept: process_accept_completion(*data, cqe->res >= 0, cqe->res);
             break;
-          case query::type_t::connect: process_connect_completion(*data, cqe->res >= 0);
+          case query::type_t::connect: process_connect_completion(*data, cqe->res);
+            break;
+          case query::type_t::recv: [[fallthrough]];
+          case query::type_t::recv_shared: process_recv_completion(*data, cqe->res, multishot_has_more, is_using_buffer, buffer_idx);
             break;
-          case query::type_t::recv: process_recv_completion(*data, cqe->res >= 0, cqe->res, is_using_buffer, buffer_idx);
+          case query::type_t::recv_datagram: process_recv_datagram_completion(*data, cqe->res, multishot_has_more, is_using_buffer, buffer_idx);
+            break;
+          case query::type_t::recv_fds: process_recv_fds_completion(*data, cqe->res);
             break;
           case query::type_t::send: process_send_completion(*data, cqe->res >= 0, cqe->res);
             break;
+          case query::type_t::read_shared: process_read_shared_completion(*data, cqe->res >= 0, cqe->res);
+            break;
+          case query::type_t::open: process_open_completion(*data, cqe->res);
+            break;
+          case query::type_t::stat: process_stat_completion(*data, cqe->res);
+            break;
+          case query::type_t::rename: [[fallthrough]];
+          case query::type_t::unlink: process_path_completion(*data, cqe->res);
+            break;
+          case query::type_t::read_direct: process_direct_read_completion(*data, cqe->res);
+            break;
+          case query::type_t::splice: process_splice_completion(*data, cqe->res);
+            break;
+          case query::type_t::madvise: process_prefetch_completion(*data, cqe->res);
+            break;
+          case query::type_t::fsync: process_sync_completion(*data, cqe->res);
+            break;
         }
       }
 
@@ -996,6 +2401,7 @@ namespace neam::io
         switch (data->type)
         {
           case query::type_t::write: write_requests.decrement_in_flight();
+            on_write_completed(data->fid);
             break;
           case query::type_t::read: read_requests.decrement_in_flight();
             break;
@@ -1003,18 +2409,35 @@ namespace neam::io
             break;
           case query::type_t::connect: connect_requests.decrement_in_flight();
             break;
-          case query::type_t::recv: recv_requests.decrement_in_flight();
+          case query::type_t::recv: [[fallthrough]];
+          case query::type_t::recv_shared: [[fallthrough]];
+          case query::type_t::recv_datagram: [[fallthrough]];
+          case query::type_t::recv_fds: recv_requests.decrement_in_flight();
             break;
           case query::type_t::send: send_requests.decrement_in_flight();
             break;
+          case query::type_t::read_shared: read_requests.decrement_in_flight();
+            break;
+          case query::type_t::open: open_in_flight.fetch_sub(1, std::memory_order_release);
+            break;
+          case query::type_t::stat: stat_requests.decrement_in_flight();
+            break;
+          case query::type_t::rename: [[fallthrough]];
+          case query::type_t::unlink: path_requests.decrement_in_flight();
+            break;
+          case query::type_t::read_direct: // the request is in flight until all its chunks are completed
+            break;
+          case query::type_t::splice: // the request is in flight until the whole range is sent
+            break;
+          case query::type_t::madvise: prefetch_requests.decrement_in_flight();
+            break;
+          case query::type_t::fsync: sync_requests.decrement_in_flight();
+            break;
         }
+        disarm_deadline(*data);
         data->~query();
         operator delete ((void*)data);
       }
-
-      // re-allocate the lost buffer:
-      if (is_using_buffer)
-        allocate_buffers_for_multi_ops();
     }
 
     io_uring_cqe_seen(&ring, cqe);
@@ -1033,10 +2456,11 @@ namespace neam::io
 
       fd_to_be_closed.erase(fd_to_be_closed.begin());
 
+      // the fd is not used anymore (and no operation using it is pending submission): free its slot
+      unregister_fixed_file(fd);
       io_uring_prep_close(sqe, fd);
       io_uring_sqe_set_flags(sqe, IOSQE_CQE_SKIP_SUCCESS);
       io_uring_sqe_set_data(sqe, nullptr);
-      check::unx::n_check_success(io_uring_submit(&ring));
     }
     return true;
   }
@@ -1056,6 +2480,81 @@ namespace neam::io
     to_be_canceled.push_back({ .data = (uint64_t)fd, .is_fd = true, });
   }
 
+  void context::set_operation_timeout(id_t fid, std::chrono::milliseconds timeout)
+  {
+    check::debug::n_assert(timeout.count() > 0 && timeout.count() <= ~uint32_t(0), "io::context: invalid timeout ({}ms)", timeout.count());
+    std::lock_guard _tl(timeout_lock);
+    operation_timeouts.insert_or_assign(fid, timeout);
+    operation_timeout_count.store((uint32_t)operation_timeouts.size(), std::memory_order_release);
+  }
+
+  void context::clear_operation_timeout(id_t fid)
+  {
+    std::lock_guard _tl(timeout_lock);
+    operation_timeouts.erase(fid);
+    operation_timeout_count.store((uint32_t)operation_timeouts.size(), std::memory_order_release);
+  }
+
+  void context::arm_deadline(query& q)
+  {
+    if (q.timeout_ms == 0)
+    {
+      if (operation_timeout_count.load(std::memory_order_acquire) == 0)
+        return;
+      std::lock_guard _tl(timeout_lock);
+      const auto it = operation_timeouts.find(q.fid);
+      if (it == operation_timeouts.end())
+        return;
+      q.timeout_ms = (uint32_t)it->second.count();
+    }
+
+    std::lock_guard _tl(timeout_lock);
+    q.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(q.timeout_ms);
+    q.has_deadline = true;
+    deadlines.emplace(q.deadline, &q);
+  }
+
+  void context::disarm_deadline(query& q)
+  {
+    if (!q.has_deadline)
+      return;
+    std::lock_guard _tl(timeout_lock);
+    deadlines.erase({q.deadline, &q});
+    q.has_deadline = false;
+  }
+
+  void context::process_expired_deadlines()
+  {
+    std::lock_guard _tl(timeout_lock);
+    if (deadlines.empty())
+      return;
+
+    const auto now = std::chrono::steady_clock::now();
+    while (!deadlines.empty() && deadlines.begin()->first <= now)
+    {
+      query* const q = deadlines.begin()->second;
+      deadlines.erase(deadlines.begin());
+      q->has_deadline = false;
+      q->has_timed_out = true;
+      cr::out().debug("io::context: {} operation on {} timed out", get_query_type_str(q->type), q->fid);
+      cancel_operation(*q);
+    }
+
+    // wake the ring up for the earliest deadline:
+    if (deadlines.empty() || (is_timeout_armed && armed_timeout_deadline <= deadlines.begin()->first))
+      return;
+    io_uring_sqe* const sqe = get_sqe();
+    if (sqe == nullptr)
+      return;
+    armed_timeout_deadline = deadlines.begin()->first;
+    const auto delay = std::chrono::duration_cast<std::chrono::nanoseconds>(armed_timeout_deadline - now);
+    armed_timeout_ts.tv_sec = delay.count() / 1'000'000'000;
+    armed_timeout_ts.tv_nsec = delay.count() % 1'000'000'000;
+    io_uring_prep_timeout(sqe, &armed_timeout_ts, 0, 0);
+    io_uring_sqe_set_data64(sqe, k_timeout_user_data);
+    is_timeout_armed = true;
+  }
+
   void context::queue_cancel_operations()
   {
     std::lock_guard _fdl(cancel_lock);
@@ -1078,7 +2577,6 @@ namespace neam::io
       io_uring_sqe_set_flags(sqe, IOSQE_CQE_SKIP_SUCCESS);
 
       io_uring_sqe_set_data(sqe, nullptr);
-      check::unx::n_check_success(io_uring_submit(&ring));
     }
   }
 
@@ -1086,7 +2584,8 @@ namespace neam::io
   {
     if (read_requests.requests.empty())
       return;
-    std::deque<read_request> requests;
+    std::deque<read_request, cr::slab_stl_allocator<read_request>> requests;
+    std::deque<read_request, cr::slab_stl_allocator<read_request>> waiting_requests;
     {
       read_request rq;
       while (read_requests.requests.try_pop_front(rq))
@@ -1104,7 +2603,7 @@ namespace neam::io
 
       while (requests.size() > 0)
       {
-        if (requests.front().state.is_canceled())
+        if (requests.front().shared_buffer ? requests.front().shared_state.is_canceled() : requests.front().state.is_canceled())
         {
           requests.pop_front();
           continue;
@@ -1113,16 +2612,27 @@ namespace neam::io
         const id_t fid = requests.front().fid;
 
         // check if the file is opened, else open it:
-        bool try_again;
-        const int fd = open_file(fid, true, false, false, false, try_again);
+        bool is_pending;
+        const int fd = open_file(fid, true, false, false, false, is_pending);
         if (fd < 0)
         {
-          if (try_again)
-            break;
+          if (is_pending)
+          {
+            // the file is being opened, the queries for the same fid will be queued in a later cycle:
+            while (!requests.empty() && fid == requests.front().fid)
+            {
+              waiting_requests.push_back(std::move(requests.front()));
+              requests.pop_front();
+            }
+            continue;
+          }
           // fail all the queries for the same fid:
           while (!requests.empty() && fid == requests.front().fid)
           {
-            requests.front().state.complete(std::move(requests.front().data), false, 0);
+            if (requests.front().shared_buffer)
+              requests.front().shared_state.complete({}, false, 0);
+            else
+              requests.front().state.complete(std::move(requests.front().data), false, 0);
             requests.pop_front();
           }
 
@@ -1134,14 +2644,46 @@ namespace neam::io
         if (!sqe)
           break;
 
-        // Count the queries for the same file w/ contiguous queries:
-        unsigned iovec_count = 1;
+        if (requests.front().shared_buffer)
         {
-          constexpr size_t max_size_for_merging = 64 * 1024;
-          size_t offset = requests.front().offset + requests.front().size;
-          for (; iovec_count < requests.size() && iovec_count < k_max_iovec_merge; ++iovec_count)
+          // single read in a shared buffer (fixed-buffer read if the buffer is registered)
+          read_request& rq = requests.front();
+          query* q = query::allocate(fid, query::type_t::read_shared, 1, true);
+          q->iovecs[0].iov_len = rq.size;
+          q->iovecs[0].iov_base = const_cast<void*>(rq.shared_buffer.get());
+          const uint32_t buffer_index = fixed_buffers != nullptr ? fixed_buffers->get_index(rq.shared_buffer) : buffer_pool::k_invalid_index;
+          q->shared_data[0] = std::move(rq.shared_buffer);
+          q->shared_read_state[0] = std::move(rq.shared_state);
+          const size_t offset = rq.offset;
+          record_queue_wait(metric_type::read, rq.queued_at);
+          requests.pop_front();
+
+          if (buffer_index != buffer_pool::k_invalid_index)
+            io_uring_prep_read_fixed(sqe, fd, q->iovecs[0].iov_base, q->iovecs[0].iov_len, offset, buffer_index);
+          else
+            io_uring_prep_read(sqe, fd, q->iovecs[0].iov_base, q->iovecs[0].iov_len, offset);
+          apply_fixed_file(sqe);
+          io_uring_sqe_set_data(sqe, q);
+          arm_deadline(*q);
+          ++read_requests.in_flight;
+
+          q->shared_read_state[0].on_cancel([q, this]
           {
-            if (fid != requests[iovec_count].fid)
+            cancel_operation(*q);
+          });
+          continue;
+        }
+
+        // Count the queries for the same file w/ contiguous queries:
+        unsigned iovec_count = 1;
+        {
+          constexpr size_t max_size_for_merging = 64 * 1024;
+          size_t offset = requests.front().offset + requests.front().size;
+          for (; iovec_count < requests.size() && iovec_count < k_max_iovec_merge; ++iovec_count)
+          {
+            if (fid != requests[iovec_count].fid)
+              break;
+            if (requests[iovec_count].shared_buffer)
               break;
             if (offset != requests[iovec_count].offset)
               break;
@@ -1173,13 +2715,15 @@ namespace neam::io
 
           memset(q->iovecs[i].iov_base, 0, requests.front().size); // so valgrind is happy, can be skipped
 
+          record_queue_wait(metric_type::read, requests.front().queued_at);
           requests.pop_front();
         }
 
         io_uring_prep_readv(sqe, fd, q->iovecs, iovec_count, offset);
+        apply_fixed_file(sqe);
         io_uring_sqe_set_data(sqe, q);
+        arm_deadline(*q);
 
-        check::unx::n_check_success(io_uring_submit(&ring));
         ++read_requests.in_flight;
 
         for (unsigned i = 0; i < iovec_count; ++i)
@@ -1193,6 +2737,10 @@ namespace neam::io
     } // lock scope
 
     // if we have remaining requests, push them back:
+    for (auto& it : waiting_requests)
+    {
+      read_requests.add_request(std::move(it));
+    }
     for (auto& it : requests)
     {
       read_requests.add_request(std::move(it));
@@ -1201,14 +2749,91 @@ namespace neam::io
 
   void context::queue_writev_operations()
   {
-    if (write_requests.requests.empty())
+    if (write_requests.requests.empty() && sync_requests.requests.empty())
       return;
-    std::deque<write_request> requests;
+    std::deque<write_request, cr::slab_stl_allocator<write_request>> requests;
+    std::deque<write_request, cr::slab_stl_allocator<write_request>> waiting_requests;
     {
       write_request rq;
       while (write_requests.requests.try_pop_front(rq))
         requests.emplace_back(std::move(rq));
     }
+
+    // syncs are submitted after the writes of the same file (see queue_fsync())
+    std::mtc_unordered_map<id_t, std::mtc_vector<sync_request>> syncs;
+    {
+      sync_request rq;
+      while (sync_requests.requests.try_pop_front(rq))
+      {
+        if (!rq.state.is_canceled())
+          syncs[rq.fid].push_back(std::move(rq));
+      }
+    }
+
+    // number of requests (starting at requests[first]) that are merged in a single writev
+    const auto get_merged_request_count = [&requests](size_t first) -> unsigned
+    {
+      const write_request& first_rq = requests[first];
+      if (!first_rq.segments.empty())
+        return 1; // segmented writes are not merged
+      const bool should_append = first_rq.offset == append;
+      const bool should_truncate = first_rq.offset == truncate;
+      size_t offset = first_rq.offset + first_rq.size_to_write;
+      unsigned count = 1;
+      for (; !should_truncate && first + count < requests.size() && count < k_max_iovec_merge; ++count)
+      {
+        const write_request& rq = requests[first + count];
+        if (first_rq.fid != rq.fid)
+          break;
+        if (!rq.segments.empty())
+          break;
+        if (!should_append)
+        {
+          if (offset != rq.offset)
+            break;
+          if (rq.offset == truncate)
+            break;
+          if (rq.offset == append)
+            break;
+          offset += rq.size_to_write;
+        }
+        else
+        {
+          if (rq.offset != append)
+            break;
+        }
+      }
+      return count;
+    };
+
+    // the file whose writes are currently being queued.
+    // If linked, its writes are linked to an fsync submitted right after them (so the sqe of the group must be submitted together)
+    id_t group_fid = id_t::none;
+    int group_fd = -1;
+    bool is_group_linked = false;
+    // the last write of the linked group
+    io_uring_sqe* group_last_sqe = nullptr;
+    const auto end_group = [&]
+    {
+      if (!is_group_linked)
+        return;
+      is_group_linked = false;
+      auto it = syncs.find(group_fid);
+      io_uring_sqe* const sqe = get_sqe();
+      if (check::debug::n_check(sqe != nullptr, "io::context: no sqe for a linked fsync"))
+      {
+        queue_fsync_operation(sqe, group_fid, group_fd, std::move(it->second));
+      }
+      else
+      {
+        if (group_last_sqe != nullptr)
+          group_last_sqe->flags &= ~IOSQE_IO_LINK;
+        if (!hold_sync_requests(group_fid, it->second))
+          return;
+      }
+      syncs.erase(it);
+    };
+
     {
 
       // sort reads by fid, so we have reads for the same file at the same place (better for readv)
@@ -1221,21 +2846,52 @@ namespace neam::io
 
       while (requests.size() > 0)
       {
+        const id_t fid = requests.front().fid;
+        if (fid != group_fid)
+        {
+          end_group();
+          group_fid = fid;
+        }
+
         if (requests.front().state.is_canceled())
         {
           requests.pop_front();
           continue;
         }
 
-        const id_t fid = requests.front().fid;
-
         // check if the file is opened, else open it:
-        bool try_again;
-        const int fd = open_file(fid, false, true, requests.front().offset == 0, requests.front().offset == truncate, try_again);
+        bool is_pending;
+        const int fd = open_file(fid, false, true, requests.front().offset == 0, requests.front().offset == truncate, is_pending);
+        if (fd >= 0 && !is_group_linked && syncs.contains(fid) && !has_writes_in_flight(fid))
+        {
+          // link the writes of the file to the fsync, if all their sqe (and the one of the fsync) can be submitted in the same batch:
+          unsigned sqe_count = 1;
+          for (size_t i = 0; i < requests.size() && requests[i].fid == fid; i += get_merged_request_count(i))
+            ++sqe_count;
+          if (sqe_count <= queue_depth)
+          {
+            if (io_uring_sq_space_left(&ring) < sqe_count)
+              submit_pending_operations();
+            if (io_uring_sq_space_left(&ring) >= sqe_count)
+            {
+              is_group_linked = true;
+              group_fd = fd;
+              group_last_sqe = nullptr;
+            }
+          }
+        }
         if (fd < 0)
         {
-          if (try_again)
-            break;
+          if (is_pending)
+          {
+            // the file is being opened, the queries for the same fid will be queued in a later cycle:
+            while (!requests.empty() && fid == requests.front().fid)
+            {
+              waiting_requests.push_back(std::move(requests.front()));
+              requests.pop_front();
+            }
+            continue;
+          }
           // fail all the queries for the same fid:
           while (!requests.empty() && fid == requests.front().fid)
           {
@@ -1249,39 +2905,67 @@ namespace neam::io
         // Get a SQE
         io_uring_sqe* const sqe = get_sqe();
         if (!sqe)
+        {
+          // the fsync will not follow the last write: it must not be linked to whatever is submitted next
+          // (the syncs are queued again once the remaining writes are submitted)
+          if (is_group_linked && group_last_sqe != nullptr)
+            group_last_sqe->flags &= ~IOSQE_IO_LINK;
+          is_group_linked = false;
           break;
+        }
 
-        // Count the queries for the same file w/ contiguous queries:
-        unsigned iovec_count = 1;
+        if (!requests.front().segments.empty())
         {
-          const bool should_append = requests.front().offset == append;
-          const bool should_truncate = requests.front().offset == truncate;
-          size_t offset = requests.front().offset + requests.front().data.size;
-          for (; !should_truncate && iovec_count < requests.size() && iovec_count < k_max_iovec_merge; ++iovec_count)
+          // segmented write: a single writev, no merge with the other requests
+          write_request& rq = requests.front();
+          const unsigned iovec_count = (unsigned)rq.segments.size();
+          query* q = query::allocate(fid, query::type_t::write, iovec_count, true);
+          q->segmented = true;
+          const size_t offset = rq.offset == truncate ? 0 : rq.offset;
+          for (unsigned i = 0; i < iovec_count; ++i)
           {
-            if (fid != requests[iovec_count].fid)
-              break;
-            if (!should_append)
-            {
-              if (offset != requests[iovec_count].offset)
-                break;
-              if (requests[iovec_count].offset == truncate)
-                break;
-              if (requests[iovec_count].offset == append)
-                break;
-              offset += requests[iovec_count].size_to_write;
-            }
-            else
-            {
-              if (requests[iovec_count].offset != append)
-                break;
-            }
+            q->iovecs[i].iov_len = rq.segments[i].get_size();
+            q->iovecs[i].iov_base = const_cast<void*>(rq.segments[i].get());
+            q->shared_data[i] = std::move(rq.segments[i]);
+          }
+          q->write_states[0] = std::move(rq.state);
+          q->write_offset = offset;
+          record_queue_wait(metric_type::write, rq.queued_at);
+          requests.pop_front();
+
+          const uint32_t buffer_index = (fixed_buffers != nullptr && iovec_count == 1) ? fixed_buffers->get_index(q->shared_data[0]) : buffer_pool::k_invalid_index;
+          if (buffer_index != buffer_pool::k_invalid_index)
+            io_uring_prep_write_fixed(sqe, fd, q->iovecs[0].iov_base, q->iovecs[0].iov_len, offset, buffer_index);
+          else
+            io_uring_prep_writev(sqe, fd, q->iovecs, iovec_count, offset);
+          if (offset == append)
+            sqe->rw_flags |= RWF_APPEND;
+          apply_fixed_file(sqe);
+          if (is_group_linked)
+          {
+            sqe->flags |= IOSQE_IO_LINK;
+            group_last_sqe = sqe;
           }
+          io_uring_sqe_set_data(sqe, q);
+          arm_deadline(*q);
+
+          ++write_requests.in_flight;
+          on_write_submitted(fid);
+
+          q->write_states[0].on_cancel([q, this]
+          {
+            cancel_operation(*q);
+          });
+          continue;
         }
 
+        // Count the queries for the same file w/ contiguous queries:
+        const unsigned iovec_count = get_merged_request_count(0);
+
         // Allocate + fill the query structure:
         query* q = query::allocate(fid, query::type_t::write, iovec_count);
         const size_t offset = requests.front().offset == truncate ? 0 : requests.front().offset;
+        q->write_offset = offset;
 
         for (unsigned i = 0; i < iovec_count; ++i)
         {
@@ -1291,6 +2975,7 @@ namespace neam::io
           q->iovecs[i].iov_len = requests.front().size_to_write;
           q->iovecs[i].iov_base = (uint8_t*)requests.front().data.data.release() + requests.front().offset_in_data;
           q->write_states[i] = std::move(requests.front().state);
+          record_queue_wait(metric_type::write, requests.front().queued_at);
           requests.pop_front();
         }
 
@@ -1298,10 +2983,17 @@ namespace neam::io
         // add the append flags if necessary
         if (offset == append)
           sqe->rw_flags |= RWF_APPEND;
+        apply_fixed_file(sqe);
+        if (is_group_linked)
+        {
+          sqe->flags |= IOSQE_IO_LINK;
+          group_last_sqe = sqe;
+        }
         io_uring_sqe_set_data(sqe, q);
+        arm_deadline(*q);
 
-        check::unx::n_check_success(io_uring_submit(&ring));
         ++write_requests.in_flight;
+        on_write_submitted(fid);
 
         for (unsigned i = 0; i < iovec_count; ++i)
         {
@@ -1311,15 +3003,143 @@ namespace neam::io
           });
         }
       }
+      end_group();
     } // lock scope
 
+    // sync the files whose writes are all submitted / completed:
+    for (auto& [fid, rqs] : syncs)
+    {
+      const auto is_same_file = [fid](const write_request& rq) { return rq.fid == fid; };
+      const bool has_queued_writes = std::ranges::any_of(requests, is_same_file) || std::ranges::any_of(waiting_requests, is_same_file);
+      if (!has_queued_writes)
+      {
+        if (hold_sync_requests(fid, rqs))
+          continue;
+
+        bool is_pending;
+        const int fd = get_fd_for_sync(fid, is_pending);
+        if (fd < 0 && !is_pending)
+        {
+          for (auto& it : rqs)
+            it.state.complete(false);
+          continue;
+        }
+        if (fd >= 0)
+        {
+          if (io_uring_sqe* const sqe = get_sqe(); sqe != nullptr)
+          {
+            queue_fsync_operation(sqe, fid, fd, std::move(rqs));
+            continue;
+          }
+        }
+      }
+      // the writes / the file are not ready, try again later:
+      for (auto& it : rqs)
+        sync_requests.add_request(std::move(it));
+    }
+
     // if we have remaining requests, push them back:
+    for (auto& it : waiting_requests)
+    {
+      write_requests.add_request(std::move(it));
+    }
     for (auto& it : requests)
     {
       write_requests.add_request(std::move(it));
     }
   }
 
+  void context::queue_fsync_operation(io_uring_sqe* sqe, id_t fid, int fd, std::mtc_vector<sync_request>&& rqs)
+  {
+    // a single fsync for everything: a full sync if any of the requests asked for it
+    query* q = query::allocate(fid, query::type_t::fsync, (unsigned)rqs.size());
+    bool datasync = true;
+    for (unsigned i = 0; i < rqs.size(); ++i)
+    {
+      datasync = datasync && rqs[i].datasync;
+      q->sync_states[i] = std::move(rqs[i].state);
+    }
+    rqs.clear();
+
+    io_uring_prep_fsync(sqe, fd, datasync ? IORING_FSYNC_DATASYNC : 0);
+    apply_fixed_file(sqe);
+    io_uring_sqe_set_data(sqe, q);
+
+    ++sync_requests.in_flight;
+  }
+
+  int context::get_fd_for_sync(id_t fid, bool& is_pending)
+  {
+    is_pending = false;
+    {
+      std::lock_guard _fdl(fd_lock);
+      if (const auto it = opened_fd.find(fid); it != opened_fd.end())
+        return it->second.fd;
+    }
+    // fsync works with read-only fd (which is the only way to open a directory)
+    return open_file(fid, true, false, false, false, is_pending);
+  }
+
+  bool context::hold_sync_requests(id_t fid, std::mtc_vector<sync_request>& rqs)
+  {
+    std::lock_guard _sl(sync_lock);
+    if (!file_writes_in_flight.contains(fid))
+      return false;
+    auto& held = held_sync_requests[fid];
+    for (auto& it : rqs)
+      held.push_back(std::move(it));
+    rqs.clear();
+    return true;
+  }
+
+  bool context::has_writes_in_flight(id_t fid)
+  {
+    std::lock_guard _sl(sync_lock);
+    return file_writes_in_flight.contains(fid);
+  }
+
+  void context::on_write_submitted(id_t fid)
+  {
+    std::lock_guard _sl(sync_lock);
+    ++file_writes_in_flight[fid];
+  }
+
+  void context::on_write_completed(id_t fid)
+  {
+    std::mtc_vector<sync_request> released;
+    {
+      std::lock_guard _sl(sync_lock);
+      const auto it = file_writes_in_flight.find(fid);
+      if (it == file_writes_in_flight.end())
+        return;
+      if (--it->second > 0)
+        return;
+      file_writes_in_flight.erase(it);
+
+      if (const auto hit = held_sync_requests.find(fid); hit != held_sync_requests.end())
+      {
+        released = std::move(hit->second);
+        held_sync_requests.erase(hit);
+      }
+    }
+    // the writes before the syncs are done, they can be queued:
+    for (auto& it : released)
+      sync_requests.add_request(std::move(it));
+  }
+
+  void context::process_sync_completion(query& q, int res)
+  {
+    if (res < 0)
+      cr::out().debug("io::context: fsync of {} failed: {}", get_string_for_id(q.fid), strerror(-res));
+    for (unsigned i = 0; i < q.iovec_count; ++i)
+    {
+#if N_ASYNC_USE_TASK_MANAGER
+      q.sync_states[i].set_default_deferred_info(task_manager, group_id);
+#endif
+      q.sync_states[i].complete(res >= 0);
+    }
+  }
+
   void context::queue_accept_operations()
   {
     while (!accept_requests.requests.empty())
@@ -1341,6 +3161,7 @@ namespace neam::io
 
       // Allocate + fill the query structure:
       query* q = query::allocate(fid, query::type_t::accept, 0);
+      record_queue_wait(metric_type::accept, rq.queued_at);
 
       *(q->accept_state) = std::move(rq.state);
 
@@ -1352,9 +3173,10 @@ namespace neam::io
         io_uring_prep_accept(sqe, fd, nullptr, nullptr, 0);
 
       // add the append flags if necessary
+      apply_fixed_file(sqe);
       io_uring_sqe_set_data(sqe, q);
+      arm_deadline(*q);
 
-      check::unx::n_check_success(io_uring_submit(&ring));
       ++accept_requests.in_flight;
 
       q->accept_state->on_cancel([q, this]
@@ -1364,12 +3186,21 @@ namespace neam::io
     }
   }
 
+  static int get_socket_family(int fd)
+  {
+    int family = AF_UNSPEC;
+    socklen_t len = sizeof(family);
+    if (getsockopt(fd, SOL_SOCKET, SO_DOMAIN, &family, &len) < 0)
+      return AF_UNSPEC;
+    return family;
+  }
+
   void context::queue_connect_operations()
   {
     while (!connect_requests.requests.empty())
     {
       // Get a SQE
-      io_uring_sqe* const sqe = get_sqe();
+      io_uring_sqe* sqe = get_sqe();
       if (!sqe)
         break;
 
@@ -1380,45 +3211,181 @@ namespace neam::io
         continue;
       }
 
-      const id_t fid = rq.fid;
-      const int fd = rq.sock_fd;
+      if (!rq.is_resolved)
+      {
+        // fast path: numeric addresses and cached hosts are resolved inline
+        if (!get_dns_resolver().try_resolve(rq.addr, (uint16_t)rq.port, rq.addresses))
+        {
+          resolve_connect(std::move(rq));
+          // use the sqe to be woken-up when the resolution is done
+          if (!is_wakeup_armed)
+            arm_wakeup(sqe);
+          else
+            return_sqe(sqe);
+          continue;
+        }
+        rq.is_resolved = true;
+        dns_resolver::order_for_connection(rq.addresses, get_socket_family(rq.sock_fd));
+      }
 
-      addrinfo* result;
-      const auto port_str = fmt::format("{}", rq.port);
-      if (check::unx::n_check_success(getaddrinfo(rq.addr.c_str(), port_str.c_str(), nullptr, &result)) < 0)
+      if (rq.address_index >= rq.addresses.size())
       {
+        cr::out().debug("queue_connect: failed to connect to {}:{}: no (more) address to try", rq.addr, rq.port);
         rq.state.complete(false);
         return_sqe(sqe);
         continue;
       }
 
+      const id_t fid = rq.fid;
+      const int fd = rq.sock_fd;
+
       // Allocate + fill the query structure:
       query* q = query::allocate(fid, query::type_t::connect, 0);
+      record_queue_wait(metric_type::connect, rq.queued_at);
 
       *(q->connect_state) = std::move(rq.state);
+      // the address must be kept alive until the operation is submitted, and the remaining ones are needed if the connect fails
+      q->connect_rq = new connect_request(std::move(rq));
 
-      io_uring_prep_connect(sqe, fd, result->ai_addr, result->ai_addrlen);
+      const dns_resolver::address& addr = q->connect_rq->addresses[q->connect_rq->address_index];
+      io_uring_prep_connect(sqe, fd, addr.get_sockaddr(), addr.len);
 
       // add the append flags if necessary
+      apply_fixed_file(sqe);
       io_uring_sqe_set_data(sqe, q);
+      arm_deadline(*q);
 
-      check::unx::n_check_success(io_uring_submit(&ring));
       ++connect_requests.in_flight;
 
-      freeaddrinfo(result);
-
       q->connect_state->on_cancel([q, this]
       {
         cancel_operation(*q);
       });
     }
+
+    // resolutions are in progress and the previous wake-up has been consumed:
+    if (resolving_connect_count.load(std::memory_order_acquire) > 0 && !is_wakeup_armed)
+    {
+      if (io_uring_sqe* sqe = get_sqe(); sqe != nullptr)
+        arm_wakeup(sqe);
+    }
+  }
+
+  void context::resolve_connect(connect_request&& rq)
+  {
+    // the resolution counts as an in-flight connect, so waiting on the context waits for it
+    ++connect_requests.in_flight;
+    resolving_connect_count.fetch_add(1, std::memory_order_release);
+
+    const std::string host = rq.addr;
+    const uint16_t port = (uint16_t)rq.port;
+    get_dns_resolver().resolve(host, port).then([this, rq = std::move(rq)](dns_resolver::address_list&& addresses) mutable
+    {
+      // NOTE: called from a resolver thread
+      rq.addresses = std::move(addresses);
+      rq.is_resolved = true;
+      dns_resolver::order_for_connection(rq.addresses, get_socket_family(rq.sock_fd));
+
+      connect_requests.add_request(std::move(rq));
+      connect_requests.decrement_in_flight();
+      resolving_connect_count.fetch_sub(1, std::memory_order_release);
+      check::unx::n_check_success(eventfd_write(wakeup_fd, 1));
+    });
+  }
+
+  void context::arm_wakeup(io_uring_sqe* sqe)
+  {
+    io_uring_prep_read(sqe, wakeup_fd, &wakeup_buffer, sizeof(wakeup_buffer), 0);
+    io_uring_sqe_set_data64(sqe, k_wakeup_user_data);
+    is_wakeup_armed = true;
+  }
+
+  void context::wait_for_activity()
+  {
+    if (!completion_lock.try_lock())
+      return;
+    std::lock_guard<spinlock> _cl(completion_lock, std::adopt_lock);
+
+    // wake_up() completes the read of the eventfd:
+    if (!is_wakeup_armed)
+    {
+      io_uring_sqe* const sqe = get_sqe();
+      if (sqe == nullptr)
+      {
+        submit_pending_operations();
+        return;
+      }
+      arm_wakeup(sqe);
+    }
+
+    // operations queued after this will wake us up
+    is_waiting.store(true, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (has_pending_operations() || io_uring_cq_ready(&ring) > 0)
+    {
+      is_waiting.store(false, std::memory_order_relaxed);
+      submit_pending_operations();
+      return;
+    }
+
+    // submit + wait in a single syscall:
+    submit_pending_operations(true);
+    is_waiting.store(false, std::memory_order_release);
+  }
+
+  void context::wake_up()
+  {
+    if (is_waiting.exchange(false, std::memory_order_seq_cst))
+      check::unx::n_check_success(eventfd_write(wakeup_fd, 1));
+  }
+
+  void context::_force_wake_up()
+  {
+    is_waiting.store(false, std::memory_order_seq_cst);
+    check::unx::n_check_success(eventfd_write(wakeup_fd, 1));
+  }
+
+  void context::wake_up_from(context& sender)
+  {
+    if (&sender == this || !sender.has_msg_ring)
+      return wake_up();
+    if (!is_waiting.exchange(false, std::memory_order_seq_cst))
+      return;
+
+    io_uring_sqe* const sqe = sender.get_sqe();
+    if (sqe == nullptr)
+    {
+      check::unx::n_check_success(eventfd_write(wakeup_fd, 1));
+      return;
+    }
+    io_uring_prep_msg_ring(sqe, ring.ring_fd, 0, k_msg_ring_user_data, 0);
+    io_uring_sqe_set_flags(sqe, IOSQE_CQE_SKIP_SUCCESS);
+    io_uring_sqe_set_data(sqe, nullptr);
+  }
+
+  dns_resolver& context::get_dns_resolver()
+  {
+    if (!resolver)
+      resolver = std::make_unique<dns_resolver>(dns_config);
+    return *resolver;
   }
 
   void context::queue_recv_operations()
   {
-    // Allocate the buffers here, as we may (or may not) have a connection that require preallocated buffers
-    if (!recv_requests.requests.empty())
-      allocate_buffers_for_multi_ops();
+    // re-arm the receives that ran out of buffers once enough buffers are back in the ring:
+    if (stalled_recv_count.load(std::memory_order_relaxed) > 0 && recv_buffers != nullptr)
+    {
+      std::lock_guard _sl(stalled_recv_lock);
+      std::erase_if(stalled_recv_requests, [](const recv_request& rq) { return rq.is_canceled(); });
+      if (recv_buffers->get_available_count() >= std::max(1u, recv_buffers->get_buffer_count() / k_recv_buffer_resume_divisor))
+      {
+        cr::out().debug("queue_recv: re-arming {} stalled receives", stalled_recv_requests.size());
+        for (recv_request& it : stalled_recv_requests)
+          recv_requests.add_request(std::move(it));
+        stalled_recv_requests.clear();
+      }
+      stalled_recv_count.store((uint32_t)stalled_recv_requests.size(), std::memory_order_relaxed);
+    }
 
     while (!recv_requests.requests.empty())
     {
@@ -1428,119 +3395,776 @@ namespace neam::io
         break;
 
       recv_request rq;
-      if (!recv_requests.requests.try_pop_front(rq) || rq.state.is_canceled())
+      if (!recv_requests.requests.try_pop_front(rq) || rq.is_canceled())
+      {
+        return_sqe(sqe);
+        continue;
+      }
+
+      const id_t fid = rq.fid;
+      const int fd = rq.sock_fd;
+      const bool is_shared = !!rq.shared_state;
+      const bool is_datagram = !!rq.datagram_state;
+      const bool is_receiving_fds = !!rq.fd_state;
+
+      bool is_using_buffer_ring = (rq.multishot || (!rq.data.data && (!rq.wait_all && rq.size_to_recv == everything)));
+      if (is_using_buffer_ring && !setup_recv_buffer_ring())
+      {
+        if (rq.multishot)
+        {
+          // multishot receives cannot work without a buffer ring
+          return_sqe(sqe);
+          if (is_shared)
+            rq.shared_state.complete({}, false, 0);
+          else if (is_datagram)
+            rq.datagram_state.complete({}, {}, false);
+          else
+            rq.state.complete({}, false, 0);
+          continue;
+        }
+        // fallback to a normal receive:
+        is_using_buffer_ring = false;
+        rq.size_to_recv = recv_buffer_size;
+      }
+
+      // Allocate + fill the query structure:
+      const query::type_t type = is_shared ? query::type_t::recv_shared
+                                 : is_datagram ? query::type_t::recv_datagram
+                                 : is_receiving_fds ? query::type_t::recv_fds
+                                 : query::type_t::recv;
+      query* q = query::allocate(fid, type, 1);
+      record_queue_wait(metric_type::recv, rq.queued_at);
+
+      if (is_shared)
+        q->shared_read_state[0] = std::move(rq.shared_state);
+      else if (is_datagram)
+        q->datagram_state[0] = std::move(rq.datagram_state);
+      else if (is_receiving_fds)
+        q->fd_read_state[0] = std::move(rq.fd_state);
+      else
+        q->read_states[0] = std::move(rq.state);
+
+      q->multishot = rq.multishot;
+
+      if (!is_using_buffer_ring)
+      {
+        if (!rq.data.data)
+        {
+          rq.data = raw_data::allocate(rq.size_to_recv);
+          rq.offset_in_data = 0;
+          memset(rq.data.get(), 0, rq.size_to_recv); // so valgrind is happy, can be skipped
+        }
+        *(q->get_data_offset_for_iovec(0)) = rq.offset_in_data;
+        *(q->get_data_size_for_iovec(0)) = rq.data.size;
+
+        q->iovecs[0].iov_len = rq.size_to_recv;
+        q->iovecs[0].iov_base = (uint8_t*)rq.data.data.release() + rq.offset_in_data;
+      }
+      else
+      {
+        q->iovecs[0].iov_base = nullptr;
+        q->iovecs[0].iov_len = 0;
+      }
+
+      if (is_datagram)
+      {
+        // the kernel writes the source address and the control messages at the start of the buffer (see process_recv_datagram_completion())
+        q->has_msg_op = true;
+        q->msg_op = new msg_operation {};
+        q->msg_op->msg.msg_namelen = sizeof(sockaddr_storage);
+        q->msg_op->msg.msg_controllen = CMSG_SPACE(sizeof(int)); // UDP_GRO
+        io_uring_prep_recvmsg_multishot(sqe, fd, &q->msg_op->msg, 0);
+      }
+      else if (is_receiving_fds)
+      {
+        q->has_msg_op = true;
+        q->msg_op = new msg_operation {};
+        q->msg_op->msg.msg_iov = q->iovecs;
+        q->msg_op->msg.msg_iovlen = 1;
+        q->msg_op->msg.msg_control = q->msg_op->control;
+        q->msg_op->msg.msg_controllen = sizeof(msg_operation::control);
+        io_uring_prep_recvmsg(sqe, fd, &q->msg_op->msg, MSG_CMSG_CLOEXEC);
+      }
+      else if (rq.multishot)
+        io_uring_prep_recv_multishot(sqe, fd, nullptr, 0, 0);
+      else
+        io_uring_prep_recv(sqe, fd, q->iovecs[0].iov_base, q->iovecs[0].iov_len, rq.wait_all ? MSG_WAITALL : 0);
+
+      cr::out().debug("queue_recv: multishot: {}, wait-all: {}, use-buffer-ring: {}, shared: {}, datagram: {}", rq.multishot, rq.wait_all, is_using_buffer_ring, is_shared, is_datagram);
+      if (is_using_buffer_ring)
+      {
+        io_uring_sqe_set_flags(sqe, IOSQE_BUFFER_SELECT);
+        sqe->buf_group = k_recv_buffer_group_id;
+      }
+
+      apply_fixed_file(sqe);
+      io_uring_sqe_set_data(sqe, q);
+      arm_deadline(*q);
+
+      ++recv_requests.in_flight;
+
+      if (is_shared)
+      {
+        q->shared_read_state->on_cancel([q, this]
+        {
+          cancel_operation(*q);
+        });
+      }
+      else if (is_datagram)
+      {
+        q->datagram_state->on_cancel([q, this]
+        {
+          cancel_operation(*q);
+        });
+      }
+      else if (is_receiving_fds)
+      {
+        q->fd_read_state->on_cancel([q, this]
+        {
+          cancel_operation(*q);
+        });
+      }
+      else
+      {
+        q->read_states->on_cancel([q, this]
+        {
+          cancel_operation(*q);
+        });
+      }
+    }
+  }
+
+  void context::queue_send_operations()
+  {
+    while (!send_requests.requests.empty())
+    {
+      // Get a SQE
+      io_uring_sqe* const sqe = get_sqe();
+      if (!sqe)
+        break;
+
+      send_request rq;
+      if (!send_requests.requests.try_pop_front(rq) || rq.state.is_canceled())
+      {
+        return_sqe(sqe);
+        continue;
+      }
+
+      const id_t fid = rq.fid;
+      const int fd = rq.sock_fd;
+
+      // Allocate + fill the query structure:
+      const unsigned iovec_count = rq.segments.empty() ? 1 : (unsigned)rq.segments.size();
+      query* q = query::allocate(fid, query::type_t::send, iovec_count, !rq.segments.empty());
+      record_queue_wait(metric_type::send, rq.queued_at);
+      q->segmented = iovec_count > 1;
+
+      q->write_states[0] = std::move(rq.state);
+
+      if (!rq.segments.empty())
+      {
+        // keep a reference on the shared data until the query is destructed:
+        for (unsigned i = 0; i < iovec_count; ++i)
+        {
+          q->iovecs[i].iov_len = rq.segments[i].get_size();
+          q->iovecs[i].iov_base = const_cast<void*>(rq.segments[i].get());
+          q->shared_data[i] = std::move(rq.segments[i]);
+        }
+      }
+      else
+      {
+        *(q->get_data_offset_for_iovec(0)) = rq.offset_in_data;
+        *(q->get_data_size_for_iovec(0)) = rq.data.size;
+        q->iovecs[0].iov_len = rq.size_to_send;
+        q->iovecs[0].iov_base = (uint8_t*)rq.data.data.release() + rq.offset_in_data;
+      }
+
+      const int flags = rq.wait_all ? MSG_WAITALL : 0;
+      // AF_UNIX sockets refuse zero-copy sends (EOPNOTSUPP)
+      const bool can_zero_copy = !std::bit_cast<file_descriptor>(fid).local;
+      const uint32_t buffer_index = (can_zero_copy && fixed_buffers != nullptr && q->shared_data != nullptr && !q->segmented && !rq.is_datagram && rq.fds.empty())
+                                    ? fixed_buffers->get_index(q->shared_data[0]) : buffer_pool::k_invalid_index;
+      if (rq.is_datagram || !rq.fds.empty())
+      {
+        // the inline msghdr of segmented sends (if any) is unused, this one also holds the destination / the control messages:
+        q->has_msg_op = true;
+        q->msg_op = new msg_operation {};
+        msghdr& msg = q->msg_op->msg;
+        if (rq.is_datagram)
+        {
+          memcpy(&q->msg_op->addr, &rq.destination.addr, std::min<size_t>(rq.destination.len, sizeof(sockaddr_storage)));
+          msg.msg_name = &q->msg_op->addr;
+          msg.msg_namelen = rq.destination.len;
+        }
+        msg.msg_iov = q->iovecs;
+        msg.msg_iovlen = iovec_count;
+        if (!rq.fds.empty())
+        {
+          msg.msg_control = q->msg_op->control;
+          msg.msg_controllen = CMSG_SPACE(sizeof(int) * rq.fds.size());
+          cmsghdr* const cmsg = CMSG_FIRSTHDR(&msg);
+          cmsg->cmsg_level = SOL_SOCKET;
+          cmsg->cmsg_type = SCM_RIGHTS;
+          cmsg->cmsg_len = CMSG_LEN(sizeof(int) * rq.fds.size());
+          memcpy(CMSG_DATA(cmsg), rq.fds.data(), sizeof(int) * rq.fds.size());
+        }
+        else if (rq.gso_size > 0)
+        {
+          msg.msg_control = q->msg_op->control;
+          msg.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+          cmsghdr* const cmsg = CMSG_FIRSTHDR(&msg);
+          cmsg->cmsg_level = SOL_UDP;
+          cmsg->cmsg_type = UDP_SEGMENT;
+          cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+          memcpy(CMSG_DATA(cmsg), &rq.gso_size, sizeof(uint16_t));
+        }
+        io_uring_prep_sendmsg(sqe, fd, &msg, flags);
+      }
+      else if (buffer_index != buffer_pool::k_invalid_index)
+      {
+        // registered buffer: zero-copy send without the page pinning
+        io_uring_prep_send_zc_fixed(sqe, fd, q->iovecs[0].iov_base, q->iovecs[0].iov_len, flags, 0, buffer_index);
+      }
+      else if (q->segmented)
+      {
+        q->msg->msg_iov = q->iovecs;
+        q->msg->msg_iovlen = iovec_count;
+        if (can_zero_copy && rq.size_to_send < 2 * 1024 * 1024)
+          io_uring_prep_sendmsg_zc(sqe, fd, q->msg, flags);
+        else
+          io_uring_prep_sendmsg(sqe, fd, q->msg, flags);
+      }
+      else if (can_zero_copy && q->iovecs[0].iov_len < 2 * 1024 * 1024)
+      {
+        // we can do zero-copy, as we have ownership of the data during the write and we keep it alive
+        // It seems performing big zero-copy send generate ENOMEM, failing the send. We only allow buffer less than 2Mib to perform zero copy sends.
+        io_uring_prep_send_zc(sqe, fd, q->iovecs[0].iov_base, q->iovecs[0].iov_len, flags, 0);
+      }
+      else
+      {
+        io_uring_prep_send(sqe, fd, q->iovecs[0].iov_base, q->iovecs[0].iov_len, flags);
+      }
+
+      apply_fixed_file(sqe);
+      io_uring_sqe_set_data(sqe, q);
+      arm_deadline(*q);
+
+      ++send_requests.in_flight;
+
+      q->write_states->on_cancel([q, this]
+      {
+        cancel_operation(*q);
+      });
+    }
+  }
+
+  void context::queue_stat_operations()
+  {
+    while (!stat_requests.requests.empty())
+    {
+      // Get a SQE
+      io_uring_sqe* const sqe = get_sqe();
+      if (!sqe)
+        break;
+
+      stat_request rq;
+      if (!stat_requests.requests.try_pop_front(rq) || rq.state.is_canceled())
+      {
+        return_sqe(sqe);
+        continue;
+      }
+
+      query* q = query::allocate(rq.fid, query::type_t::stat, 1, false);
+      q->file_op = new file_operation { .path = {}, .stx = {}, .read = false, .write = false, .direct = false, .new_path = {} };
+      *q->stat_state = std::move(rq.state);
+
+      // files are stat-ed by path (their fd may be closed before the statx runs), other fd directly
+      int dirfd = AT_FDCWD;
+      int flags = 0;
+      {
+        std::lock_guard<spinlock> _ml(mapped_lock);
+        if (auto it = mapped_files.find(rq.fid); it != mapped_files.end())
+          q->file_op->path = it->second;
+      }
+      if (q->file_op->path.empty())
+      {
+        dirfd = _get_fd(rq.fid);
+        flags = AT_EMPTY_PATH;
+      }
+      io_uring_prep_statx(sqe, dirfd, q->file_op->path.c_str(), flags, STATX_BASIC_STATS, &q->file_op->stx);
+      io_uring_sqe_set_data(sqe, q);
+
+      ++stat_requests.in_flight;
+    }
+  }
+
+  void context::process_stat_completion(query& q, int res)
+  {
+#if N_ASYNC_USE_TASK_MANAGER
+    q.stat_state->set_default_deferred_info(task_manager, group_id);
+#endif
+    q.stat_state->complete(std::move(q.file_op->stx), res >= 0);
+  }
+
+  void context::queue_path_operations()
+  {
+    while (!path_requests.requests.empty())
+    {
+      // Get a SQE
+      io_uring_sqe* const sqe = get_sqe();
+      if (!sqe)
+        break;
+
+      path_request rq;
+      if (!path_requests.requests.try_pop_front(rq) || rq.state.is_canceled())
+      {
+        return_sqe(sqe);
+        continue;
+      }
+
+      const bool is_rename = !rq.new_path.empty();
+      query* q = query::allocate(id_t::none, is_rename ? query::type_t::rename : query::type_t::unlink, 1, false);
+      q->file_op = new file_operation { .path = std::move(rq.path), .stx = {}, .read = false, .write = false, .direct = false, .new_path = std::move(rq.new_path) };
+      q->sync_states[0] = std::move(rq.state);
+
+      if (is_rename)
+        io_uring_prep_renameat(sqe, AT_FDCWD, q->file_op->path.c_str(), AT_FDCWD, q->file_op->new_path.c_str(), 0);
+      else
+        io_uring_prep_unlinkat(sqe, AT_FDCWD, q->file_op->path.c_str(), 0);
+      io_uring_sqe_set_data(sqe, q);
+
+      ++path_requests.in_flight;
+    }
+  }
+
+  void context::process_path_completion(query& q, int res)
+  {
+    if (res < 0)
+    {
+      cr::out().debug("io::context: {} of {} failed: {}", get_query_type_str(q.type), q.file_op->path,
+                      debug::errors::unix_errors::get_code_name(res));
+    }
+#if N_ASYNC_USE_TASK_MANAGER
+    q.sync_states[0].set_default_deferred_info(task_manager, group_id);
+#endif
+    q.sync_states[0].complete(res >= 0);
+  }
+
+  void context::queue_direct_read_operations()
+  {
+    if (direct_read_requests.requests.empty())
+      return;
+
+    std::mtc_vector<direct_read_request*> waiting_requests;
+    direct_read_request* rq;
+    while (direct_read_requests.requests.try_pop_front(rq))
+    {
+      std::unique_lock _l(rq->lock);
+      if (!rq->is_started)
+      {
+        rq->is_started = true;
+        ++direct_read_requests.in_flight;
+      }
+
+      // keep up to readahead_window chunks in flight:
+      bool is_pending = false;
+      while (!rq->is_done() && rq->chunks_in_flight < rq->readahead_window)
+      {
+        const int fd = open_file(rq->fid, true, false, false, false, is_pending);
+        if (fd < 0)
+        {
+          rq->has_failed = !is_pending;
+          break;
+        }
+
+        void* const buffer = direct_io_buffers.acquire();
+        if (buffer == nullptr)
+        {
+          is_pending = true;
+          break;
+        }
+        io_uring_sqe* const sqe = get_sqe();
+        if (!sqe)
+        {
+          direct_io_buffers.release(buffer);
+          is_pending = true;
+          break;
+        }
+
+        const size_t chunk_size = std::min(direct_io_buffers.get_buffer_size(), rq->end_offset - rq->next_chunk_offset);
+        query* q = query::allocate(rq->fid, query::type_t::read_direct, 1, false);
+        q->direct_chunk = new direct_read_chunk { rq, rq->next_chunk_offset };
+        q->iovecs[0].iov_base = buffer;
+        q->iovecs[0].iov_len = chunk_size;
+        io_uring_prep_read(sqe, fd, buffer, (unsigned)chunk_size, rq->next_chunk_offset);
+        apply_fixed_file(sqe);
+        io_uring_sqe_set_data(sqe, q);
+
+        rq->next_chunk_offset += chunk_size;
+        ++rq->chunks_in_flight;
+      }
+
+      if (rq->chunks_in_flight == 0 && rq->is_done())
+      {
+        _l.unlock();
+        finish_direct_read(rq);
+      }
+      else if (is_pending)
+      {
+        // no buffer / sqe / the file is being opened: try again on the next cycle
+        waiting_requests.push_back(rq);
+      }
+      else
+      {
+        // the window is full (or there's nothing left to read): completions will queue the request again if needed
+        rq->is_queued = false;
+      }
+    }
+
+    for (direct_read_request* it : waiting_requests)
+      direct_read_requests.add_request(std::move(it));
+  }
+
+  void context::process_direct_read_completion(query& q, int res)
+  {
+    direct_read_request* const rq = q.direct_chunk->rq;
+    const size_t chunk_offset = q.direct_chunk->offset;
+    const size_t chunk_size = q.iovecs[0].iov_len;
+
+    std::unique_lock _l(rq->lock);
+    --rq->chunks_in_flight;
+    if (res < 0)
+    {
+      rq->has_failed = true;
+    }
+    else
+    {
+      stats_total_read_bytes.fetch_add(res, std::memory_order_relaxed);
+
+      // copy the part of the chunk that was asked for:
+      const size_t start = std::max(chunk_offset, rq->offset);
+      const size_t end = std::min(chunk_offset + (size_t)res, rq->offset + rq->size);
+      if (end > start)
+      {
+        memcpy((uint8_t*)rq->data.get() + rq->offset_in_data + (start - rq->offset), (const uint8_t*)q.iovecs[0].iov_base + (start - chunk_offset), end - start);
+        rq->read_size += end - start;
+      }
+      if ((size_t)res < chunk_size)
+        rq->has_reached_eof = true;
+    }
+    direct_io_buffers.release(q.iovecs[0].iov_base);
+    q.iovecs[0].iov_base = nullptr;
+
+    // if the request is queued, queue_direct_read_operations() has the ownership of it
+    if (rq->is_queued)
+      return;
+    if (rq->chunks_in_flight == 0 && rq->is_done())
+    {
+      _l.unlock();
+      finish_direct_read(rq);
+    }
+    else if (!rq->is_done())
+    {
+      rq->is_queued = true;
+      _l.unlock();
+      direct_read_request* to_queue = rq;
+      direct_read_requests.add_request(std::move(to_queue));
+    }
+  }
+
+  void context::finish_direct_read(direct_read_request* rq)
+  {
+    if (!rq->state.is_canceled())
+    {
+#if N_ASYNC_USE_TASK_MANAGER
+      rq->state.set_default_deferred_info(task_manager, group_id);
+#endif
+      const bool success = !rq->has_failed;
+      rq->state.complete(std::move(rq->data), success, success ? rq->read_size : 0);
+    }
+    if (rq->is_started)
+      direct_read_requests.decrement_in_flight();
+    delete rq;
+  }
+
+  context::write_chain context::queue_send_file(id_t socket_fid, id_t file_fid, size_t offset, size_t size)
+  {
+    check::debug::n_check(socket_fid != id_t::none && socket_fid != id_t::invalid, "Invalid send-file operation");
+    if (size == 0)
+      return write_chain::create_and_complete({}, true, 0);
+
+    file_send_request* rq = new file_send_request
+    {
+      .socket_fid = socket_fid,
+      .file_fid = file_fid,
+      .sock_fd = _get_fd(socket_fid),
+      .offset = offset,
+      // whole_file: until the end of the file
+      .end_offset = size == whole_file ? whole_file : offset + size,
+      .state = {},
+      .lock = {},
+    };
+
+    write_chain ret;
+    rq->state = ret.create_state();
+    file_send_requests.add_request(std::move(rq));
+    return ret;
+  }
+
+  bool context::acquire_splice_pipe(file_send_request& rq)
+  {
+    {
+      std::lock_guard _pl(splice_pipe_lock);
+      if (!free_splice_pipes.empty())
+      {
+        rq.pipe = free_splice_pipes.back();
+        free_splice_pipes.pop_back();
+        return true;
+      }
+    }
+
+    if (check::unx::n_check_success(pipe2(rq.pipe.fds, O_CLOEXEC)) < 0)
+    {
+      rq.pipe = {};
+      return false;
+    }
+    // bigger pipes mean less splices (the kernel may refuse, in which case the pipe keeps its default size)
+    fcntl(rq.pipe.fds[1], F_SETPIPE_SZ, (int)k_splice_pipe_size);
+    const int pipe_size = fcntl(rq.pipe.fds[1], F_GETPIPE_SZ);
+    rq.pipe.size = pipe_size > 0 ? (size_t)pipe_size : 64 * 1024;
+    return true;
+  }
+
+  void context::release_splice_pipe(file_send_request& rq)
+  {
+    if (rq.pipe.fds[0] < 0)
+      return;
+
+    // a pipe with data left in it cannot be reused
+    if (rq.in_pipe == 0)
+    {
+      std::lock_guard _pl(splice_pipe_lock);
+      if (free_splice_pipes.size() < k_max_free_splice_pipe_count)
+      {
+        free_splice_pipes.push_back(rq.pipe);
+        rq.pipe = {};
+        return;
+      }
+    }
+    check::unx::n_check_success(::close(rq.pipe.fds[0]));
+    check::unx::n_check_success(::close(rq.pipe.fds[1]));
+    rq.pipe = {};
+  }
+
+  void context::prep_splice(io_uring_sqe* sqe, file_send_request* rq, int file_fd, bool to_socket, size_t size, bool link)
+  {
+    query* q = query::allocate(to_socket ? rq->socket_fid : rq->file_fid, query::type_t::splice, 0, false);
+    q->splice_chunk = new file_send_chunk { rq, to_socket, link, size };
+    if (to_socket)
+      io_uring_prep_splice(sqe, rq->pipe.fds[0], -1, rq->sock_fd, -1, (unsigned)size, SPLICE_F_MOVE);
+    else
+      io_uring_prep_splice(sqe, file_fd, (int64_t)rq->offset, rq->pipe.fds[1], -1, (unsigned)size, SPLICE_F_MOVE);
+    if (link)
+      io_uring_sqe_set_flags(sqe, IOSQE_IO_LINK);
+    io_uring_sqe_set_data(sqe, q);
+    if (to_socket)
+      arm_deadline(*q);
+    ++rq->splices_in_flight;
+  }
+
+  void context::queue_file_send_operations()
+  {
+    if (file_send_requests.requests.empty())
+      return;
+
+    std::mtc_vector<file_send_request*> waiting_requests;
+    file_send_request* rq;
+    while (file_send_requests.requests.try_pop_front(rq))
+    {
+      std::unique_lock _l(rq->lock);
+      if (!rq->is_started)
+      {
+        rq->is_started = true;
+        ++file_send_requests.in_flight;
+      }
+
+      bool is_pending = false;
+      if (!rq->is_done() && rq->splices_in_flight == 0)
+      {
+        if (rq->pipe.fds[0] < 0 && !acquire_splice_pipe(*rq))
+        {
+          rq->has_failed = true;
+        }
+        else if (rq->in_pipe > 0)
+        {
+          // what's left in the pipe (the splice to the socket was short, or canceled because the splice from the file was short):
+          if (io_uring_sqe* const sqe = get_sqe(); sqe != nullptr)
+          {
+            prep_splice(sqe, rq, -1, true, rq->in_pipe, false);
+            record_retry(metric_type::send);
+          }
+          else
+            is_pending = true;
+        }
+        else
+        {
+          const int fd = open_file(rq->file_fid, true, false, false, false, is_pending);
+          io_uring_sqe* const sqe = fd >= 0 ? get_sqe() : nullptr;
+          if (fd < 0)
+          {
+            rq->has_failed = !is_pending;
+          }
+          else if (sqe == nullptr)
+          {
+            is_pending = true;
+          }
+          else
+          {
+            // file -> pipe, linked to pipe -> socket (if both fit in the submit queue, so they are submitted together)
+            const size_t chunk_size = std::min(rq->pipe.size, rq->end_offset - rq->offset);
+            io_uring_sqe* const linked_sqe = io_uring_sq_space_left(&ring) > 0 ? get_sqe() : nullptr;
+            prep_splice(sqe, rq, fd, false, chunk_size, linked_sqe != nullptr);
+            if (linked_sqe != nullptr)
+              prep_splice(linked_sqe, rq, -1, true, chunk_size, false);
+          }
+        }
+      }
+
+      if (rq->splices_in_flight == 0 && rq->is_done())
+      {
+        _l.unlock();
+        finish_file_send(rq);
+      }
+      else if (is_pending)
+      {
+        // no sqe / the file is being opened: try again on the next cycle
+        waiting_requests.push_back(rq);
+      }
+      else
       {
-        return_sqe(sqe);
-        continue;
+        // completions will queue the request again
+        rq->is_queued = false;
       }
+    }
 
-      const id_t fid = rq.fid;
-      const int fd = rq.sock_fd;
-
-      const bool is_using_prealloc_buffer = (rq.multishot || (!rq.data.data && (!rq.wait_all && rq.size_to_recv == everything)));
-
-      // Allocate + fill the query structure:
-      query* q = query::allocate(fid, query::type_t::recv, 1);
-
-      q->read_states[0] = std::move(rq.state);
+    for (file_send_request* it : waiting_requests)
+      file_send_requests.add_request(std::move(it));
+  }
 
-      q->multishot = rq.multishot;
+  void context::process_splice_completion(query& q, int res)
+  {
+    file_send_request* const rq = q.splice_chunk->rq;
 
-      if (!is_using_prealloc_buffer)
+    std::unique_lock _l(rq->lock);
+    --rq->splices_in_flight;
+    if (!q.splice_chunk->to_socket)
+    {
+      if (res < 0)
       {
-        if (!rq.data.data)
-        {
-          rq.data = raw_data::allocate(rq.size_to_recv);
-          rq.offset_in_data = 0;
-          memset(rq.data.get(), 0, rq.size_to_recv); // so valgrind is happy, can be skipped
-        }
-        *(q->get_data_offset_for_iovec(0)) = rq.offset_in_data;
-        *(q->get_data_size_for_iovec(0)) = rq.data.size;
-
-        q->iovecs[0].iov_len = rq.size_to_recv;
-        q->iovecs[0].iov_base = (uint8_t*)rq.data.data.release() + rq.offset_in_data;
+        rq->has_failed = true;
       }
       else
       {
-        q->iovecs[0].iov_base = nullptr;
-        q->iovecs[0].iov_len = 0;
+        stats_total_read_bytes.fetch_add(res, std::memory_order_relaxed);
+        rq->offset += res;
+        rq->in_pipe += res;
+        if (res == 0)
+          rq->has_reached_eof = true;
+        if (q.splice_chunk->is_linked && (size_t)res < q.splice_chunk->size)
+          rq->is_link_broken = true;
+      }
+    }
+    else
+    {
+      if (res == -ECANCELED && rq->is_link_broken && !q.has_timed_out)
+      {
+        // nothing was sent, the data in the pipe is sent by the next splice
+        rq->is_link_broken = false;
+      }
+      else if (res <= 0)
+      {
+        rq->has_failed = true;
+        rq->has_timed_out = q.has_timed_out;
       }
-
-      if (rq.multishot)
-        io_uring_prep_recv_multishot(sqe, fd, nullptr, 0, 0);
       else
-        io_uring_prep_recv(sqe, fd, q->iovecs[0].iov_base, q->iovecs[0].iov_len, rq.wait_all ? MSG_WAITALL : 0);
-
-      cr::out().debug("queue_recv: multishot: {}, wait-all: {}, use-prealloc-buffers: {}", rq.multishot, rq.wait_all, is_using_prealloc_buffer);
-      if (is_using_prealloc_buffer)
-        io_uring_sqe_set_flags(sqe, IOSQE_BUFFER_SELECT);
-
-      io_uring_sqe_set_data(sqe, q);
+      {
+        stats_total_written_bytes.fetch_add(res, std::memory_order_relaxed);
+        rq->in_pipe -= res;
+        rq->sent_size += res;
+      }
+    }
 
-      check::unx::n_check_success(io_uring_submit(&ring));
-      ++recv_requests.in_flight;
+    // if the request is queued, queue_file_send_operations() has the ownership of it
+    if (rq->is_queued || rq->splices_in_flight > 0)
+      return;
+    if (rq->is_done())
+    {
+      _l.unlock();
+      finish_file_send(rq);
+    }
+    else
+    {
+      rq->is_queued = true;
+      _l.unlock();
+      file_send_request* to_queue = rq;
+      file_send_requests.add_request(std::move(to_queue));
+    }
+  }
 
-      q->read_states->on_cancel([q, this]
-      {
-        cancel_operation(*q);
-      });
+  void context::finish_file_send(file_send_request* rq)
+  {
+    if (!rq->state.is_canceled())
+    {
+#if N_ASYNC_USE_TASK_MANAGER
+      rq->state.set_default_deferred_info(task_manager, group_id);
+#endif
+      const bool success = !rq->has_failed;
+      rq->state.complete({}, success, success ? rq->sent_size : (rq->has_timed_out ? k_timed_out : 0));
     }
+    release_splice_pipe(*rq);
+    if (rq->is_started)
+      file_send_requests.decrement_in_flight();
+    delete rq;
   }
 
-  void context::queue_send_operations()
+  void context::queue_prefetch_operations()
   {
-    while (!send_requests.requests.empty())
+    while (!prefetch_requests.requests.empty())
     {
       // Get a SQE
       io_uring_sqe* const sqe = get_sqe();
       if (!sqe)
         break;
 
-      send_request rq;
-      if (!send_requests.requests.try_pop_front(rq) || rq.state.is_canceled())
+      prefetch_request rq;
+      if (!prefetch_requests.requests.try_pop_front(rq) || rq.state.is_canceled())
       {
         return_sqe(sqe);
         continue;
       }
 
-      const id_t fid = rq.fid;
-      const int fd = rq.sock_fd;
-
-      // Allocate + fill the query structure:
-      query* q = query::allocate(fid, query::type_t::send, 1);
-
-      q->write_states[0] = std::move(rq.state);
-
-      *(q->get_data_offset_for_iovec(0)) = rq.offset_in_data;
-      *(q->get_data_size_for_iovec(0)) = rq.data.size;
-
-      q->iovecs[0].iov_len = rq.size_to_send;
-      q->iovecs[0].iov_base = (uint8_t*)rq.data.data.release() + rq.offset_in_data;
-
-      const int flags = rq.wait_all ? MSG_WAITALL : 0;
-      if (q->iovecs[0].iov_len < 2 * 1024 * 1024)
-      {
-        // we can do zero-copy, as we have ownership of the data during the write and we keep it alive
-        // It seems performing big zero-copy send generate ENOMEM, failing the send. We only allow buffer less than 2Mib to perform zero copy sends.
-        io_uring_prep_send_zc(sqe, fd, q->iovecs[0].iov_base, q->iovecs[0].iov_len, flags, 0);
-      }
-      else
-      {
-        io_uring_prep_send(sqe, fd, q->iovecs[0].iov_base, q->iovecs[0].iov_len, flags);
-      }
-
+      query* q = query::allocate(id_t::none, query::type_t::madvise, 1, false);
+      q->view = new file_view(std::move(rq.view));
+      *q->prefetch_state = std::move(rq.state);
+      io_uring_prep_madvise(sqe, q->view->get_page_aligned_start(), (off_t)q->view->get_page_aligned_size(), MADV_WILLNEED);
       io_uring_sqe_set_data(sqe, q);
 
-      check::unx::n_check_success(io_uring_submit(&ring));
-      ++send_requests.in_flight;
-
-      q->write_states->on_cancel([q, this]
-      {
-        cancel_operation(*q);
-      });
+      ++prefetch_requests.in_flight;
     }
   }
 
+  void context::process_prefetch_completion(query& q, int res)
+  {
+    // kernels without IORING_OP_MADVISE:
+    if (res == -EINVAL || res == -EOPNOTSUPP)
+      res = q.view->advise(file_view::advice::willneed) ? 0 : -errno;
+
+#if N_ASYNC_USE_TASK_MANAGER
+    q.prefetch_state->set_default_deferred_info(task_manager, group_id);
+#endif
+    q.prefetch_state->complete(res >= 0);
+  }
+
   void context::process_deferred_operations()
   {
     deferred_request rq;
@@ -1556,17 +4180,41 @@ namespace neam::io
     if (success)
       stats_total_written_bytes.fetch_add(sz, std::memory_order_relaxed);
 
+    // reads of the range done while the write was in flight may have cached the old content:
+    // (blocks being read are not inserted, see block_cache::invalidate())
+    if (cache)
+    {
+      size_t write_size = 0;
+      for (unsigned i = 0; i < q.iovec_count; ++i)
+        write_size += q.iovecs[i].iov_len;
+      invalidate_cached_blocks(q.fid, q.write_offset, write_size);
+    }
+
+    if (q.segmented)
+    {
+      // a single operation, the data is kept alive by the query until it is destructed
+#if N_ASYNC_USE_TASK_MANAGER
+      q.write_states[0].set_default_deferred_info(task_manager, group_id);
+#endif
+      q.write_states[0].complete({}, success, success ? sz : get_failure_size(q));
+      return;
+    }
+
     for (unsigned i = 0; i < q.iovec_count; ++i)
     {
 #if N_ASYNC_USE_TASK_MANAGER
       q.write_states[i].set_default_deferred_info(task_manager, group_id);
 #endif
-      void* base_data = (uint8_t*)q.iovecs[i].iov_base - *(q.get_data_offset_for_iovec(i));
-      raw_data data {raw_data::unique_ptr(base_data), *(q.get_data_size_for_iovec(i))};
+      raw_data data;
+      if (q.shared_data == nullptr)
+      {
+        void* base_data = (uint8_t*)q.iovecs[i].iov_base - *(q.get_data_offset_for_iovec(i));
+        data = {raw_data::unique_ptr(base_data), *(q.get_data_size_for_iovec(i))};
+      }
       size_t write_size = std::min(sz, q.iovecs[i].iov_len);
       if (!success)
       {
-        q.write_states[i].complete(std::move(data), false, 0);
+        q.write_states[i].complete(std::move(data), false, get_failure_size(q));
       }
       else
       {
@@ -1579,6 +4227,21 @@ namespace neam::io
     }
   }
 
+  void context::process_read_shared_completion(query& q, bool success, size_t sz)
+  {
+    if (success)
+      stats_total_read_bytes.fetch_add(sz, std::memory_order_relaxed);
+
+#if N_ASYNC_USE_TASK_MANAGER
+    q.shared_read_state[0].set_default_deferred_info(task_manager, group_id);
+#endif
+    shared_raw_data data = std::move(q.shared_data[0]);
+    if (!success)
+      q.shared_read_state[0].complete({}, false, get_failure_size(q));
+    else
+      q.shared_read_state[0].complete(data.slice(0, sz), true, sz);
+  }
+
   void context::process_read_completion(query& q, bool success, size_t sz)
   {
     if (success)
@@ -1591,7 +4254,7 @@ namespace neam::io
 #endif
       if (!success)
       {
-        q.read_states[i].complete({raw_data::unique_ptr(), 0}, false, 0);
+        q.read_states[i].complete({raw_data::unique_ptr(), 0}, false, get_failure_size(q));
       }
       else
       {
@@ -1621,25 +4284,73 @@ namespace neam::io
     // add the new id as a socket supporting read/writes:
     if (success)
     {
-      const id_t id = register_socket(fd, false);
+      // connections accepted by an AF_UNIX socket are AF_UNIX sockets
+      const id_t id = register_socket(fd, false, std::bit_cast<file_descriptor>(q.fid).local);
       q.accept_state->complete(id);
     }
     else
     {
-      q.accept_state->complete(id_t::invalid);
+      q.accept_state->complete(q.has_timed_out ? id_t::none : id_t::invalid);
     }
   }
 
-  void context::process_connect_completion(query& q, bool success)
+  void context::process_connect_completion(query& q, int res)
   {
+    // try the next address (unless the connect was canceled):
+    if (res < 0 && q.connect_rq != nullptr && q.connect_rq->address_index + 1 < q.connect_rq->addresses.size()
+        && !q.connect_state->is_canceled())
+    {
+      cr::out().debug("io::context: connect to {}:{} failed ({}), trying the next address", q.connect_rq->addr, q.connect_rq->port,
+                      debug::errors::unix_errors::get_code_name(res));
+      // the socket may still be connecting (timed-out attempt) or be left in an unspecified state: start over from a fresh one
+      if (!reset_socket(q.connect_rq->sock_fd))
+      {
+        cr::out().debug("io::context: connect to {}:{}: failed to reset the socket", q.connect_rq->addr, q.connect_rq->port);
+#if N_ASYNC_USE_TASK_MANAGER
+        q.connect_state->set_default_deferred_info(task_manager, group_id);
+#endif
+        q.connect_state->complete(false);
+        return;
+      }
+      connect_request rq = std::move(*q.connect_rq);
+      ++rq.address_index;
+      rq.queued_at = std::chrono::steady_clock::now();
+      record_retry(metric_type::connect);
+      // the query is about to be destructed, so the cancel callback must not reference it anymore:
+      rq.state = std::move(*q.connect_state);
+      rq.state.on_cancel([] {});
+      connect_requests.add_request(std::move(rq));
+      return;
+    }
+
 #if N_ASYNC_USE_TASK_MANAGER
     q.connect_state->set_default_deferred_info(task_manager, group_id);
 #endif
-    q.connect_state->complete(success);
+    q.connect_state->complete(res >= 0);
   }
 
-  void context::process_recv_completion(query& q, bool success, size_t sz, bool is_using_buffer, uint16_t buffer_index)
+  void context::process_recv_completion(query& q, int res, bool has_more, bool is_using_buffer, uint16_t buffer_index)
   {
+    const bool success = res >= 0;
+    const size_t sz = success ? (size_t)res : 0;
+
+    // the ring was empty: stall the receive until buffers are back in the ring.
+    // (the socket is not read in the meantime, so the kernel buffers fill up and the peer is throttled)
+    if (res == -ENOBUFS && !has_more && recv_buffers != nullptr)
+    {
+      stall_receive(q);
+      return;
+    }
+
+    if (q.type == query::type_t::recv_shared)
+    {
+      shared_raw_data data;
+      if (is_using_buffer)
+        data = recv_buffers->take(buffer_index, sz);
+      q.shared_read_state[0].complete(std::move(data), success, success ? sz : get_failure_size(q));
+      return;
+    }
+
     raw_data data;
     if (!is_using_buffer)
     {
@@ -1653,63 +4364,333 @@ namespace neam::io
     }
     else
     {
-      data = std::move(prealloc_multi_buffers[buffer_index]);
-      data.size = sz;
+      // copy out, so the buffer is immediately back in the ring
+      data = recv_buffers->take_copy(buffer_index, sz);
+    }
+
+    q.read_states[0].complete(std::move(data), success, success ? sz : get_failure_size(q));
+  }
+
+  void context::process_recv_datagram_completion(query& q, int res, bool has_more, bool is_using_buffer, uint16_t buffer_index)
+  {
+    if (res == -ENOBUFS && !has_more && recv_buffers != nullptr)
+    {
+      stall_receive(q);
+      return;
+    }
+    if (res < 0 || !is_using_buffer)
+    {
+      q.datagram_state[0].complete({}, {}, false);
+      return;
+    }
+
+    const shared_raw_data buffer = recv_buffers->take(buffer_index, (size_t)res);
+    msghdr& msg = q.msg_op->msg;
+    io_uring_recvmsg_out* const out = io_uring_recvmsg_validate(const_cast<void*>(buffer.get()), res, &msg);
+    if (out == nullptr)
+    {
+      cr::out().debug("io::context: invalid recvmsg output on {}", get_string_for_id(q.fid));
+    }
+    else if ((out->flags & MSG_TRUNC) != 0)
+    {
+      cr::out().debug("io::context: dropping a truncated datagram on {} (receive buffers: {}b)", get_string_for_id(q.fid), recv_buffer_size);
+    }
+    else
+    {
+      dns_resolver::address source;
+      memset(&source, 0, sizeof(source));
+      source.len = std::min<socklen_t>(out->namelen, sizeof(source.addr));
+      memcpy(&source.addr, io_uring_recvmsg_name(out), source.len);
+
+      // UDP_GRO: the payload is multiple datagrams of segment_size bytes (the last one can be smaller)
+      size_t segment_size = 0;
+      for (cmsghdr* cmsg = io_uring_recvmsg_cmsg_firsthdr(out, &msg); cmsg != nullptr; cmsg = io_uring_recvmsg_cmsg_nexthdr(out, &msg, cmsg))
+      {
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
+        {
+          int value;
+          memcpy(&value, CMSG_DATA(cmsg), sizeof(value));
+          segment_size = value > 0 ? (size_t)value : 0;
+        }
+      }
+
+      const size_t payload_offset = (const uint8_t*)io_uring_recvmsg_payload(out, &msg) - (const uint8_t*)buffer.get();
+      const size_t payload_size = io_uring_recvmsg_payload_length(out, res, &msg);
+      const shared_raw_data payload = buffer.slice(payload_offset, payload_size);
+      if (segment_size == 0 || segment_size >= payload_size)
+      {
+        q.datagram_state[0].complete(shared_raw_data(payload), source, true);
+      }
+      else
+      {
+        for (size_t offset = 0; offset < payload_size; offset += segment_size)
+          q.datagram_state[0].complete(payload.slice(offset, segment_size), source, true);
+      }
+    }
+
+    // the multishot receive stopped (it must be queued again):
+    if (!has_more)
+      q.datagram_state[0].complete({}, {}, false);
+  }
+
+  void context::process_recv_fds_completion(query& q, int res)
+  {
+    const bool success = res >= 0;
+
+    void* base_data = (uint8_t*)q.iovecs[0].iov_base - *(q.get_data_offset_for_iovec(0));
+    raw_data data {raw_data::unique_ptr(base_data), *(q.get_data_size_for_iovec(0))};
+    // We have transfered the ownership to the callback, remove the pointer
+    q.iovecs[0].iov_base = nullptr;
+
+    std::vector<int> fds;
+    if (success)
+    {
+      msghdr& msg = q.msg_op->msg;
+      if ((msg.msg_flags & MSG_CTRUNC) != 0)
+        cr::out().warn("io::context: received more than {} fds on {}, the remaining ones have been dropped", k_max_passed_fd_count, get_string_for_id(q.fid));
+      for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg))
+      {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+          continue;
+        const size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        const size_t first = fds.size();
+        fds.resize(first + count);
+        memcpy(fds.data() + first, CMSG_DATA(cmsg), count * sizeof(int));
+      }
+
+      // nobody will take the ownership of the fds (the chain was canceled after the recvmsg completed):
+      if (!fds.empty() && q.fd_read_state[0].is_canceled())
+      {
+        for (const int fd : fds)
+          ::close(fd);
+        fds.clear();
+      }
+    }
+
+    q.fd_read_state[0].complete(std::move(data), std::move(fds), success, success ? (size_t)res : get_failure_size(q));
+  }
+
+  void context::stall_receive(query& q)
+  {
+    recv_buffers->on_exhausted();
+    record_retry(metric_type::recv);
+
+    recv_request rq
+    {
+      .fid = q.fid,
+      .sock_fd = _get_fd(q.fid),
+      .data = {},
+      .offset_in_data = 0,
+      .size_to_recv = everything,
+      .wait_all = false,
+      .multishot = q.multishot,
+      .state = {},
+    };
+    // the query is about to be destructed, so the cancel callback must not reference it anymore:
+    if (q.type == query::type_t::recv_shared)
+    {
+      rq.shared_state = std::move(q.shared_read_state[0]);
+      rq.shared_state.on_cancel([] {});
+    }
+    else if (q.type == query::type_t::recv_datagram)
+    {
+      rq.datagram_state = std::move(q.datagram_state[0]);
+      rq.datagram_state.on_cancel([] {});
+    }
+    else
+    {
+      rq.state = std::move(q.read_states[0]);
+      rq.state.on_cancel([] {});
     }
 
-    q.read_states[0].complete(std::move(data), success, success ? sz : 0);
+    std::lock_guard _sl(stalled_recv_lock);
+    stalled_recv_requests.push_back(std::move(rq));
+    stalled_recv_count.store((uint32_t)stalled_recv_requests.size(), std::memory_order_relaxed);
   }
 
   void context::process_send_completion(query& q, bool success, size_t sz)
   {
+    if (q.shared_data != nullptr)
+    {
+      // shared data (or segments): the data is kept alive by the query until it is destructed, the caller has its own references
+      q.write_states[0].complete({}, success, success ? sz : get_failure_size(q));
+      return;
+    }
+
     void* base_data = (uint8_t*)q.iovecs[0].iov_base - *(q.get_data_offset_for_iovec(0));
     raw_data data {raw_data::unique_ptr(base_data), *(q.get_data_size_for_iovec(0))};
     // We have transfered the ownership to the callback, remove the pointer
     q.iovecs[0].iov_base = nullptr;
 
-    q.write_states[0].complete(std::move(data), success, success ? sz : 0);
+    q.write_states[0].complete(std::move(data), success, success ? sz : get_failure_size(q));
   }
 
-  void context::allocate_buffers_for_multi_ops()
+  bool context::setup_recv_buffer_ring()
   {
-    if (buffer_count < k_prealloc_buffer_count)
+    if (recv_buffers != nullptr)
+      return true;
+    if (has_recv_buffer_ring_failed)
+      return false;
+
+    cr::out().debug("io::context: creating the receive buffer ring ({} buffers of {}Kib)...", recv_buffer_count, recv_buffer_size / 1024);
+    recv_buffers = buffer_ring::create(ring, recv_buffer_count, recv_buffer_size, k_recv_buffer_group_id);
+    if (recv_buffers == nullptr)
     {
-      cr::out().debug("io::context: allocating {} buffers of {}Mib...", k_prealloc_buffer_count - buffer_count, k_prealloc_buffer_size / 1024 / 1024);
-      while (buffer_count < k_prealloc_buffer_count)
-      {
-        io_uring_sqe* sqe = get_sqe();
-        if (!sqe)
-          return; // might be bad
-        prealloc_multi_buffers[buffer_count] = raw_data::allocate(k_prealloc_buffer_size);
-        memset(prealloc_multi_buffers[buffer_count].get(), 0, k_prealloc_buffer_size);
+      cr::out().warn("io::context: receive buffer rings are not supported, multishot receives are disabled");
+      has_recv_buffer_ring_failed = true;
+      return false;
+    }
+    return true;
+  }
+
+  context::metric_type context::get_metric_type(const query& q)
+  {
+    switch (q.type)
+    {
+      case query::type_t::read: [[fallthrough]];
+      case query::type_t::read_shared: [[fallthrough]];
+      case query::type_t::read_direct: return metric_type::read;
+      case query::type_t::write: return metric_type::write;
+      case query::type_t::accept: return metric_type::accept;
+      case query::type_t::connect: return metric_type::connect;
+      case query::type_t::recv: [[fallthrough]];
+      case query::type_t::recv_shared: [[fallthrough]];
+      case query::type_t::recv_datagram: [[fallthrough]];
+      case query::type_t::recv_fds: return metric_type::recv;
+      case query::type_t::send: return metric_type::send;
+      case query::type_t::splice: return q.splice_chunk->to_socket ? metric_type::send : metric_type::read;
+      case query::type_t::open: [[fallthrough]];
+      case query::type_t::stat: [[fallthrough]];
+      case query::type_t::fsync: [[fallthrough]];
+      case query::type_t::rename: [[fallthrough]];
+      case query::type_t::unlink: [[fallthrough]];
+      case query::type_t::madvise: return metric_type::file;
+    }
+    return metric_type::file;
+  }
 
-        io_uring_prep_provide_buffers(sqe, prealloc_multi_buffers[buffer_count].get(), k_prealloc_buffer_size, 1, 0, buffer_count);
-        io_uring_sqe_set_flags(sqe, IOSQE_CQE_SKIP_SUCCESS);
-        check::unx::n_check_success(io_uring_submit(&ring));
+  void context::record_completion_metrics(query& q, int res)
+  {
+    const metric_type type = get_metric_type(q);
+    operation_metric_counters& m = metrics[std::to_underlying(type)];
 
-        ++buffer_count;
-      }
+    const auto now = std::chrono::steady_clock::now();
+    m.latency.record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(now - q.submit_time).count());
+    if (q.multishot)
+      q.submit_time = now;
+    m.completion_count.fetch_add(1, std::memory_order_relaxed);
+
+    if (res < 0)
+    {
+      m.error_count.fetch_add(1, std::memory_order_relaxed);
+      if (q.has_timed_out)
+        m.timeout_count.fetch_add(1, std::memory_order_relaxed);
+      m.errors[std::min((unsigned)-res, k_max_tracked_errno)].fetch_add(1, std::memory_order_relaxed);
+      return;
     }
-    else
+
+    if (type == metric_type::accept || type == metric_type::connect || type == metric_type::file)
+      return;
+    m.size.record((uint64_t)res);
+
+    // short transfers (only when the size is known upfront: not for multishot receives / buffer ring receives / datagrams)
+    size_t requested_size = 0;
+    if (q.type == query::type_t::splice)
     {
-      for (uint32_t i = 0; i < k_prealloc_buffer_count; ++i)
-      {
-        if (prealloc_multi_buffers[i].data)
-          continue;
+      requested_size = q.splice_chunk->size;
+    }
+    else if (!q.multishot && q.type != query::type_t::recv_datagram)
+    {
+      for (unsigned i = 0; i < q.iovec_count; ++i)
+        requested_size += q.iovecs[i].iov_len;
+    }
+    if ((size_t)res < requested_size)
+      m.short_count.fetch_add(1, std::memory_order_relaxed);
+  }
 
-        io_uring_sqe* sqe = get_sqe();
-        if (!sqe)
-          return; // might be bad
-        prealloc_multi_buffers[i] = raw_data::allocate(k_prealloc_buffer_size);
+  void context::record_queue_wait(metric_type t, std::chrono::steady_clock::time_point queued_at)
+  {
+    const auto wait = std::chrono::steady_clock::now() - queued_at;
+    metrics[std::to_underlying(t)].queue_wait.record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(wait).count());
+  }
 
-        // for valgrind, could be skipped
-        memset(prealloc_multi_buffers[i].get(), 0, k_prealloc_buffer_size);
+  void context::record_retry(metric_type t)
+  {
+    metrics[std::to_underlying(t)].retry_count.fetch_add(1, std::memory_order_relaxed);
+  }
 
-        io_uring_prep_provide_buffers(sqe, prealloc_multi_buffers[i].get(), k_prealloc_buffer_size, 1, 0, i);
-        io_uring_sqe_set_flags(sqe, IOSQE_CQE_SKIP_SUCCESS);
-        check::unx::n_check_success(io_uring_submit(&ring));
-      }
+  context::metrics_snapshot context::get_metrics() const
+  {
+    metrics_snapshot ret;
+    for (unsigned i = 0; i < k_metric_type_count; ++i)
+    {
+      const operation_metric_counters& m = metrics[i];
+      operation_metrics& out = ret.operations[i];
+      out.latency = m.latency.get_snapshot();
+      out.queue_wait = m.queue_wait.get_snapshot();
+      out.size = m.size.get_snapshot();
+      out.completion_count = m.completion_count.load(std::memory_order_relaxed);
+      out.error_count = m.error_count.load(std::memory_order_relaxed);
+      out.timeout_count = m.timeout_count.load(std::memory_order_relaxed);
+      out.short_count = m.short_count.load(std::memory_order_relaxed);
+      out.retry_count = m.retry_count.load(std::memory_order_relaxed);
+      for (unsigned j = 0; j <= k_max_tracked_errno; ++j)
+        out.errors[j] = m.errors[j].load(std::memory_order_relaxed);
+    }
+    return ret;
+  }
+
+  void context::reset_metrics()
+  {
+    for (unsigned i = 0; i < k_metric_type_count; ++i)
+    {
+      operation_metric_counters& m = metrics[i];
+      m.latency.reset();
+      m.queue_wait.reset();
+      m.size.reset();
+      m.completion_count.store(0, std::memory_order_relaxed);
+      m.error_count.store(0, std::memory_order_relaxed);
+      m.timeout_count.store(0, std::memory_order_relaxed);
+      m.short_count.store(0, std::memory_order_relaxed);
+      m.retry_count.store(0, std::memory_order_relaxed);
+      for (auto& it : m.errors)
+        it.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  void context::operation_metrics::merge(const operation_metrics& o)
+  {
+    latency.merge(o.latency);
+    queue_wait.merge(o.queue_wait);
+    size.merge(o.size);
+    completion_count += o.completion_count;
+    error_count += o.error_count;
+    timeout_count += o.timeout_count;
+    short_count += o.short_count;
+    retry_count += o.retry_count;
+    for (unsigned i = 0; i <= k_max_tracked_errno; ++i)
+      errors[i] += o.errors[i];
+  }
+
+  void context::metrics_snapshot::merge(const metrics_snapshot& o)
+  {
+    for (unsigned i = 0; i < k_metric_type_count; ++i)
+      operations[i].merge(o.operations[i]);
+  }
+
+  const char* context::get_metric_type_str(metric_type t)
+  {
+    switch (t)
+    {
+      case metric_type::read: return "read";
+      case metric_type::write: return "write";
+      case metric_type::accept: return "accept";
+      case metric_type::connect: return "connect";
+      case metric_type::recv: return "recv";
+      case metric_type::send: return "send";
+      case metric_type::file: return "file";
     }
+    return "unknown";
   }
 
   const char* context::get_query_type_str(query::type_t t)
@@ -1722,6 +4703,18 @@ namespace neam::io
       case query::type_t::connect: return "connect";
       case query::type_t::recv: return "recv";
       case query::type_t::send: return "send";
+      case query::type_t::read_shared: return "read-shared";
+      case query::type_t::recv_shared: return "recv-shared";
+      case query::type_t::recv_datagram: return "recv-datagram";
+      case query::type_t::recv_fds: return "recv-fds";
+      case query::type_t::open: return "open";
+      case query::type_t::stat: return "stat";
+      case query::type_t::read_direct: return "read-direct";
+      case query::type_t::splice: return "splice";
+      case query::type_t::madvise: return "madvise";
+      case query::type_t::fsync: return "fsync";
+      case query::type_t::rename: return "rename";
+      case query::type_t::unlink: return "unlink";
     }
     return "unknown";
   }
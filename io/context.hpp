@@ -32,12 +32,18 @@
 
 #include <liburing.h>
 
+#include <sys/stat.h>
+
+#include <chrono>
 #include <filesystem>
+#include <list>
+#include <memory>
 #include <deque>
 #include <unordered_map>
 #include <unordered_set>
 
 #include "../mt_check/deque.hpp"
+#include "../mt_check/set.hpp"
 #include "../mt_check/unordered_set.hpp"
 #include "../mt_check/unordered_map.hpp"
 #include "../mt_check/vector.hpp"
@@ -50,10 +56,19 @@
 
 #include "../async/async.hpp"
 #include "../raw_data.hpp"
+#include "../shared_raw_data.hpp"
 #include "../raw_memory_pool_ts.hpp"
+#include "../slab_allocator.hpp"
 #include "../spinlock.hpp"
+#include "../log_histogram.hpp"
 
 #include "ip.hpp"
+#include "buffer_pool.hpp"
+#include "aligned_buffer_pool.hpp"
+#include "file_view.hpp"
+#include "block_cache.hpp"
+#include "buffer_ring.hpp"
+#include "dns_resolver.hpp"
 
 namespace neam::io
 {
@@ -64,31 +79,144 @@ namespace neam::io
   class context
   {
     private:
-      // Max number of queries that can be merged together.
-      // A too high value will cause the OS to outright reject the query.
-      static constexpr unsigned k_max_iovec_merge = IOV_MAX;
-      static constexpr uint8_t k_max_cycle_to_close = 6;
       static constexpr size_t k_max_open_file_count = 384;
 
-      // Necessary for queue_multi_receive. Only allocated on the first receive process.
-      static constexpr size_t k_prealloc_buffer_count = 8;
-      static constexpr size_t k_prealloc_buffer_size = 6 * 1024 * 1024;
+      // buffer group of the receive buffer ring
+      static constexpr uint16_t k_recv_buffer_group_id = 0;
+      // stalled receives are re-armed when at least 1/k_recv_buffer_resume_divisor of the ring is available
+      static constexpr uint32_t k_recv_buffer_resume_divisor = 8;
+
+      // requested size of the pipes of the file sends (the size of a chunk). The kernel may refuse it (see /proc/sys/fs/pipe-max-size)
+      static constexpr size_t k_splice_pipe_size = 1024 * 1024;
+      static constexpr size_t k_max_free_splice_pipe_count = 16;
 
     public:
       using read_chain = async::chain<raw_data&& /*data*/, bool /*success*/, size_t /*read_size*/>;
       using write_chain = async::chain<raw_data&& /*data*/, bool /*success*/, size_t /*write_size*/>;
+      using shared_read_chain = async::chain<shared_raw_data&& /*data*/, bool /*success*/, size_t /*read_size*/>;
       using connect_chain = async::chain<bool /*success*/>;
       using accept_chain = async::chain<id_t /* connection id (or invalid)*/>;
+      using stat_chain = async::chain<struct statx&& /*stat*/, bool /*success*/>;
+      using prefetch_chain = async::chain<bool /*success*/>;
+      using sync_chain = async::chain<bool /*success*/>;
+      /// \brief Completed once per received datagram (see queue_multi_receive_datagrams())
+      using datagram_chain = async::chain<shared_raw_data&& /*data*/, const dns_resolver::address& /*source*/, bool /*success*/>;
+      /// \brief Completed with the received data and the fds sent with it (see queue_receive_fds())
+      using fd_read_chain = async::chain<raw_data&& /*data*/, std::vector<int>&& /*fds*/, bool /*success*/, size_t /*read_size*/>;
 
       static constexpr size_t whole_file = ~uint64_t(0);
       static constexpr size_t everything = whole_file;
       static constexpr size_t append = ~uint64_t(0); // for writes only, indicate we want to append
       static constexpr size_t truncate = append - 1; // for writes only, indicate we want to truncate
 
+      // number of reads in flight for a single direct-io read (see set_direct_io())
+      static constexpr unsigned k_default_readahead_window = 4;
+
+      // Max number of queries that can be merged together.
+      // A too high value will cause the OS to outright reject the query.
+      static constexpr unsigned k_max_iovec_merge = IOV_MAX;
+
+      /// \brief Size of the operations that timed out (see set_operation_timeout()). Their success flag is false.
+      static constexpr size_t k_timed_out = ~uint32_t(0);
+
+      /// \brief Setup options of the io_uring ring.
+      /// Options that are refused by the kernel are dropped at construction (with a warning), see get_ring_flags()
+      struct ring_config
+      {
+        unsigned queue_depth = k_max_open_file_count;
+
+        /// \brief Maximum number of files kept open. When reached, the least recently used file is closed. (sockets / pipes are not counted)
+        unsigned max_open_file_count = k_max_open_file_count;
+        /// \brief 0 for the default (2 * queue_depth). Should be bigger than queue_depth if there's a lot of multishot operations.
+        unsigned completion_queue_depth = 0;
+
+        /// \brief Have a kernel thread poll the submit queue (removes the submit syscalls)
+        bool sqpoll = false;
+        /// \brief CPU the poll thread is pinned to (-1: no pinning)
+        int sqpoll_cpu = -1;
+        /// \brief Time before the poll thread goes to sleep (0: kernel default)
+        unsigned sqpoll_idle_ms = 0;
+
+        /// \warning If set, only the thread that created the context may call process() and the _wait functions
+        bool single_issuer = false;
+        /// \brief Only run the completion work when the completions are reaped. Requires single_issuer.
+        bool defer_taskrun = false;
+        /// \brief Don't interrupt the issuer to run the completion work
+        bool coop_taskrun = false;
+
+        /// \brief Size of the registered file table (0: disabled). Registered fd skip the per-operation fd lookup.
+        unsigned registered_file_count = 0;
+
+        /// \brief Number of buffers registered with the ring (0: disabled). See acquire_fixed_buffer()
+        unsigned fixed_buffer_count = 0;
+        size_t fixed_buffer_size = 64 * 1024;
+
+        /// \brief Number of buffers in the receive buffer ring (must be a power of two). The ring is created on the first receive that needs it.
+        /// Used by queue_multi_receive() and queue_receive() without a buffer and of size `everything`.
+        unsigned recv_buffer_count = 256;
+        /// \brief Size of each receive buffer (the maximum size of a single receive completion)
+        size_t recv_buffer_size = 16 * 1024;
+
+        /// \brief Number of page-aligned buffers used by direct-io reads (see set_direct_io()). Buffers are allocated on first use.
+        unsigned direct_io_buffer_count = 32;
+        /// \brief Size of the direct-io buffers: the size of a single direct read (rounded up to a multiple of the page size)
+        size_t direct_io_buffer_size = 1024 * 1024;
+
+        /// \brief Memory budget of the block cache (0: disabled). When enabled, small reads go through the cache (see get_block_cache())
+        size_t block_cache_budget = 0;
+        /// \brief Size of the blocks of the cache (reads are done per block)
+        size_t block_cache_block_size = 64 * 1024;
+        /// \brief Reads bigger than this bypass the cache (so streaming big files don't evict everything)
+        size_t block_cache_max_read_size = 256 * 1024;
+
+        /// \brief Settings of the resolver used by queue_connect()
+        dns_resolver::config dns = {};
+
+        /// \brief Index of the context, encoded in the ids of the sockets / pipes it creates (see get_shard_index(id_t)).
+        /// Used to route the operations when there are multiple contexts (see sharded_context)
+        uint8_t shard_index = 0;
+      };
+
       explicit context(const unsigned _queue_depth = k_max_open_file_count);
+      explicit context(const ring_config& config);
 
       ~context();
 
+      /// \brief Return the IORING_SETUP_* flags the ring has been created with
+      unsigned get_ring_flags() const { return ring_flags; }
+
+      /// \brief Return a buffer registered with the ring, or an empty shared_raw_data if none are available
+      /// Sends and single-segment writes of those buffers (or slices of them) automatically use fixed-buffer operations.
+      /// The buffer goes back to the pool when its last reference is dropped.
+      shared_raw_data acquire_fixed_buffer() { return fixed_buffers != nullptr ? fixed_buffers->acquire() : shared_raw_data{}; }
+
+      /// \brief Return the pool of registered buffers (nullptr if disabled)
+      const buffer_pool* get_fixed_buffer_pool() const { return fixed_buffers; }
+
+      /// \brief Return the receive buffer ring (nullptr if not yet created or not supported)
+      const buffer_ring* get_recv_buffer_ring() const { return recv_buffers; }
+
+      /// \brief Return whether receives are stalled because the receive buffer ring is exhausted
+      /// Stalled receives are re-armed once enough buffers are back in the ring (so slow consumers end-up throttling the peers)
+      bool has_recv_buffer_pressure() const { return stalled_recv_count.load(std::memory_order_relaxed) > 0; }
+
+      /// \brief Number of receives waiting for buffers to be back in the receive buffer ring
+      uint32_t get_stalled_receive_count() const { return stalled_recv_count.load(std::memory_order_relaxed); }
+
+      /// \brief Return the block cache (nullptr if disabled), for the stats / manual invalidation
+      /// Reads of at most ring_config::block_cache_max_read_size bytes (without provided data) are served from the cache,
+      /// and concurrent reads of the same block share a single read. Writes done with the context invalidate the blocks they touch
+      /// (when they are queued and when they complete, so reads done while the write is in flight are not kept in the cache).
+      /// \note Direct-io files and queue_read_fixed() bypass the cache
+      block_cache* get_block_cache() { return cache.get(); }
+      const block_cache* get_block_cache() const { return cache.get(); }
+
+      /// \brief Return the resolver used by queue_connect() (created on first use)
+      dns_resolver& get_dns_resolver();
+
+      /// \brief Return the size of the registered file table (0 if disabled)
+      unsigned get_registered_file_count() const { return registered_file_count; }
+
       /// \brief Tweak some of the behavior to avoid bad cases in multi-threaded contexts.
       /// \note if true, process() will have to be manually called (see the warning on the class comment)
       /// The default is true.
@@ -128,6 +256,8 @@ namespace neam::io
       {
         // prefix change means conflicts, we force close all opened files:
         force_close_all_fd(false);
+        if (cache)
+          cache->clear();
 
         prefix_directory = std::move(prefix);
       }
@@ -154,6 +284,24 @@ namespace neam::io
         return fid;
       }
 
+      /// \brief Make a file mapped on \e other visible to this context, with the same id and filename
+      /// (used by sharded_context, for operations on a file done by the shard of an other id)
+      /// \return false if the file is not mapped on \e other
+      bool _map_file_from(const context& other, id_t fid)
+      {
+        std::string filename;
+        {
+          std::lock_guard<spinlock> _ml(other.mapped_lock);
+          const auto it = other.mapped_files.find(fid);
+          if (it == other.mapped_files.end())
+            return false;
+          filename = it->second;
+        }
+        std::lock_guard<spinlock> _ml(mapped_lock);
+        mapped_files.insert_or_assign(fid, std::move(filename));
+        return true;
+      }
+
       static id_t get_file_id(const std::string& path)
       {
         return (id_t)((uint64_t)((id_t)string_id::_runtime_build_from_string(path.data(), path.size())) >> k_id_shift);
@@ -164,6 +312,8 @@ namespace neam::io
       {
         std::lock_guard<spinlock> _ml(mapped_lock);
         mapped_files.erase(fid);
+        direct_io_files.erase(fid);
+        file_views.erase(fid);
       }
 
       /// \brief Clear all mapped files
@@ -191,6 +341,44 @@ namespace neam::io
       /// \brief queue a read operation using pre-existing data
       [[nodiscard]] read_chain queue_read(id_t fid, size_t offset, size_t size, raw_data&& data, uint32_t offset_in_data = 0);
 
+      /// \brief Read the file with O_DIRECT, bypassing the page cache. Best for big files that are streamed once (the page cache is left alone).
+      /// Reads of the file are split in aligned chunks of ring_config::direct_io_buffer_size, with at most \e readahead_window of them in flight.
+      /// Unaligned offsets / sizes are supported (the chunks are over-read and the data is copied to the destination).
+      /// If the filesystem refuses O_DIRECT, the file is opened normally (the reads are still done in chunks).
+      /// \note Files opened for writing don't use O_DIRECT (unaligned writes would require a read-modify-write),
+      ///       so writes to the file are done as usual
+      /// \note queue_read_fixed() ignores this setting
+      void set_direct_io(id_t fid, unsigned readahead_window = k_default_readahead_window);
+      /// \brief Go back to buffered reads for the file
+      void clear_direct_io(id_t fid);
+      bool is_using_direct_io(id_t fid) const
+      {
+        std::lock_guard<spinlock> _ml(mapped_lock);
+        return direct_io_files.contains(fid);
+      }
+
+      /// \brief Memory-map the file (read-only) and return a view of [offset, offset + size). Cheaper than reads for random accesses in big files.
+      /// All the views of a file share the same mapping. The file is mapped on the first call (which is blocking),
+      /// and mapped again if a view goes past the end of the current mapping and the file has grown.
+      /// \note Returns an empty view if the file cannot be mapped, or if the range starts past the end of the file (it is clamped to the end of the file otherwise)
+      /// \note The view is not tied to the file being opened by the context, so reads / writes / views can be mixed freely
+      [[nodiscard]] file_view map_file_view(id_t fid, size_t offset = 0, size_t size = whole_file, file_view::advice advice = file_view::advice::normal);
+
+      /// \brief Drop the mapping kept by the context for the file (views still alive keep it mapped)
+      void release_file_view(id_t fid)
+      {
+        std::lock_guard<spinlock> _ml(mapped_lock);
+        file_views.erase(fid);
+      }
+
+      /// \brief Asynchronously prefetch the pages of the view (IORING_OP_MADVISE with MADV_WILLNEED),
+      /// so threads accessing the view don't stall on page faults
+      [[nodiscard]] prefetch_chain queue_prefetch(file_view view);
+
+      /// \brief Read in a registered buffer (see acquire_fixed_buffer()). Fallback to a normal buffer if none are available / size is too big.
+      /// \note Reads are not merged, so best for small random reads
+      [[nodiscard]] shared_read_chain queue_read_fixed(id_t fid, size_t offset, size_t size);
+
       /// \brief queue a write operation
       /// \note an offset of 0 will truncate the file if it isn't already opened)
       /// \warning order of writes are not guranteed unless writes are on contiguous chunks of data
@@ -198,14 +386,46 @@ namespace neam::io
       ///          (in this case the order will be from the lowest offset to the highest one, not the submission order)
       write_chain queue_write(id_t fid, size_t offset, raw_data&& data, uint32_t offset_in_data = 0, uint32_t size_to_write = 0);
 
+      /// \brief Write a list of segments (like the output of rle::encoder::to_segments()) with a single writev, without flattening them
+      /// \note The chain is completed with an empty raw_data, and the total written size
+      /// \note There can be at most k_max_iovec_merge segments
+      write_chain queue_write(id_t fid, size_t offset, std::vector<shared_raw_data>&& segments);
+
+      /// \brief Flush the file to the disk (fsync, or fdatasync if \e datasync is set)
+      /// Writes of the file queued before the call are on the disk once the chain completes.
+      /// Writes submitted in the same cycle are linked to the fsync (IOSQE_IO_LINK), so there's no extra round-trip.
+      /// Syncs of the same file queued in the same cycle are merged in a single fsync (group commit).
+      /// \note Works on any mapped path (directories included)
+      [[nodiscard]] sync_chain queue_fsync(id_t fid, bool datasync = false);
+
+      /// \brief Write + fdatasync. The chain is completed once the data is on the disk.
+      /// \note Durable writes of the same file queued in the same cycle share a single fdatasync
+      write_chain queue_write_durable(id_t fid, size_t offset, raw_data&& data, uint32_t offset_in_data = 0, uint32_t size_to_write = 0);
+
+      /// \brief Atomically replace the content of the file: the data is written to a temporary file (path + ".tmp"),
+      /// which is flushed then renamed over the file, then the directory is flushed.
+      /// The file has either the old content or the new one, even after a crash.
+      /// \note The file is closed (and its blocks evicted from the block cache) once the rename is done
+      [[nodiscard]] sync_chain queue_atomic_replace(id_t fid, raw_data&& data);
+
       static constexpr size_t k_invalid_file_size = ~size_t(0);
       /// \brief returns on-disk size of the file
+      /// \note blocking, see queue_stat()
       [[nodiscard]] size_t get_file_size(id_t fid) const;
 
       /// \brief return the most recent of either the modified time or the created time
       /// (some copy utilities seems to keep the modified date but only update the created date)
+      /// \note blocking, see queue_stat()
       [[nodiscard]] std::filesystem::file_time_type get_modified_or_created_time(id_t fid) const;
 
+      /// \brief Asynchronous statx of the file (STATX_BASIC_STATS)
+      [[nodiscard]] stat_chain queue_stat(id_t fid);
+
+      /// \brief Size of a regular file from a statx (k_invalid_file_size otherwise)
+      static size_t get_file_size(const struct statx& st);
+      /// \brief Same as get_modified_or_created_time(), from a statx
+      static std::filesystem::file_time_type get_modified_or_created_time(const struct statx& st);
+
       const char* get_c_filename(id_t fid) const
       {
         if (fid == id_t::invalid)
@@ -238,6 +458,10 @@ namespace neam::io
       [[nodiscard]] id_t create_socket(bool ipv6 = false);
 
       /// \brief connect to a host. Return whether the connect has succeeded or not.
+      /// The host is resolved asynchronously (numeric addresses and cached hosts are resolved inline).
+      /// If the host has multiple addresses, they are tried in turn (alternating IPv6 / IPv4) until one succeeds.
+      /// Each retry is done on a fresh socket (the fd and id of \e fid are kept). A timeout (see set_operation_timeout())
+      /// applies to each attempt, and a timed-out attempt also moves on to the next address.
       [[nodiscard]] connect_chain queue_connect(id_t fid, std::string host, uint32_t port, bool do_not_call_process = false)
       {
         connect_chain ret;
@@ -275,11 +499,116 @@ namespace neam::io
 
       [[nodiscard]] read_chain queue_receive(id_t fid, size_t size, raw_data&& data = {}, uint32_t offset_in_data = 0);
       [[nodiscard]] read_chain queue_full_receive(id_t fid, size_t size, raw_data&& data = {}, uint32_t offset_in_data = 0);
+      /// \brief Receive in a buffer of the receive buffer ring
+      /// \note the data is copied out of the ring buffer (so the buffer goes back to the ring immediately).
+      ///       Use queue_multi_receive_shared() to avoid the copy.
+      /// \note the completion chain will be triggered more than once, until it is cancelled or an error occurs
       [[nodiscard]] read_chain queue_multi_receive(id_t fid);
 
+      /// \brief Same as queue_multi_receive(), but hand out the buffer of the receive buffer ring directly (no copy)
+      /// The buffer goes back to the ring when the last reference to the data is dropped:
+      /// holding on to the data will stall the receives once the ring is exhausted.
+      [[nodiscard]] shared_read_chain queue_multi_receive_shared(id_t fid);
+
       [[nodiscard]] write_chain queue_send(id_t fid, raw_data&& data, uint32_t offset_in_data = 0, size_t size = 0);
       [[nodiscard]] write_chain queue_full_send(id_t fid, raw_data&& data, uint32_t offset_in_data = 0, size_t size = 0);
 
+      /// \brief Send a shared buffer (use slice() to only send a part of it). The data is kept alive until the send is done.
+      /// \note As the caller may keep references to the data, the chain is completed with an empty raw_data
+      [[nodiscard]] write_chain queue_send(id_t fid, shared_raw_data data);
+      [[nodiscard]] write_chain queue_full_send(id_t fid, shared_raw_data data);
+
+      /// \brief Send a list of segments (like the output of rle::encoder::to_segments()) with a single sendmsg, without flattening them
+      /// \note The chain is completed with an empty raw_data, and the total sent size
+      /// \note There can be at most k_max_iovec_merge segments
+      [[nodiscard]] write_chain queue_send(id_t fid, std::vector<shared_raw_data>&& segments);
+      [[nodiscard]] write_chain queue_full_send(id_t fid, std::vector<shared_raw_data>&& segments);
+
+      /// \brief Send the content of a file through a socket without copying it to userspace:
+      /// the data is spliced from the file to a pipe, and from the pipe to the socket (by chunks of the size of the pipe).
+      /// \note The chain is completed with an empty raw_data and the sent size, once everything is sent.
+      ///       If the file is smaller than offset + size, the chain is completed (successfully) with what was available.
+      /// \note Timeouts of the socket (see set_operation_timeout()) apply to each chunk
+      [[nodiscard]] write_chain queue_send_file(id_t socket_fid, id_t file_fid, size_t offset = 0, size_t size = whole_file);
+
+    public: // local (AF_UNIX) stuff
+      /// \brief Maximum number of fds sent / received with queue_send_fds() / queue_receive_fds()
+      static constexpr unsigned k_max_passed_fd_count = 16;
+
+      /// \brief Create an AF_UNIX socket + call bind/listen on it.
+      /// \param path A filesystem path, or a name in the abstract namespace if it starts with '@' (no file, gone with the socket).
+      ///             An existing socket file at \e path is removed first.
+      /// \param seqpacket Use SOCK_SEQPACKET (message boundaries are kept) instead of SOCK_STREAM
+      /// Accept with queue_accept() / queue_multi_accept() (or base_server).
+      [[nodiscard]] id_t create_unix_listening_socket(std::string_view path, bool seqpacket = false, uint16_t backlog_connection_count = 16);
+
+      /// \brief Create an AF_UNIX socket (for use with queue_connect_unix)
+      [[nodiscard]] id_t create_unix_socket(bool seqpacket = false);
+
+      /// \brief Connect to a unix socket (same \e path format as create_unix_listening_socket())
+      [[nodiscard]] connect_chain queue_connect_unix(id_t fid, std::string_view path);
+
+      /// \brief Create a pair of connected AF_UNIX sockets
+      /// \note if the return value is false, both a and b are unchanged
+      bool create_socket_pair(id_t& a, id_t& b, bool seqpacket = false);
+
+      /// \brief Send \e fds (SCM_RIGHTS) with \e data. The fds are duplicated by the kernel, so they can be closed once the send is done.
+      /// As ancillary data can't be sent alone on stream sockets, a single 0 byte is sent if \e data is empty.
+      /// \note The chain is completed with an empty raw_data
+      /// \note There can be at most k_max_passed_fd_count fds
+      [[nodiscard]] write_chain queue_send_fds(id_t fid, std::vector<int> fds, shared_raw_data data = {});
+
+      /// \brief Receive up to \e size bytes, and the fds sent with them (SCM_RIGHTS).
+      /// The received fds are owned by the caller (they are opened with O_CLOEXEC).
+      /// \note If the chain is canceled, the fds received by the (already completed) recvmsg are closed and not passed to the chain.
+      /// \note On stream sockets the fds are received with the first byte of the data they were sent with:
+      ///       the protocol must make sure the receive doesn't merge data sent with and without fds.
+      [[nodiscard]] fd_read_chain queue_receive_fds(id_t fid, size_t size);
+
+      /// \brief Create an anonymous file (memfd) of \e size bytes, to share large payloads with another process with queue_send_fds()
+      /// \return the fd (owned by the caller) or -1
+      static int create_shared_memory_fd(const char* name, size_t size);
+
+    public: // datagram (UDP) stuff
+      // UDP_MAX_SEGMENTS (the kernel refuses GSO sends with more segments)
+      static constexpr unsigned k_max_gso_segment_count = 64;
+      // the datagrams of a GSO send are a single (64KiB max) packet before segmentation
+      static constexpr size_t k_max_gso_batch_size = 63 * 1024;
+
+      /// \brief Create an UDP socket bound to \e port (0 for any port). IPV4 version.
+      /// \note Non-zero ports use SO_REUSEPORT, so multiple sockets (like one per shard) can share the datagrams of a port
+      [[nodiscard]] id_t create_udp_socket(uint16_t port = 0, uint32_t bind_addr = ipv4(0, 0, 0, 0) /*INADDR_ANY*/);
+      /// \brief Create an UDP socket bound to \e port (0 for any port). IPV6 version.
+      [[nodiscard]] id_t create_udp_socket(uint16_t port, const ipv6& ip, bool allow_ipv4 = true);
+
+      /// \brief Return whether the kernel supports UDP segmentation offload (known after the first create_udp_socket())
+      bool has_udp_gso() const { return has_udp_gso_support.load(std::memory_order_relaxed); }
+
+      /// \brief Enable UDP receive offload (UDP_GRO) on the socket: the kernel coalesces consecutive datagrams of the same flow,
+      /// which are split back by queue_multi_receive_datagrams() (so there is still a completion per datagram).
+      /// \note The receive buffers (ring_config::recv_buffer_size) should be 64KiB, bigger coalesced datagrams are truncated (and dropped)
+      /// \return false if not supported
+      bool set_udp_gro(id_t sid, bool enable = true);
+
+      /// \brief Receive datagrams (recvmsg multishot) in buffers of the receive buffer ring, with their source address.
+      /// The data is a slice of the buffer of the ring, which goes back to the ring when the last reference is dropped.
+      /// \note the completion chain is triggered for every datagram. It is completed as failed when the receive stops
+      ///       (error, cancellation, or the kernel dropped the multishot), in which case the receive must be queued again.
+      /// \note Truncated datagrams (bigger than ring_config::recv_buffer_size) are dropped
+      [[nodiscard]] datagram_chain queue_multi_receive_datagrams(id_t fid);
+
+      /// \brief Send a datagram to \e destination (use dns_resolver::parse_numeric_address() / dns_resolver::resolve() to get an address)
+      /// \note The chain is completed with an empty raw_data
+      [[nodiscard]] write_chain queue_send_datagram(id_t fid, const dns_resolver::address& destination, shared_raw_data data);
+
+      /// \brief Send multiple datagrams to \e destination.
+      /// If the kernel supports it and the datagrams have the same size (except the last one, which can be smaller),
+      /// they are sent with a single GSO sendmsg (segmented by the kernel / the NIC). Otherwise each datagram is a sendmsg
+      /// (still submitted with the other operations of the process()).
+      /// \note The chain is completed once all the datagrams are sent, with an empty raw_data and the total sent size.
+      ///       If any of the datagrams failed, the chain is completed as failed.
+      [[nodiscard]] write_chain queue_send_datagrams(id_t fid, const dns_resolver::address& destination, std::vector<shared_raw_data>&& datagrams);
+
     public: // misc stuff:
       /// \brief Create a pipe, with a read-end and a write-end
       /// \note if the return value is false, both read and write are unchanegd
@@ -289,6 +618,16 @@ namespace neam::io
       /// \note The id must be flagged as a non-automanaged id (pipe / socket / std{in,out,err})
       void cancel_all_pending_operations_for(id_t eid);
 
+      /// \brief Set a timeout on the operations of the id (reads, writes, receives, sends, accepts and connects), like SO_RCVTIMEO / SO_SNDTIMEO.
+      /// Operations queued after the call that are not completed after \e timeout are canceled and completed with a timeout status:
+      ///  - read / write chains are completed as failed, with a size of k_timed_out
+      ///  - accept chains are completed with id_t::none (id_t::invalid is for failures)
+      ///  - connect chains are completed as failed (each address of the host has its own timeout)
+      /// Multishot operations (multi-accept / multi-receive) time out after \e timeout without a completion (idle timeout).
+      /// \note Deadlines are checked by process() (the ring is woken up when the earliest one expires)
+      void set_operation_timeout(id_t fid, std::chrono::milliseconds timeout);
+      void clear_operation_timeout(id_t fid);
+
     public: // deferred operations (not async, only deferred. Can be canceled)
       async::continuation_chain _queue_deferred_operation()
       {
@@ -339,6 +678,13 @@ namespace neam::io
                || recv_requests.has_any_in_flight()
                || send_requests.has_any_in_flight()
                || deferred_requests.has_any_in_flight()
+               || stat_requests.has_any_in_flight()
+               || direct_read_requests.has_any_in_flight()
+               || file_send_requests.has_any_in_flight()
+               || prefetch_requests.has_any_in_flight()
+               || sync_requests.has_any_in_flight()
+               || path_requests.has_any_in_flight()
+               || open_in_flight.load(std::memory_order_acquire) > 0
                ;
       }
 
@@ -353,10 +699,17 @@ namespace neam::io
                || recv_requests.has_any_pending()
                || send_requests.has_any_pending()
                || deferred_requests.has_any_pending()
+               || stat_requests.has_any_pending()
+               || direct_read_requests.has_any_pending()
+               || file_send_requests.has_any_pending()
+               || prefetch_requests.has_any_pending()
+               || sync_requests.has_any_pending()
+               || path_requests.has_any_pending()
                ;
       }
 
       /// \brief process the queue
+      /// \note All the operations queued since the last call are submitted with a single syscall
       void process();
 
       /// \brief Only process completed queries
@@ -374,6 +727,35 @@ namespace neam::io
       /// \warning stall until there's something to do.
       void _wait_for_queries();
 
+      /// \brief Block until there's something to do: a completion, or a call to wake_up() (from any thread).
+      /// Pending operations are submitted before waiting. Completions are not processed (call process() after).
+      /// \note Meant for threads dedicated to processing the context:
+      ///       \code while (running) { ctx.process(); ctx.wait_for_activity(); } \endcode
+      void wait_for_activity();
+
+      /// \brief Wake-up the thread blocked in wait_for_activity(), if any. Thread-safe, and only does a syscall if the context is waiting.
+      void wake_up();
+
+      /// \brief Same as wake_up(), but always signals the eventfd: if nobody is waiting yet, the next wait_for_activity() returns right away.
+      /// For wake-ups that aren't backed by a queued operation (like stopping the thread processing the context).
+      void _force_wake_up();
+
+      /// \brief Same as wake_up(), but must be called by the thread processing \e sender:
+      /// the wake-up is an IORING_OP_MSG_RING submitted with the next batch of \e sender (so no syscall).
+      /// Fallbacks to wake_up() if the kernel doesn't support it.
+      void wake_up_from(context& sender);
+
+      /// \brief Index of the context (see ring_config::shard_index)
+      uint8_t get_shard_index() const { return shard_index; }
+
+      /// \brief Return whether the id is a socket / pipe / ... (as opposed to a mapped file)
+      static bool is_external_id(id_t id) { return ((uint64_t)id & k_external_id_flag) != 0; }
+      /// \brief Return the index of the context that created an external id
+      static uint8_t get_shard_index(id_t id)
+      {
+        return std::bit_cast<file_descriptor>((uint64_t)id & ~k_external_id_flag).shard_index;
+      }
+
     public: // stats:
       /// \brief Return the total number of operations sent to liburing
       /// \note slower than has_in_flight_operations
@@ -387,6 +769,13 @@ namespace neam::io
                + recv_requests.get_in_flight_count()
                + send_requests.get_in_flight_count()
                + deferred_requests.get_in_flight_count()
+               + stat_requests.get_in_flight_count()
+               + direct_read_requests.get_in_flight_count()
+               + file_send_requests.get_in_flight_count()
+               + prefetch_requests.get_in_flight_count()
+               + sync_requests.get_in_flight_count()
+               + path_requests.get_in_flight_count()
+               + open_in_flight.load(std::memory_order_acquire)
                ;
       }
 
@@ -402,14 +791,94 @@ namespace neam::io
                + recv_requests.get_in_queued_count()
                + send_requests.get_in_queued_count()
                + deferred_requests.get_in_queued_count()
+               + stat_requests.get_in_queued_count()
+               + direct_read_requests.get_in_queued_count()
+               + file_send_requests.get_in_queued_count()
+               + prefetch_requests.get_in_queued_count()
+               + sync_requests.get_in_queued_count()
+               + path_requests.get_in_queued_count()
                ;
       }
 
       uint64_t get_total_written_bytes() const { return stats_total_written_bytes.load(std::memory_order_relaxed); }
       uint64_t get_total_read_bytes() const { return stats_total_read_bytes.load(std::memory_order_relaxed); }
 
+      /// \brief Number of io_uring_submit calls (that submitted at least one operation)
+      uint64_t get_submit_count() const { return stats_submit_count.load(std::memory_order_relaxed); }
+      /// \brief Number of operations (SQE) submitted to io_uring
+      uint64_t get_submitted_sqe_count() const { return stats_submitted_sqe_count.load(std::memory_order_relaxed); }
+      /// \brief Maximum number of operations (SQE) submitted in a single io_uring_submit call
+      uint64_t get_max_sqe_per_submit() const { return stats_max_sqe_per_submit.load(std::memory_order_relaxed); }
+      /// \brief Average number of operations (SQE) per io_uring_submit call
+      double get_average_sqe_per_submit() const
+      {
+        const uint64_t submit_count = get_submit_count();
+        return submit_count > 0 ? (double)get_submitted_sqe_count() / (double)submit_count : 0.0;
+      }
+
       uint32_t get_opened_file_descriptors() const { return opened_fd.size(); }
-      bool has_too_many_file_descriptors() const { return get_opened_file_descriptors() >= k_max_open_file_count; }
+      /// \brief Number of files kept open (see ring_config::max_open_file_count)
+      uint32_t get_opened_file_count() const { return (uint32_t)file_lru.size(); }
+      /// \brief Files are closed as needed, so only the other fd (sockets, pipes, ...) are counted
+      bool has_too_many_file_descriptors() const { return get_opened_file_descriptors() - get_opened_file_count() >= max_open_file_count; }
+
+    public: // metrics
+      /// \brief What the operations do (queries are grouped by type for the metrics)
+      enum class metric_type : uint8_t
+      {
+        read, // file reads (including direct reads and the file side of queue_send_file())
+        write,
+        accept,
+        connect,
+        recv, // all receives (including datagrams and fd passing)
+        send, // all sends (including the socket side of queue_send_file())
+        file, // open, stat, fsync, rename, unlink, madvise
+      };
+      static constexpr unsigned k_metric_type_count = 7;
+      /// \brief Errors with an errno above are counted as k_max_tracked_errno
+      static constexpr unsigned k_max_tracked_errno = 134;
+
+      /// \brief Values are in ns for durations, in bytes for sizes
+      using metric_histogram = cr::log_histogram<>;
+
+      struct operation_metrics
+      {
+        /// \brief Duration between the preparation of the operation and its completion (the operation is submitted in the same process())
+        /// \note For multishot operations, each completion measures the duration since the previous one
+        metric_histogram::snapshot latency = {};
+        /// \brief Duration between the call to queue_*() and the preparation of the operation (read, write, accept, connect, recv, send only)
+        /// \note For connects, this includes the name resolution
+        metric_histogram::snapshot queue_wait = {};
+        /// \brief Size of the successful reads, writes, receives and sends
+        metric_histogram::snapshot size = {};
+
+        uint64_t completion_count = 0;
+        uint64_t error_count = 0;
+        /// \brief Operations that timed out (see set_operation_timeout()), also counted in the errors (as ECANCELED)
+        uint64_t timeout_count = 0;
+        /// \brief Successful transfers of less than what was asked for (reads at the end of a file, receives of what was available, ...)
+        uint64_t short_count = 0;
+        /// \brief Operations the context submitted again (connects to the next address, receives stalled on the buffer ring, ...)
+        uint64_t retry_count = 0;
+        /// \brief Errors indexed by errno
+        std::vector<uint64_t> errors = std::vector<uint64_t>(k_max_tracked_errno + 1, 0);
+
+        void merge(const operation_metrics& o);
+      };
+
+      struct metrics_snapshot
+      {
+        operation_metrics operations[k_metric_type_count];
+
+        const operation_metrics& operator[](metric_type t) const { return operations[std::to_underlying(t)]; }
+        void merge(const metrics_snapshot& o);
+      };
+
+      /// \brief Return a copy of the metrics (latencies, sizes and errors) of the operations
+      metrics_snapshot get_metrics() const;
+      void reset_metrics();
+
+      static const char* get_metric_type_str(metric_type t);
 
     private: // data structure:
       struct read_request
@@ -422,6 +891,13 @@ namespace neam::io
         uint32_t offset_in_data;
 
         read_chain::state state;
+
+        // if set, data and state are unused and the request is not merged with other requests
+        shared_raw_data shared_buffer = {};
+        shared_read_chain::state shared_state = {};
+
+        // for the metrics (see operation_metrics::queue_wait)
+        std::chrono::steady_clock::time_point queued_at = std::chrono::steady_clock::now();
       };
 
       struct write_request
@@ -433,6 +909,12 @@ namespace neam::io
         uint32_t size_to_write;
 
         write_chain::state state;
+
+        // if not empty, data is unused and the request is not merged with other requests
+        std::vector<shared_raw_data> segments = {};
+
+        // for the metrics (see operation_metrics::queue_wait)
+        std::chrono::steady_clock::time_point queued_at = std::chrono::steady_clock::now();
       };
 
       struct accept_request
@@ -443,6 +925,9 @@ namespace neam::io
         bool multi_accept;
 
         accept_chain::state state;
+
+        // for the metrics (see operation_metrics::queue_wait)
+        std::chrono::steady_clock::time_point queued_at = std::chrono::steady_clock::now();
       };
 
       struct connect_request
@@ -453,6 +938,14 @@ namespace neam::io
         uint32_t port;
 
         connect_chain::state state;
+
+        // filled by the resolution:
+        dns_resolver::address_list addresses = {};
+        uint32_t address_index = 0;
+        bool is_resolved = false;
+
+        // for the metrics (see operation_metrics::queue_wait)
+        std::chrono::steady_clock::time_point queued_at = std::chrono::steady_clock::now();
       };
 
       struct recv_request
@@ -467,25 +960,156 @@ namespace neam::io
         bool multishot;
 
         read_chain::state state;
+
+        // only for shared receives (state is unused then)
+        shared_read_chain::state shared_state = {};
+        // only for datagram receives (state is unused then)
+        datagram_chain::state datagram_state = {};
+        // only for receives with fd passing (state is unused then)
+        fd_read_chain::state fd_state = {};
+
+        // for the metrics (see operation_metrics::queue_wait)
+        std::chrono::steady_clock::time_point queued_at = std::chrono::steady_clock::now();
+
+        bool is_canceled() const
+        {
+          if (shared_state)
+            return shared_state.is_canceled();
+          if (datagram_state)
+            return datagram_state.is_canceled();
+          if (fd_state)
+            return fd_state.is_canceled();
+          return state.is_canceled();
+        }
       };
 
       struct send_request
       {
         id_t fid;
         int sock_fd;
-        raw_data data;
+        raw_data data = {};
+        std::vector<shared_raw_data> segments = {}; // if not empty, data is unused
         uint32_t offset_in_data;
         size_t size_to_send;
 
         bool wait_all;
 
         write_chain::state state;
+
+        // only for datagrams (segments is used then)
+        bool is_datagram = false;
+        uint16_t gso_size = 0; // if not 0, the segments are sent as datagrams of this size (UDP_SEGMENT)
+        dns_resolver::address destination = {};
+
+        // fds to send (SCM_RIGHTS, segments is used then)
+        std::vector<int> fds = {};
+
+        // for the metrics (see operation_metrics::queue_wait)
+        std::chrono::steady_clock::time_point queued_at = std::chrono::steady_clock::now();
       };
 
       struct deferred_request
       {
         async::continuation_chain::state state;
       };
+      // a read of a direct-io file, split in aligned chunks (in flight until all its chunks are completed)
+      struct direct_read_request
+      {
+        id_t fid;
+        size_t offset;
+        size_t size;
+
+        raw_data data;
+        uint32_t offset_in_data;
+
+        read_chain::state state;
+
+        unsigned readahead_window;
+
+        spinlock lock;
+        size_t next_chunk_offset; // aligned
+        size_t end_offset; // aligned
+        size_t read_size = 0;
+        unsigned chunks_in_flight = 0;
+        bool has_failed = false;
+        bool has_reached_eof = false;
+        bool is_queued = true;
+        bool is_started = false;
+
+        bool is_done() const
+        {
+          return has_failed || has_reached_eof || next_chunk_offset >= end_offset || state.is_canceled();
+        }
+      };
+      struct direct_read_chunk
+      {
+        direct_read_request* rq;
+        size_t offset;
+      };
+      struct splice_pipe
+      {
+        int fds[2] = { -1, -1 }; // read, write
+        size_t size = 0;
+      };
+      // a file sent through a socket (in flight until the whole range is sent)
+      struct file_send_request
+      {
+        id_t socket_fid;
+        id_t file_fid;
+        int sock_fd;
+        size_t offset; // next offset to splice from the file
+        size_t end_offset;
+
+        write_chain::state state;
+
+        spinlock lock;
+        splice_pipe pipe = {};
+        size_t in_pipe = 0; // spliced from the file, not yet to the socket
+        size_t sent_size = 0;
+        unsigned splices_in_flight = 0;
+        bool has_failed = false;
+        bool has_timed_out = false;
+        bool has_reached_eof = false;
+        // the splice from the file was short, so the linked splice to the socket is canceled
+        bool is_link_broken = false;
+        bool is_queued = true;
+        bool is_started = false;
+
+        bool is_done() const
+        {
+          return has_failed || state.is_canceled() || (in_pipe == 0 && (has_reached_eof || offset >= end_offset));
+        }
+      };
+      struct file_send_chunk
+      {
+        file_send_request* rq;
+        bool to_socket; // file -> pipe, or pipe -> socket
+        bool is_linked; // (file -> pipe only) the splice to the socket is linked to this one
+        size_t size;
+      };
+      struct prefetch_request
+      {
+        file_view view;
+        prefetch_chain::state state;
+      };
+      struct stat_request
+      {
+        id_t fid;
+        stat_chain::state state;
+      };
+      // rename (or unlink, if new_path is empty)
+      struct path_request
+      {
+        std::string path;
+        std::string new_path;
+        sync_chain::state state;
+      };
+      struct sync_request
+      {
+        id_t fid;
+        bool datasync;
+        sync_chain::state state;
+      };
       struct cancel_request
       {
         uint64_t data;
@@ -527,6 +1151,27 @@ namespace neam::io
         }
       };
 
+      // path / result of open and stat operations (must outlive the submission)
+      struct file_operation
+      {
+        std::string path;
+        struct statx stx;
+        bool read;
+        bool write;
+        bool direct;
+        // only for renames
+        std::string new_path;
+      };
+
+      // msghdr of sendmsg / recvmsg operations (datagrams, fd passing). Must outlive the submission.
+      struct msg_operation
+      {
+        msghdr msg;
+        sockaddr_storage addr;
+        // UDP_SEGMENT (sends) / UDP_GRO (receives) / SCM_RIGHTS
+        alignas(cmsghdr) uint8_t control[CMSG_SPACE(sizeof(int) * k_max_passed_fd_count)];
+      };
+
       // user data sent to io-uring
       struct query
       {
@@ -541,12 +1186,69 @@ namespace neam::io
           connect,
           recv,
           send,
+
+          // single read in a shared buffer:
+          read_shared,
+          // receive in a (shared) buffer of the receive buffer ring:
+          recv_shared,
+          // recvmsg multishot in a buffer of the receive buffer ring:
+          recv_datagram,
+          // recvmsg with SCM_RIGHTS:
+          recv_fds,
+
+          // files:
+          open,
+          stat,
+          read_direct,
+          // file -> pipe -> socket:
+          splice,
+          fsync,
+          rename,
+          unlink,
+
+          // file views:
+          madvise,
         };
 
         id_t fid;
         type_t type;
 
         bool multishot : 1;
+        // all the iovecs are part of the same operation (only the first state is used)
+        bool segmented : 1;
+        // the query is in context::deadlines (see set_operation_timeout())
+        bool has_deadline : 1;
+        // the query has been canceled because its deadline expired
+        bool has_timed_out : 1;
+        // sendmsg / recvmsg (msg_op is set)
+        bool has_msg_op : 1;
+
+        uint32_t timeout_ms;
+        std::chrono::steady_clock::time_point deadline;
+        // for the metrics (see operation_metrics::latency)
+        std::chrono::steady_clock::time_point submit_time;
+
+        // if not null, one per iovec. iovecs are not owned if set.
+        shared_raw_data* shared_data;
+        union
+        {
+          // only for segmented sends
+          msghdr* msg;
+          // only for connects: the remaining addresses (state is unused)
+          connect_request* connect_rq;
+          // only for open / stat / rename / unlink
+          file_operation* file_op;
+          // only for direct reads (state is unused, the buffer is iovecs[0])
+          direct_read_chunk* direct_chunk;
+          // only for splices (state is unused)
+          file_send_chunk* splice_chunk;
+          // only for madvise (keeps the mapping alive)
+          file_view* view;
+          // only for datagrams
+          msg_operation* msg_op;
+          // only for writes (the cached blocks of the range are invalidated on completion)
+          size_t write_offset;
+        };
 
         unsigned iovec_count;
         unsigned data_offet_array_offset;
@@ -556,6 +1258,12 @@ namespace neam::io
           write_chain::state* write_states;
           accept_chain::state* accept_state;
           connect_chain::state* connect_state;
+          shared_read_chain::state* shared_read_state;
+          stat_chain::state* stat_state;
+          prefetch_chain::state* prefetch_state;
+          sync_chain::state* sync_states; // one per iovec (iovecs are unused)
+          datagram_chain::state* datagram_state;
+          fd_read_chain::state* fd_read_state;
         };
         iovec iovecs[];
 
@@ -564,7 +1272,7 @@ namespace neam::io
 
         ~query();
 
-        static query* allocate(id_t fid, type_t t, unsigned iovec_count);
+        static query* allocate(id_t fid, type_t t, unsigned iovec_count, bool with_shared_data = false);
       };
 
       static constexpr uint64_t k_external_id_flag = 0x8000000000000000;
@@ -573,12 +1281,14 @@ namespace neam::io
       {
         int fd;
 
-        uint8_t counter = 0;
+        // index of the context that registered the fd (see ring_config::shard_index)
+        uint8_t shard_index = 0;
 
         // type:
         bool socket: 1 = false;
         bool pipe: 1 = false;
         bool file: 1 = false;
+        bool local: 1 = false; // AF_UNIX socket (zero-copy sends are not supported)
 
         // capabilities:
         bool read: 1 = false;
@@ -589,16 +1299,43 @@ namespace neam::io
       static_assert(alignof(file_descriptor) == alignof(id_t));
 
     private: // functions:
+      /// \brief Return a SQE to fill. The operation is only submitted on the next submit_pending_operations()
       io_uring_sqe* get_sqe();
       void return_sqe(io_uring_sqe* sqe);
 
-      int open_file(id_t fid, bool read, bool write, bool truncate, bool force_truncate, bool& try_again);
+      /// \brief If the fd is in the registered file table, make the sqe use it
+      void apply_fixed_file(io_uring_sqe* sqe);
+      void register_fixed_file(int fd);
+      void unregister_fixed_file(int fd);
+
+      /// \brief Submit all the prepared SQE in a single syscall (optionally also waiting for a completion)
+      void submit_pending_operations(bool wait_for_one_completion = false);
+
+      /// \brief process(), but the submission of the prepared operations can be left to the caller
+      void process_internal(bool submit);
+
+      /// \brief Return the fd of the file, or -1 if the file cannot be opened / is being opened (\e is_pending is set then)
+      int open_file(id_t fid, bool read, bool write, bool truncate, bool force_truncate, bool& is_pending);
+      void process_open_completion(query& q, int res);
+
+      // NOTE: fd_lock must be held
+      void touch_file_lru(id_t fid);
+      void remove_from_file_lru(id_t fid);
+      bool close_least_recently_used_file();
 
       id_t register_fd(file_descriptor fd, bool skip_if_already_registered = false);
-      id_t register_socket(int fd, bool accept);
+      id_t register_socket(int fd, bool accept, bool local = false);
+      /// \brief Replace the socket behind \e fd by a fresh, unconnected one (same fd number, so same id)
+      /// A socket that had a connect attempt (failed, canceled or timed-out) cannot be reliably reused for an other connect.
+      bool reset_socket(int fd);
 
       void process_completed_query(io_uring_cqe* cqe);
 
+      static metric_type get_metric_type(const query& q);
+      void record_completion_metrics(query& q, int res);
+      void record_queue_wait(metric_type t, std::chrono::steady_clock::time_point queued_at);
+      void record_retry(metric_type t);
+
 
       bool queue_close_operations_fd();
       bool queue_close_operations_id();
@@ -613,6 +1350,22 @@ namespace neam::io
       void queue_connect_operations();
       void queue_recv_operations();
       void queue_send_operations();
+      void queue_stat_operations();
+      void queue_direct_read_operations();
+      void queue_file_send_operations();
+      void queue_prefetch_operations();
+      void queue_path_operations();
+
+      /// \brief Prepare a single fsync for all the syncs of a file (group commit)
+      void queue_fsync_operation(io_uring_sqe* sqe, id_t fid, int fd, std::mtc_vector<sync_request>&& rqs);
+      /// \brief Return the fd to sync (any fd of the file will do), or -1 if the file cannot be opened / is being opened (\e is_pending is set then)
+      int get_fd_for_sync(id_t fid, bool& is_pending);
+      /// \brief Hold the syncs until the writes in flight of the file are completed
+      /// \return false (and the syncs are left untouched) if there are no writes in flight for the file
+      bool hold_sync_requests(id_t fid, std::mtc_vector<sync_request>& rqs);
+      bool has_writes_in_flight(id_t fid);
+      void on_write_submitted(id_t fid);
+      void on_write_completed(id_t fid);
 
       void process_deferred_operations();
 
@@ -620,21 +1373,126 @@ namespace neam::io
       void process_write_completion(query& q, bool success, size_t sz);
       void process_read_completion(query& q, bool success, size_t sz);
       void process_accept_completion(query& q, bool success, int ret);
-      void process_connect_completion(query& q, bool success);
-      void process_recv_completion(query& q, bool success, size_t ret, bool is_using_buffer, uint16_t buffer_index);
+      void process_connect_completion(query& q, int res);
+      void process_recv_completion(query& q, int res, bool has_more, bool is_using_buffer, uint16_t buffer_index);
+      void process_recv_datagram_completion(query& q, int res, bool has_more, bool is_using_buffer, uint16_t buffer_index);
+      void process_recv_fds_completion(query& q, int res);
+      /// \brief Hold a receive that failed because the receive buffer ring was empty, until enough buffers are back in the ring
+      void stall_receive(query& q);
+      void probe_udp_gso(int sock);
+      /// \brief Fill \e out with the address of a unix socket (a leading @ is for the abstract namespace)
+      static bool get_unix_address(std::string_view path, dns_resolver::address& out);
       void process_send_completion(query& q, bool success, size_t ret);
+      void process_read_shared_completion(query& q, bool success, size_t sz);
+      void process_stat_completion(query& q, int res);
+      void process_path_completion(query& q, int res);
+      void process_direct_read_completion(query& q, int res);
+      void finish_direct_read(direct_read_request* rq);
+      void process_splice_completion(query& q, int res);
+      void finish_file_send(file_send_request* rq);
+      /// \brief Prepare a splice of the file send. If \e link is set, the next operation is only run if the splice is complete.
+      void prep_splice(io_uring_sqe* sqe, file_send_request* rq, int file_fd, bool to_socket, size_t size, bool link);
+      /// \brief Give a (possibly recycled) pipe to the file send
+      bool acquire_splice_pipe(file_send_request& rq);
+      void release_splice_pipe(file_send_request& rq);
+      void process_prefetch_completion(query& q, int res);
+      void process_sync_completion(query& q, int res);
+
+      /// \brief mmap the whole file (read-only)
+      static file_view map_whole_file(const std::string& path);
+
+      /// \brief Return the readahead window of a direct-io file, 0 if the file is not using direct-io
+      unsigned get_direct_io_window(id_t fid) const;
+      read_chain queue_direct_read(id_t fid, size_t offset, size_t size, raw_data&& data, uint32_t offset_in_data, unsigned readahead_window);
+      /// \brief Read through the block cache (the blocks that are not in the cache are read with shared reads)
+      read_chain queue_cached_read(id_t fid, size_t offset, size_t size);
+      void invalidate_cached_blocks(id_t fid, size_t offset, size_t size);
+
+      /// \brief Asynchronous rename / unlink (IORING_OP_RENAMEAT / IORING_OP_UNLINKAT) of unprefixed paths
+      sync_chain queue_rename(std::string path, std::string new_path);
+      sync_chain queue_unlink(std::string path);
 
       static const char* get_query_type_str(query::type_t t);
 
       bool stat_file(id_t fid, struct stat& st) const;
 
       // NOTE: Must be called during a process or queue
-      void allocate_buffers_for_multi_ops();
+      bool setup_recv_buffer_ring();
+
+      void resolve_connect(connect_request&& rq);
+      void arm_wakeup(io_uring_sqe* sqe);
+
+      /// \brief Set the deadline of the query, if its id has a timeout (see set_operation_timeout())
+      void arm_deadline(query& q);
+      void disarm_deadline(query& q);
+      /// \brief Cancel the queries whose deadline expired, and arm a timeout for the earliest deadline
+      void process_expired_deadlines();
+      /// \brief Size to report for a failed query
+      static size_t get_failure_size(const query& q) { return q.has_timed_out ? k_timed_out : 0; }
 
     private: // members:
       unsigned queue_depth;
+      unsigned completion_queue_depth;
+      unsigned ring_flags = 0;
       io_uring ring;
       io_uring_sqe* returned_sqe = nullptr;
+      unsigned pending_sqe_count = 0; // prepared but not yet submitted
+
+      // registered files / buffers:
+      unsigned registered_file_count = 0;
+      spinlock fixed_file_lock;
+      std::mtc_unordered_map<int, unsigned> fixed_file_slots; // fd -> slot
+      std::mtc_vector<unsigned> free_fixed_file_slots;
+      buffer_pool* fixed_buffers = nullptr;
+
+      // direct-io reads:
+      aligned_buffer_pool direct_io_buffers;
+
+      // pipes of the file sends (see queue_send_file()). Only empty pipes are recycled.
+      spinlock splice_pipe_lock;
+      std::mtc_vector<splice_pipe> free_splice_pipes;
+
+      // block cache:
+      std::unique_ptr<block_cache> cache;
+      size_t block_cache_max_read_size;
+
+      // receive buffers:
+      uint32_t recv_buffer_count;
+      size_t recv_buffer_size;
+      buffer_ring* recv_buffers = nullptr;
+      bool has_recv_buffer_ring_failed = false;
+      spinlock stalled_recv_lock;
+      std::mtc_vector<recv_request> stalled_recv_requests; // receives that ran out of buffers
+      std::atomic<uint32_t> stalled_recv_count = 0;
+
+      std::atomic<bool> has_udp_gso_support = false;
+
+      // wake-ups: the resolver threads / wake_up() write to wakeup_fd (a read of it is armed while waiting)
+      static constexpr uint64_t k_wakeup_user_data = 1; // never a valid query pointer
+      // wake-ups sent by other rings (IORING_OP_MSG_RING):
+      static constexpr uint64_t k_msg_ring_user_data = 2;
+      int wakeup_fd = -1;
+      uint64_t wakeup_buffer = 0;
+      bool is_wakeup_armed = false;
+      std::atomic<bool> is_waiting = false;
+      bool has_msg_ring = false;
+      uint8_t shard_index = 0;
+
+      // operation timeouts (see set_operation_timeout()):
+      static constexpr uint64_t k_timeout_user_data = 3;
+      spinlock timeout_lock;
+      std::mtc_unordered_map<id_t, std::chrono::milliseconds> operation_timeouts;
+      std::atomic<uint32_t> operation_timeout_count = 0;
+      std::mtc_set<std::pair<std::chrono::steady_clock::time_point, query*>> deadlines;
+      // the IORING_OP_TIMEOUT waking the ring up for the earliest deadline:
+      bool is_timeout_armed = false;
+      std::chrono::steady_clock::time_point armed_timeout_deadline = {};
+      __kernel_timespec armed_timeout_ts = {};
+
+      // name resolution:
+      dns_resolver::config dns_config;
+      std::unique_ptr<dns_resolver> resolver;
+      std::atomic<uint32_t> resolving_connect_count = 0;
 
       std::string prefix_directory;
 
@@ -645,11 +1503,24 @@ namespace neam::io
 
       mutable spinlock mapped_lock;
       std::mtc_unordered_map<id_t, std::string> mapped_files;
+      struct direct_io_file
+      {
+        unsigned readahead_window;
+        bool is_refused = false; // the filesystem refused O_DIRECT, the file is opened normally
+      };
+      std::mtc_unordered_map<id_t, direct_io_file> direct_io_files;
+      std::mtc_unordered_map<id_t, file_view> file_views; // views of the whole files (see map_file_view())
 
 
       mutable spinlock fd_lock;
       std::mtc_unordered_map<id_t, file_descriptor> opened_fd;
       std::mtc_unordered_set<int> fd_to_be_closed; // list of fd to be closed. fd must not be present in opened_fd.
+      unsigned max_open_file_count;
+      std::list<id_t, cr::slab_stl_allocator<id_t>> file_lru; // opened files, most recently used first
+      std::mtc_unordered_map<id_t, decltype(file_lru)::iterator> file_lru_entries;
+      std::mtc_unordered_map<id_t, file_descriptor> opening_files; // files with an open in flight
+      std::mtc_unordered_set<id_t> failed_opens; // files whose open failed (the pending operations must fail)
+      std::atomic<unsigned> open_in_flight = 0;
       mutable spinlock cancel_lock;
       std::mtc_deque<cancel_request> to_be_canceled; // list of operations to cancel
 
@@ -660,12 +1531,38 @@ namespace neam::io
       request<recv_request> recv_requests;
       request<send_request> send_requests;
       request<deferred_request> deferred_requests;
-
-      raw_data prealloc_multi_buffers[k_prealloc_buffer_count];
-      uint32_t buffer_count = 0;
+      request<stat_request> stat_requests;
+      request<direct_read_request*> direct_read_requests; // in flight: the number of direct reads not yet completed
+      request<file_send_request*> file_send_requests; // in flight: the number of file sends not yet completed
+      request<prefetch_request> prefetch_requests;
+      request<sync_request> sync_requests;
+      request<path_request> path_requests;
+
+      // writes in flight per file, and the syncs waiting for them (see queue_fsync()):
+      spinlock sync_lock;
+      std::mtc_unordered_map<id_t, unsigned> file_writes_in_flight;
+      std::mtc_unordered_map<id_t, std::mtc_vector<sync_request>> held_sync_requests;
 
       std::atomic<uint64_t> stats_total_read_bytes = 0;
       std::atomic<uint64_t> stats_total_written_bytes = 0;
+      std::atomic<uint64_t> stats_submit_count = 0;
+      std::atomic<uint64_t> stats_submitted_sqe_count = 0;
+      std::atomic<uint64_t> stats_max_sqe_per_submit = 0;
+
+      struct operation_metric_counters
+      {
+        metric_histogram latency;
+        metric_histogram queue_wait;
+        metric_histogram size;
+        std::atomic<uint64_t> completion_count = 0;
+        std::atomic<uint64_t> error_count = 0;
+        std::atomic<uint64_t> timeout_count = 0;
+        std::atomic<uint64_t> short_count = 0;
+        std::atomic<uint64_t> retry_count = 0;
+        std::atomic<uint64_t> errors[k_max_tracked_errno + 1] = {};
+      };
+      // heap allocated, as the histograms are quite big
+      std::unique_ptr<operation_metric_counters[]> metrics = std::make_unique<operation_metric_counters[]>(k_metric_type_count);
 
       static constexpr unsigned k_max_pending_queue_size = 20; // above this, it will trigger a process call()
 
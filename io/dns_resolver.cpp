@@ -0,0 +1,308 @@
+//
+// created by : Timothée Feuillet
+// date: 2026-10-18
+//
+//
+// Copyright (c) 2026 Timothée Feuillet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include <cstring>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+#include "../debug/assert.hpp"
+
+#include "dns_resolver.hpp"
+
+namespace neam::io
+{
+  void dns_resolver::address::set_port(uint16_t port)
+  {
+    if (addr.ss_family == AF_INET)
+      ((sockaddr_in*)&addr)->sin_port = htons(port);
+    else if (addr.ss_family == AF_INET6)
+      ((sockaddr_in6*)&addr)->sin6_port = htons(port);
+  }
+
+  dns_resolver::dns_resolver()
+    : dns_resolver(config {})
+  {
+  }
+
+  dns_resolver::dns_resolver(const config& _conf)
+    : conf(_conf)
+  {
+  }
+
+  dns_resolver::~dns_resolver()
+  {
+    {
+      std::lock_guard _jl(jobs_lock);
+      should_stop = true;
+    }
+    jobs_cv.notify_all();
+    for (auto& it : threads)
+      it.join();
+  }
+
+  dns_resolver::resolve_chain dns_resolver::resolve(std::string host, uint16_t port)
+  {
+    address_list addresses;
+    if (try_resolve(host, port, addresses))
+      return resolve_chain::create_and_complete(std::move(addresses));
+
+    stats_cache_misses.fetch_add(1, std::memory_order_relaxed);
+
+    resolve_chain ret;
+    bool is_first_waiter;
+    {
+      std::lock_guard _cl(cache_lock);
+      auto& waiters = pending[host];
+      is_first_waiter = waiters.empty();
+      waiters.push_back({ port, ret.create_state() });
+    }
+
+    if (is_first_waiter)
+    {
+      pending_count.fetch_add(1, std::memory_order_relaxed);
+      {
+        std::lock_guard _jl(jobs_lock);
+        if (threads.empty())
+          start_threads();
+        jobs.push_back(std::move(host));
+      }
+      jobs_cv.notify_one();
+    }
+    return ret;
+  }
+
+  bool dns_resolver::try_resolve(std::string_view host, uint16_t port, address_list& out)
+  {
+    address numeric;
+    if (parse_numeric_address(host, port, numeric))
+    {
+      out.clear();
+      out.push_back(numeric);
+      return true;
+    }
+    return lookup_cache(host, port, out);
+  }
+
+  bool dns_resolver::parse_numeric_address(std::string_view host, uint16_t port, address& out)
+  {
+    if (host.size() >= 2 && host.front() == '[' && host.back() == ']')
+      host = host.substr(1, host.size() - 2);
+
+    // inet_pton requires a null-terminated string
+    char buffer[INET6_ADDRSTRLEN + 1];
+    if (host.empty() || host.size() >= sizeof(buffer))
+      return false;
+    memcpy(buffer, host.data(), host.size());
+    buffer[host.size()] = 0;
+
+    memset(&out, 0, sizeof(out));
+    sockaddr_in* const in4 = (sockaddr_in*)&out.addr;
+    if (inet_pton(AF_INET, buffer, &in4->sin_addr) == 1)
+    {
+      in4->sin_family = AF_INET;
+      in4->sin_port = htons(port);
+      out.len = sizeof(sockaddr_in);
+      return true;
+    }
+    sockaddr_in6* const in6 = (sockaddr_in6*)&out.addr;
+    if (inet_pton(AF_INET6, buffer, &in6->sin6_addr) == 1)
+    {
+      in6->sin6_family = AF_INET6;
+      in6->sin6_port = htons(port);
+      out.len = sizeof(sockaddr_in6);
+      return true;
+    }
+    return false;
+  }
+
+  void dns_resolver::order_for_connection(address_list& addresses, int socket_family)
+  {
+    if (socket_family != AF_INET && socket_family != AF_INET6)
+      return;
+
+    address_list v6;
+    address_list v4;
+    for (const address& it : addresses)
+    {
+      if (it.get_family() == AF_INET6)
+      {
+        if (socket_family == AF_INET6)
+          v6.push_back(it);
+      }
+      else if (it.get_family() == AF_INET)
+      {
+        if (socket_family == AF_INET)
+        {
+          v4.push_back(it);
+        }
+        else
+        {
+          // v4-mapped address (::ffff:a.b.c.d)
+          const sockaddr_in* const in4 = (const sockaddr_in*)&it.addr;
+          address mapped;
+          memset(&mapped, 0, sizeof(mapped));
+          sockaddr_in6* const in6 = (sockaddr_in6*)&mapped.addr;
+          in6->sin6_family = AF_INET6;
+          in6->sin6_port = in4->sin_port;
+          in6->sin6_addr.s6_addr[10] = 0xFF;
+          in6->sin6_addr.s6_addr[11] = 0xFF;
+          memcpy(&in6->sin6_addr.s6_addr[12], &in4->sin_addr, 4);
+          mapped.len = sizeof(sockaddr_in6);
+          v4.push_back(mapped);
+        }
+      }
+    }
+
+    addresses.clear();
+    for (size_t i = 0; i < std::max(v6.size(), v4.size()); ++i)
+    {
+      if (i < v6.size())
+        addresses.push_back(v6[i]);
+      if (i < v4.size())
+        addresses.push_back(v4[i]);
+    }
+  }
+
+  void dns_resolver::clear_cache()
+  {
+    std::lock_guard _cl(cache_lock);
+    cache.clear();
+  }
+
+  bool dns_resolver::lookup_cache(std::string_view host, uint16_t port, address_list& out)
+  {
+    std::lock_guard _cl(cache_lock);
+    auto it = cache.find(std::string(host));
+    if (it == cache.end())
+      return false;
+    if (it->second.expiration <= std::chrono::steady_clock::now())
+    {
+      cache.erase(it);
+      return false;
+    }
+    out = with_port(it->second.addresses, port);
+    stats_cache_hits.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  void dns_resolver::insert_in_cache(const std::string& host, const address_list& addresses)
+  {
+    const std::chrono::seconds ttl = addresses.empty() ? conf.negative_cache_ttl : conf.cache_ttl;
+    if (ttl.count() <= 0)
+      return;
+
+    const auto now = std::chrono::steady_clock::now();
+    std::lock_guard _cl(cache_lock);
+    if (cache.size() >= conf.max_cache_entry_count)
+    {
+      std::erase_if(cache, [now](const auto& it) { return it.second.expiration <= now; });
+      if (cache.size() >= conf.max_cache_entry_count && !cache.empty())
+        cache.erase(cache.begin());
+    }
+    cache.insert_or_assign(host, cache_entry { addresses, now + ttl });
+  }
+
+  dns_resolver::address_list dns_resolver::with_port(const address_list& addresses, uint16_t port)
+  {
+    address_list ret = addresses;
+    for (address& it : ret)
+      it.set_port(port);
+    return ret;
+  }
+
+  void dns_resolver::start_threads()
+  {
+    const unsigned count = std::max(1u, conf.thread_count);
+    threads.reserve(count);
+    for (unsigned i = 0; i < count; ++i)
+      threads.emplace_back([this] { thread_func(); });
+  }
+
+  void dns_resolver::thread_func()
+  {
+    while (true)
+    {
+      std::string host;
+      {
+        std::unique_lock _jl(jobs_lock);
+        jobs_cv.wait(_jl, [this] { return should_stop || !jobs.empty(); });
+        if (should_stop)
+          return;
+        host = std::move(jobs.front());
+        jobs.pop_front();
+      }
+      resolve_host(host);
+    }
+  }
+
+  void dns_resolver::resolve_host(const std::string& host)
+  {
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    address_list addresses;
+    addrinfo* result = nullptr;
+    const int ret = getaddrinfo(host.c_str(), nullptr, &hints, &result);
+    if (ret == 0)
+    {
+      for (const addrinfo* it = result; it != nullptr; it = it->ai_next)
+      {
+        if ((it->ai_family != AF_INET && it->ai_family != AF_INET6) || it->ai_addrlen > sizeof(sockaddr_storage))
+          continue;
+        address addr;
+        memset(&addr, 0, sizeof(addr));
+        memcpy(&addr.addr, it->ai_addr, it->ai_addrlen);
+        addr.len = it->ai_addrlen;
+        addresses.push_back(addr);
+      }
+      freeaddrinfo(result);
+    }
+    else
+    {
+      cr::out().debug("io::dns_resolver: failed to resolve {}: {}", host, gai_strerror(ret));
+    }
+
+    insert_in_cache(host, addresses);
+
+    std::mtc_vector<waiter> waiters;
+    {
+      std::lock_guard _cl(cache_lock);
+      if (auto it = pending.find(host); it != pending.end())
+      {
+        waiters = std::move(it->second);
+        pending.erase(it);
+      }
+    }
+    pending_count.fetch_sub(1, std::memory_order_relaxed);
+
+    for (waiter& it : waiters)
+      it.state.complete(with_port(addresses, it.port));
+  }
+}
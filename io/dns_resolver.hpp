@@ -0,0 +1,150 @@
+//
+// created by : Timothée Feuillet
+// date: 2026-10-18
+//
+//
+// Copyright (c) 2026 Timothée Feuillet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+
+#include <sys/socket.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "../mt_check/unordered_map.hpp"
+#include "../mt_check/vector.hpp"
+#include "../async/chain.hpp"
+#include "../spinlock.hpp"
+
+namespace neam::io
+{
+  /// \brief Asynchronous name resolution (getaddrinfo on a small pool of threads), with an in-memory cache.
+  /// Numeric addresses (IPv4 / IPv6, with or without brackets) skip the resolution entirely.
+  ///
+  /// \note getaddrinfo does not expose the TTL of the records, so entries are kept for a fixed duration (see config)
+  /// \note The threads are only started on the first resolution that is not a numeric address / in the cache.
+  class dns_resolver
+  {
+    public:
+      struct address
+      {
+        sockaddr_storage addr;
+        socklen_t len;
+
+        int get_family() const { return addr.ss_family; }
+        const sockaddr* get_sockaddr() const { return (const sockaddr*)&addr; }
+
+        void set_port(uint16_t port);
+      };
+      using address_list = std::vector<address>;
+
+      /// \brief Completed with the addresses (empty if the resolution failed)
+      using resolve_chain = async::chain<address_list&& /*addresses*/>;
+
+      struct config
+      {
+        unsigned thread_count = 2;
+        /// \brief Duration successful resolutions are kept in the cache
+        std::chrono::seconds cache_ttl = std::chrono::seconds(60);
+        /// \brief Duration failed resolutions are kept in the cache (0 to disable negative caching)
+        std::chrono::seconds negative_cache_ttl = std::chrono::seconds(5);
+        unsigned max_cache_entry_count = 1024;
+      };
+
+    public:
+      dns_resolver();
+      explicit dns_resolver(const config& _conf);
+      ~dns_resolver();
+
+      /// \brief Resolve a host.
+      /// \note The chain is completed inline for numeric addresses and cache hits, on a resolver thread otherwise
+      [[nodiscard]] resolve_chain resolve(std::string host, uint16_t port);
+
+      /// \brief Fast path: resolve numeric addresses and cached hosts.
+      /// \return false if the host requires an actual resolution (\e out is not modified then)
+      bool try_resolve(std::string_view host, uint16_t port, address_list& out);
+
+      /// \brief Parse a numeric IPv4 / IPv6 address (IPv6 addresses may be enclosed in brackets)
+      static bool parse_numeric_address(std::string_view host, uint16_t port, address& out);
+
+      /// \brief Filter and order the addresses for connection attempts with a socket of the family \e socket_family:
+      ///  - AF_INET sockets only keep the IPv4 addresses
+      ///  - AF_INET6 sockets keep everything (IPv4 addresses are converted to v4-mapped IPv6 addresses)
+      /// The families are interleaved, IPv6 first (as in RFC 8305), so an unreachable family only costs a single failed attempt.
+      static void order_for_connection(address_list& addresses, int socket_family);
+
+      /// \brief Remove all the entries of the cache
+      void clear_cache();
+
+      uint64_t get_cache_hit_count() const { return stats_cache_hits.load(std::memory_order_relaxed); }
+      uint64_t get_cache_miss_count() const { return stats_cache_misses.load(std::memory_order_relaxed); }
+      /// \brief Number of resolutions waiting for / being resolved by a resolver thread
+      uint32_t get_pending_resolution_count() const { return pending_count.load(std::memory_order_relaxed); }
+
+    private:
+      struct cache_entry
+      {
+        address_list addresses; // port is 0
+        std::chrono::steady_clock::time_point expiration;
+      };
+
+      struct waiter
+      {
+        uint16_t port;
+        resolve_chain::state state;
+      };
+
+      bool lookup_cache(std::string_view host, uint16_t port, address_list& out);
+      void insert_in_cache(const std::string& host, const address_list& addresses);
+      static address_list with_port(const address_list& addresses, uint16_t port);
+
+      void start_threads();
+      void thread_func();
+      void resolve_host(const std::string& host);
+
+    private:
+      const config conf;
+
+      spinlock cache_lock;
+      std::mtc_unordered_map<std::string, cache_entry> cache;
+      // hosts being resolved (the same host is only resolved once)
+      std::mtc_unordered_map<std::string, std::mtc_vector<waiter>> pending;
+
+      std::mutex jobs_lock;
+      std::condition_variable jobs_cv;
+      std::deque<std::string> jobs;
+      std::vector<std::thread> threads;
+      bool should_stop = false;
+
+      std::atomic<uint32_t> pending_count = 0;
+      std::atomic<uint64_t> stats_cache_hits = 0;
+      std::atomic<uint64_t> stats_cache_misses = 0;
+  };
+}
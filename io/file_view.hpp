@@ -0,0 +1,220 @@
+//
+// created by : Timothée Feuillet
+// date: 2026-10-18
+//
+//
+// Copyright (c) 2026 Timothée Feuillet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#pragma once
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <atomic>
+#include <string_view>
+
+#include "../raw_data.hpp"
+#include "../memory.hpp"
+#include "../debug/assert.hpp"
+
+namespace neam::io
+{
+  class context;
+
+  /// \brief Refcounted read-only view over a memory-mapped file (see context::map_file_view()).
+  /// Copies and slices are cheap (no memory copy, only a refcount increment); all the views of a file share the same mapping,
+  /// which is unmapped when the last view is dropped.
+  ///
+  /// \warning The mapping is shared with the file: truncating the file while views are alive will cause SIGBUS on access,
+  ///          and writes to the file are visible through the views.
+  /// \note Thread-safe in the same way std::shared_ptr is: the refcount is, concurrent access to the same instance is not.
+  class file_view
+  {
+    public:
+      enum class advice
+      {
+        normal,
+        sequential,
+        random,
+        willneed,
+        dontneed,
+      };
+
+    public:
+      file_view() = default;
+
+      file_view(const file_view& o) : map(o.map), offset(o.offset), size(o.size)
+      {
+        acquire();
+      }
+
+      file_view(file_view&& o) noexcept : map(o.map), offset(o.offset), size(o.size)
+      {
+        o.map = nullptr;
+        o.offset = 0;
+        o.size = 0;
+      }
+
+      file_view& operator = (const file_view& o)
+      {
+        if (&o == this) return *this;
+        o.acquire();
+        release();
+        map = o.map;
+        offset = o.offset;
+        size = o.size;
+        return *this;
+      }
+
+      file_view& operator = (file_view&& o) noexcept
+      {
+        if (&o == this) return *this;
+        release();
+        map = o.map;
+        offset = o.offset;
+        size = o.size;
+        o.map = nullptr;
+        o.offset = 0;
+        o.size = 0;
+        return *this;
+      }
+
+      ~file_view() { release(); }
+
+    public:
+      const void* get() const
+      {
+        if (map == nullptr) return nullptr;
+        return (const uint8_t*)map->base + offset;
+      }
+
+      template<typename T>
+      const T* get_as() const { return (const T*)get(); }
+
+      std::string_view get_as_string_view() const { return { (const char*)get(), size }; }
+
+      uint64_t get_size() const { return size; }
+      /// \brief Offset of the view in the file
+      uint64_t get_offset() const { return offset; }
+
+      explicit operator bool () const { return map != nullptr; }
+
+      /// \brief Size of the whole mapping (the size of the file when it was mapped)
+      uint64_t get_mapping_size() const { return map != nullptr ? map->size : 0; }
+
+      /// \brief Return a view of a sub-range of the data
+      /// \note The range is clamped to the current view
+      [[nodiscard]] file_view slice(uint64_t slice_offset, uint64_t slice_size = ~uint64_t(0)) const
+      {
+        check::debug::n_assert(slice_offset <= size, "file_view: slice offset ({}) outside of the view (size: {})", slice_offset, size);
+        file_view ret = *this;
+        ret.offset = offset + slice_offset;
+        ret.size = std::min(slice_size, size - slice_offset);
+        return ret;
+      }
+
+      /// \brief Copy the content of the view to a new raw_data
+      [[nodiscard]] raw_data duplicate() const
+      {
+        return raw_data::duplicate(get(), size);
+      }
+
+      /// \brief Start of the pages covered by the view (for madvise and co)
+      void* get_page_aligned_start() const
+      {
+        if (map == nullptr) return nullptr;
+        return (uint8_t*)map->base + (offset - offset % memory::get_page_size());
+      }
+      /// \brief Size of the pages covered by the view (for madvise and co)
+      size_t get_page_aligned_size() const
+      {
+        if (map == nullptr) return 0;
+        return size + offset % memory::get_page_size();
+      }
+
+      /// \brief madvise() the pages covered by the view
+      /// \note willneed may block while the readahead is started. See context::queue_prefetch() for the non-blocking version.
+      bool advise(advice a) const
+      {
+        if (map == nullptr || size == 0)
+          return false;
+        return madvise(get_page_aligned_start(), get_page_aligned_size(), get_madvise_flag(a)) == 0;
+      }
+
+      static int get_madvise_flag(advice a)
+      {
+        switch (a)
+        {
+          case advice::normal: return MADV_NORMAL;
+          case advice::sequential: return MADV_SEQUENTIAL;
+          case advice::random: return MADV_RANDOM;
+          case advice::willneed: return MADV_WILLNEED;
+          case advice::dontneed: return MADV_DONTNEED;
+        }
+        return MADV_NORMAL;
+      }
+
+    private:
+      struct mapping
+      {
+        std::atomic<uint32_t> ref_count;
+        void* base;
+        uint64_t size;
+      };
+
+      /// \brief Take the ownership of a mapping of the whole file (of \e size bytes)
+      static file_view from_mapping(void* base, uint64_t size)
+      {
+        file_view ret;
+        ret.map = new mapping { {1}, base, size };
+        ret.size = size;
+        return ret;
+      }
+
+      void acquire() const
+      {
+        if (map != nullptr)
+          map->ref_count.fetch_add(1, std::memory_order_relaxed);
+      }
+
+      void release()
+      {
+        if (map == nullptr)
+          return;
+        if (map->ref_count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+          munmap(map->base, map->size);
+          delete map;
+        }
+        map = nullptr;
+      }
+
+    private:
+      mapping* map = nullptr;
+      uint64_t offset = 0;
+      uint64_t size = 0;
+
+      friend class context;
+  };
+}
@@ -39,6 +39,18 @@ namespace neam::io::network
     ioctx->close(socket);
     socket = id_t::none;
 
+    // fail the queued sends:
+    std::vector<queued_send_t> queued;
+    {
+      std::lock_guard _sl(send_lock);
+      queued.swap(send_queue);
+      queued_send_size = 0;
+    }
+    for (auto& it : queued)
+      it.state.complete({}, false, 0);
+
+    _release_flow_control();
+
     if (server_base != nullptr)
     {
       server_base->move_to_ended_connections(*this);
@@ -57,9 +69,12 @@ namespace neam::io::network
 
   context::write_chain connection_t::queue_send(raw_data&& data, uint32_t offset_in_data)
   {
+    const size_t size = data.size - offset_in_data;
+    _add_outbound_size(size);
     return ioctx->queue_send(socket, std::move(data), offset_in_data)
-    .then([this](raw_data&& rd, bool success, uint32_t read_size)
+    .then([this, size](raw_data&& rd, bool success, uint32_t read_size)
     {
+      _release_outbound_size(size);
       if (!success || read_size == 0)
       {
         close();
@@ -71,9 +86,12 @@ namespace neam::io::network
   }
   context::write_chain connection_t::queue_full_send(raw_data&& data, uint32_t offset_in_data)
   {
+    const size_t size = data.size - offset_in_data;
+    _add_outbound_size(size);
     return ioctx->queue_full_send(socket, std::move(data), offset_in_data)
-    .then([this](raw_data&& rd, bool success, uint32_t read_size)
+    .then([this, size](raw_data&& rd, bool success, uint32_t read_size)
     {
+      _release_outbound_size(size);
       if (!success || read_size == 0)
       {
         close();
@@ -83,6 +101,387 @@ namespace neam::io::network
       return context::write_chain::create_and_complete(std::move(rd), true, read_size);
     });
   }
+  context::write_chain connection_t::queue_send_file(id_t file_fid, size_t offset, size_t size)
+  {
+    return ioctx->queue_send_file(socket, file_fid, offset, size)
+    .then([this](raw_data&& rd, bool success, size_t sent_size)
+    {
+      if (!success)
+      {
+        close();
+        return context::write_chain::create_and_complete({}, false, sent_size);
+      }
+
+      return context::write_chain::create_and_complete(std::move(rd), true, sent_size);
+    });
+  }
+
+  context::write_chain connection_t::queue_coalesced_send(raw_data&& data, uint32_t offset_in_data)
+  {
+    return queue_coalesced_send(shared_raw_data(std::move(data)).slice(offset_in_data));
+  }
+
+  context::write_chain connection_t::queue_coalesced_send(shared_raw_data data)
+  {
+    if (is_closed())
+      return context::write_chain::create_and_complete({}, false, 0);
+
+    context::write_chain ret;
+    bool should_flush = false;
+    bool should_schedule = false;
+    _add_outbound_size(data.get_size());
+    {
+      std::lock_guard _sl(send_lock);
+      queued_send_size += data.get_size();
+      send_queue.push_back({ std::move(data), ret.create_state() });
+
+      if (queued_send_size >= send_budget || send_queue.size() >= context::k_max_iovec_merge)
+      {
+        should_flush = true;
+      }
+      else if (!corked && !is_flush_scheduled)
+      {
+        is_flush_scheduled = true;
+        should_schedule = true;
+      }
+    }
+
+    if (should_flush)
+      flush();
+    else if (should_schedule)
+      _schedule_flush();
+    return ret;
+  }
+
+  void connection_t::flush()
+  {
+    std::vector<queued_send_t> batch;
+    {
+      std::lock_guard _sl(send_lock);
+      batch.swap(send_queue);
+      queued_send_size = 0;
+    }
+    if (batch.empty())
+      return;
+
+    if (is_closed())
+    {
+      for (auto& it : batch)
+      {
+        _release_outbound_size(it.data.get_size());
+        it.state.complete({}, false, 0);
+      }
+      return;
+    }
+
+    _send_batch(std::move(batch));
+  }
+
+  void connection_t::cork()
+  {
+    std::lock_guard _sl(send_lock);
+    corked = true;
+  }
+
+  void connection_t::uncork()
+  {
+    {
+      std::lock_guard _sl(send_lock);
+      corked = false;
+    }
+    flush();
+  }
+
+  void connection_t::_schedule_flush()
+  {
+    // deferred operations are run at the end of process(), after the sends have been queued:
+    // everything queued until then is part of the same batch
+    ioctx->_queue_deferred_operation().then([this, tk = in_flight_operations.get_token()]
+    {
+      bool should_flush;
+      {
+        std::lock_guard _sl(send_lock);
+        is_flush_scheduled = false;
+        should_flush = !corked;
+      }
+      if (should_flush)
+        flush();
+    });
+  }
+
+  void connection_t::_send_batch(std::vector<queued_send_t>&& batch)
+  {
+    std::vector<shared_raw_data> segments;
+    std::vector<size_t> sizes;
+    std::vector<context::write_chain::state> states;
+    segments.reserve(batch.size());
+    sizes.reserve(batch.size());
+    states.reserve(batch.size());
+    size_t batch_size = 0;
+    for (auto& it : batch)
+    {
+      batch_size += it.data.get_size();
+      sizes.push_back(it.data.get_size());
+      segments.push_back(std::move(it.data));
+      states.push_back(std::move(it.state));
+    }
+
+    ioctx->queue_full_send(socket, std::move(segments))
+    .then([this, batch_size, sizes = std::move(sizes), states = std::move(states), tk = in_flight_operations.get_token()]
+          (raw_data&& /*rd*/, bool success, uint32_t sent_size) mutable
+    {
+      _release_outbound_size(batch_size);
+      if (!success || sent_size == 0)
+      {
+        close();
+        for (auto& it : states)
+          it.complete({}, false, 0);
+        return;
+      }
+
+      for (size_t i = 0; i < states.size(); ++i)
+        states[i].complete({}, true, sizes[i]);
+    });
+  }
+
+  void connection_t::set_send_watermarks(size_t low, size_t high)
+  {
+    check::debug::n_assert(high == 0 || low < high, "connection_t::set_send_watermarks: low watermark ({}) must be below the high watermark ({})", low, high);
+    {
+      std::lock_guard _fl(flow_lock);
+      send_low_watermark = low;
+      send_high_watermark = high;
+      is_send_blocked = high > 0 && outbound_size >= high;
+    }
+    _update_flow_control();
+  }
+
+  void connection_t::set_receive_watermarks(size_t low, size_t high)
+  {
+    check::debug::n_assert(high == 0 || low < high, "connection_t::set_receive_watermarks: low watermark ({}) must be below the high watermark ({})", low, high);
+    {
+      std::lock_guard _fl(flow_lock);
+      receive_low_watermark = low;
+      receive_high_watermark = high;
+      is_receive_blocked = high > 0 && inbound_size >= high;
+    }
+    _update_flow_control();
+  }
+
+  size_t connection_t::get_outbound_size() const
+  {
+    std::lock_guard _fl(flow_lock);
+    return outbound_size;
+  }
+
+  size_t connection_t::get_inbound_size() const
+  {
+    std::lock_guard _fl(flow_lock);
+    return inbound_size;
+  }
+
+  bool connection_t::has_send_capacity() const
+  {
+    if (server_base != nullptr && server_base->is_over_memory_budget())
+      return false;
+    std::lock_guard _fl(flow_lock);
+    return !is_send_blocked;
+  }
+
+  bool connection_t::is_receive_paused() const
+  {
+    if (server_base != nullptr && server_base->is_over_memory_budget())
+      return true;
+    std::lock_guard _fl(flow_lock);
+    return is_receive_blocked;
+  }
+
+  connection_t::capacity_chain connection_t::wait_for_send_capacity()
+  {
+    if (is_closed())
+      return capacity_chain::create_and_complete(false);
+    if (has_send_capacity())
+      return capacity_chain::create_and_complete(true);
+
+    capacity_chain ret;
+    {
+      std::lock_guard _fl(flow_lock);
+      send_capacity_waiters.push_back(ret.create_state());
+    }
+    // the capacity may have changed in the meantime:
+    _update_flow_control();
+    return ret;
+  }
+
+  connection_t::capacity_chain connection_t::wait_for_receive_capacity()
+  {
+    if (is_closed())
+      return capacity_chain::create_and_complete(false);
+    if (!is_receive_paused())
+      return capacity_chain::create_and_complete(true);
+
+    capacity_chain ret;
+    {
+      std::lock_guard _fl(flow_lock);
+      receive_capacity_waiters.push_back(ret.create_state());
+    }
+    // the capacity may have changed in the meantime:
+    _update_flow_control();
+    return ret;
+  }
+
+  void connection_t::add_inbound_size(size_t size)
+  {
+    bool is_released;
+    {
+      std::lock_guard _fl(flow_lock);
+      inbound_size += size;
+      if (receive_high_watermark > 0 && inbound_size >= receive_high_watermark)
+        is_receive_blocked = true;
+      is_released = is_flow_released;
+    }
+    if (server_base != nullptr && !is_released)
+      server_base->_on_buffered_size_changed((ptrdiff_t)size);
+  }
+
+  void connection_t::release_inbound_size(size_t size)
+  {
+    bool is_released;
+    {
+      std::lock_guard _fl(flow_lock);
+      check::debug::n_assert(size <= inbound_size, "connection_t::release_inbound_size: releasing more than what was added");
+      size = std::min(size, inbound_size);
+      inbound_size -= size;
+      if (is_receive_blocked && inbound_size <= receive_low_watermark)
+        is_receive_blocked = false;
+      is_released = is_flow_released;
+    }
+    if (server_base != nullptr && !is_released)
+      server_base->_on_buffered_size_changed(-(ptrdiff_t)size);
+    _update_flow_control();
+  }
+
+  void connection_t::_add_outbound_size(size_t size)
+  {
+    bool is_released;
+    {
+      std::lock_guard _fl(flow_lock);
+      outbound_size += size;
+      if (send_high_watermark > 0 && outbound_size >= send_high_watermark)
+        is_send_blocked = true;
+      is_released = is_flow_released;
+    }
+    if (server_base != nullptr && !is_released)
+      server_base->_on_buffered_size_changed((ptrdiff_t)size);
+  }
+
+  void connection_t::_release_outbound_size(size_t size)
+  {
+    bool is_released;
+    {
+      std::lock_guard _fl(flow_lock);
+      size = std::min(size, outbound_size);
+      outbound_size -= size;
+      if (is_send_blocked && outbound_size <= send_low_watermark)
+        is_send_blocked = false;
+      is_released = is_flow_released;
+    }
+    if (server_base != nullptr && !is_released)
+      server_base->_on_buffered_size_changed(-(ptrdiff_t)size);
+    _update_flow_control();
+  }
+
+  void connection_t::_update_flow_control()
+  {
+    const bool is_over_budget = server_base != nullptr && server_base->is_over_memory_budget();
+    std::vector<capacity_chain::state> send_ready;
+    std::vector<capacity_chain::state> receive_ready;
+    {
+      std::lock_guard _fl(flow_lock);
+      if (!is_over_budget && !is_send_blocked)
+        send_ready.swap(send_capacity_waiters);
+      if (!is_over_budget && !is_receive_blocked)
+        receive_ready.swap(receive_capacity_waiters);
+    }
+    for (auto& it : send_ready)
+      it.complete(true);
+    for (auto& it : receive_ready)
+      it.complete(true);
+  }
+
+  void connection_t::_release_flow_control()
+  {
+    std::vector<capacity_chain::state> send_waiters;
+    std::vector<capacity_chain::state> receive_waiters;
+    size_t accounted_size;
+    {
+      std::lock_guard _fl(flow_lock);
+      if (is_flow_released)
+        return;
+      is_flow_released = true;
+      accounted_size = outbound_size + inbound_size;
+      send_waiters.swap(send_capacity_waiters);
+      receive_waiters.swap(receive_capacity_waiters);
+      // the receive itself has been canceled with the other operations of the socket
+      cancel_receive_loop = {};
+    }
+    if (server_base != nullptr && accounted_size > 0)
+      server_base->_on_buffered_size_changed(-(ptrdiff_t)accounted_size);
+    for (auto& it : send_waiters)
+      it.complete(false);
+    for (auto& it : receive_waiters)
+      it.complete(false);
+  }
+
+  void connection_t::_set_receive_loop(std::move_only_function<void()>&& cancel)
+  {
+    std::lock_guard _fl(flow_lock);
+    cancel_receive_loop = std::move(cancel);
+  }
+
+  void connection_t::_check_receive_pause()
+  {
+    if (!is_receive_paused())
+      return;
+    {
+      std::lock_guard _fl(flow_lock);
+      if (is_receive_loop_canceled || !cancel_receive_loop)
+        return;
+      is_receive_loop_canceled = true;
+    }
+
+    // the receive is being completed (and its chain is locked): cancel it at the end of process()
+    ioctx->_queue_deferred_operation().then([this, tk = in_flight_operations.get_token()]
+    {
+      std::move_only_function<void()> cancel;
+      {
+        std::lock_guard _fl(flow_lock);
+        cancel = std::move(cancel_receive_loop);
+      }
+      if (cancel)
+        cancel();
+    });
+  }
+
+  bool connection_t::_on_receive_loop_ended(std::move_only_function<void()>&& restart)
+  {
+    {
+      std::lock_guard _fl(flow_lock);
+      cancel_receive_loop = {};
+      if (!is_receive_loop_canceled)
+        return false;
+      is_receive_loop_canceled = false;
+    }
+    if (is_closed())
+      return true;
+
+    wait_for_receive_capacity().then([restart = std::move(restart)](bool success) mutable
+    {
+      if (success)
+        restart();
+    });
+    return true;
+  }
 
   context::read_chain connection_t::queue_receive(size_t size, raw_data&& data, uint32_t offset_in_data)
   {
@@ -131,6 +530,13 @@ namespace neam::io::network
   {
     ioctx.queue_multi_accept(listen_socket).then([this](neam::id_t connection)
     {
+      if (connection == neam::id_t::none)
+      {
+        // the accept timed out (the listening socket has a timeout): keep accepting
+        if (!is_listening_socket_closed())
+          async_accept();
+        return;
+      }
       if (connection != neam::id_t::invalid)
       {
         // Prevent opening too many connections
@@ -142,6 +548,9 @@ namespace neam::io::network
           return;
         }
 
+        if (idle_timeout.count() > 0)
+          ioctx.set_operation_timeout(connection, idle_timeout);
+
         {
           std::unique_ptr<connection_t> ptr = on_connection({this, &ioctx, connection});
           if (ptr && !ptr->is_closed())
@@ -159,6 +568,30 @@ namespace neam::io::network
     });
   }
 
+  void base_server_interface::_on_buffered_size_changed(ptrdiff_t delta)
+  {
+    const size_t total = buffered_size.fetch_add((size_t)delta, std::memory_order_relaxed) + (size_t)delta;
+    const size_t budget = memory_budget;
+    if (budget > 0 && total >= budget)
+    {
+      is_over_budget.store(true, std::memory_order_relaxed);
+      return;
+    }
+    if ((budget == 0 || total <= budget - budget / 4) && is_over_budget.exchange(false, std::memory_order_relaxed))
+    {
+      // back below the budget: wake the connections that were waiting for it
+      for_each_connection([](connection_t& c, cr::token_counter::ref&&) { c._update_flow_control(); });
+    }
+  }
+
+  void base_server_interface::_setup_flow_control(connection_t& connection) const
+  {
+    if (connection_send_watermarks.high > 0)
+      connection.set_send_watermarks(connection_send_watermarks.low, connection_send_watermarks.high);
+    if (connection_receive_watermarks.high > 0)
+      connection.set_receive_watermarks(connection_receive_watermarks.low, connection_receive_watermarks.high);
+  }
+
   void base_server_interface::close_listening_socket()
   {
     ioctx.cancel_all_pending_operations_for(listen_socket);
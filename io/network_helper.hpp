@@ -26,9 +26,14 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <functional>
 #include <map>
+#include <vector>
 #include "../id/id.hpp"
 #include "../token_counting.hpp"
+#include "../spinlock.hpp"
 #include "io.hpp"
 
 #include "../event.hpp"
@@ -58,6 +63,65 @@ namespace neam::io::network
     context::write_chain queue_send(raw_data&& data, uint32_t offset_in_data = 0);
     context::write_chain queue_full_send(raw_data&& data, uint32_t offset_in_data = 0);
 
+    /// \brief Send (a part of) a file through the connection, without copying it to userspace (see context::queue_send_file())
+    /// \note On failure, the connection is closed
+    context::write_chain queue_send_file(id_t file_fid, size_t offset = 0, size_t size = context::whole_file);
+
+    /// \brief Coalesced sends: the data is queued on the connection, and everything queued during a process() of the context
+    /// is sent with a single sendmsg (zero-copy, like the segmented context::queue_send()).
+    /// The queue is sent right away once it holds more than the send budget (see set_send_budget()),
+    /// and only by flush() / the budget when the connection is corked.
+    /// \note Each chain is completed with an empty raw_data and its own size once the whole batch is sent.
+    ///       On failure, the connection is closed and all the chains of the batch are completed as failed.
+    /// \warning Data sent with queue_send() / queue_full_send() is not ordered with the data queued here
+    context::write_chain queue_coalesced_send(raw_data&& data, uint32_t offset_in_data = 0);
+    context::write_chain queue_coalesced_send(shared_raw_data data);
+
+    /// \brief Send the queued data now (even when the connection is corked)
+    void flush();
+
+    /// \brief Hold the queued data until flush() is called (or the send budget is reached)
+    void cork();
+    /// \brief Stop holding the queued data, and send what was queued while corked
+    void uncork();
+    bool is_corked() const { return corked; }
+
+    /// \brief Set the amount of queued data above which the queue is sent without waiting for the next process()
+    void set_send_budget(size_t bytes) { send_budget = bytes; }
+    size_t get_send_budget() const { return send_budget; }
+    /// \brief Amount of data queued and not yet sent (in-flight sends excluded)
+    size_t get_queued_send_size() const { return queued_send_size; }
+
+    /// \brief Completed with true once there is capacity, false if the connection is closed
+    using capacity_chain = async::chain<bool /*success*/>;
+
+    /// \brief Bound the data sent through the connection and not yet sent (see get_outbound_size()):
+    /// above \e high bytes, has_send_capacity() returns false and wait_for_send_capacity() waits until the connection is below \e low bytes.
+    /// \note The sends themselves are never refused: it's up to the sender to wait for capacity. \e high = 0 disables the limit.
+    void set_send_watermarks(size_t low, size_t high);
+    /// \brief Bound the data received and not yet processed (see add_inbound_size()):
+    /// above \e high bytes reads are paused, and they resume once the connection is below \e low bytes.
+    /// \note \e high = 0 disables the limit
+    void set_receive_watermarks(size_t low, size_t high);
+
+    /// \brief Data passed to the send helpers (queue_send(), queue_coalesced_send(), ...) and not yet sent
+    /// \note File sends are not accounted for, as their data is never in memory
+    size_t get_outbound_size() const;
+    /// \brief Data received and not yet processed
+    size_t get_inbound_size() const;
+
+    /// \brief Whether the connection is below its send watermark (and the server is below its memory budget)
+    bool has_send_capacity() const;
+    [[nodiscard]] capacity_chain wait_for_send_capacity();
+    /// \brief Whether the connection is above its receive watermark (or the server above its memory budget)
+    bool is_receive_paused() const;
+    [[nodiscard]] capacity_chain wait_for_receive_capacity();
+
+    /// \brief Account data received but not yet processed. The connection types do it for the data they buffer,
+    /// children that hold the received data (to process it asynchronously, for example) can add what they hold and release it once done.
+    void add_inbound_size(size_t size);
+    void release_inbound_size(size_t size);
+
     /// \brief Queue a receive operation of a given size
     /// \note handle connection closing automatically
     /// \note queuing the next read from inside the chain is the duty of the caller
@@ -82,6 +146,72 @@ namespace neam::io::network
       });
     }
 
+    /// \brief Init a connection to a local (AF_UNIX) socket (see context::create_unix_listening_socket() for the path format)
+    async::chain<bool, cr::token_counter::ref&&> queue_connect_unix(std::string_view path, bool seqpacket = false)
+    {
+      socket = ioctx->create_unix_socket(seqpacket);
+      return ioctx->queue_connect_unix(socket, path).then([this, tk = in_flight_operations.get_token()](bool success) mutable
+      {
+        if (!success)
+        {
+          ioctx->close(socket);
+          socket = id_t::none;
+        }
+
+        return async::chain<bool, cr::token_counter::ref&&>::create_and_complete(success, std::move(tk));
+      });
+    }
+
+    static constexpr size_t k_default_send_budget = 64 * 1024;
+
+    // coalesced sends:
+    // (kept public, so connection_t stays an aggregate)
+    struct queued_send_t
+    {
+      shared_raw_data data;
+      context::write_chain::state state;
+    };
+
+    void _schedule_flush();
+    void _send_batch(std::vector<queued_send_t>&& batch);
+
+    spinlock send_lock {};
+    std::vector<queued_send_t> send_queue {};
+    size_t queued_send_size = 0;
+    size_t send_budget = k_default_send_budget;
+    bool corked = false;
+    bool is_flush_scheduled = false;
+
+    // flow control:
+    void _add_outbound_size(size_t size);
+    void _release_outbound_size(size_t size);
+    /// \brief Complete the capacity waiters if the connection is below its watermarks
+    void _update_flow_control();
+    /// \brief Fail the capacity waiters and remove what the connection accounted from the server (on close)
+    void _release_flow_control();
+
+    /// \brief Multishot receive loops (see connections.hpp): \e cancel cancels the receive, to pause reads
+    void _set_receive_loop(std::move_only_function<void()>&& cancel);
+    /// \brief To call after each receive of the loop: cancel the receive if reads are paused
+    void _check_receive_pause();
+    /// \brief To call when the receive of the loop ended.
+    /// \return true if the receive was canceled by a pause, in which case \e restart is called once reads resume
+    bool _on_receive_loop_ended(std::move_only_function<void()>&& restart);
+
+    mutable spinlock flow_lock {};
+    size_t outbound_size = 0;
+    size_t inbound_size = 0;
+    size_t send_low_watermark = 0;
+    size_t send_high_watermark = 0;
+    size_t receive_low_watermark = 0;
+    size_t receive_high_watermark = 0;
+    bool is_send_blocked = false;
+    bool is_receive_blocked = false;
+    bool is_flow_released = false;
+    bool is_receive_loop_canceled = false;
+    std::vector<capacity_chain::state> send_capacity_waiters {};
+    std::vector<capacity_chain::state> receive_capacity_waiters {};
+    std::move_only_function<void()> cancel_receive_loop {};
   };
 
   /// \brief Handle most of the boilerplate of setting up and maintaining a server using neam::io
@@ -111,6 +241,26 @@ namespace neam::io::network
       /// \brief Forcefully close all the open / active connections
       void close_all_connections();
 
+      /// \brief Close the connections whose operations (receives, sends) don't complete for more than \e timeout (0 to disable)
+      /// Connections that always have a receive queued (like ring_buffer_connection_t / header_connection_t) are closed
+      /// after \e timeout without receiving anything.
+      /// \note Only applies to the connections accepted after the call (see context::set_operation_timeout())
+      void set_idle_timeout(std::chrono::milliseconds timeout) { idle_timeout = timeout; }
+      std::chrono::milliseconds get_idle_timeout() const { return idle_timeout; }
+
+      /// \brief Limit the memory used by all the connections (their outbound + inbound data, see connection_t::set_send_watermarks()).
+      /// Above the budget, the reads of all the connections are paused and wait_for_send_capacity() waits,
+      /// until the connections use less than 3/4 of the budget. 0 disables the limit.
+      void set_memory_budget(size_t bytes) { memory_budget = bytes; }
+      size_t get_memory_budget() const { return memory_budget; }
+      /// \brief Outbound + inbound data of all the connections
+      size_t get_buffered_size() const { return buffered_size.load(std::memory_order_relaxed); }
+      bool is_over_memory_budget() const { return is_over_budget.load(std::memory_order_relaxed); }
+
+      /// \brief Watermarks of the connections accepted after the call (see connection_t::set_send_watermarks() / set_receive_watermarks())
+      void set_connection_send_watermarks(size_t low, size_t high) { connection_send_watermarks = { low, high }; }
+      void set_connection_receive_watermarks(size_t low, size_t high) { connection_receive_watermarks = { low, high }; }
+
       bool has_any_connections() const { return !active_connections.empty(); }
       size_t get_connection_count() const { return active_connections.size(); }
 
@@ -142,6 +292,11 @@ namespace neam::io::network
         }
       }
 
+    public: // flow control (used by the connections)
+      void _on_buffered_size_changed(ptrdiff_t delta);
+      /// \brief Apply the connection watermarks to a new connection
+      void _setup_flow_control(connection_t& connection) const;
+
     protected:
       /// \brief Handle connections. If returning nullptr, the connection has been either closed or should not be tracked by this class.
       virtual std::unique_ptr<connection_t> on_connection(connection_t&& connection) = 0;
@@ -152,6 +307,18 @@ namespace neam::io::network
     protected:
       io::context& ioctx;
       uint32_t max_connection_count = 32;
+      std::chrono::milliseconds idle_timeout { 0 };
+
+      struct watermarks_t
+      {
+        size_t low = 0;
+        size_t high = 0;
+      };
+      watermarks_t connection_send_watermarks;
+      watermarks_t connection_receive_watermarks;
+      size_t memory_budget = 0;
+      std::atomic<size_t> buffered_size = 0;
+      std::atomic<bool> is_over_budget = false;
 
       id_t listen_socket = id_t::none;
 
@@ -189,6 +356,8 @@ namespace neam::io::network
         connection_uptr->server_base = connection.server_base;
         connection_uptr->ioctx = connection.ioctx;
         connection_uptr->socket = connection.socket;
+        if (connection_uptr->server_base != nullptr)
+          connection_uptr->server_base->_setup_flow_control(*connection_uptr);
 
         if (ConnectionType::on_connection(*connection_uptr))
         {
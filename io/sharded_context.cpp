@@ -0,0 +1,157 @@
+//
+// created by : Timothée Feuillet
+// date: 2026-10-18
+//
+//
+// Copyright (c) 2026 Timothée Feuillet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#include "sharded_context.hpp"
+
+namespace neam::io
+{
+  thread_local context* sharded_context::current_shard = nullptr;
+
+  sharded_context::sharded_context(unsigned shard_count, const context::ring_config& config)
+  {
+    check::debug::n_assert(shard_count > 0 && shard_count <= k_max_shard_count,
+                           "sharded_context: invalid shard count ({}, must be in [1, {}])", shard_count, k_max_shard_count);
+
+    context::ring_config shard_config = config;
+    shard_config.single_issuer = false;
+    shard_config.defer_taskrun = false;
+
+    shards.reserve(shard_count);
+    for (unsigned i = 0; i < shard_count; ++i)
+    {
+      shard_config.shard_index = (uint8_t)i;
+      shards.push_back(std::make_unique<context>(shard_config));
+      shards.back()->is_used_across_threads(true);
+    }
+
+    workers.reserve(shard_count);
+    for (unsigned i = 0; i < shard_count; ++i)
+      workers.emplace_back([this, i] { worker_func(i); });
+  }
+
+  sharded_context::~sharded_context()
+  {
+    stop();
+  }
+
+  void sharded_context::stop()
+  {
+    if (should_stop.exchange(true, std::memory_order_seq_cst))
+      return;
+    // a worker may be between its should_stop check and wait_for_activity(), where wake_up() would be a no-op:
+    for (auto& it : shards)
+      it->_force_wake_up();
+    for (auto& it : workers)
+      it.join();
+    workers.clear();
+  }
+
+  void sharded_context::worker_func(unsigned index)
+  {
+    context& shard = *shards[index];
+    current_shard = &shard;
+    while (true)
+    {
+      shard.process();
+      // process() may have consumed the wake-up of stop(), so check before waiting:
+      if (should_stop.load(std::memory_order_seq_cst))
+        break;
+      shard.wait_for_activity();
+    }
+    current_shard = nullptr;
+  }
+
+  void sharded_context::set_prefix_directory(std::string prefix)
+  {
+    for (auto& it : shards)
+      it->set_prefix_directory(prefix);
+  }
+
+  void sharded_context::clear_mapped_files()
+  {
+    for (auto& it : shards)
+      it->clear_mapped_files();
+  }
+
+  bool sharded_context::has_in_flight_operations() const
+  {
+    for (const auto& it : shards)
+    {
+      if (it->has_in_flight_operations())
+        return true;
+    }
+    return false;
+  }
+
+  bool sharded_context::has_pending_operations() const
+  {
+    for (const auto& it : shards)
+    {
+      if (it->has_pending_operations())
+        return true;
+    }
+    return false;
+  }
+
+  uint64_t sharded_context::get_total_written_bytes() const
+  {
+    uint64_t ret = 0;
+    for (const auto& it : shards)
+      ret += it->get_total_written_bytes();
+    return ret;
+  }
+
+  uint64_t sharded_context::get_total_read_bytes() const
+  {
+    uint64_t ret = 0;
+    for (const auto& it : shards)
+      ret += it->get_total_read_bytes();
+    return ret;
+  }
+
+  uint64_t sharded_context::get_submit_count() const
+  {
+    uint64_t ret = 0;
+    for (const auto& it : shards)
+      ret += it->get_submit_count();
+    return ret;
+  }
+
+  context::metrics_snapshot sharded_context::get_metrics() const
+  {
+    context::metrics_snapshot ret;
+    for (const auto& it : shards)
+      ret.merge(it->get_metrics());
+    return ret;
+  }
+
+  void sharded_context::reset_metrics()
+  {
+    for (const auto& it : shards)
+      it->reset_metrics();
+  }
+}
@@ -0,0 +1,397 @@
+//
+// created by : Timothée Feuillet
+// date: 2026-10-18
+//
+//
+// Copyright (c) 2026 Timothée Feuillet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "context.hpp"
+
+namespace neam::io
+{
+  /// \brief Multiple io::context (shards), each with its own ring and its own worker thread.
+  /// Operations are routed to the shard that owns the id:
+  ///  - sockets / pipes belong to the shard that created them (the shard index is encoded in the id).
+  ///    Accepted connections belong to the shard of the listening socket.
+  ///  - files are assigned to a shard from their id (so all the operations on a file go through the same ring)
+  /// New sockets / pipes are created on the shards in turn.
+  ///
+  /// Operations are handed to the shard using its request queues (which are lock-free), and the shard is woken up if it is waiting:
+  /// from another shard's worker (in a completion callback) with an IORING_OP_MSG_RING submitted with the next batch of that shard,
+  /// from any other thread with an eventfd write.
+  ///
+  /// \note Completion callbacks are called on the worker thread of the shard (or deferred, see context::force_deferred_execution())
+  /// \note The API is the same as the one of context, for the routed operations. Use get_shard() for everything else.
+  class sharded_context
+  {
+    public:
+      using read_chain = context::read_chain;
+      using write_chain = context::write_chain;
+      using shared_read_chain = context::shared_read_chain;
+      using connect_chain = context::connect_chain;
+      using accept_chain = context::accept_chain;
+      using stat_chain = context::stat_chain;
+      using prefetch_chain = context::prefetch_chain;
+      using sync_chain = context::sync_chain;
+      using datagram_chain = context::datagram_chain;
+      using fd_read_chain = context::fd_read_chain;
+
+      static constexpr size_t whole_file = context::whole_file;
+      static constexpr size_t everything = context::everything;
+      static constexpr size_t append = context::append;
+      static constexpr size_t truncate = context::truncate;
+      static constexpr size_t k_timed_out = context::k_timed_out;
+
+      static constexpr unsigned k_max_shard_count = 256;
+
+      /// \brief Create \e shard_count contexts with the same config and start their worker threads
+      /// \note config.shard_index is ignored, and config.single_issuer / config.defer_taskrun are dropped
+      ///       (the rings are created on this thread but are submitted to by the workers)
+      explicit sharded_context(unsigned shard_count, const context::ring_config& config = {});
+      ~sharded_context();
+
+      sharded_context(const sharded_context&) = delete;
+      sharded_context& operator=(const sharded_context&) = delete;
+
+      unsigned get_shard_count() const { return (unsigned)shards.size(); }
+      context& get_shard(unsigned index) { return *shards[index]; }
+      const context& get_shard(unsigned index) const { return *shards[index]; }
+
+      /// \brief Return the shard that owns the id
+      context& get_shard_for(id_t id) { return *shards[get_shard_index_for(id)]; }
+      unsigned get_shard_index_for(id_t id) const
+      {
+        if (context::is_external_id(id))
+          return context::get_shard_index(id) % shards.size();
+        return (unsigned)((uint64_t)id % shards.size());
+      }
+
+      /// \brief Return the shard whose worker is the current thread, or nullptr
+      static context* get_current_shard() { return current_shard; }
+
+      /// \brief Stop the workers. Operations queued after this are never processed.
+      /// \note Called by the destructor
+      void stop();
+
+    public: // general IO stuff
+      id_t stdin() { return shards[0]->stdin(); }
+      id_t stdout() { return shards[0]->stdout(); }
+      id_t stderr() { return shards[0]->stderr(); }
+
+    public: // file stuff
+      const std::string& get_prefix_directory() const { return shards[0]->get_prefix_directory(); }
+      /// \note Closes all the opened files of all the shards
+      void set_prefix_directory(std::string prefix);
+
+      [[nodiscard]] id_t map_file(const std::string& path) { return get_shard_for(context::get_file_id(path)).map_file(path); }
+      [[nodiscard]] id_t map_unprefixed_file(std::string path)
+      {
+        context& shard = get_shard_for(context::get_file_id(path));
+        return shard.map_unprefixed_file(std::move(path));
+      }
+      /// \note The file is also unmapped from the shards it was sent from (see queue_send_file())
+      void unmap_file(id_t fid)
+      {
+        for (auto& it : shards)
+          it->unmap_file(fid);
+      }
+      void clear_mapped_files();
+      bool is_file_mapped(id_t fid) { return get_shard_for(fid).is_file_mapped(fid); }
+
+      [[nodiscard]] read_chain queue_read(id_t fid, size_t offset, size_t size)
+      {
+        return route(fid, [&](context& shard) { return shard.queue_read(fid, offset, size); });
+      }
+      [[nodiscard]] read_chain queue_read(id_t fid, size_t offset, size_t size, raw_data&& data, uint32_t offset_in_data = 0)
+      {
+        return route(fid, [&](context& shard) { return shard.queue_read(fid, offset, size, std::move(data), offset_in_data); });
+      }
+      [[nodiscard]] shared_read_chain queue_read_fixed(id_t fid, size_t offset, size_t size)
+      {
+        return route(fid, [&](context& shard) { return shard.queue_read_fixed(fid, offset, size); });
+      }
+
+      void set_direct_io(id_t fid, unsigned readahead_window = context::k_default_readahead_window) { get_shard_for(fid).set_direct_io(fid, readahead_window); }
+      void clear_direct_io(id_t fid) { get_shard_for(fid).clear_direct_io(fid); }
+      bool is_using_direct_io(id_t fid) { return get_shard_for(fid).is_using_direct_io(fid); }
+
+      [[nodiscard]] file_view map_file_view(id_t fid, size_t offset = 0, size_t size = whole_file, file_view::advice advice = file_view::advice::normal)
+      {
+        return get_shard_for(fid).map_file_view(fid, offset, size, advice);
+      }
+      void release_file_view(id_t fid) { get_shard_for(fid).release_file_view(fid); }
+      /// \note The view does not know its file: the prefetch is done by the current shard (or by the shards in turn)
+      [[nodiscard]] prefetch_chain queue_prefetch(file_view view)
+      {
+        context& shard = current_shard != nullptr ? *current_shard : get_next_shard();
+        prefetch_chain ret = shard.queue_prefetch(std::move(view));
+        wake_up(shard);
+        return ret;
+      }
+
+      write_chain queue_write(id_t fid, size_t offset, raw_data&& data, uint32_t offset_in_data = 0, uint32_t size_to_write = 0)
+      {
+        return route(fid, [&](context& shard) { return shard.queue_write(fid, offset, std::move(data), offset_in_data, size_to_write); });
+      }
+      write_chain queue_write(id_t fid, size_t offset, std::vector<shared_raw_data>&& segments)
+      {
+        return route(fid, [&](context& shard) { return shard.queue_write(fid, offset, std::move(segments)); });
+      }
+
+      [[nodiscard]] sync_chain queue_fsync(id_t fid, bool datasync = false)
+      {
+        return route(fid, [&](context& shard) { return shard.queue_fsync(fid, datasync); });
+      }
+      write_chain queue_write_durable(id_t fid, size_t offset, raw_data&& data, uint32_t offset_in_data = 0, uint32_t size_to_write = 0)
+      {
+        return route(fid, [&](context& shard) { return shard.queue_write_durable(fid, offset, std::move(data), offset_in_data, size_to_write); });
+      }
+      /// \note The temporary file and the directory are handled by the shard of the file
+      [[nodiscard]] sync_chain queue_atomic_replace(id_t fid, raw_data&& data)
+      {
+        return route(fid, [&](context& shard) { return shard.queue_atomic_replace(fid, std::move(data)); });
+      }
+
+      [[nodiscard]] size_t get_file_size(id_t fid) { return get_shard_for(fid).get_file_size(fid); }
+      [[nodiscard]] std::filesystem::file_time_type get_modified_or_created_time(id_t fid) { return get_shard_for(fid).get_modified_or_created_time(fid); }
+      [[nodiscard]] stat_chain queue_stat(id_t fid)
+      {
+        return route(fid, [&](context& shard) { return shard.queue_stat(fid); });
+      }
+
+      const char* get_c_filename(id_t fid) { return get_shard_for(fid).get_c_filename(fid); }
+      std::string get_string_for_id(id_t fid) { return get_shard_for(fid).get_string_for_id(fid); }
+
+      async::chain<bool> queue_deferred_remove(id_t fid)
+      {
+        return route(fid, [&](context& shard) { return shard.queue_deferred_remove(fid); });
+      }
+
+    public: // network stuff
+      [[nodiscard]] id_t create_listening_socket(uint16_t port = 0, uint32_t listen_addr = context::ipv4(0, 0, 0, 0), uint16_t backlog_connection_count = 16)
+      {
+        return get_next_shard().create_listening_socket(port, listen_addr, backlog_connection_count);
+      }
+      [[nodiscard]] id_t create_listening_socket(uint16_t port = 0, const ipv6& ip = ipv6::any(), uint16_t backlog_connection_count = 16, bool allow_ipv4 = true)
+      {
+        return get_next_shard().create_listening_socket(port, ip, backlog_connection_count, allow_ipv4);
+      }
+      [[nodiscard]] id_t create_socket(bool ipv6 = false) { return get_next_shard().create_socket(ipv6); }
+
+      [[nodiscard]] connect_chain queue_connect(id_t fid, std::string host, uint32_t port)
+      {
+        return route(fid, [&](context& shard) { return shard.queue_connect(fid, std::move(host), port, true); });
+      }
+      [[nodiscard]] uint16_t get_socket_port(id_t sid) { return get_shard_for(sid).get_socket_port(sid); }
+
+      [[nodiscard]] accept_chain queue_accept(id_t fid)
+      {
+        return route(fid, [&](context& shard) { return shard.queue_accept(fid); });
+      }
+      [[nodiscard]] accept_chain queue_multi_accept(id_t fid)
+      {
+        return route(fid, [&](context& shard) { return shard.queue_multi_accept(fid); });
+      }
+
+      [[nodiscard]] read_chain queue_receive(id_t fid, size_t size, raw_data&& data = {}, uint32_t offset_in_data = 0)
+      {
+        return route(fid, [&](context& shard) { return shard.queue_receive(fid, size, std::move(data), offset_in_data); });
+      }
+      [[nodiscard]] read_chain queue_full_receive(id_t fid, size_t size, raw_data&& data = {}, uint32_t offset_in_data = 0)
+      {
+        return route(fid, [&](context& shard) { return shard.queue_full_receive(fid, size, std::move(data), offset_in_data); });
+      }
+      [[nodiscard]] read_chain queue_multi_receive(id_t fid)
+      {
+        return route(fid, [&](context& shard) { return shard.queue_multi_receive(fid); });
+      }
+      [[nodiscard]] shared_read_chain queue_multi_receive_shared(id_t fid)
+      {
+        return route(fid, [&](context& shard) { return shard.queue_multi_receive_shared(fid); });
+      }
+
+      [[nodiscard]] write_chain queue_send(id_t fid, raw_data&& data, uint32_t offset_in_data = 0, size_t size = 0)
+      {
+        return route(fid, [&](context& shard) { return shard.queue_send(fid, std::move(data), offset_in_data, size); });
+      }
+      [[nodiscard]] write_chain queue_full_send(id_t fid, raw_data&& data, uint32_t offset_in_data = 0, size_t size = 0)
+      {
+        return route(fid, [&](context& shard) { return shard.queue_full_send(fid, std::move(data), offset_in_data, size); });
+      }
+      [[nodiscard]] write_chain queue_send(id_t fid, shared_raw_data data)
+      {
+        return route(fid, [&](context& shard) { return shard.queue_send(fid, std::move(data)); });
+      }
+      [[nodiscard]] write_chain queue_full_send(id_t fid, shared_raw_data data)
+      {
+        return route(fid, [&](context& shard) { return shard.queue_full_send(fid, std::move(data)); });
+      }
+      [[nodiscard]] write_chain queue_send(id_t fid, std::vector<shared_raw_data>&& segments)
+      {
+        return route(fid, [&](context& shard) { return shard.queue_send(fid, std::move(segments)); });
+      }
+      /// \note The file is read by the shard of the socket (the file is mapped there too)
+      [[nodiscard]] write_chain queue_send_file(id_t socket_fid, id_t file_fid, size_t offset = 0, size_t size = context::whole_file)
+      {
+        context& socket_shard = get_shard_for(socket_fid);
+        context& file_shard = get_shard_for(file_fid);
+        if (&socket_shard != &file_shard)
+          socket_shard._map_file_from(file_shard, file_fid);
+        return route(socket_fid, [&](context& shard) { return shard.queue_send_file(socket_fid, file_fid, offset, size); });
+      }
+      [[nodiscard]] write_chain queue_full_send(id_t fid, std::vector<shared_raw_data>&& segments)
+      {
+        return route(fid, [&](context& shard) { return shard.queue_full_send(fid, std::move(segments)); });
+      }
+
+    public: // local (AF_UNIX) stuff
+      [[nodiscard]] id_t create_unix_listening_socket(std::string_view path, bool seqpacket = false, uint16_t backlog_connection_count = 16)
+      {
+        return get_next_shard().create_unix_listening_socket(path, seqpacket, backlog_connection_count);
+      }
+      [[nodiscard]] id_t create_unix_socket(bool seqpacket = false) { return get_next_shard().create_unix_socket(seqpacket); }
+      [[nodiscard]] connect_chain queue_connect_unix(id_t fid, std::string_view path)
+      {
+        return route(fid, [&](context& shard) { return shard.queue_connect_unix(fid, path); });
+      }
+      /// \brief Create a pair of connected sockets (both ends belong to the same shard)
+      bool create_socket_pair(id_t& a, id_t& b, bool seqpacket = false) { return get_next_shard().create_socket_pair(a, b, seqpacket); }
+
+      [[nodiscard]] write_chain queue_send_fds(id_t fid, std::vector<int> fds, shared_raw_data data = {})
+      {
+        return route(fid, [&](context& shard) { return shard.queue_send_fds(fid, std::move(fds), std::move(data)); });
+      }
+      [[nodiscard]] fd_read_chain queue_receive_fds(id_t fid, size_t size)
+      {
+        return route(fid, [&](context& shard) { return shard.queue_receive_fds(fid, size); });
+      }
+
+    public: // datagram (UDP) stuff
+      /// \note To spread the datagrams of a port on all the shards, create one socket per shard with the same port (they use SO_REUSEPORT)
+      [[nodiscard]] id_t create_udp_socket(uint16_t port = 0, uint32_t bind_addr = context::ipv4(0, 0, 0, 0))
+      {
+        return get_next_shard().create_udp_socket(port, bind_addr);
+      }
+      [[nodiscard]] id_t create_udp_socket(uint16_t port, const ipv6& ip, bool allow_ipv4 = true)
+      {
+        return get_next_shard().create_udp_socket(port, ip, allow_ipv4);
+      }
+      /// \brief Return whether the kernel supports UDP segmentation offload (known after the first create_udp_socket(), on any shard)
+      bool has_udp_gso() const
+      {
+        for (const auto& it : shards)
+        {
+          if (it->has_udp_gso())
+            return true;
+        }
+        return false;
+      }
+      bool set_udp_gro(id_t sid, bool enable = true) { return get_shard_for(sid).set_udp_gro(sid, enable); }
+
+      [[nodiscard]] datagram_chain queue_multi_receive_datagrams(id_t fid)
+      {
+        return route(fid, [&](context& shard) { return shard.queue_multi_receive_datagrams(fid); });
+      }
+      [[nodiscard]] write_chain queue_send_datagram(id_t fid, const dns_resolver::address& destination, shared_raw_data data)
+      {
+        return route(fid, [&](context& shard) { return shard.queue_send_datagram(fid, destination, std::move(data)); });
+      }
+      [[nodiscard]] write_chain queue_send_datagrams(id_t fid, const dns_resolver::address& destination, std::vector<shared_raw_data>&& datagrams)
+      {
+        return route(fid, [&](context& shard) { return shard.queue_send_datagrams(fid, destination, std::move(datagrams)); });
+      }
+
+    public: // misc stuff:
+      /// \brief Create a pipe (both ends belong to the same shard)
+      bool create_pipe(id_t& read, id_t& write) { return get_next_shard().create_pipe(read, write); }
+
+      void cancel_all_pending_operations_for(id_t eid)
+      {
+        context& shard = get_shard_for(eid);
+        shard.cancel_all_pending_operations_for(eid);
+        wake_up(shard);
+      }
+
+      void set_operation_timeout(id_t fid, std::chrono::milliseconds timeout) { get_shard_for(fid).set_operation_timeout(fid, timeout); }
+      void clear_operation_timeout(id_t fid) { get_shard_for(fid).clear_operation_timeout(fid); }
+
+      void close(id_t fid)
+      {
+        context& shard = get_shard_for(fid);
+        shard.close(fid);
+        wake_up(shard);
+      }
+
+    public: // stats (sum over all the shards):
+      bool has_in_flight_operations() const;
+      bool has_pending_operations() const;
+      uint64_t get_total_written_bytes() const;
+      uint64_t get_total_read_bytes() const;
+      uint64_t get_submit_count() const;
+      context::metrics_snapshot get_metrics() const;
+      void reset_metrics();
+
+    private:
+      /// \brief Queue an operation on the shard that owns \e id, then wake the shard up
+      template<typename Fnc>
+      std::invoke_result_t<Fnc, context&> route(id_t id, Fnc&& fnc)
+      {
+        context& shard = get_shard_for(id);
+        auto ret = fnc(shard);
+        wake_up(shard);
+        return ret;
+      }
+
+      /// \brief Wake-up the worker of the shard if it is waiting (using IORING_OP_MSG_RING from another shard)
+      static void wake_up(context& shard)
+      {
+        if (current_shard != nullptr)
+          shard.wake_up_from(*current_shard);
+        else
+          shard.wake_up();
+      }
+
+      context& get_next_shard()
+      {
+        return *shards[next_shard.fetch_add(1, std::memory_order_relaxed) % shards.size()];
+      }
+
+      void worker_func(unsigned index);
+
+    private:
+      std::vector<std::unique_ptr<context>> shards;
+      std::vector<std::thread> workers;
+      std::atomic<bool> should_stop = false;
+      std::atomic<uint32_t> next_shard = 0;
+
+      static thread_local context* current_shard;
+  };
+}
@@ -0,0 +1,170 @@
+//
+// created by : Timothée Feuillet
+// date: 2026-10-18
+//
+//
+// Copyright (c) 2026 Timothée Feuillet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <vector>
+
+namespace neam::cr
+{
+  /// \brief Histogram with logarithmic buckets (HDR-style): each power of two is split in 2^SubBucketBits linear sub-buckets,
+  /// so the relative error of the reported values is at most 1 / 2^SubBucketBits, whatever the magnitude of the value.
+  /// Recording is lock-free (relaxed atomics), so values can be recorded from any thread.
+  ///
+  /// \note Values above k_max_value are recorded as k_max_value
+  template<unsigned SubBucketBits = 3, unsigned MaxValueBits = 40>
+  class log_histogram
+  {
+    public:
+      static_assert(SubBucketBits > 0 && SubBucketBits < MaxValueBits && MaxValueBits <= 64);
+
+      static constexpr unsigned k_sub_bucket_count = 1u << SubBucketBits;
+      static constexpr unsigned k_bucket_count = (MaxValueBits - SubBucketBits + 1) * k_sub_bucket_count;
+      static constexpr uint64_t k_max_value = MaxValueBits == 64 ? ~uint64_t(0) : (uint64_t(1) << MaxValueBits) - 1;
+
+      /// \brief A copy of the histogram.
+      /// \note The copy is not atomic: values recorded during the copy may only be partially accounted for
+      struct snapshot
+      {
+        std::vector<uint64_t> counts = std::vector<uint64_t>(k_bucket_count, 0);
+        uint64_t count = 0;
+        uint64_t sum = 0;
+        uint64_t min = 0;
+        uint64_t max = 0;
+
+        double get_mean() const { return count > 0 ? (double)sum / (double)count : 0.0; }
+
+        /// \brief Return the value under which \e percentile % of the recorded values are (so 99 for the p99, 99.9 for the p999)
+        /// \note The value is the upper bound of its bucket (clamped to the max recorded value)
+        uint64_t get_percentile(double percentile) const
+        {
+          if (count == 0)
+            return 0;
+          const double clamped = percentile < 0 ? 0 : (percentile > 100 ? 100 : percentile);
+          uint64_t rank = (uint64_t)((clamped / 100.0) * (double)count + 0.5);
+          rank = rank == 0 ? 1 : (rank > count ? count : rank);
+
+          uint64_t total = 0;
+          for (unsigned i = 0; i < k_bucket_count; ++i)
+          {
+            total += counts[i];
+            if (total >= rank)
+            {
+              const uint64_t value = get_bucket_upper_bound(i);
+              return value < max ? (value > min ? value : min) : max;
+            }
+          }
+          return max;
+        }
+
+        void merge(const snapshot& o)
+        {
+          if (o.count == 0)
+            return;
+          for (unsigned i = 0; i < k_bucket_count; ++i)
+            counts[i] += o.counts[i];
+          min = count == 0 ? o.min : std::min(min, o.min);
+          max = std::max(max, o.max);
+          count += o.count;
+          sum += o.sum;
+        }
+      };
+
+    public:
+      void record(uint64_t value)
+      {
+        value = value > k_max_value ? k_max_value : value;
+        buckets[get_bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+        total_count.fetch_add(1, std::memory_order_relaxed);
+        total_sum.fetch_add(value, std::memory_order_relaxed);
+
+        uint64_t current = min_value.load(std::memory_order_relaxed);
+        while (value < current && !min_value.compare_exchange_weak(current, value, std::memory_order_relaxed));
+        current = max_value.load(std::memory_order_relaxed);
+        while (value > current && !max_value.compare_exchange_weak(current, value, std::memory_order_relaxed));
+      }
+
+      snapshot get_snapshot() const
+      {
+        snapshot ret;
+        for (unsigned i = 0; i < k_bucket_count; ++i)
+          ret.counts[i] = buckets[i].load(std::memory_order_relaxed);
+        ret.count = total_count.load(std::memory_order_relaxed);
+        ret.sum = total_sum.load(std::memory_order_relaxed);
+        ret.min = ret.count > 0 ? min_value.load(std::memory_order_relaxed) : 0;
+        ret.max = max_value.load(std::memory_order_relaxed);
+        return ret;
+      }
+
+      void reset()
+      {
+        for (auto& it : buckets)
+          it.store(0, std::memory_order_relaxed);
+        total_count.store(0, std::memory_order_relaxed);
+        total_sum.store(0, std::memory_order_relaxed);
+        min_value.store(~uint64_t(0), std::memory_order_relaxed);
+        max_value.store(0, std::memory_order_relaxed);
+      }
+
+      static constexpr unsigned get_bucket_index(uint64_t value)
+      {
+        if (value < k_sub_bucket_count)
+          return (unsigned)value;
+        const unsigned msb = (unsigned)std::bit_width(value) - 1;
+        const unsigned shift = msb - SubBucketBits;
+        return (shift + 1) * k_sub_bucket_count + (unsigned)((value >> shift) - k_sub_bucket_count);
+      }
+
+      static constexpr uint64_t get_bucket_lower_bound(unsigned index)
+      {
+        const unsigned group = index / k_sub_bucket_count;
+        const uint64_t sub = index % k_sub_bucket_count;
+        if (group == 0)
+          return sub;
+        return (k_sub_bucket_count + sub) << (group - 1);
+      }
+
+      static constexpr uint64_t get_bucket_upper_bound(unsigned index)
+      {
+        const unsigned group = index / k_sub_bucket_count;
+        if (group == 0)
+          return get_bucket_lower_bound(index);
+        return get_bucket_lower_bound(index) + (uint64_t(1) << (group - 1)) - 1;
+      }
+
+    private:
+      std::atomic<uint64_t> buckets[k_bucket_count] = {};
+      std::atomic<uint64_t> total_count = 0;
+      std::atomic<uint64_t> total_sum = 0;
+      std::atomic<uint64_t> min_value = ~uint64_t(0);
+      std::atomic<uint64_t> max_value = 0;
+  };
+}
@@ -27,6 +27,7 @@
 #pragma once
 
 #include <cstdint>
+#include <atomic>
 
 /// \brief Utility for handling raw memory/pages. Mostly there to abstract OS shenanigans.
 namespace neam::memory
@@ -44,6 +45,14 @@ namespace neam::memory
   /// \note pointer must be page aligned.
   void free_page(void* page_ptr, uint32_t page_count, bool use_pool = true);
 
+  /// \brief Return an index unique to the calling thread (used to select a slot in per-thread tables / counters)
+  inline uint32_t get_thread_index()
+  {
+    static std::atomic<uint32_t> thread_counter = 0;
+    thread_local const uint32_t index = thread_counter.fetch_add(1, std::memory_order_relaxed);
+    return index;
+  }
+
 
   namespace statistics
   {
@@ -0,0 +1,228 @@
+//
+// created by : Timothée Feuillet
+// date: 2026-10-18
+//
+//
+// Copyright (c) 2026 Timothée Feuillet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#include "memory_accounting.hpp"
+
+#include <mutex>
+
+#include "spinlock.hpp"
+#include "logger/logger.hpp"
+
+namespace neam::memory::accounting
+{
+  namespace
+  {
+    struct registry_t
+    {
+      spinlock lock;
+      std::vector<tag*> tags;
+
+      spinlock dump_lock;
+      dump_hook_t dump_hook;
+      std::chrono::milliseconds dump_period {0};
+      std::atomic<int64_t> next_dump_time = 0; // in steady_clock ticks
+      snapshot_t last_dump;
+    };
+
+    // never destructed, as allocations may happen during static destruction
+    registry_t& get_registry()
+    {
+      static registry_t* registry = new registry_t();
+      return *registry;
+    }
+  }
+
+  void tag::reset_peaks()
+  {
+    int64_t live = live_bytes.load(std::memory_order_relaxed);
+    for (const auto& it : shards)
+      live += it.pending_live_bytes.load(std::memory_order_relaxed);
+    peak_live_bytes.store(live, std::memory_order_relaxed);
+    peak_reserved_bytes.store(reserved_bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  }
+
+  tag_snapshot_t tag::get_snapshot() const
+  {
+    tag_snapshot_t ret;
+    ret.name = name;
+
+    int64_t live = live_bytes.load(std::memory_order_relaxed);
+    for (const auto& it : shards)
+    {
+      live += it.pending_live_bytes.load(std::memory_order_relaxed);
+      ret.allocation_count += it.allocation_count.load(std::memory_order_relaxed);
+      ret.deallocation_count += it.deallocation_count.load(std::memory_order_relaxed);
+      ret.allocated_bytes += it.allocated_bytes.load(std::memory_order_relaxed);
+    }
+    ret.live_bytes = live;
+    ret.peak_live_bytes = std::max(live, peak_live_bytes.load(std::memory_order_relaxed));
+    ret.reserved_bytes = reserved_bytes.load(std::memory_order_relaxed);
+    ret.peak_reserved_bytes = std::max(ret.reserved_bytes, peak_reserved_bytes.load(std::memory_order_relaxed));
+    return ret;
+  }
+
+  tag& get_tag(std::string_view name)
+  {
+    registry_t& registry = get_registry();
+    std::lock_guard _lg(registry.lock);
+    for (tag* it : registry.tags)
+    {
+      if (it->get_name() == name)
+        return *it;
+    }
+    tag* const ret = new tag(std::string(name));
+    registry.tags.push_back(ret);
+    return *ret;
+  }
+
+  snapshot_t take_snapshot()
+  {
+    registry_t& registry = get_registry();
+    snapshot_t ret;
+    ret.time = std::chrono::steady_clock::now();
+
+    std::lock_guard _lg(registry.lock);
+    ret.tags.reserve(registry.tags.size());
+    for (const tag* it : registry.tags)
+      ret.tags.push_back(it->get_snapshot());
+    return ret;
+  }
+
+  diff_t diff(const snapshot_t& from, const snapshot_t& to)
+  {
+    diff_t ret;
+    ret.duration = std::chrono::duration<double>(to.time - from.time).count();
+    ret.tags.reserve(to.tags.size());
+
+    const tag_snapshot_t empty;
+    for (const auto& it : to.tags)
+    {
+      const tag_snapshot_t* prev = from.find(it.name);
+      if (prev == nullptr)
+        prev = &empty;
+
+      tag_diff_t& d = ret.tags.emplace_back();
+      d.name = it.name;
+      d.live_bytes = it.live_bytes;
+      d.peak_live_bytes = it.peak_live_bytes;
+      d.reserved_bytes = it.reserved_bytes;
+      d.fragmentation = it.get_fragmentation();
+
+      d.live_bytes_delta = it.live_bytes - prev->live_bytes;
+      d.reserved_bytes_delta = it.reserved_bytes - prev->reserved_bytes;
+
+      d.allocation_count = it.allocation_count - prev->allocation_count;
+      d.deallocation_count = it.deallocation_count - prev->deallocation_count;
+      d.allocated_bytes = it.allocated_bytes - prev->allocated_bytes;
+
+      if (ret.duration > 0)
+      {
+        d.allocation_rate = (double)d.allocation_count / ret.duration;
+        d.allocated_bytes_rate = (double)d.allocated_bytes / ret.duration;
+      }
+    }
+    return ret;
+  }
+
+  void log_snapshot(const snapshot_t& snapshot)
+  {
+    cr::out().log("memory accounting: {} tags:", snapshot.tags.size());
+    for (const auto& it : snapshot.tags)
+    {
+      cr::out().log("  {}: live: {}KiB (peak: {}KiB) | reserved: {}KiB (peak: {}KiB) | fragmentation: {:.1f}% | {} allocations, {} deallocations",
+                    it.name, it.live_bytes / 1024, it.peak_live_bytes / 1024, it.reserved_bytes / 1024, it.peak_reserved_bytes / 1024,
+                    it.get_fragmentation() * 100, it.allocation_count, it.deallocation_count);
+    }
+  }
+
+  void log_diff(const diff_t& diff)
+  {
+    cr::out().log("memory accounting: diff over {:.3f}s:", diff.duration);
+    for (const auto& it : diff.tags)
+    {
+      if (it.allocation_count == 0 && it.deallocation_count == 0 && it.live_bytes_delta == 0 && it.reserved_bytes_delta == 0)
+        continue;
+      cr::out().log("  {}: live: {:+}KiB | reserved: {:+}KiB | {:.0f} allocations/s ({:.1f}KiB/s) | {} deallocations",
+                    it.name, it.live_bytes_delta / 1024, it.reserved_bytes_delta / 1024,
+                    it.allocation_rate, it.allocated_bytes_rate / 1024, it.deallocation_count);
+    }
+  }
+
+  void set_periodic_dump_hook(std::chrono::milliseconds period, dump_hook_t hook)
+  {
+    registry_t& registry = get_registry();
+    std::lock_guard _lg(registry.dump_lock);
+    registry.dump_hook = std::move(hook);
+    registry.dump_period = period;
+    if (!registry.dump_hook)
+    {
+      registry.next_dump_time.store(0, std::memory_order_release);
+      return;
+    }
+    registry.last_dump = take_snapshot();
+    registry.next_dump_time.store((registry.last_dump.time + period).time_since_epoch().count(), std::memory_order_release);
+  }
+
+  void log_dump_hook(const snapshot_t& current, const diff_t& since_last_dump)
+  {
+    log_snapshot(current);
+    log_diff(since_last_dump);
+  }
+
+  void poll()
+  {
+    registry_t& registry = get_registry();
+    const int64_t next_dump_time = registry.next_dump_time.load(std::memory_order_acquire);
+    if (next_dump_time == 0)
+      return;
+    const auto now = std::chrono::steady_clock::now();
+    if (now.time_since_epoch().count() < next_dump_time)
+      return;
+
+    // only a single thread does the dump:
+    if (!registry.dump_lock.try_lock())
+      return;
+
+    dump_hook_t hook;
+    snapshot_t current;
+    diff_t since_last_dump;
+    {
+      std::lock_guard _lg(registry.dump_lock, std::adopt_lock);
+      if (!registry.dump_hook || registry.next_dump_time.load(std::memory_order_relaxed) != next_dump_time)
+        return;
+
+      current = take_snapshot();
+      since_last_dump = diff(registry.last_dump, current);
+      registry.next_dump_time.store((current.time + registry.dump_period).time_since_epoch().count(), std::memory_order_release);
+      registry.last_dump = current;
+      hook = registry.dump_hook;
+    }
+
+    // the hook is called without the lock held, so it can call set_periodic_dump_hook() or poll()
+    hook(current, since_last_dump);
+  }
+}
@@ -0,0 +1,235 @@
+//
+// created by : Timothée Feuillet
+// date: 2026-10-18
+//
+//
+// Copyright (c) 2026 Timothée Feuillet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+
+#include "memory.hpp"
+
+/// \brief Per-subsystem memory accounting.
+/// Allocators report to a tag (a named counter set, registered once and never destroyed), snapshots of all the tags can be taken and diffed.
+///
+/// Terminology:
+///  - live bytes: bytes handed to the users of the allocator
+///  - reserved bytes: bytes the allocator holds from its upstream (pages, chunks, ...)
+///  - fragmentation: the part of the reserved memory that is not live (1 - live / reserved)
+namespace neam::memory::accounting
+{
+  struct tag_snapshot_t
+  {
+    std::string name;
+
+    int64_t live_bytes = 0;
+    int64_t peak_live_bytes = 0;
+    int64_t reserved_bytes = 0;
+    int64_t peak_reserved_bytes = 0;
+
+    // cumulative counters:
+    uint64_t allocation_count = 0;
+    uint64_t deallocation_count = 0;
+    uint64_t allocated_bytes = 0;
+
+    /// \brief Return the fragmentation (0: none, 1: everything is wasted)
+    /// \note Only meaningful for tags that report reserved bytes
+    float get_fragmentation() const
+    {
+      if (reserved_bytes <= 0 || live_bytes >= reserved_bytes)
+        return 0.0f;
+      return 1.0f - (float)((double)std::max<int64_t>(live_bytes, 0) / (double)reserved_bytes);
+    }
+  };
+
+  struct snapshot_t
+  {
+    std::chrono::steady_clock::time_point time;
+    std::vector<tag_snapshot_t> tags;
+
+    const tag_snapshot_t* find(std::string_view name) const
+    {
+      for (const auto& it : tags)
+      {
+        if (it.name == name)
+          return &it;
+      }
+      return nullptr;
+    }
+  };
+
+  struct tag_diff_t
+  {
+    std::string name;
+
+    int64_t live_bytes = 0;
+    int64_t peak_live_bytes = 0;
+    int64_t reserved_bytes = 0;
+    float fragmentation = 0;
+
+    int64_t live_bytes_delta = 0;
+    int64_t reserved_bytes_delta = 0;
+
+    uint64_t allocation_count = 0;
+    uint64_t deallocation_count = 0;
+    uint64_t allocated_bytes = 0;
+
+    // per seconds:
+    double allocation_rate = 0;
+    double allocated_bytes_rate = 0;
+  };
+
+  struct diff_t
+  {
+    double duration = 0; // in seconds
+    std::vector<tag_diff_t> tags;
+  };
+
+  /// \brief A named set of counters. Allocations and deallocations only touch a counter shard of the calling thread.
+  /// \note Live bytes are flushed from the shard to the global counter every k_flush_threshold bytes,
+  ///       so the peak is accurate to k_flush_threshold * k_shard_count
+  class tag
+  {
+    public:
+      static constexpr uint32_t k_shard_count = 32;
+      static constexpr int64_t k_flush_threshold = 64 * 1024;
+
+      std::string_view get_name() const { return name; }
+
+      void on_allocate(size_t bytes, uint32_t count = 1)
+      {
+        shard_t& shard = get_shard();
+        shard.allocation_count.fetch_add(count, std::memory_order_relaxed);
+        shard.allocated_bytes.fetch_add(bytes, std::memory_order_relaxed);
+        const int64_t pending = shard.pending_live_bytes.fetch_add((int64_t)bytes, std::memory_order_relaxed) + (int64_t)bytes;
+        [[unlikely]] if (pending >= k_flush_threshold)
+          flush(shard);
+      }
+
+      void on_deallocate(size_t bytes, uint32_t count = 1)
+      {
+        shard_t& shard = get_shard();
+        shard.deallocation_count.fetch_add(count, std::memory_order_relaxed);
+        const int64_t pending = shard.pending_live_bytes.fetch_sub((int64_t)bytes, std::memory_order_relaxed) - (int64_t)bytes;
+        [[unlikely]] if (pending <= -k_flush_threshold)
+          flush(shard);
+      }
+
+      /// \brief The allocator got some memory from its upstream (slow path, directly goes to the global counter)
+      void on_reserve(size_t bytes)
+      {
+        const int64_t reserved = reserved_bytes.fetch_add((int64_t)bytes, std::memory_order_relaxed) + (int64_t)bytes;
+        update_peak(peak_reserved_bytes, reserved);
+      }
+
+      /// \brief The allocator gave back some memory to its upstream (slow path, directly goes to the global counter)
+      void on_release(size_t bytes)
+      {
+        reserved_bytes.fetch_sub((int64_t)bytes, std::memory_order_relaxed);
+      }
+
+      /// \brief Reset the peaks to the current values
+      void reset_peaks();
+
+      tag_snapshot_t get_snapshot() const;
+
+    private:
+      explicit tag(std::string _name) : name(std::move(_name)) {}
+
+      struct alignas(64) shard_t
+      {
+        std::atomic<int64_t> pending_live_bytes = 0;
+        std::atomic<uint64_t> allocation_count = 0;
+        std::atomic<uint64_t> deallocation_count = 0;
+        std::atomic<uint64_t> allocated_bytes = 0;
+      };
+
+      shard_t& get_shard()
+      {
+        return shards[get_thread_index() % k_shard_count];
+      }
+
+      void flush(shard_t& shard)
+      {
+        const int64_t pending = shard.pending_live_bytes.exchange(0, std::memory_order_relaxed);
+        const int64_t live = live_bytes.fetch_add(pending, std::memory_order_relaxed) + pending;
+        update_peak(peak_live_bytes, live);
+      }
+
+      static void update_peak(std::atomic<int64_t>& peak, int64_t value)
+      {
+        int64_t current = peak.load(std::memory_order_relaxed);
+        while (current < value && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed));
+      }
+
+    private:
+      const std::string name;
+      shard_t shards[k_shard_count];
+
+      alignas(64) std::atomic<int64_t> live_bytes = 0;
+      std::atomic<int64_t> peak_live_bytes = 0;
+      std::atomic<int64_t> reserved_bytes = 0;
+      std::atomic<int64_t> peak_reserved_bytes = 0;
+
+      friend tag& get_tag(std::string_view name);
+  };
+
+  /// \brief Return the tag for a given name, creating it if necessary
+  /// \note Tags are never destroyed. The returned reference is valid for the whole duration of the program.
+  /// \note Slow-ish (lock + search), callers are expected to cache the result.
+  tag& get_tag(std::string_view name);
+
+  /// \brief Take a snapshot of all the registered tags
+  snapshot_t take_snapshot();
+
+  /// \brief Compute the difference between two snapshots (tags missing from \e from are considered empty)
+  diff_t diff(const snapshot_t& from, const snapshot_t& to);
+
+  /// \brief Log a snapshot (one line per tag) using cr::out()
+  void log_snapshot(const snapshot_t& snapshot);
+
+  /// \brief Log a diff (one line per tag) using cr::out()
+  void log_diff(const diff_t& diff);
+
+  using dump_hook_t = std::function<void(const snapshot_t& current, const diff_t& since_last_dump)>;
+
+  /// \brief Set the function called by poll() every \e period
+  /// \note Passing an empty function removes the hook
+  void set_periodic_dump_hook(std::chrono::milliseconds period, dump_hook_t hook);
+
+  /// \brief Log the snapshot and the diff with the previous dump. Can be used with set_periodic_dump_hook.
+  void log_dump_hook(const snapshot_t& current, const diff_t& since_last_dump);
+
+  /// \brief Call the dump hook if the period has elapsed. Cheap if there's nothing to do.
+  /// \note Expected to be called regularly (from a main loop, at the end of a frame, ...)
+  void poll();
+}
@@ -35,9 +35,13 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <span>
+#include <vector>
 
 #include "raw_ptr.hpp"
 #include "raw_data.hpp"
+#include "shared_raw_data.hpp"
+#include "memory_accounting.hpp"
 
 namespace neam
 {
@@ -57,10 +61,36 @@ namespace neam
         }
 
         /// \brief Move constructor
-        memory_allocator(memory_allocator &&o) = default;
+        memory_allocator(memory_allocator &&o)
+          : first(std::move(o.first)), last(o.last), pool_size(o.pool_size), reserved_size(o.reserved_size), allocation_count(o.allocation_count),
+            failed(o.failed), fallback_data(std::move(o.fallback_data))
+        {
+          o.last = nullptr;
+          o.pool_size = 0;
+          o.reserved_size = 0;
+          o.allocation_count = 0;
+        }
 
         /// \brief Move/affectation operator
-        memory_allocator &operator = (memory_allocator &&o) = default;
+        memory_allocator &operator = (memory_allocator &&o)
+        {
+          if (&o == this)
+            return *this;
+          clear();
+          first = std::move(o.first);
+          last = o.last;
+          pool_size = o.pool_size;
+          reserved_size = o.reserved_size;
+          allocation_count = o.allocation_count;
+          failed = o.failed;
+          fallback_data = std::move(o.fallback_data);
+
+          o.last = nullptr;
+          o.pool_size = 0;
+          o.reserved_size = 0;
+          o.allocation_count = 0;
+          return *this;
+        }
 
         ~memory_allocator()
         {
@@ -103,6 +133,8 @@ namespace neam
             }
 
             nchk->end_offset = count;
+            reserved_size += nchk->data.size;
+            get_accounting_tag().on_reserve(nchk->data.size);
             if (first)
             {
               last->next = nchk;
@@ -114,6 +146,8 @@ namespace neam
               last = nchk;
             }
             pool_size += count;
+            ++allocation_count;
+            get_accounting_tag().on_allocate(count);
             return nchk->data;
           }
 
@@ -121,6 +155,8 @@ namespace neam
           void* data = last->data.get_as<uint8_t>() + last->end_offset;
           last->end_offset += count;
           pool_size += count;
+          ++allocation_count;
+          get_accounting_tag().on_allocate(count);
           return data;
         }
 
@@ -145,6 +181,8 @@ namespace neam
             }
 
             nchk->end_offset = 0;
+            reserved_size += nchk->data.size;
+            get_accounting_tag().on_reserve(nchk->data.size);
             if (first)
             {
               last->next = nchk;
@@ -196,6 +234,9 @@ namespace neam
 
           first = new_chk;
           last = new_chk;
+          get_accounting_tag().on_release(reserved_size);
+          get_accounting_tag().on_reserve(pool_size);
+          reserved_size = pool_size;
           return new_chk->data;
         }
 
@@ -229,7 +270,35 @@ namespace neam
             ret = std::move(first->data);
             ret.size = pool_size; // necessary as we might have single, normally allocated chunk
           }
-          clear();
+          clear(); // the data is not ours anymore, but is still accounted as raw_data
+          return ret;
+        }
+
+        /// \brief Return a view of the chunks (in order), without making the data contiguous.
+        /// \note The spans are invalidated by any call to a non-const function of the allocator
+        std::vector<std::span<const uint8_t>> get_segments() const
+        {
+          std::vector<std::span<const uint8_t>> ret;
+          for (const memory_chunk* chr = first; chr; chr = chr->next)
+          {
+            if (chr->end_offset > 0)
+              ret.emplace_back(chr->data.get_as<const uint8_t>(), chr->end_offset);
+          }
+          return ret;
+        }
+
+        /// \brief give the ownership of the chunks (in order) and clear the pool. No copy is done.
+        /// \note Meant for scatter-gather I/O (see io::context::queue_send / queue_write)
+        /// \see give_up_data()
+        std::vector<shared_raw_data> give_up_segments()
+        {
+          std::vector<shared_raw_data> ret;
+          for (memory_chunk* chr = first; chr; chr = chr->next)
+          {
+            if (chr->end_offset > 0)
+              ret.emplace_back(shared_raw_data(std::move(chr->data)).slice(0, chr->end_offset));
+          }
+          clear(); // the data is not ours anymore, but is still accounted as raw_data
           return ret;
         }
 
@@ -243,7 +312,13 @@ namespace neam
             delete chr;
           }
           last = nullptr;
+          if (allocation_count > 0)
+            get_accounting_tag().on_deallocate(pool_size, allocation_count);
+          if (reserved_size > 0)
+            get_accounting_tag().on_release(reserved_size);
           pool_size = 0;
+          reserved_size = 0;
+          allocation_count = 0;
           failed = false;
         }
 
@@ -274,10 +349,18 @@ namespace neam
       private:
         constexpr static size_t chunk_size = 8192 * 10; // 10 * 8Kio per-chunk
 
+        static memory::accounting::tag& get_accounting_tag()
+        {
+          static memory::accounting::tag& tag = memory::accounting::get_tag("memory_allocator");
+          return tag;
+        }
+
       private:
         raw_ptr<memory_chunk> first = nullptr;
         memory_chunk* last = nullptr;
         size_t pool_size = 0;
+        size_t reserved_size = 0;
+        uint32_t allocation_count = 0;
         bool failed = false;
         raw_data fallback_data;
         uint64_t fallback_small = 0; ///< \brief used when running out of memory and if the allocated size is lower than
@@ -31,6 +31,13 @@
 
 #include "ct_string.hpp"
 #include "debug/assert.hpp"
+#include "memory_accounting.hpp"
+
+// Report raw_data allocations to the "raw_data" memory accounting tag.
+// Free when checks are enabled (the canary already stores the size), otherwise it adds a size header to every allocation.
+#ifndef N_RAW_DATA_ACCOUNTING
+  #define N_RAW_DATA_ACCOUNTING (!N_DISABLE_CHECKS)
+#endif
 
 namespace neam
 {
@@ -90,11 +97,34 @@ namespace neam
     constexpr size_t k_canary_extra_size = 2 * sizeof(canary_t);
 #endif
 
+#if N_DISABLE_CHECKS && N_RAW_DATA_ACCOUNTING
+    // without canaries, we still need the size of the allocation for the memory accounting
+    struct alignas(16) size_header_t
+    {
+      uint64_t size;
+    };
+#endif
+
+#if N_RAW_DATA_ACCOUNTING
+    inline memory::accounting::tag& get_raw_data_accounting_tag()
+    {
+      static memory::accounting::tag& tag = memory::accounting::get_tag("raw_data");
+      return tag;
+    }
+#endif
+
     inline void* allocate_memory(size_t size)
     {
       if (size == 0) return nullptr;
 
-#if N_DISABLE_CHECKS
+#if N_RAW_DATA_ACCOUNTING
+      get_raw_data_accounting_tag().on_allocate(size);
+#endif
+#if N_DISABLE_CHECKS && N_RAW_DATA_ACCOUNTING
+      size_header_t* header = (size_header_t*)operator new (size + sizeof(size_header_t));
+      header->size = size;
+      return header + 1;
+#elif N_DISABLE_CHECKS
       return operator new (size);
 #else
       return write_canary(operator new (size + k_canary_extra_size), size);
@@ -105,13 +135,23 @@ namespace neam
     {
       void operator()(void* ptr) const
       {
-#if N_DISABLE_CHECKS
+#if N_DISABLE_CHECKS && N_RAW_DATA_ACCOUNTING
+        if (ptr != nullptr)
+        {
+          size_header_t* header = (size_header_t*)ptr - 1;
+          get_raw_data_accounting_tag().on_deallocate(header->size);
+          operator delete ((void*)header);
+        }
+#elif N_DISABLE_CHECKS
         operator delete (ptr);
 #else
         if (ptr != nullptr)
         {
           check_canary(ptr);
           canary_t* start = (canary_t*)((uint8_t*)ptr - sizeof(canary_t));
+#if N_RAW_DATA_ACCOUNTING
+          get_raw_data_accounting_tag().on_deallocate(start->size & canary_t::k_size_mask);
+#endif
           start->value = canary_t::k_deleted_value;
           start->size = 0;
           operator delete ((void*)start);
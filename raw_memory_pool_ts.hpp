@@ -33,6 +33,7 @@
 
 #include "tracy.hpp"
 #include "memory.hpp"
+#include "memory_accounting.hpp"
 #include "spinlock.hpp"
 #include "debug/assert.hpp"
 #include "ring_buffer.hpp"
@@ -108,32 +109,40 @@ namespace neam
             // Get the page
             while (true)
             {
+              uint32_t generation;
               {
-                // std::lock_guard _lg(spinlock_shared_adapter::adapt(write_page_in_use_lock));
+                std::lock_guard _lg(spinlock_shared_adapter::adapt(write_page_in_use_lock));
+                generation = write_page_generation.load(std::memory_order::acquire);
                 page = write_page.load(std::memory_order::acquire);
                 index = page->write_offset.fetch_add(1, std::memory_order_acq_rel);
                 [[likely]] if (index < object_count_per_page)
+                {
+                  // Must be done with the lock held (and before k_page_can_be_freed_marker is set), so no-one can delete the page from under us
+                  page->allocation_count.fetch_add(1, std::memory_order_release);
                   break;
+                }
                 else
+                {
                   page->write_offset.store(object_count_per_page, std::memory_order_release);
+                }
               }
 
               // FIXME: Use umwait
-              while (write_page.load(std::memory_order_relaxed) == page);
+              // NOTE: we cannot wait on the page pointer, as the page might have been freed and re-allocated at the same address
+              while (write_page_generation.load(std::memory_order_relaxed) == generation);
             }
           }
 
-          // Before storing k_page_can_be_freed_marker, so no-one can delete the page from under us
-          page->allocation_count.fetch_add(1, std::memory_order_release);
-
           if (index == object_count_per_page - 1)
           {
             // We can only really swap current/next page at this point. This means some threads might wait a bit on page-swap
             page_header_t* const next_page = next_write_page.exchange(allocate_page(), std::memory_order_acq_rel);
             write_page.store(next_page, std::memory_order_release);
+            write_page_generation.fetch_add(1, std::memory_order_release);
 
             {
-              // std::lock_guard _lg(spinlock_exclusive_adapter::adapt(write_page_in_use_lock));
+              // wait for all the threads that might still see the old page to have incremented its allocation count
+              std::lock_guard _lg(spinlock_exclusive_adapter::adapt(write_page_in_use_lock));
             }
             // mark the page as ok for release
             page->allocation_count.fetch_or(k_page_can_be_freed_marker, std::memory_order_release);
@@ -143,6 +152,7 @@ namespace neam
 
 
           object_count.fetch_add(1, std::memory_order_release);
+          accounting_tag->on_allocate(object_size);
 
           return ((uint8_t*)page + offset);
         }
@@ -157,6 +167,7 @@ namespace neam
 
             [[maybe_unused]] const uint32_t total_count = object_count.fetch_sub(1, std::memory_order_release);
             check::debug::n_assert(total_count > 0, "Double free/corruption (global|pool object)");
+            accounting_tag->on_deallocate(object_size);
 
             const uint32_t count = chk->allocation_count.fetch_sub(1, std::memory_order_release);
             check::debug::n_assert((count & ~k_page_can_be_freed_marker) <= object_count_per_page, "Double free/corruption (page-header)");
@@ -170,6 +181,14 @@ namespace neam
           }
         }
 
+        /// \brief Set the tag the pool reports its memory usage to (default is "raw_memory_pool_ts")
+        /// \warning Must be called before init()
+        void set_accounting_tag(memory::accounting::tag& tag)
+        {
+          check::debug::n_assert(!is_init(), "set_accounting_tag must be called before init()");
+          accounting_tag = &tag;
+        }
+
         // gp getters
         uint32_t get_number_of_object() const { return object_count.load(std::memory_order::relaxed); }
 
@@ -180,12 +199,19 @@ namespace neam
         std::string pool_debug_name;
 
       private: // page stuff
+        static memory::accounting::tag& get_default_accounting_tag()
+        {
+          static memory::accounting::tag& tag = memory::accounting::get_tag("raw_memory_pool_ts");
+          return tag;
+        }
+
         struct page_header_t;
         page_header_t* allocate_page() const
         {
           page_header_t* page = (page_header_t*)memory::allocate_page(page_count);
           check::debug::n_check(page != nullptr, "Could not allocate {} memory pages", page_count);
           if (!page) return nullptr;
+          accounting_tag->on_reserve(page_count * memory::get_page_size());
 
           // setup the chunk
           page->init_markers(*this);
@@ -195,6 +221,8 @@ namespace neam
 
         void free_page(page_header_t* ptr) const
         {
+          if (ptr != nullptr)
+            accounting_tag->on_release(page_count * memory::get_page_size());
           memory::free_page(ptr, page_count);
         }
 
@@ -266,11 +294,13 @@ namespace neam
 
         std::atomic<page_header_t*> write_page;
         std::atomic<page_header_t*> next_write_page;
+        std::atomic<uint32_t> write_page_generation = 0;
+
+        memory::accounting::tag* accounting_tag = &get_default_accounting_tag();
 
-        // Extra safety. Probably not needed as the condition for the race condition to trigger is either not possible or very difficult
-        // (a thread would have to go to sleep right in the page-check loop, and sleep until the last object is initialized and freed)
-        // Uncomment if this happens.
-        // shared_spinlock write_page_in_use_lock;
+        // A thread can go to sleep right in the page-check loop, and sleep until the last object of the page is allocated and freed
+        // (which happens a lot with short-lived allocations, like in the slab_allocator). The lock prevents the page from being freed in that case.
+        shared_spinlock write_page_in_use_lock;
     };
   } // namespace cr
 } // namespace neam
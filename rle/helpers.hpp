@@ -290,6 +290,40 @@ namespace neam::rle
     }
   };
 
+  /// \brief Handle shared_raw_data. Encoded the same way as raw_data (both are compatible).
+  /// \note When decoding from a shared_raw_data, the result is a slice of the source (no copy)
+  template<>
+  struct coder<shared_raw_data>
+  {
+    static void encode(encoder& ec, const shared_raw_data& v, status& /*st*/)
+    {
+      ec.encode<uint32_t>(v.get_size());
+      if (v.get_size() > 0)
+      {
+        memcpy(ec.allocate(v.get_size()), v.get(), v.get_size());
+      }
+    }
+    static shared_raw_data decode(decoder& dc, status& st)
+    {
+      decoder subdc = dc.decode_and_skip<uint32_t>();
+      if (!subdc.is_valid())
+      {
+        N_RLE_LOG_FAIL("failed to deserialize {}: decoder is not in a valid state", ct::type_name<shared_raw_data>.str);
+        return (st = status::failure), shared_raw_data{};
+      }
+
+      if (const shared_raw_data* source = subdc.get_shared_source(); source != nullptr)
+        return source->slice(subdc._get_offset(), subdc.get_size());
+      return shared_raw_data::duplicate(subdc.get_address(), subdc.get_size());
+    }
+
+    static void generate_metadata(serialization_metadata& mt)
+    {
+      mt.add_type<shared_raw_data>({ type_mode::container, 0, cr::construct<std::vector>( mt.ref<uint8_t>() ) });
+      coder<uint8_t>::generate_metadata(mt);
+    }
+  };
+
   // Some utility concepts
   namespace concepts
   {
@@ -78,6 +78,20 @@ namespace neam::rle
     return coder<T>::decode(dc, *opt_st);
   }
 
+  /// \brief Deserialize from a shared buffer. Returns a default constructed object if it failed.
+  /// \note shared_raw_data members are deserialized as slices of \e data (no copy)
+  template<typename T>
+  static T deserialize(const shared_raw_data& data, status* opt_st/* = nullptr*/, uint64_t offset /*= 0*/)
+  {
+    status st;
+    if (opt_st == nullptr)
+      opt_st = &st;
+    *opt_st = status::success;
+    decoder dc = data;
+    dc.skip(offset);
+    return coder<T>::decode(dc, *opt_st);
+  }
+
   /// \brief Deserialize in-place, destructing and re-constructing members as needed
   template<concepts::SerializableStruct T>
   status in_place_deserialize(const raw_data& data, T& dest)
@@ -28,6 +28,7 @@
 
 #include "../type_id.hpp"
 #include "../raw_data.hpp"
+#include "../shared_raw_data.hpp"
 
 namespace neam::rle
 {
@@ -37,16 +38,23 @@ namespace neam::rle
   {
     public:
       decoder(const raw_data& _data)
-        : data(_data)
-        , offset(0)
-        , size(data.size)
+        : decoder((const uint8_t*)_data.data.get(), _data.size, nullptr, 0, _data.size)
       {
       }
 
       decoder(const raw_data& _data, uint64_t _offset, uint64_t _size)
-        : data(_data)
-        , offset(_offset)
-        , size(_size == ~0ul ? data.size : _size)
+        : decoder((const uint8_t*)_data.data.get(), _data.size, nullptr, _offset, _size)
+      {
+      }
+
+      /// \brief Decode from a shared buffer. Shared buffers can be decoded without copy (see coder<shared_raw_data>)
+      decoder(const shared_raw_data& _data)
+        : decoder((const uint8_t*)_data.get(), _data.get_size(), &_data, 0, _data.get_size())
+      {
+      }
+
+      decoder(const shared_raw_data& _data, uint64_t _offset, uint64_t _size)
+        : decoder((const uint8_t*)_data.get(), _data.get_size(), &_data, _offset, _size)
       {
       }
 
@@ -55,19 +63,19 @@ namespace neam::rle
       template<typename Type = void*>
       const Type* get_address() const
       {
-        if (offset + size > data.size) return nullptr;
-        return (const Type*)((const uint8_t*)data.data.get() + offset);
+        if (offset + size > base_size) return nullptr;
+        return (const Type*)(base + offset);
       }
 
       uint64_t get_size() const
       {
-        if (offset + size > data.size) return 0;
+        if (offset + size > base_size) return 0;
         return size;
       }
 
       bool is_valid() const
       {
-        if (offset + size > data.size) return false;
+        if (offset + size > base_size) return false;
         return true;
       }
 
@@ -76,7 +84,7 @@ namespace neam::rle
         if (bytes_to_skip > size)
         {
           N_RLE_LOG_FAIL("failed to skip {} bytes: size left: {}", bytes_to_skip, size);
-          offset = data.size + 1;
+          offset = base_size + 1;
           size = 0;
           return false;
         }
@@ -109,18 +117,34 @@ namespace neam::rle
 
         const auto [decoded_size, success] = decode<SizeType>();
         if (!success)
-          return {data, data.size + 1, 0}; // invalid
-        decoder dc = {data, offset, decoded_size};
+          return {base, base_size, shared_source, base_size + 1, 0}; // invalid
+        decoder dc = {base, base_size, shared_source, offset, decoded_size};
         skip(decoded_size);
         if (!is_valid())
-          return {data, data.size + 1, 0}; // invalid
+          return {base, base_size, shared_source, base_size + 1, 0}; // invalid
         return dc;
       }
 
       uint64_t _get_offset() const { return offset; }
 
+      /// \brief If the decoder has been created from a shared_raw_data, return it (nullptr otherwise)
+      /// \note _get_offset() is relative to the shared_raw_data view
+      const shared_raw_data* get_shared_source() const { return shared_source; }
+
+    private:
+      decoder(const uint8_t* _base, uint64_t _base_size, const shared_raw_data* _shared_source, uint64_t _offset, uint64_t _size)
+        : base(_base)
+        , base_size(_base_size)
+        , shared_source(_shared_source)
+        , offset(_offset)
+        , size(_size == ~0ul ? _base_size : _size)
+      {
+      }
+
     private:
-      const raw_data& data;
+      const uint8_t* base;
+      uint64_t base_size;
+      const shared_raw_data* shared_source;
       uint64_t offset;
       uint64_t size; // from start_offset
   };
@@ -68,6 +68,12 @@ namespace neam::rle
         return ma->give_up_data();
       }
 
+      /// \brief Like to_raw_data(), but does not flatten the data (avoid a copy if there's more than one chunk)
+      std::vector<shared_raw_data> to_segments()
+      {
+        return ma->give_up_segments();
+      }
+
     private:
       cr::memory_allocator* ma = nullptr;
   };
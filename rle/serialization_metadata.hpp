@@ -38,11 +38,13 @@
 #include "../id/id.hpp" // for id_t
 #include "../id/string_id.hpp" // for string_id
 #include "../container_utils.hpp" // for for_each
+#include "../shared_raw_data.hpp" // for deserialize
 
 namespace neam::rle
 {
   // FIXME: a forward decl header:
   template<typename T> static T deserialize(const raw_data& data, status* opt_st = nullptr, uint64_t offset = 0);
+  template<typename T> static T deserialize(const shared_raw_data& data, status* opt_st = nullptr, uint64_t offset = 0);
   template<typename T> static raw_data serialize(const T& v, status* opt_st = nullptr);
 
   using type_hash_t = uint64_t;
@@ -63,23 +63,28 @@ namespace neam::rpc
 
   void dispatcher::local_call(raw_data&& data, uint64_t offset)
   {
-    if (data.size <= offset)
+    local_call(shared_raw_data(std::move(data)), offset);
+  }
+
+  void dispatcher::local_call(const shared_raw_data& data, uint64_t offset)
+  {
+    if (data.get_size() <= offset)
       return internal::on_error({}, "invalid data: no data provided");
 
     // we encode the data in the following form:
     // [---- RLE DATA ----][ protocol<k_protocol_version>_footer_t ]
-    // This avoid doing any memory operation and simply forwarding the data as-is to RLE (while simply changing the size)
-    if (data.size - offset < sizeof(protocol1_footer_t))
+    // This avoid doing any memory operation and simply forwarding a view of the data to RLE (while simply changing the size)
+    if (data.get_size() - offset < sizeof(protocol1_footer_t))
       return internal::on_error({}, "invalid data (not an rpc call)");
 
-    const protocol1_footer_t* const footer1 = (protocol1_footer_t*)((uint8_t*)(data.get()) + data.size - sizeof(protocol1_footer_t));
+    const protocol1_footer_t* const footer1 = (const protocol1_footer_t*)(data.get_as<uint8_t>() + data.get_size() - sizeof(protocol1_footer_t));
     if (footer1->protocol_key != k_protocol_key)
       return internal::on_error({}, "invalid protocol");
 
     if (footer1->protocol_version > k_protocol_version)
       return internal::on_error({}, "invalid protocol version");
 
-    data.size -= sizeof(protocol1_footer_t);
+    const shared_raw_data call_data = data.slice(0, data.get_size() - sizeof(protocol1_footer_t));
 
     // NOTE: If we have more versions, unstack the footers there
 
@@ -90,7 +95,7 @@ namespace neam::rpc
     {
       id_t previous_call = id;
       std::swap(internal::get_thread_data().current_rpc_call, previous_call);
-      it->second(std::move(data), offset);
+      it->second(call_data, offset);
       internal::get_thread_data().current_rpc_call = previous_call;
       return;
     }
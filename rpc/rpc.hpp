@@ -34,6 +34,7 @@
 #include "../logger/logger.hpp"
 #include "../rle/rle.hpp"
 #include "../raw_data.hpp"
+#include "../shared_raw_data.hpp"
 #include "../id/string_id.hpp"
 #include "../macro.hpp"
 #include "../function.hpp"
@@ -68,7 +69,7 @@ namespace neam::rpc
 {
   namespace internal
   {
-    using function_t = std::move_only_function<void(raw_data&&, uint64_t)>;
+    using function_t = std::move_only_function<void(const shared_raw_data&, uint64_t)>;
     adapter_base* get_current_adapter();
     void set_current_adapter(adapter_base* ab);
 
@@ -90,7 +91,7 @@ namespace neam::rpc
 
       raii_register()
       {
-        register_function(function_id, [](raw_data&& dt, uint64_t offset)
+        register_function(function_id, [](const shared_raw_data& dt, uint64_t offset)
         {
           using traits = ct::function_traits<decltype(Fnc)>;
           if constexpr (ct::list::size<typename traits::arg_list> > 0)
@@ -157,6 +158,10 @@ namespace neam::rpc
       /// \brief Perform a local call
       static void local_call(raw_data&& data, uint64_t offset = 0);
 
+      /// \brief Perform a local call
+      /// \note shared_raw_data arguments of the called function are slices of \e data (no copy is performed)
+      static void local_call(const shared_raw_data& data, uint64_t offset = 0);
+
     private:
       static size_t get_footer_size();
       [[nodiscard]] static raw_data prepare_for_empty_call(id_t rpc_id, adapter_base& adapter);
@@ -0,0 +1,241 @@
+//
+// created by : Timothée Feuillet
+// date: 2026-10-18
+//
+//
+// Copyright (c) 2026 Timothée Feuillet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+
+#include <atomic>
+#include <string_view>
+
+#include "raw_data.hpp"
+#include "slab_allocator.hpp"
+#include "debug/assert.hpp"
+
+namespace neam
+{
+  /// \brief Reference counted view over a raw_data. Copies and slices are cheap (no memory copy, only a refcount increment).
+  /// \note The data is considered read-only once shared (get_mutable() is only allowed for the unique owner).
+  /// \note Thread-safe in the same way std::shared_ptr is: the refcount is, concurrent access to the same instance is not.
+  class shared_raw_data
+  {
+    public:
+      /// \brief Receives the data of a recyclable shared_raw_data when its last reference is dropped (instead of freeing it)
+      /// \note recycle() can be called from any thread
+      class recycler
+      {
+        public:
+          virtual void recycle(raw_data&& data, uint32_t index) = 0;
+
+        protected:
+          ~recycler() = default;
+      };
+
+    public:
+      shared_raw_data() = default;
+
+      /// \brief Take the ownership of the raw_data (no copy is done)
+      explicit shared_raw_data(raw_data&& rd)
+      {
+        if (!rd.data)
+          return;
+        size = rd.size;
+        void* const ptr = cr::slab_allocator::get_global().allocate(sizeof(block_t), alignof(block_t));
+        check::debug::n_assert(ptr != nullptr, "shared_raw_data: failed to allocate the control block");
+        block = new (ptr) block_t { {1}, 0, nullptr, std::move(rd) };
+      }
+
+      /// \brief Create a shared_raw_data that gives back its data to \e owner when the last reference is dropped
+      /// \note \e index is an opaque value, given back to the recycler (see get_recycler_index())
+      [[nodiscard]] static shared_raw_data make_recyclable(raw_data&& rd, recycler& owner, uint32_t index)
+      {
+        shared_raw_data ret(std::move(rd));
+        if (ret.block != nullptr)
+        {
+          ret.block->recycler_index = index;
+          ret.block->owner = &owner;
+        }
+        return ret;
+      }
+
+      shared_raw_data(const shared_raw_data& o) : block(o.block), offset(o.offset), size(o.size)
+      {
+        acquire();
+      }
+
+      shared_raw_data(shared_raw_data&& o) noexcept : block(o.block), offset(o.offset), size(o.size)
+      {
+        o.block = nullptr;
+        o.offset = 0;
+        o.size = 0;
+      }
+
+      shared_raw_data& operator = (const shared_raw_data& o)
+      {
+        if (&o == this) return *this;
+        o.acquire();
+        release();
+        block = o.block;
+        offset = o.offset;
+        size = o.size;
+        return *this;
+      }
+
+      shared_raw_data& operator = (shared_raw_data&& o) noexcept
+      {
+        if (&o == this) return *this;
+        release();
+        block = o.block;
+        offset = o.offset;
+        size = o.size;
+        o.block = nullptr;
+        o.offset = 0;
+        o.size = 0;
+        return *this;
+      }
+
+      ~shared_raw_data() { release(); }
+
+      /// \brief Allocate a new, uninitialized buffer (use get_mutable() to fill it)
+      [[nodiscard]] static shared_raw_data allocate(size_t size) { return shared_raw_data(raw_data::allocate(size)); }
+
+      /// \brief Copy some data to a new buffer
+      [[nodiscard]] static shared_raw_data duplicate(const void* data, size_t size) { return shared_raw_data(raw_data::duplicate(data, size)); }
+
+    public:
+      void check_overruns() const
+      {
+        if (block != nullptr)
+          block->data.check_overruns();
+      }
+
+      const void* get() const
+      {
+        if (block == nullptr) return nullptr;
+        check_overruns();
+        return (const uint8_t*)block->data.data.get() + offset;
+      }
+
+      template<typename T>
+      const T* get_as() const { return (const T*)get(); }
+
+      /// \brief Only allowed if the caller is the unique owner of the data
+      void* get_mutable()
+      {
+        check::debug::n_assert(is_unique(), "shared_raw_data: get_mutable() called on a shared buffer");
+        return const_cast<void*>(get());
+      }
+
+      std::string_view get_as_string_view() const { return { (const char*)get(), size }; }
+
+      uint64_t get_size() const { return size; }
+      uint64_t get_offset() const { return offset; }
+
+      explicit operator bool () const { return block != nullptr; }
+
+      /// \brief Return a view of a sub-range of the data
+      /// \note The range is clamped to the current view
+      [[nodiscard]] shared_raw_data slice(uint64_t slice_offset, uint64_t slice_size = ~uint64_t(0)) const
+      {
+        check::debug::n_assert(slice_offset <= size, "shared_raw_data: slice offset ({}) outside of the data (size: {})", slice_offset, size);
+        shared_raw_data ret = *this;
+        ret.offset = offset + slice_offset;
+        ret.size = std::min(slice_size, size - slice_offset);
+        return ret;
+      }
+
+      /// \brief Return the recycler of the data (nullptr if the data is not recyclable)
+      recycler* get_recycler() const { return block != nullptr ? block->owner : nullptr; }
+      uint32_t get_recycler_index() const { return block != nullptr ? block->recycler_index : 0; }
+
+      /// \brief Return the start of the underlying buffer (ignoring the view)
+      const void* get_base() const { return block != nullptr ? block->data.data.get() : nullptr; }
+
+      bool is_unique() const { return block != nullptr && block->ref_count.load(std::memory_order_acquire) == 1; }
+      uint32_t get_ref_count() const { return block != nullptr ? block->ref_count.load(std::memory_order_relaxed) : 0; }
+
+      void reset()
+      {
+        release();
+        block = nullptr;
+        offset = 0;
+        size = 0;
+      }
+
+      /// \brief Return a raw_data with the content of the view. No copy is done if the view is unique and covers all the data.
+      [[nodiscard]] raw_data to_raw_data() &&
+      {
+        if (block == nullptr)
+          return {};
+        if (is_unique() && offset == 0 && size == block->data.size && block->owner == nullptr)
+        {
+          raw_data ret = std::move(block->data);
+          reset();
+          return ret;
+        }
+        raw_data ret = duplicate();
+        reset();
+        return ret;
+      }
+
+      /// \brief Copy the content of the view to a new raw_data
+      [[nodiscard]] raw_data duplicate() const
+      {
+        return raw_data::duplicate(get(), size);
+      }
+
+    private:
+      struct block_t
+      {
+        std::atomic<uint32_t> ref_count;
+        uint32_t recycler_index;
+        recycler* owner;
+        raw_data data;
+      };
+
+      void acquire() const
+      {
+        if (block != nullptr)
+          block->ref_count.fetch_add(1, std::memory_order_relaxed);
+      }
+
+      void release()
+      {
+        if (block == nullptr)
+          return;
+        if (block->ref_count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+          if (block->owner != nullptr)
+            block->owner->recycle(std::move(block->data), block->recycler_index);
+          block->~block_t();
+          cr::slab_allocator::get_global().deallocate(block, sizeof(block_t), alignof(block_t));
+        }
+      }
+
+    private:
+      block_t* block = nullptr;
+      uint64_t offset = 0;
+      uint64_t size = 0;
+  };
+}
@@ -0,0 +1,308 @@
+//
+// created by : Timothée Feuillet
+// date: 2026-10-18
+//
+//
+// Copyright (c) 2026 Timothée Feuillet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <bit>
+#include <new>
+#include <algorithm>
+#include <memory_resource>
+
+#include "memory.hpp"
+#include "memory_accounting.hpp"
+#include "spinlock.hpp"
+#include "debug/assert.hpp"
+#include "raw_memory_pool_ts.hpp"
+
+namespace neam::cr
+{
+  /// \brief General purpose, thread-safe allocator. Dispatch allocations to size-classes, each backed by a raw_memory_pool_ts.
+  ///        Allocations bigger than the biggest size-class go directly to memory::allocate_page.
+  ///
+  /// \note Size classes are powers of two with an intermediate step (16, 24, 32, 48, 64, ... 32KiB)
+  ///       so the worst-case internal fragmentation is ~33%.
+  /// \note Pools are only initialized on their first allocation.
+  /// \note As with std::pmr::memory_resource, the size (and alignment) must be provided for the deallocation
+  ///
+  /// \warning The underlying pools have the same limitations as raw_memory_pool_ts (no defragmentation, best with similar lifespans)
+  class slab_allocator
+  {
+    public:
+      static constexpr size_t k_min_size_class = 16;
+      static constexpr size_t k_max_size_class = 32 * 1024;
+      static constexpr uint32_t k_size_class_count = 2 * (std::bit_width(k_max_size_class) - std::bit_width(k_min_size_class)) + 1;
+
+      // minimum number of objects a page-run of a pool can hold (for the biggest size-classes)
+      static constexpr uint32_t k_min_object_per_page_run = 8;
+      static constexpr uint32_t k_min_page_per_page_run = 4;
+
+      // page-runs are page aligned, so this is the strongest alignment a size-class can guarantee
+      static constexpr size_t k_max_size_class_alignment = 4096;
+
+    public:
+      slab_allocator() = default;
+      ~slab_allocator() = default;
+
+      // no copy, no move.
+      slab_allocator(const slab_allocator&) = delete;
+      slab_allocator& operator = (const slab_allocator&) = delete;
+
+      /// \brief Return the allocator used by the slab_stl_allocator by default.
+      /// \note Never destructed, as containers using it may be static and destructed after it.
+      static slab_allocator& get_global()
+      {
+        static slab_allocator* allocator = new slab_allocator();
+        return *allocator;
+      }
+
+      /// \brief Allocate some memory
+      /// \return nullptr on failure
+      void* allocate(size_t size, size_t alignment = alignof(std::max_align_t))
+      {
+        if (size == 0)
+          return nullptr;
+
+        const uint32_t index = get_size_class_index(size, alignment);
+        [[unlikely]] if (index >= k_size_class_count)
+          return allocate_large(size, alignment);
+
+        return get_size_class(index).allocate();
+      }
+
+      /// \brief Deallocate some memory.
+      /// \warning size and alignment must be the same as the ones provided to allocate()
+      void deallocate(void* ptr, size_t size, size_t alignment = alignof(std::max_align_t))
+      {
+        if (ptr == nullptr || size == 0)
+          return;
+
+        const uint32_t index = get_size_class_index(size, alignment);
+        [[unlikely]] if (index >= k_size_class_count)
+          return deallocate_large(ptr, size);
+
+        size_classes[index].pool.deallocate(ptr);
+      }
+
+      /// \brief Return the number of live allocations of the size-classes (large allocations are not counted)
+      uint32_t get_number_of_object() const
+      {
+        uint32_t count = 0;
+        for (const auto& it : size_classes)
+          count += it.pool.get_number_of_object();
+        return count;
+      }
+
+      /// \brief Return the number of pages allocated for the large allocations
+      uint32_t get_large_allocation_page_count() const
+      {
+        return large_page_count.load(std::memory_order_relaxed);
+      }
+
+    public: // size-class stuff:
+      static constexpr size_t get_size_class_size(uint32_t index)
+      {
+        const uint32_t shift = index / 2 + std::bit_width(k_min_size_class) - 1;
+        if (index % 2 == 0)
+          return size_t(1) << shift;
+        return size_t(3) << (shift - 1);
+      }
+
+      static constexpr size_t get_size_class_alignment(uint32_t index)
+      {
+        const size_t size = get_size_class_size(index);
+        return std::min(size & ~(size - 1), k_max_size_class_alignment);
+      }
+
+      /// \brief Return the index of the size class for an allocation, or k_size_class_count for large allocations
+      static constexpr uint32_t get_size_class_index(size_t size, size_t alignment = alignof(std::max_align_t))
+      {
+        if (size > k_max_size_class)
+          return k_size_class_count;
+
+        uint32_t index = 0;
+        if (size > k_min_size_class)
+        {
+          // 2^(shift - 1) < size <= 2^shift
+          const uint32_t shift = std::bit_width(size - 1);
+          const uint32_t base_index = 2 * (shift - (std::bit_width(k_min_size_class) - 1));
+          // intermediate step (1.5 * 2^(shift - 1)):
+          index = (size <= (size_t(3) << (shift - 2))) ? base_index - 1 : base_index;
+        }
+
+        // find the first size-class with an alignment that is compatible:
+        while (index < k_size_class_count && get_size_class_alignment(index) < alignment)
+          ++index;
+        return index;
+      }
+
+    private:
+      struct size_class_t
+      {
+        raw_memory_pool_ts pool;
+        std::atomic<bool> is_init = false;
+        spinlock init_lock;
+      };
+
+      raw_memory_pool_ts& get_size_class(uint32_t index)
+      {
+        size_class_t& sc = size_classes[index];
+        [[unlikely]] if (!sc.is_init.load(std::memory_order_acquire))
+        {
+          std::lock_guard _lg(sc.init_lock);
+          if (!sc.is_init.load(std::memory_order_acquire))
+          {
+            const size_t size = get_size_class_size(index);
+            const uint64_t page_size = memory::get_page_size();
+            const uint32_t page_count = std::max<uint32_t>(k_min_page_per_page_run, (size * k_min_object_per_page_run + page_size - 1) / page_size);
+            sc.pool.set_accounting_tag(get_accounting_tag());
+            sc.pool.init(size, get_size_class_alignment(index), page_count);
+            sc.is_init.store(true, std::memory_order_release);
+          }
+        }
+        return sc.pool;
+      }
+
+      static memory::accounting::tag& get_accounting_tag()
+      {
+        static memory::accounting::tag& tag = memory::accounting::get_tag("slab_allocator");
+        return tag;
+      }
+
+      static uint32_t get_page_count(size_t size)
+      {
+        const uint64_t page_size = memory::get_page_size();
+        return (uint32_t)((size + page_size - 1) / page_size);
+      }
+
+      void* allocate_large(size_t size, size_t alignment)
+      {
+        check::debug::n_assert(alignment <= memory::get_page_size(), "slab_allocator: cannot allocate with an alignment ({}) greater than the page size", alignment);
+        const uint32_t page_count = get_page_count(size);
+        void* ptr = memory::allocate_page(page_count);
+        if (ptr != nullptr)
+        {
+          large_page_count.fetch_add(page_count, std::memory_order_relaxed);
+          get_accounting_tag().on_reserve(page_count * memory::get_page_size());
+          get_accounting_tag().on_allocate(size);
+        }
+        return ptr;
+      }
+
+      void deallocate_large(void* ptr, size_t size)
+      {
+        const uint32_t page_count = get_page_count(size);
+        large_page_count.fetch_sub(page_count, std::memory_order_relaxed);
+        get_accounting_tag().on_deallocate(size);
+        get_accounting_tag().on_release(page_count * memory::get_page_size());
+        memory::free_page(ptr, page_count);
+      }
+
+    private:
+      size_class_t size_classes[k_size_class_count];
+      std::atomic<uint32_t> large_page_count = 0;
+  };
+
+  static_assert(slab_allocator::get_size_class_size(slab_allocator::k_size_class_count - 1) == slab_allocator::k_max_size_class);
+  static_assert(slab_allocator::get_size_class_index(slab_allocator::k_max_size_class) == slab_allocator::k_size_class_count - 1);
+  static_assert(slab_allocator::get_size_class_index(1) == 0);
+  static_assert(slab_allocator::get_size_class_index(17, 8) == 1);
+  static_assert(slab_allocator::get_size_class_index(25, 8) == 2);
+  static_assert(slab_allocator::get_size_class_index(24, 16) == 2);
+
+  /// \brief std::pmr::memory_resource interface over a slab_allocator
+  class slab_memory_resource : public std::pmr::memory_resource
+  {
+    public:
+      slab_memory_resource() : allocator(slab_allocator::get_global()) {}
+      explicit slab_memory_resource(slab_allocator& _allocator) : allocator(_allocator) {}
+
+      slab_allocator& get_allocator() const { return allocator; }
+
+    protected:
+      void* do_allocate(size_t bytes, size_t alignment) override
+      {
+        void* ptr = allocator.allocate(bytes == 0 ? 1 : bytes, alignment);
+        if (ptr == nullptr)
+          throw std::bad_alloc();
+        return ptr;
+      }
+
+      void do_deallocate(void* ptr, size_t bytes, size_t alignment) override
+      {
+        allocator.deallocate(ptr, bytes == 0 ? 1 : bytes, alignment);
+      }
+
+      bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+      {
+        if (this == &other)
+          return true;
+        const slab_memory_resource* const o = dynamic_cast<const slab_memory_resource*>(&other);
+        return o != nullptr && &o->allocator == &allocator;
+      }
+
+    private:
+      slab_allocator& allocator;
+  };
+
+  /// \brief STL compatible allocator over a slab_allocator (the global one by default)
+  /// \code std::mtc_vector<int, cr::slab_stl_allocator<int>> \endcode
+  template<typename T>
+  class slab_stl_allocator
+  {
+    public:
+      using value_type = T;
+
+      slab_stl_allocator() noexcept : allocator(&slab_allocator::get_global()) {}
+      explicit slab_stl_allocator(slab_allocator& _allocator) noexcept : allocator(&_allocator) {}
+      template<typename U>
+      slab_stl_allocator(const slab_stl_allocator<U>& o) noexcept : allocator(o.allocator) {}
+
+      [[nodiscard]] T* allocate(size_t count)
+      {
+        void* ptr = allocator->allocate(count * sizeof(T), alignof(T));
+        if (ptr == nullptr)
+          throw std::bad_alloc();
+        return reinterpret_cast<T*>(ptr);
+      }
+
+      void deallocate(T* ptr, size_t count) noexcept
+      {
+        allocator->deallocate(ptr, count * sizeof(T), alignof(T));
+      }
+
+      template<typename U>
+      bool operator == (const slab_stl_allocator<U>& o) const noexcept { return allocator == o.allocator; }
+
+    private:
+      slab_allocator* allocator;
+
+      template<typename U> friend class slab_stl_allocator;
+  };
+}
+
@@ -1,3 +1,4 @@
 
 #include "utilities/for_each.hpp"
 #include "utilities/rate_limit.hpp"
+#include "utilities/directory_scanner.hpp"
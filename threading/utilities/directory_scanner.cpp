@@ -0,0 +1,353 @@
+//
+// created by : Timothée Feuillet
+// date: 2026-10-18
+//
+//
+// Copyright (c) 2026 Timothée Feuillet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <set>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "directory_scanner.hpp"
+
+#include "../task_manager.hpp"
+#include "../../debug/assert.hpp"
+#include "../../spinlock.hpp"
+#include "../../tracy.hpp"
+
+namespace neam::threading
+{
+  namespace
+  {
+    int64_t to_ns(const timespec& ts)
+    {
+      return (int64_t)ts.tv_sec * 1'000'000'000 + (int64_t)ts.tv_nsec;
+    }
+
+    // same as cr::get_modified_or_created_time()
+    int64_t get_modified_or_created_time_ns(const struct stat& st)
+    {
+      return std::max(to_ns(st.st_mtim), to_ns(st.st_ctim));
+    }
+
+    template<typename Entry>
+    const Entry* find_entry(const std::vector<Entry>& entries, std::string_view path)
+    {
+      auto it = std::lower_bound(entries.begin(), entries.end(), path, [](const Entry& a, std::string_view b) { return a.path < b; });
+      if (it == entries.end() || it->path != path)
+        return nullptr;
+      return &*it;
+    }
+
+    std::string get_child_path(const std::string& parent, const char* name)
+    {
+      if (parent.empty())
+        return name;
+      std::string ret;
+      ret.reserve(parent.size() + 1 + strlen(name));
+      ret.append(parent).append(1, '/').append(name);
+      return ret;
+    }
+
+    // list the content of a directory (getdents64, via readdir). Follows the same rules as cr::get_all_files_recursive():
+    // regular files and symlinks that don't point to a directory are files, symlinks to directories are followed.
+    bool list_directory(int dfd, directory_scanner::directory_entry& dir)
+    {
+      const int list_fd = dup(dfd);
+      if (list_fd < 0)
+        return false;
+      DIR* const d = fdopendir(list_fd);
+      if (d == nullptr)
+      {
+        close(list_fd);
+        return false;
+      }
+
+      while (const dirent* entry = readdir(d))
+      {
+        const char* const name = entry->d_name;
+        if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0)))
+          continue;
+
+        unsigned char type = entry->d_type;
+        struct stat st;
+        if (type == DT_UNKNOWN)
+        {
+          if (fstatat(dfd, name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+            continue;
+          type = S_ISLNK(st.st_mode) ? DT_LNK : S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+        }
+        if (type == DT_LNK)
+          type = (fstatat(dfd, name, &st, 0) == 0 && S_ISDIR(st.st_mode)) ? DT_DIR : DT_REG;
+
+        if (type == DT_DIR)
+          dir.subdirectories.emplace_back(name);
+        else if (type == DT_REG)
+          dir.files.emplace_back(name);
+      }
+      closedir(d);
+
+      std::sort(dir.files.begin(), dir.files.end());
+      std::sort(dir.subdirectories.begin(), dir.subdirectories.end());
+      return true;
+    }
+  }
+
+  struct directory_scanner::scan_state
+  {
+    scan_state(task_manager& _tm, group_t _group, std::filesystem::path&& _root, const config& _conf, batch_function_t&& _on_batch, snapshot&& _previous)
+      : tm(_tm)
+      , group(_group)
+      , root(std::move(_root))
+      , conf(_conf)
+      , on_batch(std::move(_on_batch))
+      , previous(std::move(_previous))
+    {
+      pending_batch.reserve(conf.batch_size);
+    }
+
+    task_manager& tm;
+    const group_t group;
+    const std::filesystem::path root;
+    const config conf;
+    const batch_function_t on_batch;
+    const snapshot previous;
+    int root_fd = -1;
+
+    std::atomic<uint32_t> pending_directory_count = 0;
+
+    spinlock lock;
+    std::vector<file_entry> files;
+    std::vector<directory_entry> directories;
+    std::vector<change> pending_batch;
+    std::set<std::pair<uint64_t, uint64_t>> visited_directories; // (dev, ino)
+
+    std::mutex batch_lock; // on_batch is never called concurrently
+
+    scan_chain::state chain_state;
+
+    // NOTE: the lock must be held
+    void push_change(change&& c, std::vector<std::vector<change>>& ready_batches)
+    {
+      pending_batch.push_back(std::move(c));
+      if (pending_batch.size() >= conf.batch_size)
+      {
+        ready_batches.push_back(std::move(pending_batch));
+        pending_batch = {};
+        pending_batch.reserve(conf.batch_size);
+      }
+    }
+
+    // NOTE: the lock must not be held
+    void send_batches(std::vector<std::vector<change>>&& batches)
+    {
+      if (batches.empty())
+        return;
+      std::lock_guard _bl(batch_lock);
+      for (auto& it : batches)
+        on_batch(std::move(it));
+    }
+  };
+
+  std::filesystem::file_time_type directory_scanner::file_entry::get_modified_or_created_time() const
+  {
+    return std::filesystem::file_time_type
+    {
+      std::chrono::duration_cast<std::filesystem::file_time_type::duration>(std::chrono::nanoseconds{mtime_ns})
+    };
+  }
+
+  const directory_scanner::file_entry* directory_scanner::snapshot::find_file(std::string_view path) const
+  {
+    return find_entry(files, path);
+  }
+
+  const directory_scanner::directory_entry* directory_scanner::snapshot::find_directory(std::string_view path) const
+  {
+    return find_entry(directories, path);
+  }
+
+  directory_scanner::scan_chain directory_scanner::scan(task_manager& tm, group_t group, std::filesystem::path root, batch_function_t&& on_batch, const config& conf)
+  {
+    return rescan(tm, group, std::move(root), {}, std::move(on_batch), conf);
+  }
+
+  directory_scanner::scan_chain directory_scanner::rescan(task_manager& tm, group_t group, std::filesystem::path root, snapshot&& previous,
+                                                          batch_function_t&& on_batch, const config& conf)
+  {
+    check::debug::n_assert(conf.batch_size > 0, "directory_scanner: the batch size must not be 0");
+    check::debug::n_assert(!!on_batch, "directory_scanner: the batch function must be valid");
+
+    auto state = std::make_shared<scan_state>(tm, group, std::move(root), conf, std::move(on_batch), std::move(previous));
+
+    scan_chain ret;
+    state->chain_state = ret.create_state();
+
+    state->root_fd = open(state->root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (state->root_fd < 0)
+      cr::out().debug("threading::directory_scanner: failed to open {}: {}", state->root.c_str(), strerror(errno));
+
+    dispatch_directory(state, {});
+    return ret;
+  }
+
+  void directory_scanner::dispatch_directory(const std::shared_ptr<scan_state>& state, std::string path)
+  {
+    state->pending_directory_count.fetch_add(1, std::memory_order_relaxed);
+
+    function_t fnc = [state, path = std::move(path)]
+    {
+      scan_directory(state, path);
+      if (state->pending_directory_count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        finish(*state);
+    };
+
+    if (state->group == k_invalid_task_group)
+      state->tm.get_long_duration_task(std::move(fnc));
+    else
+      state->tm.get_task(state->group, std::move(fnc));
+  }
+
+  void directory_scanner::scan_directory(const std::shared_ptr<scan_state>& state, const std::string& path)
+  {
+    TRACY_SCOPED_ZONE;
+    if (state->root_fd < 0)
+      return;
+
+    const int dfd = openat(state->root_fd, path.empty() ? "." : path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd < 0)
+    {
+      cr::out().debug("threading::directory_scanner: failed to open {}: {}", (state->root / path).c_str(), strerror(errno));
+      return;
+    }
+
+    struct stat st;
+    if (fstat(dfd, &st) != 0)
+    {
+      close(dfd);
+      return;
+    }
+    {
+      std::lock_guard _l(state->lock);
+      if (!state->visited_directories.emplace((uint64_t)st.st_dev, (uint64_t)st.st_ino).second)
+      {
+        // already scanned (symlink loop / multiple symlinks to the same directory)
+        close(dfd);
+        return;
+      }
+    }
+
+    directory_entry dir;
+    dir.path = path;
+    dir.mtime_ns = get_modified_or_created_time_ns(st);
+
+    // the listing of a directory only changes when its modification time changes
+    const directory_entry* const previous_dir = state->previous.find_directory(path);
+    if (previous_dir != nullptr && previous_dir->mtime_ns == dir.mtime_ns)
+    {
+      dir.files = previous_dir->files;
+      dir.subdirectories = previous_dir->subdirectories;
+    }
+    else if (!list_directory(dfd, dir))
+    {
+      cr::out().debug("threading::directory_scanner: failed to read {}: {}", (state->root / path).c_str(), strerror(errno));
+      close(dfd);
+      return;
+    }
+
+    // fan-out the sub-directories first so they can be scanned while the files of this directory are stat'ed
+    for (const std::string& it : dir.subdirectories)
+      dispatch_directory(state, get_child_path(path, it.c_str()));
+
+    std::vector<file_entry> files;
+    std::vector<change> changes;
+    files.reserve(dir.files.size());
+    for (const std::string& it : dir.files)
+    {
+      // files that cannot be stat'ed after following symlinks are broken symlinks
+      if (fstatat(dfd, it.c_str(), &st, 0) != 0 && fstatat(dfd, it.c_str(), &st, AT_SYMLINK_NOFOLLOW) != 0)
+        continue; // removed since the directory was read
+
+      file_entry entry
+      {
+        .path = get_child_path(path, it.c_str()),
+        .size = (uint64_t)st.st_size,
+        .mtime_ns = get_modified_or_created_time_ns(st),
+      };
+
+      change_type type = change_type::added;
+      if (const file_entry* const previous_file = state->previous.find_file(entry.path); previous_file != nullptr)
+      {
+        const bool is_modified = previous_file->size != entry.size || previous_file->mtime_ns != entry.mtime_ns;
+        type = is_modified ? change_type::modified : change_type::unchanged;
+      }
+      if (type != change_type::unchanged || state->conf.report_unchanged)
+        changes.push_back({ entry, type });
+      files.push_back(std::move(entry));
+    }
+    close(dfd);
+
+    std::vector<std::vector<change>> ready_batches;
+    {
+      std::lock_guard _l(state->lock);
+      state->directories.push_back(std::move(dir));
+      state->files.insert(state->files.end(), std::make_move_iterator(files.begin()), std::make_move_iterator(files.end()));
+      for (change& it : changes)
+        state->push_change(std::move(it), ready_batches);
+    }
+    state->send_batches(std::move(ready_batches));
+  }
+
+  void directory_scanner::finish(scan_state& state)
+  {
+    TRACY_SCOPED_ZONE;
+    if (state.root_fd >= 0)
+      close(state.root_fd);
+
+    // no task is running anymore, the lock is not necessary
+    std::sort(state.files.begin(), state.files.end(), [](const file_entry& a, const file_entry& b) { return a.path < b.path; });
+    std::sort(state.directories.begin(), state.directories.end(), [](const directory_entry& a, const directory_entry& b) { return a.path < b.path; });
+
+    // removed files: in the previous snapshot but not in the new one (both are sorted)
+    std::vector<std::vector<change>> ready_batches;
+    auto it = state.files.begin();
+    for (const file_entry& previous_file : state.previous.files)
+    {
+      while (it != state.files.end() && it->path < previous_file.path)
+        ++it;
+      if (it == state.files.end() || it->path != previous_file.path)
+        state.push_change({ previous_file, change_type::removed }, ready_batches);
+    }
+    if (!state.pending_batch.empty())
+      ready_batches.push_back(std::move(state.pending_batch));
+    state.send_batches(std::move(ready_batches));
+
+    state.chain_state.complete(snapshot { std::move(state.files), std::move(state.directories) });
+  }
+}
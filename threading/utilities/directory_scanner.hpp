@@ -0,0 +1,165 @@
+//
+// created by : Timothée Feuillet
+// date: 2026-10-18
+//
+//
+// Copyright (c) 2026 Timothée Feuillet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../types.hpp"
+#include "../../async/chain.hpp"
+#include "../../struct_metadata/struct_metadata.hpp"
+
+namespace neam::threading
+{
+  /// \brief Parallel version of cr::get_all_files_recursive(): every directory is read (and its files stat'ed) in its own task,
+  /// and the files are streamed to a callback in batches while the scan progresses.
+  ///
+  /// Incremental scans (rescan()) compare the tree with the snapshot of a previous scan (which can be persisted with rle::serialize()):
+  /// only the added / modified / removed files are reported, and the directories that did not change since the snapshot
+  /// are not read again. Their files are still stat'ed, as modifying a file does not change the directory.
+  ///
+  /// \note Symlinks are followed (broken symlinks are reported as files), directories reached twice (symlink loops) are only scanned once.
+  /// \note Directories that cannot be opened are skipped (like std::filesystem::directory_options::skip_permission_denied)
+  class directory_scanner
+  {
+    public:
+      struct file_entry
+      {
+        std::string path; // relative to the root, '/' separated
+        uint64_t size = 0;
+        int64_t mtime_ns = 0; // the most recent of the modification / status change times (see cr::get_modified_or_created_time())
+
+        std::filesystem::file_time_type get_modified_or_created_time() const;
+      };
+
+      struct directory_entry
+      {
+        std::string path; // relative to the root, empty for the root
+        int64_t mtime_ns = 0;
+        std::vector<std::string> files;
+        std::vector<std::string> subdirectories;
+      };
+
+      /// \brief Result of a scan. Both vectors are sorted by path.
+      struct snapshot
+      {
+        std::vector<file_entry> files;
+        std::vector<directory_entry> directories;
+
+        const file_entry* find_file(std::string_view path) const;
+        const directory_entry* find_directory(std::string_view path) const;
+      };
+
+      enum class change_type : uint8_t
+      {
+        added,
+        modified,
+        removed,
+        unchanged,
+      };
+
+      struct change
+      {
+        file_entry file; // for removed files, the entry of the previous snapshot
+        change_type type;
+      };
+
+      /// \brief Called from the scan tasks with batches of changes. Never called concurrently.
+      using batch_function_t = std::function<void(std::vector<change>&& batch)>;
+
+      /// \brief Completed with the snapshot of the tree once all the batches have been sent
+      using scan_chain = async::chain<snapshot&& /*snapshot*/>;
+
+      struct config
+      {
+        /// \brief Maximum number of changes in a batch
+        uint32_t batch_size = 1024;
+        /// \brief Also report the files that did not change (incremental scans only)
+        bool report_unchanged = false;
+      };
+
+    public:
+      /// \brief Scan the tree under \e root. All the files are reported as added.
+      /// \param group the group of the scan tasks, k_invalid_task_group to use long-duration tasks
+      [[nodiscard]] static scan_chain scan(task_manager& tm, group_t group, std::filesystem::path root, batch_function_t&& on_batch, const config& conf);
+      [[nodiscard]] static scan_chain scan(task_manager& tm, group_t group, std::filesystem::path root, batch_function_t&& on_batch)
+      {
+        return scan(tm, group, std::move(root), std::move(on_batch), config {});
+      }
+
+      /// \brief Scan the tree under \e root and report the differences with \e previous
+      /// \param group the group of the scan tasks, k_invalid_task_group to use long-duration tasks
+      [[nodiscard]] static scan_chain rescan(task_manager& tm, group_t group, std::filesystem::path root, snapshot&& previous,
+                                             batch_function_t&& on_batch, const config& conf);
+      [[nodiscard]] static scan_chain rescan(task_manager& tm, group_t group, std::filesystem::path root, snapshot&& previous, batch_function_t&& on_batch)
+      {
+        return rescan(tm, group, std::move(root), std::move(previous), std::move(on_batch), config {});
+      }
+
+    private:
+      struct scan_state;
+
+      static void dispatch_directory(const std::shared_ptr<scan_state>& state, std::string path);
+      static void scan_directory(const std::shared_ptr<scan_state>& state, const std::string& path);
+      static void finish(scan_state& state);
+  };
+}
+
+N_METADATA_STRUCT(neam::threading::directory_scanner::file_entry)
+{
+  using member_list = neam::ct::type_list
+  <
+    N_MEMBER_DEF(path),
+    N_MEMBER_DEF(size),
+    N_MEMBER_DEF(mtime_ns)
+  >;
+};
+
+N_METADATA_STRUCT(neam::threading::directory_scanner::directory_entry)
+{
+  using member_list = neam::ct::type_list
+  <
+    N_MEMBER_DEF(path),
+    N_MEMBER_DEF(mtime_ns),
+    N_MEMBER_DEF(files),
+    N_MEMBER_DEF(subdirectories)
+  >;
+};
+
+N_METADATA_STRUCT(neam::threading::directory_scanner::snapshot)
+{
+  using member_list = neam::ct::type_list
+  <
+    N_MEMBER_DEF(files),
+    N_MEMBER_DEF(directories)
+  >;
+};